@@ -303,24 +303,20 @@ void CCCPDemoDlg::OnEnChangeEdit3()
 void CCCPDemoDlg::OnBnClickedButton7()
 {
 	TCCPResult ccpResult;
-	bool CurrentStatus = true;
-	unsigned int buflen = 4;
-	BYTE *Seed;
-
-	Seed = (BYTE*)malloc(buflen * sizeof(BYTE));
-
-	ccpResult = CCP_GetSeed(m_PccpHandle, CCP_RSM_DATA_ADQUISITION, false, Seed, 0);
-	free(Seed);
-	//Seed = (char*)malloc(buflen * sizeof(char));
-	//if (ccpResult != CCP_ERROR_ACKNOWLEDGE_OK)
-	//	MessageBox(GetErrorText(ccpResult), "Error");
-	//else
-	//{
-	// 
-		//laSlaveVersion.Format(ptrstr);
-//		UpdateData(FALSE);
-	//}
-	//free(ptrstr);
-	//return 0;
+	bool CurrentStatus = false;
+	BYTE Seed[4];
+	CString strMessage;
 
+	// The key is computed by the seed & key algorithm of the ECU vendor;
+	// the demo only shows the protection status and the seed
+	ccpResult = CCP_GetSeed(m_PccpHandle, CCP_RSM_DATA_ADQUISITION, &CurrentStatus, Seed, 0);
+	if (ccpResult != CCP_ERROR_ACKNOWLEDGE_OK)
+		MessageBox(GetErrorText(ccpResult), "Error");
+	else if (!CurrentStatus)
+		MessageBox("Data acquisition is unlocked");
+	else
+	{
+		strMessage.Format("Data acquisition is locked. Seed: %.2X %.2X %.2X %.2X", Seed[0], Seed[1], Seed[2], Seed[3]);
+		MessageBox(strMessage);
+	}
 }
@@ -0,0 +1,1018 @@
+//  CcpSimBench.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Regression test and throughput bench of the CCP paths, run against
+//  simulated slaves (CCcpSlaveSimulator) on a virtual CAN bus
+//
+//  ~~~~~~~~~~~~
+//
+//  Each scenario uses its own bus and channel, checks the data the slaves
+//  end up with or send, and prints the achieved rates. The process exits
+//  with 1 if any check failed, so it can run under ctest.
+//
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpProtocol.h"
+#include "CcpRegistry.h"
+#include "CcpSlaveSimulator.h"
+#include "CcpCoroutine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define BENCH_RAM_BASE                         0x10000   // RAM region of the slaves
+#define BENCH_RAM_SIZE                         0x10000
+#define BENCH_FLASH_BASE                       0x8000    // Flash region of the slaves
+#define BENCH_FLASH_SIZE                       0x8000
+#define BENCH_FLASH_SECTOR                     0x800     // Erase unit used by the flash scenario
+#define BENCH_IMAGE_FILE                       "CcpSimBench.hex"
+#define BENCH_DAQ_ECUS                         3         // Slaves started together by the DAQ scenario
+#define BENCH_DAQ_SIGNALS                      12        // 4 byte signals measured on each slave
+#define BENCH_DAQ_TIME                         300       // Measuring time of the DAQ scenario (millis)
+#define BENCH_MUX_STATIONS                     8         // Slaves sharing the identifiers in the mux scenario
+#define BENCH_MUX_COMMANDS                     200       // Commands sent to each station
+#define BENCH_WAIT_TIME                        5000      // Longest wait for asynchronous completions (millis)
+#define BENCH_CHECKSUM_SIZE                    0x1000    // Range checked by BUILD_CHKSUM / CCP_VerifyMemory
+#define BENCH_DECODE_FAST                      8         // 4 byte signals of the decode scenario, every 5 ms
+#define BENCH_DECODE_SLOW                      4         // 2 byte signals of the decode scenario, every 50 ms
+#define BENCH_TASK_SLAVES                      4         // Slaves driven by one coroutine each
+#define BENCH_TASK_BLOCK                       0x400     // Bytes written and read back by each coroutine
+
+typedef std::chrono::steady_clock TBenchClock;
+
+////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////
+
+static int g_Failures = 0;
+
+/// <summary>
+/// Counts and reports a failed check
+/// </summary>
+static void Check(bool Condition, const char *Scenario, const char *What)
+{
+	if (!Condition)
+	{
+		printf("FAIL  %s: %s\n", Scenario, What);
+		g_Failures++;
+	}
+}
+
+static double Seconds(TBenchClock::time_point Start)
+{
+	return std::chrono::duration<double>(TBenchClock::now() - Start).count();
+}
+
+/// <summary>
+/// The content of the memory image at a given offset
+/// </summary>
+static BYTE Pattern(DWORD Offset, BYTE Seed)
+{
+	return (BYTE)(Offset * 13 + (Offset >> 8) + Seed);
+}
+
+static void FillPattern(std::vector<BYTE> &Data, BYTE Seed)
+{
+	for (DWORD i = 0; i < Data.size(); i++)
+		Data[i] = Pattern(i, Seed);
+}
+
+/// <summary>
+/// Initializes a channel on a virtual bus
+/// </summary>
+static bool OpenChannel(TPCANHandle Channel, const std::shared_ptr<CVirtualCanBus> &Bus)
+{
+	CCcpRegistry::Instance().AttachTransport(Channel, Bus->CreatePort());
+	return CCP_InitializeChannel(Channel, PCAN_BAUD_500K, 0, 0, 0) == CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+/// <summary>
+/// Connects a slave, repeating the CONNECT a few times on slaves that drop answers
+/// </summary>
+static TCCPResult Connect(TPCANHandle Channel, const TCCPSlaveSimConfig &Config, TCCPHandle *Handle)
+{
+	TCCPSlaveData slave = Config.Slave;
+	TCCPResult result = CCP_ERROR_ACKNOWLEDGE_OK;
+
+	for (int attempt = 0; attempt < 5; attempt++)
+	{
+		result = CCP_Connect(Channel, &slave, Handle, 0);
+		if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+			break;
+	}
+	return result;
+}
+
+/// <summary>
+/// Writes an Intel HEX image of a memory range
+/// </summary>
+static bool WriteHexImage(LPCSTR FileName, DWORD Addr, const std::vector<BYTE> &Data)
+{
+	FILE *file = fopen(FileName, "w");
+	if (!file)
+		return false;
+
+	BYTE sum = (BYTE)(2 + 4 + (Addr >> 24) + (Addr >> 16));
+	fprintf(file, ":02000004%04X%02X\n", (unsigned)(Addr >> 16), (BYTE)(0 - sum));
+	for (DWORD offset = 0; offset < Data.size(); offset += 32)
+	{
+		DWORD count = std::min((DWORD)Data.size() - offset, (DWORD)32);
+		WORD addr = (WORD)(Addr + offset);
+
+		sum = (BYTE)(count + (addr >> 8) + addr);
+		fprintf(file, ":%02X%04X00", (unsigned)count, (unsigned)addr);
+		for (DWORD i = 0; i < count; i++)
+		{
+			fprintf(file, "%02X", Data[offset + i]);
+			sum += Data[offset + i];
+		}
+		fprintf(file, "%02X\n", (BYTE)(0 - sum));
+	}
+	fprintf(file, ":00000001FF\n");
+	return fclose(file) == 0;
+}
+
+/// <summary>
+/// Bitwise reference of the BUILD_CHKSUM checksum types, written from their
+/// definitions: the simulated slaves compute their checksums with the same
+/// CCcpChecksum class as the master, so neither can check the other
+/// </summary>
+static DWORD ReferenceChecksum(BYTE Type, bool IntelFormat, const BYTE *Data, DWORD Length)
+{
+	DWORD sum = 0, crc, i;
+	int bit;
+
+	switch (Type)
+	{
+		case CCP_CHECKSUM_ADD_BB:
+		case CCP_CHECKSUM_ADD_BW:
+		case CCP_CHECKSUM_ADD_BD:
+			for (i = 0; i < Length; i++)
+				sum += Data[i];
+			return Type == CCP_CHECKSUM_ADD_BB ? sum & 0xFF : Type == CCP_CHECKSUM_ADD_BW ? sum & 0xFFFF : sum;
+
+		case CCP_CHECKSUM_ADD_WW:
+		case CCP_CHECKSUM_ADD_WD:
+			for (i = 0; i + 2 <= Length; i += 2)
+				sum += IntelFormat ? (Data[i] | (Data[i + 1] << 8)) : ((Data[i] << 8) | Data[i + 1]);
+			return Type == CCP_CHECKSUM_ADD_WW ? sum & 0xFFFF : sum;
+
+		case CCP_CHECKSUM_ADD_DD:
+			for (i = 0; i + 4 <= Length; i += 4)
+				for (int b = 0; b < 4; b++)
+					sum += (DWORD)Data[i + b] << (IntelFormat ? 8 * b : 8 * (3 - b));
+			return sum;
+
+		case CCP_CHECKSUM_CRC_16:
+			crc = 0;
+			for (i = 0; i < Length; i++)
+			{
+				crc ^= Data[i];
+				for (bit = 0; bit < 8; bit++)
+					crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+			}
+			return crc;
+
+		case CCP_CHECKSUM_CRC_16_CITT:
+			crc = 0xFFFF;
+			for (i = 0; i < Length; i++)
+			{
+				crc ^= (DWORD)Data[i] << 8;
+				for (bit = 0; bit < 8; bit++)
+					crc = ((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1) & 0xFFFF;
+			}
+			return crc;
+
+		case CCP_CHECKSUM_CRC_32:
+			crc = 0xFFFFFFFF;
+			for (i = 0; i < Length; i++)
+			{
+				crc ^= Data[i];
+				for (bit = 0; bit < 8; bit++)
+					crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+			}
+			return ~crc;
+	}
+	return 0;
+}
+
+/// <summary>
+/// A value of the memory image, as a slave of the given byte order reads it
+/// </summary>
+static DWORD ImageValue(const BYTE *Data, BYTE Size, bool IntelFormat)
+{
+	DWORD value = 0;
+
+	for (BYTE b = 0; b < Size; b++)
+		value |= (DWORD)Data[b] << (IntelFormat ? 8 * b : 8 * (Size - 1 - b));
+	return value;
+}
+
+//------------------------------
+// Scenarios
+//------------------------------
+
+/// <summary>
+/// Bulk read (CCP_ReadMemory / CCP_ReadMemoryAsync) and scatter write (CCP_WriteMemory)
+/// </summary>
+static void BenchMemory(TPCANHandle Channel)
+{
+	const char *scenario = "memory";
+	auto bus = std::make_shared<CVirtualCanBus>();
+	TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+	CCcpSlaveSimulator slave(bus, config);
+	std::vector<BYTE> image(BENCH_RAM_SIZE);
+	TCCPTransferStats stats;
+	TCCPHandle handle;
+
+	FillPattern(image, 0);
+	slave.AddMemory(0, BENCH_RAM_BASE, BENCH_RAM_SIZE, false);
+	slave.WriteImage(0, BENCH_RAM_BASE, image.data(), BENCH_RAM_SIZE);
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+
+	// TEST of the slave, then of a station nobody answers for: its time out must fire
+	//
+	TCCPSlaveData absent = config.Slave;
+	absent.EcuAddress++;
+	Check(CCP_Test(Channel, &config.Slave, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "TEST not answered");
+	TBenchClock::time_point test = TBenchClock::now();
+	Check(CCP_Test(Channel, &absent, 50) != CCP_ERROR_ACKNOWLEDGE_OK && Seconds(test) < 1.0, scenario, "TEST of an absent station did not time out");
+	Check(Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+
+	// Whole region, then a short read that fits a single SHORT_UP
+	//
+	std::vector<BYTE> data(BENCH_RAM_SIZE);
+	Check(CCP_ReadMemory(handle, 0, BENCH_RAM_BASE, BENCH_RAM_SIZE, data.data(), &stats, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "ReadMemory failed");
+	Check(data == image, scenario, "ReadMemory data differs from the image");
+	printf("%-8s read        %8u bytes %6u cmds %10u bytes/s\n", scenario, stats.Bytes, stats.Commands, stats.BytesPerSecond);
+
+	Check(CCP_ReadMemory(handle, 0, BENCH_RAM_BASE + 3, 5, data.data(), &stats, 0) == CCP_ERROR_ACKNOWLEDGE_OK
+		&& stats.Commands == 1 && !memcmp(data.data(), &image[3], 5), scenario, "short ReadMemory is not one SHORT_UP");
+
+	struct TAsync { std::atomic<bool> Done; TCCPResult Result; TCCPTransferStats Stats; } async;
+	async.Done = false;
+	CCP_ReadMemoryAsync(handle, 0, BENCH_RAM_BASE + 0x100, 0x1000, data.data(), 0,
+		[](void *Context, TCCPResult Result, const TCCPTransferStats *Stats)
+		{
+			TAsync *async = (TAsync *)Context;
+			async->Result = Result;
+			async->Stats = *Stats;
+			async->Done = true;
+		}, &async);
+	TBenchClock::time_point start = TBenchClock::now();
+	while (!async.Done && Seconds(start) * 1000 < BENCH_WAIT_TIME)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	Check(async.Done && async.Result == CCP_ERROR_ACKNOWLEDGE_OK && !memcmp(data.data(), &image[0x100], 0x1000),
+		scenario, "ReadMemoryAsync failed");
+	if (async.Done)
+		printf("%-8s read async  %8u bytes %6u cmds %10u bytes/s\n", scenario, async.Stats.Bytes, async.Stats.Commands, async.Stats.BytesPerSecond);
+
+	// Scatter list: 64 blocks in reverse order, some of them overlapping
+	//
+	std::vector<BYTE> written(0x4000);
+	std::vector<TCCPMemoryBlock> blocks;
+	FillPattern(written, 0x5A);
+	for (int i = 63; i >= 0; i--)
+	{
+		DWORD offset = i * 0x100 + (i % 3) * 0x20;
+		DWORD length = (i % 4) ? 0xC0 : 0x140;
+		blocks.push_back({ 0, BENCH_RAM_BASE + offset, length, &written[offset] });
+		memcpy(&image[offset], &written[offset], length);
+	}
+	Check(CCP_WriteMemory(handle, blocks.data(), (DWORD)blocks.size(), &stats, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "WriteMemory failed");
+	slave.ReadImage(0, BENCH_RAM_BASE, data.data(), BENCH_RAM_SIZE);
+	Check(data == image, scenario, "WriteMemory left other data than the blocks");
+	printf("%-8s write       %8u bytes %6u cmds %10u bytes/s\n", scenario, stats.Bytes, stats.Commands, stats.BytesPerSecond);
+
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// Flash programming of an Intel HEX image with verification, then a delta
+/// programming after one sector of the slave changed
+/// </summary>
+static void BenchFlash(TPCANHandle Channel)
+{
+	const char *scenario = "flash";
+	auto bus = std::make_shared<CVirtualCanBus>();
+	TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+	CCcpSlaveSimulator slave(bus, config);
+	std::vector<BYTE> image(BENCH_FLASH_SIZE), flash(BENCH_FLASH_SIZE);
+	TCCPFlashParams params = { 0, BENCH_FLASH_SECTOR, 0, true, 0, false };
+	TCCPFlashProgress progress;
+	TCCPHandle handle;
+
+	FillPattern(image, 0x33);
+	slave.AddMemory(0, BENCH_FLASH_BASE, BENCH_FLASH_SIZE, true);
+	if (!WriteHexImage(BENCH_IMAGE_FILE, BENCH_FLASH_BASE, image))
+	{
+		Check(false, scenario, "image file not written");
+		return;
+	}
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		remove(BENCH_IMAGE_FILE);
+		return;
+	}
+	Check(Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+
+	Check(CCP_FlashImage(handle, BENCH_IMAGE_FILE, &params, NULL, NULL, &progress, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "FlashImage failed");
+	slave.ReadImage(0, BENCH_FLASH_BASE, flash.data(), BENCH_FLASH_SIZE);
+	Check(flash == image, scenario, "flash differs from the image");
+	printf("%-8s full        %8u bytes %6u cmds %10u bytes/s %3u sectors\n", scenario,
+		progress.BytesProgrammed, progress.Commands, progress.BytesPerSecond, progress.SectorsCleared);
+
+	// One changed byte: only its sector is cleared and programmed again
+	//
+	BYTE changed = (BYTE)~image[3 * BENCH_FLASH_SECTOR + 0x10];
+	slave.WriteImage(0, BENCH_FLASH_BASE + 3 * BENCH_FLASH_SECTOR + 0x10, &changed, 1);
+	params.Delta = true;
+	Check(CCP_FlashImage(handle, BENCH_IMAGE_FILE, &params, NULL, NULL, &progress, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "delta FlashImage failed");
+	slave.ReadImage(0, BENCH_FLASH_BASE, flash.data(), BENCH_FLASH_SIZE);
+	Check(flash == image, scenario, "flash differs from the image after the delta");
+	Check(progress.SectorsCleared == 1 && progress.SectorsSkipped == BENCH_FLASH_SIZE / BENCH_FLASH_SECTOR - 1,
+		scenario, "delta did not skip the unchanged sectors");
+	printf("%-8s delta       %8u bytes %6u cmds %10u bytes/s %3u skipped\n", scenario,
+		progress.BytesProgrammed, progress.Commands, progress.BytesPerSecond, progress.SectorsSkipped);
+
+	CCP_UninitializeChannel(Channel);
+	remove(BENCH_IMAGE_FILE);
+}
+
+/// <summary>
+/// DAQ configuration of several slaves, synchronized start and reassembly of
+/// the cycles, whose signals are checked against the memory of the slaves
+/// </summary>
+static void BenchDaq(TPCANHandle Channel)
+{
+	const char *scenario = "daq";
+	auto bus = std::make_shared<CVirtualCanBus>();
+	std::vector<std::unique_ptr<CCcpSlaveSimulator> > slaves;
+	std::vector<std::vector<BYTE> > images(BENCH_DAQ_ECUS, std::vector<BYTE>(BENCH_DAQ_SIGNALS * 4));
+	TCCPDaqPlacement placements[BENCH_DAQ_ECUS][BENCH_DAQ_SIGNALS];
+	TCCPHandle handles[BENCH_DAQ_ECUS];
+	TCCPSlaveSimConfig config;
+
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+	for (int ecu = 0; ecu < BENCH_DAQ_ECUS; ecu++)
+	{
+		TCCPDaqSignal signals[BENCH_DAQ_SIGNALS];
+
+		config = CCcpSlaveSimulator::DefaultConfig();
+		config.Slave.EcuAddress = (WORD)(0x10 + ecu);
+		config.Slave.IdCRO = 0x600 + ecu;
+		config.Slave.IdDTO = 0x700 + ecu;
+		config.EventPeriodUs[0] = 1000;
+		slaves.emplace_back(new CCcpSlaveSimulator(bus, config));
+		FillPattern(images[ecu], (BYTE)ecu);
+		slaves.back()->AddMemory(0, BENCH_RAM_BASE, BENCH_RAM_SIZE, false);
+		slaves.back()->WriteImage(0, BENCH_RAM_BASE, images[ecu].data(), (DWORD)images[ecu].size());
+
+		for (int i = 0; i < BENCH_DAQ_SIGNALS; i++)
+			signals[i] = { 0, (DWORD)(BENCH_RAM_BASE + i * 4), 4, 0, 1 };
+		Check(Connect(Channel, config, &handles[ecu]) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+		Check(CCP_ConfigureDaq(handles[ecu], config.DaqLists, signals, BENCH_DAQ_SIGNALS, placements[ecu], NULL, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+			scenario, "ConfigureDaq failed");
+		Check(CCP_SetDaqAssembly(handles[ecu], true, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "SetDaqAssembly failed");
+	}
+
+	TCCPDaqStartReport reports[BENCH_DAQ_ECUS * CCPSIM_MAX_DAQ_LISTS];
+	TCCPDaqStartStats startStats;
+	DWORD count = 0;
+	Check(CCP_StartDaqSynchronized(Channel, 200, reports, BENCH_DAQ_ECUS * CCPSIM_MAX_DAQ_LISTS, &count, &startStats) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "StartDaqSynchronized failed");
+	for (DWORD i = 0; i < count; i++)
+		Check(reports[i].Started == 1, scenario, "a DAQ list did not start");
+	printf("%-8s start       %8u lists %5u us spread %6u us max skew\n", scenario, startStats.Lists, startStats.FireSpreadUs, startStats.MaxSkewUs);
+
+	// Read the cycles as they arrive and compare each signal with the memory of its slave
+	//
+	UINT64 samples = 0, bytes = 0;
+	DWORD lastCycle[BENCH_DAQ_ECUS] = { 0 };
+	BYTE data[CCPSIM_MAX_ODTS * CCP_ODT_DATA_SIZE];
+	bool match = true, ordered = true;
+	TBenchClock::time_point start = TBenchClock::now();
+	while (Seconds(start) * 1000 < BENCH_DAQ_TIME)
+	{
+		bool idle = true;
+		for (int ecu = 0; ecu < BENCH_DAQ_ECUS; ecu++)
+		{
+			TCCPDaqSampleInfo info;
+			BYTE list = placements[ecu][0].ListNumber;
+
+			while (CCP_ReadDaqSample(handles[ecu], list, data, sizeof(data), &info) == CCP_ERROR_ACKNOWLEDGE_OK)
+			{
+				idle = false;
+				samples++;
+				bytes += info.Length;
+				if (info.Cycle <= lastCycle[ecu])
+					ordered = false;
+				lastCycle[ecu] = info.Cycle;
+				for (int i = 0; i < BENCH_DAQ_SIGNALS; i++)
+				{
+					const TCCPDaqPlacement &placement = placements[ecu][i];
+					if (placement.ListNumber == list
+						&& memcmp(&data[placement.OdtNumber * CCP_ODT_DATA_SIZE + placement.Offset], &images[ecu][i * 4], 4))
+						match = false;
+				}
+			}
+		}
+		if (idle)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	double elapsed = Seconds(start);
+	Check(CCP_StopDaqSynchronized(Channel) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "StopDaqSynchronized failed");
+
+	TCCPDaqCycleStats cycles, list;
+	memset(&cycles, 0, sizeof(cycles));
+	for (int ecu = 0; ecu < BENCH_DAQ_ECUS; ecu++)
+	{
+		CCP_GetDaqCycleStats(handles[ecu], CCP_DAQ_ALL_LISTS, &list);
+		cycles.Complete += list.Complete;
+		cycles.Torn += list.Torn;
+		cycles.Incomplete += list.Incomplete;
+		cycles.Overruns += list.Overruns;
+	}
+	Check(samples > 0, scenario, "no DAQ cycle assembled");
+	Check(match, scenario, "a signal differs from the memory of its slave");
+	Check(ordered, scenario, "cycles out of order");
+	Check(cycles.Torn == 0 && cycles.Incomplete == 0, scenario, "torn or incomplete cycles on a lossless bus");
+	printf("%-8s cycles      %8llu complete %4llu overruns %7.0f cycles/s %10.0f bytes/s\n", scenario,
+		(unsigned long long)cycles.Complete, (unsigned long long)cycles.Overruns, samples / elapsed, bytes / elapsed);
+
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// Stations sharing the CRO / DTO identifiers, served by a multiplexer
+/// </summary>
+static void BenchMux(TPCANHandle Channel)
+{
+	const char *scenario = "mux";
+	auto bus = std::make_shared<CVirtualCanBus>();
+	std::vector<std::unique_ptr<CCcpSlaveSimulator> > slaves;
+	TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+	TCCPHandle mux;
+	BYTE stations[BENCH_MUX_STATIONS];
+
+	for (int i = 0; i < BENCH_MUX_STATIONS; i++)
+	{
+		std::vector<BYTE> image(0x100);
+
+		config.Slave.EcuAddress = (WORD)(0x100 + i);
+		config.RandomSeed = i + 1;
+		slaves.emplace_back(new CCcpSlaveSimulator(bus, config));
+		FillPattern(image, (BYTE)(i * 31));
+		slaves.back()->AddMemory(0, BENCH_RAM_BASE, (DWORD)image.size(), false);
+		slaves.back()->WriteImage(0, BENCH_RAM_BASE, image.data(), (DWORD)image.size());
+	}
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+	Check(CCP_MuxCreate(Channel, NULL, &mux) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "MuxCreate failed");
+	for (int i = 0; i < BENCH_MUX_STATIONS; i++)
+	{
+		config.Slave.EcuAddress = (WORD)(0x100 + i);
+		Check(CCP_MuxAddStation(mux, &config.Slave, &stations[i]) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "MuxAddStation failed");
+	}
+
+	// Interleaved SHORT_UPs of one byte; each answer must come from its own station
+	//
+	struct TCommand { BYTE Expected; std::atomic<int> *Done, *Bad; };
+	std::vector<TCommand> commands(BENCH_MUX_STATIONS * BENCH_MUX_COMMANDS);
+	std::atomic<int> done(0), bad(0);
+	TBenchClock::time_point start = TBenchClock::now();
+	for (int k = 0; k < BENCH_MUX_COMMANDS; k++)
+		for (int i = 0; i < BENCH_MUX_STATIONS; i++)
+		{
+			TCommand &command = commands[k * BENCH_MUX_STATIONS + i];
+			BYTE cro[8] = { CCP_CMD_SHORT_UP, 0, 1, 0 };
+
+			CcpPutDword(&cro[4], BENCH_RAM_BASE + k % 0x100, config.Slave.IntelFormat);
+			command = { Pattern(k % 0x100, (BYTE)(i * 31)), &done, &bad };
+			CCP_MuxSendCommandAsync(mux, stations[i], cro, 0,
+				[](void *Context, TCCPResult Result, const BYTE *Crm)
+				{
+					TCommand *command = (TCommand *)Context;
+					if (Result != CCP_ERROR_ACKNOWLEDGE_OK || Crm[CCP_CRM_DATA_OFFSET] != command->Expected)
+						(*command->Bad)++;
+					(*command->Done)++;
+				}, &command);
+		}
+	while (done < (int)commands.size() && Seconds(start) * 1000 < BENCH_WAIT_TIME)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	double elapsed = Seconds(start);
+
+	TCCPMuxStats stats;
+	CCP_MuxGetStats(mux, &stats, NULL, 0);
+	Check(done == (int)commands.size(), scenario, "commands not completed");
+	Check(bad == 0, scenario, "commands failed or answered by another station");
+	printf("%-8s commands    %8d done %6u switches %8.0f cmds/s %4u/1000 switching %4u/1000 fairness\n", scenario,
+		(int)done, stats.Switches, done / elapsed, stats.SwitchOverhead, stats.Fairness);
+
+	CCP_MuxRelease(mux);
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// Bulk read and write on a slave that answers busy and drops answers:
+/// the data must arrive intact through the repeats and resends
+/// </summary>
+static void BenchLossy(TPCANHandle Channel)
+{
+	const char *scenario = "lossy";
+	auto bus = std::make_shared<CVirtualCanBus>();
+	TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+	config.ResponseLatencyUs = 200;
+	config.ResponseJitterUs = 100;
+	config.BusyPercent = 5;
+	config.DropPercent = 2;
+	config.RandomSeed = 7;
+	CCcpSlaveSimulator slave(bus, config);
+	std::vector<BYTE> image(0x2000), data(0x2000);
+	TCCPTransferStats stats;
+	TCCPHandle handle;
+
+	FillPattern(image, 0x77);
+	slave.AddMemory(0, BENCH_RAM_BASE, (DWORD)image.size(), false);
+	slave.WriteImage(0, BENCH_RAM_BASE, image.data(), (DWORD)image.size());
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+	Check(Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+
+	Check(CCP_ReadMemory(handle, 0, BENCH_RAM_BASE, (DWORD)data.size(), data.data(), &stats, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "ReadMemory failed");
+	Check(data == image, scenario, "ReadMemory data differs from the image");
+	printf("%-8s read        %8u bytes %6u cmds %10u bytes/s\n", scenario, stats.Bytes, stats.Commands, stats.BytesPerSecond);
+
+	TCCPMemoryBlock block = { 0, BENCH_RAM_BASE, 3000, data.data() };
+	FillPattern(data, 0x99);
+	memcpy(image.data(), data.data(), 3000);
+	Check(CCP_WriteMemory(handle, &block, 1, &stats, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "WriteMemory failed");
+	slave.ReadImage(0, BENCH_RAM_BASE, data.data(), (DWORD)data.size());
+	Check(data == image, scenario, "WriteMemory data differs from the blocks");
+	printf("%-8s write       %8u bytes %6u cmds %10u bytes/s\n", scenario, stats.Bytes, stats.Commands, stats.BytesPerSecond);
+
+	TCCPSlaveSimStats slaveStats = slave.GetStats();
+	TCCPRttStats rtt;
+	TCCPBusyStats busy;
+	CCP_GetRttStats(handle, &rtt);
+	CCP_GetBusyStats(handle, &busy);
+	Check(slaveStats.BusyResponses > 0 && slaveStats.DroppedResponses > 0, scenario, "the slave neither answered busy nor dropped");
+	printf("%-8s slave       %8llu busy %5llu dropped | master %u repeats %u resends %u srtt us\n", scenario,
+		(unsigned long long)slaveStats.BusyResponses, (unsigned long long)slaveStats.DroppedResponses,
+		busy.Repeats, rtt.Retries, rtt.SmoothedRtt);
+
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// Checksums: CCP_CalculateChecksum and the BUILD_CHKSUM of the slave against
+/// the bitwise reference for each type and byte order, then CCP_VerifyMemory
+/// </summary>
+static void BenchChecksum(TPCANHandle Channel)
+{
+	const char *scenario = "checksum";
+	static const DWORD lengths[] = { 1, 4, 7, 12, 100, 4093, BENCH_CHECKSUM_SIZE };
+	auto bus = std::make_shared<CVirtualCanBus>();
+	std::vector<BYTE> data(BENCH_CHECKSUM_SIZE);
+	DWORD value;
+	BYTE size;
+
+	// The reference itself, against the check values of the CRC catalogues
+	//
+	BYTE digits[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+	Check(ReferenceChecksum(CCP_CHECKSUM_CRC_16, true, digits, 9) == 0xBB3D
+		&& ReferenceChecksum(CCP_CHECKSUM_CRC_16_CITT, true, digits, 9) == 0x29B1
+		&& ReferenceChecksum(CCP_CHECKSUM_CRC_32, true, digits, 9) == 0xCBF43926, scenario, "reference CRC check values differ");
+
+	// Lengths around the 16 byte blocks of the vectorized sums and the 8 byte
+	// slices of the CRCs, word / dword multiples only for ADD_W* / ADD_DD
+	//
+	FillPattern(data, 0xC3);
+	for (BYTE type = CCP_CHECKSUM_ADD_BB; type <= CCP_CHECKSUM_CRC_32; type++)
+	{
+		DWORD unit = type == CCP_CHECKSUM_ADD_DD ? 4 : (type == CCP_CHECKSUM_ADD_WW || type == CCP_CHECKSUM_ADD_WD) ? 2 : 1;
+
+		for (int intel = 0; intel < 2; intel++)
+		{
+			for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+			{
+				if (lengths[i] % unit)
+					continue;
+				Check(CCP_CalculateChecksum(type, intel != 0, data.data(), lengths[i], &value, &size) == CCP_ERROR_ACKNOWLEDGE_OK
+					&& value == ReferenceChecksum(type, intel != 0, data.data(), lengths[i]), scenario, "CalculateChecksum differs from the reference");
+			}
+		}
+	}
+	Check(CCP_CalculateChecksum(CCP_CHECKSUM_ADD_WW, true, data.data(), 3, &value, &size) != CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "CalculateChecksum took an odd length for ADD_WW");
+
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+
+	// One slave per checksum type, in turn on the same identifiers
+	//
+	TBenchClock::time_point start = TBenchClock::now();
+	DWORD verified = 0;
+	for (BYTE type = CCP_CHECKSUM_ADD_BB; type <= CCP_CHECKSUM_CRC_32; type++)
+	{
+		TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+		config.ChecksumType = type;
+		config.Slave.IntelFormat = (type & 1) != 0;
+		CCcpSlaveSimulator slave(bus, config);
+		BYTE checksum[4];
+		TCCPHandle handle;
+		bool match = false;
+
+		slave.AddMemory(0, BENCH_RAM_BASE, BENCH_CHECKSUM_SIZE, false);
+		slave.WriteImage(0, BENCH_RAM_BASE, data.data(), BENCH_CHECKSUM_SIZE);
+		if (Connect(Channel, config, &handle) != CCP_ERROR_ACKNOWLEDGE_OK)
+		{
+			Check(false, scenario, "CONNECT failed");
+			continue;
+		}
+
+		Check(CCP_SetMemoryTransferAddress(handle, 0, 0, BENCH_RAM_BASE, 0) == CCP_ERROR_ACKNOWLEDGE_OK
+			&& CCP_BuildChecksum(handle, BENCH_CHECKSUM_SIZE, checksum, &size, 0) == CCP_ERROR_ACKNOWLEDGE_OK
+			&& ImageValue(checksum, size, config.Slave.IntelFormat) == ReferenceChecksum(type, config.Slave.IntelFormat, data.data(), BENCH_CHECKSUM_SIZE),
+			scenario, "BUILD_CHKSUM of the slave differs from the reference");
+
+		Check(CCP_VerifyMemory(handle, type, 0, BENCH_RAM_BASE, BENCH_CHECKSUM_SIZE, data.data(), &match, 0) == CCP_ERROR_ACKNOWLEDGE_OK && match,
+			scenario, "VerifyMemory did not match the image");
+		BYTE changed = (BYTE)(data[0x123] + 1);
+		slave.WriteImage(0, BENCH_RAM_BASE + 0x123, &changed, 1);
+		Check(CCP_VerifyMemory(handle, type, 0, BENCH_RAM_BASE, BENCH_CHECKSUM_SIZE, data.data(), &match, 0) == CCP_ERROR_ACKNOWLEDGE_OK && !match,
+			scenario, "VerifyMemory matched a changed image");
+		verified += 2 * BENCH_CHECKSUM_SIZE;
+
+		CCP_Disconnect(handle, false, 0);
+	}
+	printf("%-8s verify      %8u bytes %6u types %10.0f bytes/s\n", scenario, verified,
+		CCP_CHECKSUM_CRC_32 - CCP_CHECKSUM_ADD_BB + 1, verified / Seconds(start));
+
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// Seed & key: a slave protecting all its resources is unlocked with the
+/// built-in test algorithm, the privileges are cached, and a reconnect costs
+/// a single EXCHANGE_ID
+/// </summary>
+static void BenchUnlock(TPCANHandle Channel)
+{
+	const char *scenario = "unlock";
+	const BYTE all = CCP_RSM_CALIBRATION | CCP_RSM_DATA_ADQUISITION | CCP_RSM_MEMORY_PROGRAMMING;
+	auto bus = std::make_shared<CVirtualCanBus>();
+	TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+	config.ProtectionMask = all;
+	CCcpSlaveSimulator slave(bus, config);
+	std::vector<BYTE> written(0x40), data(0x40);
+	TCCPMemoryBlock block = { 0, BENCH_RAM_BASE, (DWORD)written.size(), written.data() };
+	TCCPHandle handle;
+	BYTE privileges = 0;
+	UINT64 commands;
+
+	FillPattern(written, 0x1F);
+	slave.AddMemory(0, BENCH_RAM_BASE, BENCH_RAM_SIZE, false);
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+	Check(Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+
+	Check(CCP_WriteMemory(handle, &block, 1, NULL, 0) != CCP_ERROR_ACKNOWLEDGE_OK, scenario, "WriteMemory passed a locked calibration");
+	Check(CCP_UnlockResources(handle, 0, &privileges, 0) == CCP_ERROR_KEY_ALGORITHM, scenario, "UnlockResources without key algorithm");
+
+	TBenchClock::time_point start = TBenchClock::now();
+	Check(CCP_SetKeyAlgorithm(handle, all, NULL) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "SetKeyAlgorithm failed");
+	Check(CCP_UnlockResources(handle, 0, &privileges, 0) == CCP_ERROR_ACKNOWLEDGE_OK && privileges == all,
+		scenario, "UnlockResources did not unlock all the resources");
+	double elapsed = Seconds(start);
+	Check(CCP_WriteMemory(handle, &block, 1, NULL, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "WriteMemory failed once unlocked");
+	slave.ReadImage(0, BENCH_RAM_BASE, data.data(), (DWORD)data.size());
+	Check(data == written, scenario, "WriteMemory data differs once unlocked");
+
+	// Privileges granted since the CONNECT: no round trip
+	//
+	commands = slave.GetStats().Commands;
+	Check(CCP_UnlockResources(handle, 0, &privileges, 0) == CCP_ERROR_ACKNOWLEDGE_OK && privileges == all
+		&& slave.GetStats().Commands == commands, scenario, "UnlockResources sent commands for cached privileges");
+
+	// The slave keeps them over a temporary disconnect: one EXCHANGE_ID tells
+	//
+	Check(CCP_Disconnect(handle, true, 0) == CCP_ERROR_ACKNOWLEDGE_OK && Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "reconnect failed");
+	commands = slave.GetStats().Commands;
+	Check(CCP_UnlockResources(handle, 0, &privileges, 0) == CCP_ERROR_ACKNOWLEDGE_OK && privileges == all
+		&& slave.GetStats().Commands == commands + 1, scenario, "UnlockResources after a reconnect is not one EXCHANGE_ID");
+	printf("%-8s unlock      %8d resources %11.0f us\n", scenario, 3, elapsed * 1e6);
+
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// DAQ planned by CCP_PlanDaq, DTOs taken in place from the receive queue
+/// (CCP_PeekMsgs / CCP_ReleaseMsgs) and decoded into sample columns
+/// (CCP_DecodeMsgs / CCP_ReadSamples), and the measurement quality seen by
+/// CCP_GetDaqHealth. Commands go through a busy polling channel first
+/// (CCP_SetRxMode)
+/// </summary>
+static void BenchDecode(TPCANHandle Channel)
+{
+	const char *scenario = "decode";
+	const DWORD count = BENCH_DECODE_FAST + BENCH_DECODE_SLOW;
+	auto bus = std::make_shared<CVirtualCanBus>();
+	TCCPSlaveSimConfig config = CCcpSlaveSimulator::DefaultConfig();
+	CCcpSlaveSimulator slave(bus, config);
+	std::vector<BYTE> image(0x100);
+	TCCPDaqRequest requests[count];
+	TCCPDaqSignal signals[count];
+	TCCPDaqPlacement placements[count];
+	TCCPDaqPlanStats plan;
+	TCCPChannelStats channelStats;
+	TCCPHandle handle;
+
+	FillPattern(image, 0x42);
+	slave.AddMemory(0, BENCH_RAM_BASE, (DWORD)image.size(), false);
+	slave.WriteImage(0, BENCH_RAM_BASE, image.data(), (DWORD)image.size());
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+	Check(Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+
+	// Each signal must be sampled at least as often as requested
+	//
+	for (DWORD i = 0; i < count; i++)
+	{
+		if (i < BENCH_DECODE_FAST)
+			requests[i] = { 0, BENCH_RAM_BASE + i * 4, 4, 5000 };
+		else
+			requests[i] = { 0, BENCH_RAM_BASE + 0x40 + (i - BENCH_DECODE_FAST) * 2, 2, 50000 };
+	}
+	Check(CCP_PlanDaq(handle, config.EventPeriodUs, CCPSIM_MAX_EVENT_CHANNELS, requests, count, 0, signals, &plan) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "PlanDaq failed");
+	for (DWORD i = 0; i < count; i++)
+		Check(signals[i].Addr == requests[i].Addr && signals[i].Size == requests[i].Size
+			&& config.EventPeriodUs[signals[i].EventChannel] * std::max(signals[i].Prescaler, (WORD)1) <= requests[i].PeriodUs,
+			scenario, "PlanDaq samples a signal too slowly");
+	Check(plan.Rates >= 1 && plan.Odts >= (BENCH_DECODE_FAST * 4 + BENCH_DECODE_SLOW * 2 + CCP_ODT_DATA_SIZE - 1) / CCP_ODT_DATA_SIZE
+		&& plan.BusLoad > 0 && plan.BusLoad <= CCP_DAQ_DEFAULT_BUDGET, scenario, "PlanDaq figures out of range");
+	printf("%-8s plan        %8u rates %5u odts %8u frames/s %4u/1000 bus load\n", scenario, plan.Rates, plan.Odts, plan.FramesPerSecond, plan.BusLoad);
+
+	Check(CCP_ConfigureDaq(handle, config.DaqLists, signals, count, placements, NULL, 0) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "ConfigureDaq failed");
+	Check(CCP_CreateDecoder(handle, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CreateDecoder failed");
+
+	// Commands answered by a busy polling receive thread. The DAQ runs in
+	// event mode: polling takes a core the slaves may need on a small host
+	//
+	std::vector<BYTE> data(image.size());
+	TCCPTransferStats stats;
+	Check(CCP_SetRxMode(Channel, 0x7F) != CCP_ERROR_ACKNOWLEDGE_OK, scenario, "SetRxMode took an unknown mode");
+	Check(CCP_SetRxMode(Channel, CCP_RX_MODE_BUSY_POLL) == CCP_ERROR_ACKNOWLEDGE_OK
+		&& CCP_GetChannelStats(Channel, &channelStats) == CCP_ERROR_ACKNOWLEDGE_OK && channelStats.RxMode == CCP_RX_MODE_BUSY_POLL,
+		scenario, "SetRxMode did not switch to busy polling");
+	Check(CCP_ReadMemory(handle, 0, BENCH_RAM_BASE, (DWORD)data.size(), data.data(), &stats, 0) == CCP_ERROR_ACKNOWLEDGE_OK && data == image,
+		scenario, "ReadMemory failed while busy polling");
+	printf("%-8s busy poll   %8u bytes %6u cmds %10u bytes/s\n", scenario, stats.Bytes, stats.Commands, stats.BytesPerSecond);
+	Check(CCP_SetRxMode(Channel, CCP_RX_MODE_EVENT) == CCP_ERROR_ACKNOWLEDGE_OK
+		&& CCP_GetChannelStats(Channel, &channelStats) == CCP_ERROR_ACKNOWLEDGE_OK && channelStats.RxMode == CCP_RX_MODE_EVENT,
+		scenario, "SetRxMode did not switch back to events");
+
+	Check(CCP_StartStopDaq(handle, CCP_SSM_START, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "StartStopDaq failed");
+
+	// The messages are decoded where they lie in the receive queue, until
+	// the DAQ is stopped and the queue is empty
+	//
+	UINT64 decoded = 0;
+	bool stopped = false;
+	TBenchClock::time_point start = TBenchClock::now();
+	double elapsed = 0;
+	for (;;)
+	{
+		TCCPMsgSpan spans[CCP_MSG_SPANS];
+		DWORD waiting = 0, done;
+
+		if (!stopped && Seconds(start) * 1000 >= BENCH_DAQ_TIME)
+		{
+			elapsed = Seconds(start);
+			Check(CCP_StartStopDaq(handle, CCP_SSM_STOP, 0) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "StartStopDaq failed");
+			stopped = true;
+		}
+		if (CCP_PeekMsgs(handle, spans, &waiting) != CCP_ERROR_ACKNOWLEDGE_OK)
+		{
+			if (stopped)
+				break;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+		for (int i = 0; i < CCP_MSG_SPANS; i++)
+		{
+			if (spans[i].Count && CCP_DecodeMsgs(handle, spans[i].Msgs, spans[i].Timestamps, spans[i].Count, &done) == CCP_ERROR_ACKNOWLEDGE_OK)
+				decoded += done;
+		}
+		Check(CCP_ReleaseMsgs(handle, waiting) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "ReleaseMsgs failed");
+	}
+	Check(CCP_ReleaseMsgs(handle, 1) != CCP_ERROR_ACKNOWLEDGE_OK, scenario, "ReleaseMsgs took more than was waiting");
+
+	// Each sample of each signal is the value in the memory of the slave
+	//
+	UINT64 samples = 0;
+	bool match = true, complete = true;
+	for (DWORD i = 0; i < count; i++)
+	{
+		DWORD values[512], read = 0, lost = 0;
+		DWORD expected = ImageValue(&image[requests[i].Addr - BENCH_RAM_BASE], requests[i].Size, config.Slave.IntelFormat);
+
+		if (CCP_ReadSamples(handle, i, values, NULL, 512, &read, &lost) != CCP_ERROR_ACKNOWLEDGE_OK || !read)
+			complete = false;
+		for (DWORD k = 0; k < read; k++)
+			match = match && values[k] == expected;
+		samples += read;
+	}
+	Check(decoded > 0 && complete, scenario, "a signal got no sample");
+	Check(match, scenario, "a sample differs from the memory of the slave");
+
+	// Health of the lists. How many cycles the slave misses depends on how
+	// the host schedules its thread, and under heavy jitter the lost cycles
+	// are estimates: only gross errors are checked. An interval is measured
+	// at most once per cycle (none for a cycle begun after the STOP was sent)
+	//
+	TCCPDaqHealth health;
+	TCCPDaqListHealth lists[CCPSIM_MAX_DAQ_LISTS];
+	TCCPDaqJitterHistogram histograms[CCPSIM_MAX_EVENT_CHANNELS];
+	UINT64 lost = 0;
+	DWORD jitter = 0;
+	Check(CCP_GetDaqHealth(handle, &health, lists, CCPSIM_MAX_DAQ_LISTS, histograms, CCPSIM_MAX_EVENT_CHANNELS, false) == CCP_ERROR_ACKNOWLEDGE_OK,
+		scenario, "GetDaqHealth failed");
+	Check(health.Dtos == decoded && health.QueueDrops == 0 && health.Lists > 0, scenario, "GetDaqHealth counts differ from the DTOs decoded");
+	for (BYTE l = 0; l < health.Lists; l++)
+	{
+		UINT64 intervals = 0;
+		DWORD period = 0;
+
+		for (DWORD i = 0; i < count; i++)
+			if (placements[i].ListNumber == lists[l].ListNumber)
+				period = config.EventPeriodUs[signals[i].EventChannel] * std::max(signals[i].Prescaler, (WORD)1);
+		for (BYTE m = 0; m < health.Lists; m++)
+			if (lists[m].EventChannel == lists[l].EventChannel && lists[m].Cycles)
+				intervals += lists[m].Cycles - 1;
+		for (BYTE h = 0; h < health.Channels; h++)
+			if (histograms[h].EventChannel == lists[l].EventChannel)
+			{
+				Check((lists[l].Cycles < 10 || histograms[h].Intervals > 0) && histograms[h].Intervals <= intervals,
+					scenario, "jitter histogram intervals differ from the cycles");
+				jitter = std::max(jitter, histograms[h].MaxJitterUs);
+			}
+		Check(lists[l].Cycles > 0 && lists[l].TornCycles == 0, scenario, "torn cycles on a lossless bus");
+		Check(lists[l].LostCycles <= lists[l].Cycles, scenario, "more cycles lost than received on a lossless bus");
+		Check(lists[l].Cycles < 10 || (lists[l].PeriodUs >= period / 2 && lists[l].PeriodUs <= period + period / 2),
+			scenario, "GetDaqHealth period far from the planned one");
+		lost += lists[l].LostCycles;
+	}
+	printf("%-8s decode      %8llu dtos %6llu samples %8.0f dtos/s %4llu lost %5u us max jitter\n", scenario,
+		(unsigned long long)decoded, (unsigned long long)samples, decoded / elapsed, (unsigned long long)lost, jitter);
+
+	CCP_UninitializeChannel(Channel);
+}
+
+/// <summary>
+/// The sequence of one coroutine of the task scenario: a block written, read
+/// back, and one of its bytes read with SHORT_UP
+/// </summary>
+static CCcpTask<TCCPResult> TaskSequence(CCcpCoSession *Session, BYTE *Block, BYTE *Readback, BYTE *Byte)
+{
+	TCCPMemoryBlock block = { 0, BENCH_RAM_BASE, BENCH_TASK_BLOCK, Block };
+	TCCPResult result;
+
+	result = co_await Session->WriteMemory(&block, 1);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		co_return result;
+	result = co_await Session->ReadMemory(0, BENCH_RAM_BASE, BENCH_TASK_BLOCK, Readback);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		co_return result;
+	co_return co_await Session->ShortUpload(1, 0, BENCH_RAM_BASE + 5, Byte);
+}
+
+/// <summary>
+/// Coroutine front-end (CCcpTask / CCcpCoSession): one coroutine per slave,
+/// all of them in progress at once without a thread per slave
+/// </summary>
+static void BenchTask(TPCANHandle Channel)
+{
+	const char *scenario = "task";
+	auto bus = std::make_shared<CVirtualCanBus>();
+	std::vector<std::unique_ptr<CCcpSlaveSimulator> > slaves;
+	std::vector<std::unique_ptr<CCcpCoSession> > sessions;
+	std::vector<std::vector<BYTE> > blocks(BENCH_TASK_SLAVES, std::vector<BYTE>(BENCH_TASK_BLOCK));
+	std::vector<std::vector<BYTE> > readbacks(BENCH_TASK_SLAVES, std::vector<BYTE>(BENCH_TASK_BLOCK));
+	std::vector<CCcpTask<TCCPResult> > tasks;
+	BYTE bytes[BENCH_TASK_SLAVES] = { 0 };
+	TCCPSlaveSimConfig config;
+
+	if (!OpenChannel(Channel, bus))
+	{
+		Check(false, scenario, "channel not initialized");
+		return;
+	}
+	for (int i = 0; i < BENCH_TASK_SLAVES; i++)
+	{
+		TCCPHandle handle;
+
+		config = CCcpSlaveSimulator::DefaultConfig();
+		config.Slave.EcuAddress = (WORD)(0x20 + i);
+		config.Slave.IdCRO = 0x610 + i;
+		config.Slave.IdDTO = 0x710 + i;
+		slaves.emplace_back(new CCcpSlaveSimulator(bus, config));
+		slaves.back()->AddMemory(0, BENCH_RAM_BASE, BENCH_TASK_BLOCK, false);
+		FillPattern(blocks[i], (BYTE)(0x60 + i));
+		Check(Connect(Channel, config, &handle) == CCP_ERROR_ACKNOWLEDGE_OK, scenario, "CONNECT failed");
+		sessions.emplace_back(new CCcpCoSession(handle));
+		Check(sessions.back()->IsValid(), scenario, "CCcpCoSession of an open connection is not valid");
+	}
+	Check(CCcpTask<TCCPResult>().Wait() == CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION), scenario, "an empty task did not fail");
+
+	TBenchClock::time_point start = TBenchClock::now();
+	for (int i = 0; i < BENCH_TASK_SLAVES; i++)
+	{
+		if (!sessions[i]->IsValid())
+			continue;
+		tasks.push_back(TaskSequence(sessions[i].get(), blocks[i].data(), readbacks[i].data(), &bytes[i]));
+		tasks.back().Start();
+	}
+	bool ok = tasks.size() == BENCH_TASK_SLAVES;
+	for (size_t i = 0; i < tasks.size(); i++)
+		ok = tasks[i].Wait() == CCP_ERROR_ACKNOWLEDGE_OK && ok;
+	double elapsed = Seconds(start);
+	Check(ok, scenario, "a coroutine failed");
+
+	std::vector<BYTE> data(BENCH_TASK_BLOCK);
+	for (int i = 0; i < BENCH_TASK_SLAVES; i++)
+	{
+		slaves[i]->ReadImage(0, BENCH_RAM_BASE, data.data(), BENCH_TASK_BLOCK);
+		Check(data == blocks[i] && readbacks[i] == blocks[i] && bytes[i] == blocks[i][5], scenario, "a coroutine read or wrote other data");
+	}
+	printf("%-8s coroutines  %8d slaves %5d bytes each %10.0f bytes/s\n", scenario, BENCH_TASK_SLAVES, BENCH_TASK_BLOCK,
+		2.0 * BENCH_TASK_SLAVES * BENCH_TASK_BLOCK / elapsed);
+
+	tasks.clear();
+	sessions.clear();
+	CCP_UninitializeChannel(Channel);
+}
+
+////////////////////////////////////////////////////////////
+// Entry point
+////////////////////////////////////////////////////////////
+
+int main()
+{
+	BenchMemory(PCAN_USBBUS1);
+	BenchFlash(PCAN_USBBUS2);
+	BenchDaq(PCAN_USBBUS3);
+	BenchMux(PCAN_USBBUS4);
+	BenchLossy(PCAN_USBBUS5);
+	BenchChecksum(PCAN_USBBUS6);
+	BenchUnlock(PCAN_USBBUS7);
+	BenchDecode(PCAN_USBBUS8);
+	BenchTask(PCAN_USBBUS9);
+
+	printf("%s: %d failed checks\n", g_Failures ? "FAILED" : "PASSED", g_Failures);
+	return g_Failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+//  CanAcceptance.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Code / mask acceptance filters letting a set of CAN identifiers through
+//
+//  ~~~~~~~~~~~~
+//
+#include "CanAcceptance.h"
+
+#include <algorithm>
+#include <bitset>
+
+// Identifier bits of each format, with the format flag (MSB)
+//
+#define CAN_STD_MASK                           0x800007FFU
+#define CAN_EXT_MASK                           0x9FFFFFFFU
+
+static TCanFilter Merge(const TCanFilter &A, const TCanFilter &B)
+{
+	TCanFilter merged;
+
+	merged.Mask = A.Mask & B.Mask & ~(A.Code ^ B.Code);
+	merged.Code = A.Code & merged.Mask;
+	return merged;
+}
+
+// Identifiers let through: 2 ^ bits not cared about
+static size_t Width(const TCanFilter &Filter)
+{
+	DWORD format = (Filter.Code & 0x80000000U) ? CAN_EXT_MASK : CAN_STD_MASK;
+
+	return std::bitset<32>(format & ~Filter.Mask).count();
+}
+
+static void Reduce(std::vector<TCanFilter> &Filters, int MaxCount)
+{
+	while ((int)Filters.size() > MaxCount)
+	{
+		size_t best = 0, bestWith = 1, bestWidth = 33;
+
+		for (size_t i = 0; i < Filters.size(); i++)
+		{
+			for (size_t j = i + 1; j < Filters.size(); j++)
+			{
+				size_t width = Width(Merge(Filters[i], Filters[j]));
+
+				if (width < bestWidth)
+				{
+					best = i;
+					bestWith = j;
+					bestWidth = width;
+				}
+			}
+		}
+		Filters[best] = Merge(Filters[best], Filters[bestWith]);
+		Filters.erase(Filters.begin() + bestWith);
+
+		// A merged filter may cover others
+		for (size_t i = Filters.size(); i-- > 0; )
+		{
+			if (i != best && CanAcceptId(Filters[best], Filters[i].Code) && (Filters[i].Mask | Filters[best].Mask) == Filters[i].Mask)
+			{
+				Filters.erase(Filters.begin() + i);
+				if (i < best)
+					best--;
+			}
+		}
+	}
+}
+
+void CanBuildFilters(const DWORD *Ids, int Count, int MaxPerFormat, std::vector<TCanFilter> &Filters)
+{
+	std::vector<TCanFilter> standard, extended;
+	std::vector<DWORD> ids(Ids, Ids + Count);
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		TCanFilter filter;
+
+		filter.Mask = (ids[i] & 0x80000000U) ? CAN_EXT_MASK : CAN_STD_MASK;
+		filter.Code = ids[i] & filter.Mask;
+		if (ids[i] & 0x80000000U)
+			extended.push_back(filter);
+		else
+			standard.push_back(filter);
+	}
+
+	Reduce(standard, std::max(MaxPerFormat, 1));
+	Reduce(extended, std::max(MaxPerFormat, 1));
+	Filters = standard;
+	Filters.insert(Filters.end(), extended.begin(), extended.end());
+}
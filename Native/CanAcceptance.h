@@ -0,0 +1,55 @@
+//  CanAcceptance.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Code / mask acceptance filters letting a set of CAN identifiers through
+//
+//  ~~~~~~~~~~~~
+//
+//  Each identifier gets an exact filter. When a backend offers fewer filters
+//  than there are identifiers of a format, the two filters whose merge lets
+//  the fewest identifiers through are merged, until the filters fit: a
+//  merged filter only cares about the bits on which both agree.
+//
+#ifndef __CANACCEPTANCEH__
+#define __CANACCEPTANCEH__
+
+#include "WinTypes.h"
+
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+// An acceptance filter: a frame passes if its identifier equals Code on all
+// the bits set in Mask
+//
+typedef struct
+{
+	DWORD Code;                                            // CAN Id (29 Bits = MSB set), 0 on the bits not in Mask
+	DWORD Mask;                                            // Bits of the identifier that must match (the MSB always does)
+}TCanFilter;
+
+////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Computes the tightest filters letting a set of identifiers through
+/// </summary>
+/// <param name="Ids">CAN Ids (29 Bits = MSB set)</param>
+/// <param name="Count">Number of identifiers</param>
+/// <param name="MaxPerFormat">Filters available for the 11 bit and for the 29 bit identifiers (at least 1)</param>
+/// <param name="Filters">Buffer for the filters, 11 bit ones first</param>
+void CanBuildFilters(const DWORD *Ids, int Count, int MaxPerFormat, std::vector<TCanFilter> &Filters);
+
+/// <summary>
+/// Returns true if a filter lets an identifier through
+/// </summary>
+inline bool CanAcceptId(const TCanFilter &Filter, DWORD CcpId)
+{
+	return (CcpId & Filter.Mask) == Filter.Code;
+}
+
+#endif
@@ -0,0 +1,150 @@
+//  CanTransport.h
+//
+//  ~~~~~~~~~~~~
+//
+//  CAN transport backend interface used by the native PCAN-CCP engine
+//
+//  ~~~~~~~~~~~~
+//
+//  A transport is the physical side of a TPCANHandle channel. The engine
+//  only talks to the bus through this interface, so PCAN-Basic hardware,
+//  other drivers or an in-process bus can be plugged in per channel.
+//
+//  Reception times are 64 bit nanosecond counts, taken as close to the bus
+//  as the backend allows: the hardware time stamp if there is one, else the
+//  kernel's, else the host clock when the frame is read. Their origin is the
+//  backend's own; only differences are meaningful.
+//
+#ifndef __CANTRANSPORTH__
+#define __CANTRANSPORTH__
+
+#include "WinTypes.h"
+#include "PCANBasic.h"
+
+////////////////////////////////////////////////////////////
+// Interface definitions
+////////////////////////////////////////////////////////////
+
+class ICanTransport
+{
+public:
+	virtual ~ICanTransport() {}
+
+	/// <summary>
+	/// Opens the transport at the given bit rate
+	/// </summary>
+	/// <param name="Btr0Btr1">The speed for the communication (BTR0BTR1 code)</param>
+	/// <returns>A TPCANStatus error code</returns>
+	virtual TPCANStatus Initialize(TPCANBaudrate Btr0Btr1) = 0;
+
+	/// <summary>
+	/// Closes the transport
+	/// </summary>
+	/// <returns>A TPCANStatus error code</returns>
+	virtual TPCANStatus Uninitialize() = 0;
+
+	/// <summary>
+	/// Transmits a batch of CAN messages
+	/// </summary>
+	/// <param name="Msgs">The messages to be sent</param>
+	/// <param name="Count">Number of messages in 'Msgs'</param>
+	/// <param name="Sent">Buffer for the number of messages actually queued</param>
+	/// <returns>A TPCANStatus error code</returns>
+	virtual TPCANStatus Write(const TPCANMsg *Msgs, int Count, int *Sent) = 0;
+
+	/// <summary>
+	/// Receives up to 'MaxCount' CAN messages, waiting at most 'TimeOut' millis
+	/// for the first one
+	/// </summary>
+	/// <param name="Msgs">Buffer for the received messages</param>
+	/// <param name="Stamps">Optional buffer for the reception times, in nanos (may be NULL)</param>
+	/// <param name="MaxCount">Capacity of 'Msgs' (and 'Stamps')</param>
+	/// <param name="Received">Buffer for the number of messages received</param>
+	/// <param name="TimeOut">Wait time (millis) for the first message. Zero(0): only the messages already received</param>
+	/// <returns>A TPCANStatus error code. PCAN_ERROR_QRCVEMPTY if nothing was received</returns>
+	virtual TPCANStatus Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut) = 0;
+
+	/// <summary>
+	/// Discards the messages pending in the receive and transmit queues
+	/// </summary>
+	/// <returns>A TPCANStatus error code</returns>
+	virtual TPCANStatus Reset() = 0;
+
+	/// <summary>
+	/// Lets only the frames of the given identifiers through, as tightly as
+	/// the backend can filter. Frames of other identifiers may still arrive
+	/// </summary>
+	/// <param name="Ids">CAN Ids (29 Bits = MSB set)</param>
+	/// <param name="Count">Number of identifiers. Zero(0): no frame is needed</param>
+	/// <returns>A TPCANStatus error code. PCAN_ERROR_ILLOPERATION if the backend cannot filter</returns>
+	virtual TPCANStatus SetAcceptance(const DWORD *Ids, int Count) { (void)Ids; (void)Count; return PCAN_ERROR_ILLOPERATION; }
+
+	/// <summary>
+	/// Makes a Read waiting in another thread return at once. Backends that
+	/// cannot do so let it run into its time out
+	/// </summary>
+	virtual void Wake() {}
+};
+
+////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Fills the identifier part of a TPCANMsg from a TCCPSlaveData CAN Id (29 Bits = MSB set)
+/// </summary>
+inline void CanSetId(TPCANMsg *Msg, DWORD CcpId)
+{
+	if (CcpId & 0x80000000U)
+	{
+		Msg->ID = CcpId & 0x1FFFFFFFU;
+		Msg->MSGTYPE = PCAN_MESSAGE_EXTENDED;
+	}
+	else
+	{
+		Msg->ID = CcpId & 0x7FFU;
+		Msg->MSGTYPE = PCAN_MESSAGE_STANDARD;
+	}
+}
+
+/// <summary>
+/// Returns the TCCPSlaveData CAN Id (29 Bits = MSB set) of a received TPCANMsg
+/// </summary>
+inline DWORD CanGetId(const TPCANMsg *Msg)
+{
+	if (Msg->MSGTYPE & PCAN_MESSAGE_EXTENDED)
+		return Msg->ID | 0x80000000U;
+	return Msg->ID;
+}
+
+/// <summary>
+/// Returns the bit rate of a BTR0BTR1 code (SJA1000 registers, 16 MHz clock)
+/// </summary>
+inline DWORD CanGetBitrate(TPCANBaudrate Btr0Btr1)
+{
+	DWORD prescaler = ((Btr0Btr1 >> 8) & 0x3F) + 1;
+	DWORD quanta = 3 + (Btr0Btr1 & 0x0F) + ((Btr0Btr1 >> 4) & 0x07);
+
+	return 8000000U / (prescaler * quanta);
+}
+
+/// <summary>
+/// Returns the worst case length in bits of a data frame on the bus: frame,
+/// stuff bits and interframe space
+/// </summary>
+inline DWORD CanGetFrameBits(bool Extended, BYTE Length)
+{
+	DWORD stuffed = (Extended ? 54 : 34) + 8U * Length;
+
+	return (Extended ? 67 : 47) + 8U * Length + (stuffed - 1) / 4;
+}
+
+/// <summary>
+/// Returns a TPCANTimestamp in nanoseconds
+/// </summary>
+inline UINT64 CanGetNanos(const TPCANTimestamp *Stamp)
+{
+	return 1000ULL * (Stamp->micros + 1000ULL * Stamp->millis + 0x100000000ULL * 1000ULL * Stamp->millis_overflow);
+}
+
+#endif
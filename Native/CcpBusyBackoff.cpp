@@ -0,0 +1,63 @@
+//  CcpBusyBackoff.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Back off of the commands answered CCP_ERROR_CMD_PROCESSOR_BUSY or
+//  CCP_ERROR_DAQ_PROCESSOR_BUSY by a slave
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpBusyBackoff.h"
+
+#include <string.h>
+#include <algorithm>
+
+CCcpBusyBackoff::CCcpBusyBackoff()
+	: m_Params(DefaultParams())
+	, m_Random(std::random_device()())
+{
+	memset(&m_Stats, 0, sizeof(m_Stats));
+}
+
+TCCPBusyParams CCcpBusyBackoff::DefaultParams()
+{
+	TCCPBusyParams params;
+
+	params.MinBackoff = CCP_BUSY_DEFAULT_MIN_BACKOFF;
+	params.MaxBackoff = CCP_BUSY_DEFAULT_MAX_BACKOFF;
+	params.MaxBusyTime = CCP_BUSY_DEFAULT_MAX_TIME;
+	return params;
+}
+
+bool CCcpBusyBackoff::SetParams(const TCCPBusyParams &Params)
+{
+	if (!Params.MinBackoff || Params.MaxBackoff < Params.MinBackoff)
+		return false;
+	m_Params = Params;
+	return true;
+}
+
+DWORD CCcpBusyBackoff::OnBusy(BYTE Error, BYTE Answers)
+{
+	UINT64 backoff = m_Params.MinBackoff;
+
+	if (Error == CCP_ERROR_DAQ_PROCESSOR_BUSY)
+		m_Stats.DaqBusyAnswers++;
+	else
+		m_Stats.CmdBusyAnswers++;
+
+	// Exponential growth, then a random wait between half and all of it
+	for (; Answers && backoff < m_Params.MaxBackoff; Answers--)
+		backoff *= 2;
+	backoff = std::min(backoff, (UINT64)m_Params.MaxBackoff);
+	return (DWORD)(backoff / 2 + m_Random() % (backoff / 2 + 1));
+}
+
+void CCcpBusyBackoff::OnBusyEnd(UINT64 BusyMicros, bool GaveUp)
+{
+	m_Stats.BusyCommands++;
+	m_Stats.BusyMicros += BusyMicros;
+	m_Stats.MaxBusyMicros = std::max(m_Stats.MaxBusyMicros, (DWORD)std::min(BusyMicros, (UINT64)0xFFFFFFFFU));
+	if (GaveUp)
+		m_Stats.GaveUp++;
+}
@@ -0,0 +1,73 @@
+//  CcpBusyBackoff.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Back off of the commands answered CCP_ERROR_CMD_PROCESSOR_BUSY or
+//  CCP_ERROR_DAQ_PROCESSOR_BUSY by a slave
+//
+//  ~~~~~~~~~~~~
+//
+//  After a busy CRM, CCP 2.1 has the master wait for the final CRM of the
+//  command and repeat it on time out. The wait grows exponentially with each
+//  busy answer, with a random part, so that the slaves of a bus are not
+//  polled in lockstep.
+//
+#ifndef __CCPBUSYBACKOFFH__
+#define __CCPBUSYBACKOFFH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+#include <random>
+
+class CCcpBusyBackoff
+{
+public:
+	CCcpBusyBackoff();
+
+	/// <summary>
+	/// Returns the default policy (CCP_BUSY_DEFAULT_* values)
+	/// </summary>
+	static TCCPBusyParams DefaultParams();
+
+	/// <summary>
+	/// Returns true for the busy error codes
+	/// </summary>
+	static bool IsBusy(BYTE Error) { return Error == CCP_ERROR_CMD_PROCESSOR_BUSY || Error == CCP_ERROR_DAQ_PROCESSOR_BUSY; }
+
+	/// <summary>
+	/// Changes the policy. The statistics are kept
+	/// </summary>
+	/// <returns>False if the bounds are invalid</returns>
+	bool SetParams(const TCCPBusyParams &Params);
+	const TCCPBusyParams &GetParams() const { return m_Params; }
+
+	/// <summary>
+	/// Counts a busy answer and returns the time to wait for the final CRM
+	/// before repeating the command, in microseconds
+	/// </summary>
+	/// <param name="Error">The busy error code</param>
+	/// <param name="Answers">Busy answers already received for the command</param>
+	DWORD OnBusy(BYTE Error, BYTE Answers);
+
+	/// <summary>
+	/// Counts a command repeated after a busy answer
+	/// </summary>
+	void OnRepeat() { m_Stats.Repeats++; }
+
+	/// <summary>
+	/// Ends the busy period of a command
+	/// </summary>
+	/// <param name="BusyMicros">Time since its first busy answer</param>
+	/// <param name="GaveUp">True if the command ends with the busy error</param>
+	void OnBusyEnd(UINT64 BusyMicros, bool GaveUp);
+
+	const TCCPBusyStats &GetStats() const { return m_Stats; }
+
+private:
+	TCCPBusyParams m_Params;
+	TCCPBusyStats m_Stats;
+	std::minstd_rand m_Random;
+};
+
+#endif
@@ -0,0 +1,345 @@
+//  CcpChannel.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  A PCAN-CCP channel: one CAN transport shared by the connections (sessions)
+//  opened on a TPCANHandle
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpChannel.h"
+#include "CcpSession.h"
+
+#include <algorithm>
+
+// Frames fetched from the transport per read call
+//
+#define CCP_RX_BATCH                           64
+
+// Longest time (millis) the receive thread blocks in the transport before
+// checking the time out of the commands. It wakes up earlier for the time out
+// of the commands in progress, at once for a command sent meanwhile that times
+// out sooner (WakeBy), and when the channel is closed
+//
+#define CCP_RX_POLL_TIMEOUT                    10
+
+// Fewest slots of the routing table (a power of 2)
+//
+#define CCP_ROUTE_MIN_SLOTS                    8
+
+CCcpChannel::CCcpChannel(TPCANHandle Channel, const std::shared_ptr<ICanTransport> &Transport)
+	: m_Channel(Channel)
+	, m_Baudrate(0)
+	, m_Transport(Transport)
+	, m_Running(false)
+	, m_BusyPoll(false)
+	, m_Filtering(false)
+	, m_WakeAt(0)
+	, m_NextDeadline(std::chrono::steady_clock::time_point::max().time_since_epoch().count())
+	, m_Frames(0)
+	, m_Unknown(0)
+	, m_Reads(0)
+{
+	BuildRoutes();
+}
+
+CCcpChannel::~CCcpChannel()
+{
+	Close();
+}
+
+TPCANStatus CCcpChannel::Open(TPCANBaudrate Btr0Btr1)
+{
+	TPCANStatus status;
+
+	status = m_Transport->Initialize(Btr0Btr1);
+	if (status != PCAN_ERROR_OK)
+		return status;
+
+	m_Baudrate = Btr0Btr1;
+	{
+		std::lock_guard<std::mutex> lock(m_SessionsLock);
+
+		UpdateAcceptance(true);
+	}
+	m_Running = true;
+	m_RxThread = std::thread(&CCcpChannel::ReceiveThread, this);
+	return PCAN_ERROR_OK;
+}
+
+void CCcpChannel::Close()
+{
+	if (!m_Running.exchange(false))
+		return;
+
+	// The receive thread is woken from its read; the transport is only
+	// closed once nobody is reading from it
+	m_Transport->Wake();
+	if (m_RxThread.joinable())
+		m_RxThread.join();
+	{
+		std::lock_guard<std::mutex> lock(m_TxLock);
+
+		m_Transport->Uninitialize();
+	}
+
+	// Nothing times out the queued commands anymore
+	std::vector<std::shared_ptr<CCcpSession> > sessions;
+
+	PinSessions(sessions);
+	for (size_t i = 0; i < sessions.size(); i++)
+		sessions[i]->Abort(CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE));
+}
+
+TPCANStatus CCcpChannel::Send(const TPCANMsg *Msg)
+{
+	int sent;
+
+	return Send(Msg, 1, &sent);
+}
+
+TPCANStatus CCcpChannel::Send(const TPCANMsg *Msgs, int Count, int *Sent)
+{
+	std::lock_guard<std::mutex> lock(m_TxLock);
+
+	// Close uninitializes the transport under m_TxLock, once m_Running is cleared
+	*Sent = 0;
+	if (!m_Running)
+		return PCAN_ERROR_INITIALIZE;
+	return m_Transport->Write(Msgs, Count, Sent);
+}
+
+void CCcpChannel::WakeBy(std::chrono::steady_clock::time_point Deadline)
+{
+	std::chrono::steady_clock::rep deadline = Deadline.time_since_epoch().count();
+	std::chrono::steady_clock::rep earliest = m_NextDeadline.load();
+
+	// Recorded before the wake up time is read, the reverse of PrepareWait:
+	// either the receive thread sees the deadline before it blocks, or the
+	// wake up time it blocks until is seen here
+	while (deadline < earliest && !m_NextDeadline.compare_exchange_weak(earliest, deadline))
+		;
+	if (m_Running && deadline < m_WakeAt.load())
+		m_Transport->Wake();
+}
+
+void CCcpChannel::Attach(CCcpSession *Session)
+{
+	std::lock_guard<std::mutex> lock(m_SessionsLock);
+
+	m_Sessions.push_back(Session);
+	BuildRoutes();
+}
+
+void CCcpChannel::Detach(CCcpSession *Session)
+{
+	std::lock_guard<std::mutex> lock(m_SessionsLock);
+
+	m_Sessions.erase(std::remove(m_Sessions.begin(), m_Sessions.end(), Session), m_Sessions.end());
+	BuildRoutes();
+}
+
+void CCcpChannel::BuildRoutes()
+{
+	DWORD ids = 0, slots = CCP_ROUTE_MIN_SLOTS, bits = 3;
+
+	// Called with m_SessionsLock held. Sessions sharing an IdDTO (stations
+	// of a multiplexer) get one route
+	m_Targets = m_Sessions;
+	std::stable_sort(m_Targets.begin(), m_Targets.end(), [](CCcpSession *A, CCcpSession *B)
+	{
+		return A->GetSlaveData().IdDTO < B->GetSlaveData().IdDTO;
+	});
+	for (size_t i = 0; i < m_Targets.size(); i++)
+	{
+		if (!i || m_Targets[i]->GetSlaveData().IdDTO != m_Targets[i - 1]->GetSlaveData().IdDTO)
+			ids++;
+	}
+	while (slots < 2 * ids)
+	{
+		slots <<= 1;
+		bits++;
+	}
+
+	TRoute empty = {0, 0, 0};
+	m_Routes.assign(slots, empty);
+	m_RouteMask = slots - 1;
+	m_RouteShift = 32 - bits;
+	for (size_t i = 0; i < m_Targets.size(); )
+	{
+		DWORD id = m_Targets[i]->GetSlaveData().IdDTO;
+		DWORD slot = Hash(id);
+		size_t end = i;
+
+		while (end < m_Targets.size() && m_Targets[end]->GetSlaveData().IdDTO == id)
+			end++;
+		while (m_Routes[slot].Count)
+			slot = (slot + 1) & m_RouteMask;
+		m_Routes[slot].Id = id;
+		m_Routes[slot].First = (DWORD)i;
+		m_Routes[slot].Count = (DWORD)(end - i);
+		i = end;
+	}
+	if (m_Running)
+		UpdateAcceptance(false);
+}
+
+void CCcpChannel::UpdateAcceptance(bool Force)
+{
+	std::vector<DWORD> ids;
+
+	// Called with m_SessionsLock held and the transport open. m_Targets is
+	// sorted by IdDTO
+	for (size_t i = 0; i < m_Targets.size(); i++)
+	{
+		if (!i || m_Targets[i]->GetSlaveData().IdDTO != m_Targets[i - 1]->GetSlaveData().IdDTO)
+			ids.push_back(m_Targets[i]->GetSlaveData().IdDTO);
+	}
+	if (!Force && ids == m_AcceptanceIds)
+		return;
+	m_AcceptanceIds = ids;
+	m_Filtering = m_Transport->SetAcceptance(ids.empty() ? NULL : &ids[0], (int)ids.size()) == PCAN_ERROR_OK;
+}
+
+void CCcpChannel::GetStats(TCCPChannelStats *Stats)
+{
+	std::lock_guard<std::mutex> lock(m_SessionsLock);
+
+	Stats->Frames = m_Frames.load(std::memory_order_relaxed);
+	Stats->Unknown = m_Unknown.load(std::memory_order_relaxed);
+	Stats->Sessions = (DWORD)m_Sessions.size();
+	Stats->Filtering = m_Filtering ? 1 : 0;
+	Stats->RxMode = m_BusyPoll ? CCP_RX_MODE_BUSY_POLL : CCP_RX_MODE_EVENT;
+	Stats->Reads = m_Reads.load(std::memory_order_relaxed);
+	Stats->Ids = 0;
+	for (size_t i = 0; i < m_Routes.size(); i++)
+	{
+		if (m_Routes[i].Count)
+			Stats->Ids++;
+	}
+}
+
+void CCcpChannel::ReceiveThread()
+{
+	TPCANMsg msgs[CCP_RX_BATCH];
+	UINT64 stamps[CCP_RX_BATCH];
+	TPCANStatus status;
+	DWORD wait = CCP_RX_POLL_TIMEOUT;
+	int received;
+
+	// The receive thread is the event loop of the channel: it delivers the
+	// CRMs, sends the next commands and ends the commands that time out
+	while (m_Running)
+	{
+		// Busy polling never blocks in the transport
+		status = m_Transport->Read(msgs, stamps, CCP_RX_BATCH, &received, PrepareWait(m_BusyPoll ? 0 : wait));
+		m_WakeAt.store(0);
+		m_Reads.store(m_Reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (status != PCAN_ERROR_OK && status != PCAN_ERROR_QRCVEMPTY)
+			std::this_thread::sleep_for(std::chrono::milliseconds(std::max(wait, (DWORD)1)));
+		else if (received)
+			Dispatch(msgs, stamps, received);
+		wait = std::min(CheckTimeouts(), (DWORD)CCP_RX_POLL_TIMEOUT);
+	}
+}
+
+void CCcpChannel::PinSessions(std::vector<std::shared_ptr<CCcpSession> > &Sessions)
+{
+	std::lock_guard<std::mutex> lock(m_SessionsLock);
+
+	// Sessions being destroyed (waiting in Detach) are left out
+	Sessions.clear();
+	for (size_t i = 0; i < m_Sessions.size(); i++)
+	{
+		std::shared_ptr<CCcpSession> session = m_Sessions[i]->weak_from_this().lock();
+
+		if (session)
+			Sessions.push_back(session);
+	}
+}
+
+DWORD CCcpChannel::PrepareWait(DWORD Wait)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point wakeAt = now + std::chrono::milliseconds(Wait);
+	std::chrono::steady_clock::time_point deadline;
+
+	// Published before the deadlines built meanwhile are read (see WakeBy)
+	m_WakeAt.store(wakeAt.time_since_epoch().count());
+	deadline = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_NextDeadline.load()));
+	if (deadline >= wakeAt)
+		return Wait;
+	if (deadline <= now)
+		return 0;
+	return (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1;
+}
+
+DWORD CCcpChannel::CheckTimeouts()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	DWORD wait = CCP_WAIT_INFINITE;
+
+	// The deadlines built from here on are seen by the scan or kept for PrepareWait
+	m_NextDeadline.store(std::chrono::steady_clock::time_point::max().time_since_epoch().count());
+
+	// Time outs complete commands: no lock held while they run
+	PinSessions(m_Pinned);
+	for (size_t i = 0; i < m_Pinned.size(); i++)
+		wait = std::min(wait, m_Pinned[i]->CheckTimeout(now));
+	m_Pinned.clear();
+	return wait;
+}
+
+void CCcpChannel::Dispatch(const TPCANMsg *Msgs, const UINT64 *Stamps, int Count)
+{
+	std::unique_lock<std::mutex> lock(m_SessionsLock);
+	UINT64 unknown = 0;
+
+	// One lock for the whole batch to route it and pin its sessions; frames
+	// nobody listens to are dropped
+	m_Deliveries.clear();
+	for (int i = 0; i < Count; i++)
+	{
+		DWORD id = CanGetId(&Msgs[i]);
+		DWORD slot = Hash(id);
+
+		while (m_Routes[slot].Count && m_Routes[slot].Id != id)
+			slot = (slot + 1) & m_RouteMask;
+
+		const TRoute &route = m_Routes[slot];
+
+		if (!route.Count)
+		{
+			unknown++;
+			continue;
+		}
+		for (DWORD target = route.First; target < route.First + route.Count; target++)
+		{
+			CCcpSession *session = m_Targets[target];
+			TDelivery delivery = {i, session};
+			size_t pinned;
+
+			// A batch mostly goes to a handful of sessions
+			for (pinned = 0; pinned < m_Pinned.size() && m_Pinned[pinned].get() != session; pinned++)
+				;
+			if (pinned == m_Pinned.size())
+			{
+				std::shared_ptr<CCcpSession> pin = session->weak_from_this().lock();
+
+				// Being destroyed
+				if (!pin)
+					continue;
+				m_Pinned.push_back(pin);
+			}
+			m_Deliveries.push_back(delivery);
+		}
+	}
+	lock.unlock();
+
+	for (size_t i = 0; i < m_Deliveries.size(); i++)
+		m_Deliveries[i].Session->OnReceive(Msgs[m_Deliveries[i].Msg], Stamps[m_Deliveries[i].Msg]);
+	m_Pinned.clear();
+	m_Frames.store(m_Frames.load(std::memory_order_relaxed) + Count, std::memory_order_relaxed);
+	if (unknown)
+		m_Unknown.store(m_Unknown.load(std::memory_order_relaxed) + unknown, std::memory_order_relaxed);
+}
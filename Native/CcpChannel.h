@@ -0,0 +1,169 @@
+//  CcpChannel.h
+//
+//  ~~~~~~~~~~~~
+//
+//  A PCAN-CCP channel: one CAN transport shared by the connections (sessions)
+//  opened on a TPCANHandle
+//
+//  ~~~~~~~~~~~~
+//
+#ifndef __CCPCHANNELH__
+#define __CCPCHANNELH__
+
+#include "WinTypes.h"
+#include "PCCP.h"
+#include "PCCPExt.h"
+#include "CanTransport.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CCcpSession;
+
+class CCcpChannel
+{
+public:
+	CCcpChannel(TPCANHandle Channel, const std::shared_ptr<ICanTransport> &Transport);
+	~CCcpChannel();
+
+	/// <summary>
+	/// Initializes the transport and starts the receive thread
+	/// </summary>
+	/// <param name="Btr0Btr1">The speed for the communication (BTR0BTR1 code)</param>
+	/// <returns>A TPCANStatus error code</returns>
+	TPCANStatus Open(TPCANBaudrate Btr0Btr1);
+
+	/// <summary>
+	/// Stops the receive thread and uninitializes the transport. Commands still
+	/// queued on the attached sessions complete with PCAN_ERROR_INITIALIZE
+	/// </summary>
+	void Close();
+
+	/// <summary>
+	/// Transmits a single CAN message
+	/// </summary>
+	/// <param name="Msg">The message to be sent</param>
+	/// <returns>A TPCANStatus error code</returns>
+	TPCANStatus Send(const TPCANMsg *Msg);
+
+	/// <summary>
+	/// Transmits CAN messages back to back, in one write of the transport
+	/// (a single sendmmsg on SocketCAN)
+	/// </summary>
+	/// <param name="Msgs">The messages to be sent</param>
+	/// <param name="Count">Number of messages in 'Msgs'</param>
+	/// <param name="Sent">Buffer for the number of messages sent, the first ones of 'Msgs'</param>
+	/// <returns>A TPCANStatus error code</returns>
+	TPCANStatus Send(const TPCANMsg *Msgs, int Count, int *Sent);
+
+	/// <summary>
+	/// Makes the receive thread check the time outs by a deadline: it is woken
+	/// if it blocks in the transport past it (a command sent by another thread)
+	/// </summary>
+	/// <param name="Deadline">The time out of a command just built</param>
+	void WakeBy(std::chrono::steady_clock::time_point Deadline);
+
+	/// <summary>
+	/// Registers a session to receive the frames sent on its IdDTO
+	/// </summary>
+	void Attach(CCcpSession *Session);
+
+	/// <summary>
+	/// Unregisters a session. No more frames are delivered after it returns
+	/// </summary>
+	void Detach(CCcpSession *Session);
+
+	/// <summary>
+	/// Returns the counters of the receive thread (see CCP_GetChannelStats)
+	/// </summary>
+	void GetStats(TCCPChannelStats *Stats);
+
+	/// <summary>
+	/// Lets the receive thread poll the transport without sleeping (true) or
+	/// wait for its receive event (false, see CCP_SetRxMode)
+	/// </summary>
+	void SetBusyPoll(bool BusyPoll) { m_BusyPoll = BusyPoll; }
+
+	bool IsOpen() const { return m_Running; }
+	TPCANHandle GetHandle() const { return m_Channel; }
+	TPCANBaudrate GetBaudrate() const { return m_Baudrate; }
+	ICanTransport *GetTransport() const { return m_Transport.get(); }
+
+private:
+	// The sessions listening to one CAN identifier: m_Targets[First] to
+	// m_Targets[First + Count - 1]. Count is 0 for an empty slot
+	//
+	struct TRoute
+	{
+		DWORD Id;
+		DWORD First;
+		DWORD Count;
+	};
+
+	void ReceiveThread();
+	void Dispatch(const TPCANMsg *Msgs, const UINT64 *Stamps, int Count);
+	void PinSessions(std::vector<std::shared_ptr<CCcpSession> > &Sessions);
+	DWORD CheckTimeouts();
+	DWORD PrepareWait(DWORD Wait);
+	void BuildRoutes();
+	void UpdateAcceptance(bool Force);
+	DWORD Hash(DWORD Id) const { return (Id * 0x9E3779B1U) >> m_RouteShift; }
+
+	TPCANHandle m_Channel;
+	TPCANBaudrate m_Baudrate;
+	std::shared_ptr<ICanTransport> m_Transport;
+
+	std::thread m_RxThread;
+	std::atomic<bool> m_Running;
+	std::atomic<bool> m_BusyPoll;
+
+	std::mutex m_TxLock;
+	std::mutex m_SessionsLock;
+	std::vector<CCcpSession*> m_Sessions;
+
+	// Sessions by IdDTO, rebuilt by Attach / Detach: an open addressing
+	// table (linear probing, at most half full) over the sessions sorted by
+	// IdDTO (protected by m_SessionsLock)
+	//
+	std::vector<TRoute> m_Routes;
+	std::vector<CCcpSession*> m_Targets;
+	DWORD m_RouteMask;
+	DWORD m_RouteShift;
+
+	// IdDTO let through by the transport filters, and whether the transport
+	// filters at all (protected by m_SessionsLock)
+	//
+	std::vector<DWORD> m_AcceptanceIds;
+	bool m_Filtering;
+
+	// Frames of a batch by session, filled under m_SessionsLock and delivered
+	// once it is released: a completion run by OnReceive may open or close
+	// sessions (receive thread only)
+	//
+	struct TDelivery
+	{
+		int Msg;
+		CCcpSession *Session;
+	};
+	std::vector<TDelivery> m_Deliveries;
+	std::vector<std::shared_ptr<CCcpSession> > m_Pinned;
+
+	// When the receive thread wakes up next (0: it is awake and checks the
+	// time outs before it waits again), and the earliest deadline built since
+	// its last check. In steady_clock ticks
+	//
+	std::atomic<std::chrono::steady_clock::rep> m_WakeAt;
+	std::atomic<std::chrono::steady_clock::rep> m_NextDeadline;
+
+	// Written by the receive thread only
+	//
+	std::atomic<UINT64> m_Frames;
+	std::atomic<UINT64> m_Unknown;
+	std::atomic<UINT64> m_Reads;
+};
+
+#endif
@@ -0,0 +1,347 @@
+//  CcpChecksum.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Host side computation of the BUILD_CHKSUM checksum types
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpChecksum.h"
+#include "CcpProtocol.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CCP_CHECKSUM_SSE2
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// CRC tables (slice-by-8)
+////////////////////////////////////////////////////////////
+
+// Table [k][x]: CRC of byte x followed by k zero bytes
+//
+struct TCrcTables
+{
+	WORD Ccitt[8][256];                                    // CRC-16 CCITT, MSB first
+	WORD Crc16[8][256];                                    // CRC-16, reflected
+	DWORD Crc32[8][256];                                   // CRC-32, reflected
+
+	TCrcTables()
+	{
+		for (int x = 0; x < 256; x++)
+		{
+			WORD ccitt = (WORD)(x << 8), crc16 = (WORD)x;
+			DWORD crc32 = (DWORD)x;
+
+			for (int bit = 0; bit < 8; bit++)
+			{
+				ccitt = (ccitt & 0x8000) ? (WORD)((ccitt << 1) ^ 0x1021) : (WORD)(ccitt << 1);
+				crc16 = (crc16 & 1) ? (WORD)((crc16 >> 1) ^ 0xA001) : (WORD)(crc16 >> 1);
+				crc32 = (crc32 & 1) ? (crc32 >> 1) ^ 0xEDB88320 : crc32 >> 1;
+			}
+			Ccitt[0][x] = ccitt;
+			Crc16[0][x] = crc16;
+			Crc32[0][x] = crc32;
+		}
+		for (int k = 1; k < 8; k++)
+		{
+			for (int x = 0; x < 256; x++)
+			{
+				Ccitt[k][x] = (WORD)((Ccitt[k - 1][x] << 8) ^ Ccitt[0][Ccitt[k - 1][x] >> 8]);
+				Crc16[k][x] = (WORD)((Crc16[k - 1][x] >> 8) ^ Crc16[0][Crc16[k - 1][x] & 0xFF]);
+				Crc32[k][x] = (Crc32[k - 1][x] >> 8) ^ Crc32[0][Crc32[k - 1][x] & 0xFF];
+			}
+		}
+	}
+};
+
+static const TCrcTables &CrcTables()
+{
+	static const TCrcTables tables;
+
+	return tables;
+}
+
+static WORD CrcCcitt(WORD Crc, const BYTE *Data, size_t Size)
+{
+	const WORD (*t)[256] = CrcTables().Ccitt;
+
+	for (; Size >= 8; Size -= 8, Data += 8)
+	{
+		Crc = t[7][Data[0] ^ (Crc >> 8)] ^ t[6][Data[1] ^ (Crc & 0xFF)] ^
+			t[5][Data[2]] ^ t[4][Data[3]] ^ t[3][Data[4]] ^ t[2][Data[5]] ^ t[1][Data[6]] ^ t[0][Data[7]];
+	}
+	for (; Size; Size--, Data++)
+		Crc = (WORD)((Crc << 8) ^ t[0][(Crc >> 8) ^ *Data]);
+	return Crc;
+}
+
+static WORD Crc16(WORD Crc, const BYTE *Data, size_t Size)
+{
+	const WORD (*t)[256] = CrcTables().Crc16;
+	WORD first;
+
+	for (; Size >= 8; Size -= 8, Data += 8)
+	{
+		first = Crc ^ (WORD)(Data[0] | (Data[1] << 8));
+		Crc = t[7][first & 0xFF] ^ t[6][first >> 8] ^
+			t[5][Data[2]] ^ t[4][Data[3]] ^ t[3][Data[4]] ^ t[2][Data[5]] ^ t[1][Data[6]] ^ t[0][Data[7]];
+	}
+	for (; Size; Size--, Data++)
+		Crc = (WORD)((Crc >> 8) ^ t[0][(Crc ^ *Data) & 0xFF]);
+	return Crc;
+}
+
+static DWORD Crc32(DWORD Crc, const BYTE *Data, size_t Size)
+{
+	const DWORD (*t)[256] = CrcTables().Crc32;
+	DWORD first;
+
+	for (; Size >= 8; Size -= 8, Data += 8)
+	{
+		first = Crc ^ ((DWORD)Data[0] | ((DWORD)Data[1] << 8) | ((DWORD)Data[2] << 16) | ((DWORD)Data[3] << 24));
+		Crc = t[7][first & 0xFF] ^ t[6][(first >> 8) & 0xFF] ^ t[5][(first >> 16) & 0xFF] ^ t[4][first >> 24] ^
+			t[3][Data[4]] ^ t[2][Data[5]] ^ t[1][Data[6]] ^ t[0][Data[7]];
+	}
+	for (; Size; Size--, Data++)
+		Crc = (Crc >> 8) ^ t[0][(Crc ^ *Data) & 0xFF];
+	return Crc;
+}
+
+////////////////////////////////////////////////////////////
+// Sums
+////////////////////////////////////////////////////////////
+
+static UINT64 SumBytes(const BYTE *Data, size_t Size)
+{
+	UINT64 sum = 0;
+
+#ifdef CCP_CHECKSUM_SSE2
+	__m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128();
+	UINT64 lanes[2];
+
+	// PSADBW against zero: two 64 bit sums of 8 bytes each
+	for (; Size >= 16; Size -= 16, Data += 16)
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)Data), zero));
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+	for (; Size; Size--)
+		sum += *Data++;
+	return sum;
+}
+
+#ifdef CCP_CHECKSUM_SSE2
+static inline __m128i SwapBytes16(__m128i Value)
+{
+	return _mm_or_si128(_mm_slli_epi16(Value, 8), _mm_srli_epi16(Value, 8));
+}
+
+static inline DWORD HorizontalSum32(__m128i Value)
+{
+	DWORD lanes[4];
+
+	_mm_storeu_si128((__m128i*)lanes, Value);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+// Words are summed modulo 2^32, enough for ADD_WW and ADD_WD
+//
+static DWORD SumWords(const BYTE *Data, size_t Count, bool IntelFormat)
+{
+	DWORD sum = 0;
+
+#ifdef CCP_CHECKSUM_SSE2
+	__m128i zero = _mm_setzero_si128(), acc = _mm_setzero_si128(), value;
+
+	for (; Count >= 8; Count -= 8, Data += 16)
+	{
+		value = _mm_loadu_si128((const __m128i*)Data);
+		if (!IntelFormat)
+			value = SwapBytes16(value);
+		acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(value, zero));
+		acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(value, zero));
+	}
+	sum = HorizontalSum32(acc);
+#endif
+	for (; Count; Count--, Data += 2)
+		sum += CcpGetWord(Data, IntelFormat);
+	return sum;
+}
+
+static DWORD SumDwords(const BYTE *Data, size_t Count, bool IntelFormat)
+{
+	DWORD sum = 0;
+
+#ifdef CCP_CHECKSUM_SSE2
+	__m128i acc = _mm_setzero_si128(), value;
+
+	for (; Count >= 4; Count -= 4, Data += 16)
+	{
+		value = _mm_loadu_si128((const __m128i*)Data);
+		if (!IntelFormat)
+		{
+			value = SwapBytes16(value);
+			value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+			value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+		}
+		acc = _mm_add_epi32(acc, value);
+	}
+	sum = HorizontalSum32(acc);
+#endif
+	for (; Count; Count--, Data += 4)
+		sum += CcpGetDword(Data, IntelFormat);
+	return sum;
+}
+
+////////////////////////////////////////////////////////////
+// CCcpChecksum
+////////////////////////////////////////////////////////////
+
+CCcpChecksum::CCcpChecksum()
+{
+	Reset(CCP_CHECKSUM_CRC_16_CITT, true);
+}
+
+BYTE CCcpChecksum::GetSize(BYTE ChecksumType)
+{
+	switch (ChecksumType)
+	{
+		case CCP_CHECKSUM_ADD_BB:
+			return 1;
+		case CCP_CHECKSUM_ADD_BW:
+		case CCP_CHECKSUM_ADD_WW:
+		case CCP_CHECKSUM_CRC_16:
+		case CCP_CHECKSUM_CRC_16_CITT:
+			return 2;
+		case CCP_CHECKSUM_ADD_BD:
+		case CCP_CHECKSUM_ADD_WD:
+		case CCP_CHECKSUM_ADD_DD:
+		case CCP_CHECKSUM_CRC_32:
+			return 4;
+		default:
+			return 0;
+	}
+}
+
+bool CCcpChecksum::Reset(BYTE ChecksumType, bool IntelFormat)
+{
+	if (!GetSize(ChecksumType))
+		return false;
+
+	m_Type = ChecksumType;
+	m_IntelFormat = IntelFormat;
+	m_Sum = 0;
+	m_PartialCount = 0;
+	switch (ChecksumType)
+	{
+		case CCP_CHECKSUM_CRC_16_CITT: m_Crc = 0xFFFF; break;
+		case CCP_CHECKSUM_CRC_32: m_Crc = 0xFFFFFFFF; break;
+		default: m_Crc = 0; break;
+	}
+	return true;
+}
+
+void CCcpChecksum::UpdateWords(const BYTE *Data, size_t Count)
+{
+	m_Sum += SumWords(Data, Count, m_IntelFormat);
+}
+
+void CCcpChecksum::UpdateDwords(const BYTE *Data, size_t Count)
+{
+	m_Sum += SumDwords(Data, Count, m_IntelFormat);
+}
+
+void CCcpChecksum::Update(const BYTE *Data, size_t Size)
+{
+	size_t unit, bulk;
+
+	switch (m_Type)
+	{
+		case CCP_CHECKSUM_ADD_BB:
+		case CCP_CHECKSUM_ADD_BW:
+		case CCP_CHECKSUM_ADD_BD:
+			m_Sum += SumBytes(Data, Size);
+			return;
+
+		case CCP_CHECKSUM_CRC_16:
+			m_Crc = Crc16((WORD)m_Crc, Data, Size);
+			return;
+
+		case CCP_CHECKSUM_CRC_16_CITT:
+			m_Crc = CrcCcitt((WORD)m_Crc, Data, Size);
+			return;
+
+		case CCP_CHECKSUM_CRC_32:
+			m_Crc = Crc32(m_Crc, Data, Size);
+			return;
+
+		default:
+			break;
+	}
+
+	// ADD_WW / ADD_WD / ADD_DD: complete a word split by the previous piece first
+	unit = m_Type == CCP_CHECKSUM_ADD_DD ? 4 : 2;
+	while (m_PartialCount && m_PartialCount < unit && Size)
+	{
+		m_Partial[m_PartialCount++] = *Data++;
+		Size--;
+		if (m_PartialCount == unit)
+		{
+			if (unit == 4)
+				UpdateDwords(m_Partial, 1);
+			else
+				UpdateWords(m_Partial, 1);
+			m_PartialCount = 0;
+		}
+	}
+	if (m_PartialCount)
+		return;
+
+	bulk = Size / unit;
+	if (unit == 4)
+		UpdateDwords(Data, bulk);
+	else
+		UpdateWords(Data, bulk);
+	Data += bulk * unit;
+	Size -= bulk * unit;
+
+	memcpy(m_Partial, Data, Size);
+	m_PartialCount = Size;
+}
+
+bool CCcpChecksum::GetValue(DWORD *Checksum) const
+{
+	if (m_PartialCount)
+		return false;
+
+	switch (m_Type)
+	{
+		case CCP_CHECKSUM_ADD_BB: *Checksum = (DWORD)(m_Sum & 0xFF); break;
+		case CCP_CHECKSUM_ADD_BW:
+		case CCP_CHECKSUM_ADD_WW: *Checksum = (DWORD)(m_Sum & 0xFFFF); break;
+		case CCP_CHECKSUM_ADD_BD:
+		case CCP_CHECKSUM_ADD_WD:
+		case CCP_CHECKSUM_ADD_DD: *Checksum = (DWORD)m_Sum; break;
+		case CCP_CHECKSUM_CRC_32: *Checksum = m_Crc ^ 0xFFFFFFFF; break;
+		default: *Checksum = m_Crc; break;
+	}
+	return true;
+}
+
+bool CCcpChecksum::Matches(const BYTE *ChecksumData, BYTE ChecksumSize) const
+{
+	DWORD value;
+
+	if (ChecksumSize != GetSize(m_Type) || !GetValue(&value))
+		return false;
+	switch (ChecksumSize)
+	{
+		case 1: return ChecksumData[0] == (BYTE)value;
+		case 2: return CcpGetWord(ChecksumData, m_IntelFormat) == (WORD)value;
+		default: return CcpGetDword(ChecksumData, m_IntelFormat) == value;
+	}
+}
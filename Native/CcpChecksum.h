@@ -0,0 +1,63 @@
+//  CcpChecksum.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Host side computation of the BUILD_CHKSUM checksum types
+//
+//  ~~~~~~~~~~~~
+//
+//  CRCs use slice-by-8 tables; byte and word sums use SSE2 when available.
+//  Data may be fed in pieces of any size.
+//
+#ifndef __CCPCHECKSUMH__
+#define __CCPCHECKSUMH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+#include <stddef.h>
+
+class CCcpChecksum
+{
+public:
+	CCcpChecksum();
+
+	/// <summary>
+	/// Returns the size in bytes of a checksum type (as in the BUILD_CHKSUM CRM),
+	/// 0 for an unknown type
+	/// </summary>
+	static BYTE GetSize(BYTE ChecksumType);
+
+	/// <summary>
+	/// Starts a new computation
+	/// </summary>
+	/// <returns>False for an unknown checksum type</returns>
+	bool Reset(BYTE ChecksumType, bool IntelFormat);
+
+	void Update(const BYTE *Data, size_t Size);
+
+	/// <summary>
+	/// Returns the checksum of the data fed so far
+	/// </summary>
+	/// <returns>False if the data does not end on a word / dword boundary (ADD_W* / ADD_DD)</returns>
+	bool GetValue(DWORD *Checksum) const;
+
+	/// <summary>
+	/// Compares the checksum of the data fed so far with the checksum returned
+	/// by a slave (size and value bytes of the BUILD_CHKSUM CRM, slave byte order)
+	/// </summary>
+	bool Matches(const BYTE *ChecksumData, BYTE ChecksumSize) const;
+
+private:
+	void UpdateWords(const BYTE *Data, size_t Count);
+	void UpdateDwords(const BYTE *Data, size_t Count);
+
+	BYTE m_Type;
+	bool m_IntelFormat;
+	UINT64 m_Sum;                                          // ADD_* (modulo 2^64)
+	DWORD m_Crc;                                           // CRC_*
+	BYTE m_Partial[4];                                     // Bytes of an incomplete word / dword
+	size_t m_PartialCount;
+};
+
+#endif
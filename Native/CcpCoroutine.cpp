@@ -0,0 +1,296 @@
+//  CcpCoroutine.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  C++20 coroutine front-end of the asynchronous session layer
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpCoroutine.h"
+#include "CcpChecksum.h"
+#include "CcpRegistry.h"
+
+#include <string.h>
+#include <vector>
+
+//------------------------------
+// Awaiters
+//------------------------------
+
+CCcpCommandAwaiter::CCcpCommandAwaiter(CCcpSession *Session, const BYTE *Cro, ICcpCommandSource *Source, WORD TimeOut)
+	: m_Session(Session), m_Source(Source), m_TimeOut(TimeOut)
+{
+	memset(m_Cro, 0, sizeof(m_Cro));
+	if (Cro)
+		memcpy(m_Cro, Cro, sizeof(m_Cro));
+	memset(&m_Reply, 0, sizeof(m_Reply));
+}
+
+void CCcpCommandAwaiter::Launch()
+{
+	TCcpCompletion completion = [this](TCCPResult Result, const BYTE *Crm, DWORD Commands)
+	{
+		m_Reply.Result = Result;
+		memcpy(m_Reply.Crm, Crm, CCP_PACKET_SIZE);
+		m_Reply.Commands = Commands;
+		Resume();
+	};
+
+	if (!m_Session)
+	{
+		m_Reply.Result = CCP_RESULT_ILLHANDLE;
+		Resume();
+	}
+	else if (m_Source)
+		m_Session->CommandSequenceAsync(m_Source, m_TimeOut, completion);
+	else
+		m_Session->CommandAsync(m_Cro, m_TimeOut, completion);
+}
+
+CCcpReadAwaiter::CCcpReadAwaiter(CCcpSession *Session, BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, TCCPTransferStats *Stats, WORD TimeOut)
+	: m_Session(Session), m_AddrExtension(AddrExtension), m_Addr(Addr), m_Length(Length)
+	, m_Buffer(Buffer), m_Stats(Stats), m_TimeOut(TimeOut), m_Result(CCP_ERROR_ACKNOWLEDGE_OK)
+{
+}
+
+void CCcpReadAwaiter::Launch()
+{
+	TCCPResult result = CCP_RESULT_ILLHANDLE;
+
+	// The completion may already have stored the outcome: m_Result is only set here if nothing was queued
+	if (m_Session)
+		result = CCcpMemoryTransfer(m_Session).ReadAsync(m_AddrExtension, m_Addr, m_Length, m_Buffer, m_TimeOut, [this](TCCPResult Result, const TCCPTransferStats *Stats)
+		{
+			m_Result = Result;
+			if (m_Stats)
+				*m_Stats = *Stats;
+			Resume();
+		});
+
+	// Not queued: no completion follows
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		m_Result = result;
+		Resume();
+	}
+}
+
+CCcpWriteAwaiter::CCcpWriteAwaiter(CCcpSession *Session, const TCCPMemoryBlock *Blocks, DWORD Count, TCCPTransferStats *Stats, WORD TimeOut)
+	: m_Session(Session), m_Blocks(Blocks), m_Count(Count), m_Stats(Stats), m_TimeOut(TimeOut), m_Result(CCP_ERROR_ACKNOWLEDGE_OK)
+{
+}
+
+void CCcpWriteAwaiter::Launch()
+{
+	TCCPResult result = CCP_RESULT_ILLHANDLE;
+
+	// The completion may already have stored the outcome: m_Result is only set here if nothing was queued
+	if (m_Session)
+		result = CCcpMemoryTransfer(m_Session).WriteAsync(m_Blocks, m_Count, m_TimeOut, [this](TCCPResult Result, const TCCPTransferStats *Stats)
+		{
+			m_Result = Result;
+			if (m_Stats)
+				*m_Stats = *Stats;
+			Resume();
+		});
+
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		m_Result = result;
+		Resume();
+	}
+}
+
+//------------------------------
+// CCcpCoSession
+//------------------------------
+
+CCcpCoSession::CCcpCoSession(const std::shared_ptr<CCcpSession> &Session)
+	: m_Session(Session)
+{
+}
+
+CCcpCoSession::CCcpCoSession(TCCPHandle CcpHandle)
+	: m_Session(CCcpRegistry::Instance().FindSession(CcpHandle))
+{
+}
+
+CCcpCommandAwaiter CCcpCoSession::Command(const BYTE *Cro, WORD TimeOut)
+{
+	return CCcpCommandAwaiter(m_Session.get(), Cro, NULL, TimeOut);
+}
+
+CCcpCommandAwaiter CCcpCoSession::Sequence(ICcpCommandSource *Source, WORD TimeOut)
+{
+	return CCcpCommandAwaiter(m_Session.get(), NULL, Source, TimeOut);
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::SetMemoryTransferAddress(BYTE UsedMTA, BYTE AddrExtension, DWORD Addr, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SET_MTA};
+	TCcpReply reply;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+	if (UsedMTA > 1)
+		co_return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = UsedMTA;
+	cro[3] = AddrExtension;
+	CcpPutDword(&cro[4], Addr, m_Session->GetSlaveData().IntelFormat);
+	reply = co_await Command(cro, TimeOut);
+	if (reply.Result == CCP_ERROR_ACKNOWLEDGE_OK && UsedMTA == 0)
+		m_Session->SetMta0(AddrExtension, Addr);
+	co_return reply.Result;
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::Upload(BYTE Size, BYTE *DataBytes, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_UPLOAD};
+	TCcpReply reply;
+	BYTE mta0Ext;
+	DWORD mta0Addr;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+	if (!DataBytes || Size > CCP_MAX_UPLOAD)
+		co_return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = Size;
+	reply = co_await Command(cro, TimeOut);
+	if (reply.Result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		memcpy(DataBytes, &reply.Crm[CCP_CRM_DATA_OFFSET], Size);
+		m_Session->GetMta0(&mta0Ext, &mta0Addr);
+		m_Session->SetMta0(mta0Ext, mta0Addr + Size);
+	}
+	co_return reply.Result;
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::ShortUpload(BYTE UploadSize, BYTE MTA0Ext, DWORD MTA0Addr, BYTE *ReqData, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SHORT_UP};
+	TCcpReply reply;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+	if (!ReqData || UploadSize > CCP_MAX_UPLOAD)
+		co_return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = UploadSize;
+	cro[3] = MTA0Ext;
+	CcpPutDword(&cro[4], MTA0Addr, m_Session->GetSlaveData().IntelFormat);
+	reply = co_await Command(cro, TimeOut);
+	if (reply.Result == CCP_ERROR_ACKNOWLEDGE_OK)
+		memcpy(ReqData, &reply.Crm[CCP_CRM_DATA_OFFSET], UploadSize);
+	co_return reply.Result;
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::Download(const BYTE *DataBytes, BYTE Size, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_DNLOAD};
+	TCcpReply reply;
+	bool intel;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+	if (!DataBytes || Size > CCP_MAX_DNLOAD)
+		co_return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	intel = m_Session->GetSlaveData().IntelFormat;
+	cro[2] = Size;
+	memcpy(&cro[3], DataBytes, Size);
+	reply = co_await Command(cro, TimeOut);
+	if (reply.Result == CCP_ERROR_ACKNOWLEDGE_OK)
+		m_Session->SetMta0(reply.Crm[3], CcpGetDword(&reply.Crm[4], intel));
+	co_return reply.Result;
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::ClearMemory(DWORD MemorySize, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_CLEAR_MEMORY};
+	TCcpReply reply;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+
+	CcpPutDword(&cro[2], MemorySize, m_Session->GetSlaveData().IntelFormat);
+	reply = co_await Command(cro, TimeOut);
+	co_return reply.Result;
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::BuildChecksum(DWORD BlockSize, BYTE *ChecksumData, BYTE *ChecksumSize, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_BUILD_CHKSUM};
+	TCcpReply reply;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+	if (!ChecksumData || !ChecksumSize)
+		co_return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	CcpPutDword(&cro[2], BlockSize, m_Session->GetSlaveData().IntelFormat);
+	reply = co_await Command(cro, TimeOut);
+	if (reply.Result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		*ChecksumSize = reply.Crm[3] > 4 ? 4 : reply.Crm[3];
+		memcpy(ChecksumData, &reply.Crm[4], *ChecksumSize);
+	}
+	co_return reply.Result;
+}
+
+CCcpReadAwaiter CCcpCoSession::ReadMemory(BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, TCCPTransferStats *Stats, WORD TimeOut)
+{
+	return CCcpReadAwaiter(m_Session.get(), AddrExtension, Addr, Length, Buffer, Stats, TimeOut);
+}
+
+CCcpWriteAwaiter CCcpCoSession::WriteMemory(const TCCPMemoryBlock *Blocks, DWORD Count, TCCPTransferStats *Stats, WORD TimeOut)
+{
+	return CCcpWriteAwaiter(m_Session.get(), Blocks, Count, Stats, TimeOut);
+}
+
+CCcpTask<TCCPResult> CCcpCoSession::ProgramBlock(BYTE AddrExtension, DWORD Addr, const BYTE *Data, DWORD Length, BYTE ChecksumType, WORD TimeOut)
+{
+	std::vector<TCcpMemoryRange> ranges(1);
+	CCcpChecksum checksum;
+	BYTE checksumData[4];
+	BYTE checksumSize;
+	BYTE mta0Ext;
+	DWORD mta0Addr;
+	TCCPResult result;
+	TCcpReply reply;
+	bool intel;
+
+	if (!m_Session)
+		co_return CCP_RESULT_ILLHANDLE;
+	intel = m_Session->GetSlaveData().IntelFormat;
+	if ((!Data && Length) || (UINT64)Addr + Length > 0x100000000ULL || (ChecksumType && !checksum.Reset(ChecksumType, intel)))
+		co_return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	if (!Length)
+		co_return CCP_ERROR_ACKNOWLEDGE_OK;
+
+	// SET_MTA and the PROGRAM commands go back to back from the receive thread
+	ranges[0].Ext = AddrExtension;
+	ranges[0].Addr = Addr;
+	ranges[0].Data.assign(Data, Data + Length);
+	CCcpRangeWriteSource source(ranges, CCP_CMD_PROGRAM, CCP_CMD_PROGRAM_6, intel);
+
+	reply = co_await Sequence(&source, TimeOut);
+	if (reply.Commands)
+	{
+		source.GetMta0(&mta0Ext, &mta0Addr);
+		m_Session->SetMta0(mta0Ext, mta0Addr);
+	}
+	if (reply.Result != CCP_ERROR_ACKNOWLEDGE_OK || !ChecksumType)
+		co_return reply.Result;
+
+	result = co_await SetMemoryTransferAddress(0, AddrExtension, Addr, TimeOut);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		co_return result;
+	result = co_await BuildChecksum(Length, checksumData, &checksumSize, TimeOut);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		co_return result;
+
+	checksum.Update(ranges[0].Data.data(), Length);
+	co_return checksum.Matches(checksumData, checksumSize) ? CCP_ERROR_ACKNOWLEDGE_OK : CCP_ERROR_VERIFY_FAILED;
+}
@@ -0,0 +1,426 @@
+//  CcpCoroutine.h
+//
+//  ~~~~~~~~~~~~
+//
+//  C++20 coroutine front-end of the asynchronous session layer
+//
+//  ~~~~~~~~~~~~
+//
+//  A CCcpTask is a coroutine that co_awaits CCP operations of one or more
+//  CCcpCoSession objects. No thread is blocked while a command is on the bus:
+//  the coroutine is suspended and resumed by the receive thread of the channel
+//  once the CRM arrives, so test sequences driving many ECUs can be written as
+//  straight-line code. Like completions, coroutine code runs on the receive
+//  thread after its first co_await and must not call the blocking CCP_* API.
+//
+#ifndef __CCPCOROUTINEH__
+#define __CCPCOROUTINEH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpSession.h"
+#include "CcpMemoryTransfer.h"
+
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+template <typename T> class CCcpTask;
+
+// State shared by a task and its coroutine frame, so that a task waited on by
+// another thread can be released as soon as it is signaled
+//
+class CCcpTaskSignal
+{
+public:
+	CCcpTaskSignal() : m_Done(false) {}
+
+	void Set()
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		m_Done = true;
+		m_Event.notify_all();
+	}
+
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_Lock);
+		m_Event.wait(lock, [this] { return m_Done; });
+	}
+
+private:
+	std::mutex m_Lock;
+	std::condition_variable m_Event;
+	bool m_Done;
+};
+
+// Promise parts common to all CCcpTask types
+//
+class CCcpTaskPromiseBase
+{
+public:
+	struct TFinalAwaiter
+	{
+		bool await_ready() noexcept { return false; }
+
+		template <typename TPromise>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise> Handle) noexcept
+		{
+			CCcpTaskPromiseBase &promise = Handle.promise();
+			std::shared_ptr<CCcpTaskSignal> signal = promise.m_Signal;
+			std::coroutine_handle<> continuation = promise.m_Continuation;
+
+			// The frame may be destroyed by a waiting thread from here on
+			signal->Set();
+			return continuation ? continuation : std::noop_coroutine();
+		}
+
+		void await_resume() noexcept {}
+	};
+
+	CCcpTaskPromiseBase() : m_Signal(std::make_shared<CCcpTaskSignal>()) {}
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	TFinalAwaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() { m_Exception = std::current_exception(); }
+
+	std::shared_ptr<CCcpTaskSignal> m_Signal;
+	std::coroutine_handle<> m_Continuation;                // Coroutine awaiting this task
+	std::exception_ptr m_Exception;
+};
+
+template <typename T>
+class CCcpTaskPromise : public CCcpTaskPromiseBase
+{
+public:
+	CCcpTask<T> get_return_object();
+	void return_value(T Value) { m_Value.emplace(std::move(Value)); }
+
+	T TakeValue()
+	{
+		if (m_Exception)
+			std::rethrow_exception(m_Exception);
+		return std::move(*m_Value);
+	}
+
+private:
+	std::optional<T> m_Value;
+};
+
+template <>
+class CCcpTaskPromise<void> : public CCcpTaskPromiseBase
+{
+public:
+	CCcpTask<void> get_return_object();
+	void return_void() {}
+
+	void TakeValue()
+	{
+		if (m_Exception)
+			std::rethrow_exception(m_Exception);
+	}
+};
+
+// A lazily started coroutine. It runs when co_awaited by another task, or when
+// started by Start / Wait from a thread outside of the event loop. An empty
+// task (default constructed or moved from) completes at once with
+// PCAN_ERROR_ILLOPERATION; waiting on one of another type is a usage error
+//
+template <typename T = void>
+class CCcpTask
+{
+public:
+	typedef CCcpTaskPromise<T> promise_type;
+
+	CCcpTask() {}
+	explicit CCcpTask(std::coroutine_handle<promise_type> Handle) : m_Handle(Handle) {}
+	CCcpTask(CCcpTask &&Other) noexcept
+		: m_Handle(std::exchange(Other.m_Handle, nullptr)), m_Started(std::exchange(Other.m_Started, false)) {}
+	CCcpTask(const CCcpTask&) = delete;
+	~CCcpTask() { Release(); }
+
+	CCcpTask &operator=(CCcpTask &&Other) noexcept
+	{
+		if (this != &Other)
+		{
+			Release();
+			m_Handle = std::exchange(Other.m_Handle, nullptr);
+			m_Started = std::exchange(Other.m_Started, false);
+		}
+		return *this;
+	}
+	CCcpTask &operator=(const CCcpTask&) = delete;
+
+	/// <summary>
+	/// Runs the coroutine on the calling thread up to its first suspension
+	/// </summary>
+	/// <remarks>The task object must outlive the coroutine (see Wait)</remarks>
+	void Start()
+	{
+		if (m_Handle && !m_Started)
+		{
+			m_Started = true;
+			m_Handle.resume();
+		}
+	}
+
+	/// <summary>
+	/// Starts the coroutine if needed and blocks until it returns. Must not be
+	/// called from the receive thread (a coroutine co_awaits tasks instead)
+	/// </summary>
+	/// <returns>The value returned by the coroutine. Exceptions are rethrown</returns>
+	T Wait()
+	{
+		if (!m_Handle)
+			return Empty();
+
+		std::shared_ptr<CCcpTaskSignal> signal = m_Handle.promise().m_Signal;
+
+		Start();
+		signal->Wait();
+		return m_Handle.promise().TakeValue();
+	}
+
+	//------------------------------
+	// Awaitable
+	//------------------------------
+
+	bool await_ready() const noexcept { return !m_Handle; }
+
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> Awaiting) noexcept
+	{
+		m_Started = true;
+		m_Handle.promise().m_Continuation = Awaiting;
+		return m_Handle;
+	}
+
+	T await_resume() { return m_Handle ? m_Handle.promise().TakeValue() : Empty(); }
+
+private:
+	static T Empty()
+	{
+		if constexpr (std::is_same<T, TCCPResult>::value)
+			return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+		else
+		{
+			assert(!"CCcpTask: waiting on a task without coroutine");
+			return T();
+		}
+	}
+
+	void Release()
+	{
+		if (m_Handle)
+		{
+			// A started coroutine owns resources in use by the event loop
+			if (m_Started)
+				m_Handle.promise().m_Signal->Wait();
+			m_Handle.destroy();
+			m_Handle = nullptr;
+		}
+	}
+
+	std::coroutine_handle<promise_type> m_Handle;
+	bool m_Started = false;
+};
+
+template <typename T>
+CCcpTask<T> CCcpTaskPromise<T>::get_return_object()
+{
+	return CCcpTask<T>(std::coroutine_handle<CCcpTaskPromise<T> >::from_promise(*this));
+}
+
+inline CCcpTask<void> CCcpTaskPromise<void>::get_return_object()
+{
+	return CCcpTask<void>(std::coroutine_handle<CCcpTaskPromise<void> >::from_promise(*this));
+}
+
+// Base of the awaitables of asynchronous operations. The operation may complete
+// before the coroutine is suspended (in the context of the caller, or on the
+// receive thread racing with await_suspend): whichever of both comes last
+// resumes the coroutine, or lets it go on without suspension
+//
+class CCcpOperationAwaiter
+{
+public:
+	CCcpOperationAwaiter() : m_State(StateRunning) {}
+
+	bool await_ready() const noexcept { return false; }
+
+	bool await_suspend(std::coroutine_handle<> Handle)
+	{
+		m_Handle = Handle;
+		Launch();
+		return m_State.exchange(StateSuspended) != StateCompleted;
+	}
+
+protected:
+	virtual ~CCcpOperationAwaiter() {}
+
+	/// <summary>
+	/// Queues the operation. Resume is called once it is over
+	/// </summary>
+	virtual void Launch() = 0;
+
+	void Resume()
+	{
+		if (m_State.exchange(StateCompleted) == StateSuspended)
+			m_Handle.resume();
+	}
+
+private:
+	enum { StateRunning, StateCompleted, StateSuspended };
+
+	std::atomic<int> m_State;
+	std::coroutine_handle<> m_Handle;
+};
+
+// co_await of a single CRO, or of a command sequence
+//
+class CCcpCommandAwaiter : public CCcpOperationAwaiter
+{
+public:
+	CCcpCommandAwaiter(CCcpSession *Session, const BYTE *Cro, ICcpCommandSource *Source, WORD TimeOut);
+
+	TCcpReply await_resume() const { return m_Reply; }
+
+protected:
+	virtual void Launch();
+
+private:
+	CCcpSession *m_Session;
+	BYTE m_Cro[CCP_PACKET_SIZE];
+	ICcpCommandSource *m_Source;
+	WORD m_TimeOut;
+	TCcpReply m_Reply;
+};
+
+// co_await of a memory range read (CCcpMemoryTransfer::ReadAsync)
+//
+class CCcpReadAwaiter : public CCcpOperationAwaiter
+{
+public:
+	CCcpReadAwaiter(CCcpSession *Session, BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, TCCPTransferStats *Stats, WORD TimeOut);
+
+	TCCPResult await_resume() const { return m_Result; }
+
+protected:
+	virtual void Launch();
+
+private:
+	CCcpSession *m_Session;
+	BYTE m_AddrExtension;
+	DWORD m_Addr;
+	DWORD m_Length;
+	BYTE *m_Buffer;
+	TCCPTransferStats *m_Stats;
+	WORD m_TimeOut;
+	TCCPResult m_Result;
+};
+
+// co_await of a scatter list write (CCcpMemoryTransfer::WriteAsync)
+//
+class CCcpWriteAwaiter : public CCcpOperationAwaiter
+{
+public:
+	CCcpWriteAwaiter(CCcpSession *Session, const TCCPMemoryBlock *Blocks, DWORD Count, TCCPTransferStats *Stats, WORD TimeOut);
+
+	TCCPResult await_resume() const { return m_Result; }
+
+protected:
+	virtual void Launch();
+
+private:
+	CCcpSession *m_Session;
+	const TCCPMemoryBlock *m_Blocks;
+	DWORD m_Count;
+	TCCPTransferStats *m_Stats;
+	WORD m_TimeOut;
+	TCCPResult m_Result;
+};
+
+// Awaitable CCP operations of a connection. The pointers passed to an operation
+// must stay valid until it is co_awaited; the connection must outlive the
+// coroutines using it
+//
+class CCcpCoSession
+{
+public:
+	explicit CCcpCoSession(const std::shared_ptr<CCcpSession> &Session);
+
+	/// <summary>
+	/// Wraps an open connection
+	/// </summary>
+	/// <remarks>IsValid returns false for an unknown handle</remarks>
+	explicit CCcpCoSession(TCCPHandle CcpHandle);
+
+	bool IsValid() const { return m_Session != NULL; }
+	CCcpSession *GetSession() const { return m_Session.get(); }
+
+	//------------------------------
+	// Raw commands
+	//------------------------------
+
+	/// <summary>
+	/// Sends a CRO (see CCcpSession::CommandAsync)
+	/// </summary>
+	/// <returns>Awaitable of the TCcpReply</returns>
+	CCcpCommandAwaiter Command(const BYTE *Cro, WORD TimeOut = 0);
+
+	/// <summary>
+	/// Runs a command sequence (see CCcpSession::CommandSequence)
+	/// </summary>
+	/// <returns>Awaitable of the TCcpReply</returns>
+	CCcpCommandAwaiter Sequence(ICcpCommandSource *Source, WORD TimeOut = 0);
+
+	//------------------------------
+	// CCP commands (see PCCP.h)
+	//------------------------------
+
+	CCcpTask<TCCPResult> SetMemoryTransferAddress(BYTE UsedMTA, BYTE AddrExtension, DWORD Addr, WORD TimeOut = 0);
+	CCcpTask<TCCPResult> Upload(BYTE Size, BYTE *DataBytes, WORD TimeOut = 0);
+	CCcpTask<TCCPResult> ShortUpload(BYTE UploadSize, BYTE MTA0Ext, DWORD MTA0Addr, BYTE *ReqData, WORD TimeOut = 0);
+	CCcpTask<TCCPResult> Download(const BYTE *DataBytes, BYTE Size, WORD TimeOut = 0);
+	CCcpTask<TCCPResult> ClearMemory(DWORD MemorySize, WORD TimeOut = 0);
+	CCcpTask<TCCPResult> BuildChecksum(DWORD BlockSize, BYTE *ChecksumData, BYTE *ChecksumSize, WORD TimeOut = 0);
+
+	//------------------------------
+	// Memory transfers
+	//------------------------------
+
+	/// <summary>
+	/// Reads a memory range of any length (SET_MTA + back to back UPLOADs)
+	/// </summary>
+	/// <returns>Awaitable of the TCCPResult</returns>
+	CCcpReadAwaiter ReadMemory(BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, TCCPTransferStats *Stats = NULL, WORD TimeOut = 0);
+
+	/// <summary>
+	/// Writes a scatter list of memory blocks (see CCP_WriteMemory)
+	/// </summary>
+	/// <returns>Awaitable of the TCCPResult</returns>
+	CCcpWriteAwaiter WriteMemory(const TCCPMemoryBlock *Blocks, DWORD Count, TCCPTransferStats *Stats = NULL, WORD TimeOut = 0);
+
+	/// <summary>
+	/// Programs a block of cleared flash memory with PROGRAM_6 / PROGRAM, then
+	/// checks it with BUILD_CHKSUM unless ChecksumType is zero
+	/// </summary>
+	/// <param name="ChecksumType">Checksum type implemented by the slave (CCP_CHECKSUM_*), 0 not to verify</param>
+	/// <returns>A TCCPResult result code, CCP_ERROR_VERIFY_FAILED if the checksum differs</returns>
+	CCcpTask<TCCPResult> ProgramBlock(BYTE AddrExtension, DWORD Addr, const BYTE *Data, DWORD Length, BYTE ChecksumType = 0, WORD TimeOut = 0);
+
+private:
+	std::shared_ptr<CCcpSession> m_Session;
+};
+
+#endif
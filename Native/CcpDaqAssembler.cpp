@@ -0,0 +1,166 @@
+//  CcpDaqAssembler.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Reassembly of the DTOs of a DAQ cycle into one consistent sample
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpDaqAssembler.h"
+
+#include <string.h>
+
+CCcpDaqAssembler::CCcpDaqAssembler(const std::shared_ptr<const TCcpDaqLayout> &Layout, DWORD Capacity)
+	: m_Layout(Layout)
+{
+	DWORD capacity = 1;
+
+	while (capacity < Capacity)
+		capacity <<= 1;
+	m_Mask = capacity - 1;
+
+	memset(m_LayoutList, 0xFF, sizeof(m_LayoutList));
+	for (size_t i = 0; i < Layout->Lists.size() && i < CCP_ODT_NO_LIST; i++)
+	{
+		const TCcpDaqList &layout = Layout->Lists[i];
+		std::unique_ptr<TList> list(new TList());
+
+		if (layout.Odts.empty())
+			continue;
+		list->ListNumber = layout.ListNumber;
+		list->LastOdt = (BYTE)(layout.Odts.size() - 1);
+		list->Length = (WORD)(layout.Odts.size() * CCP_ODT_DATA_SIZE);
+		list->Cycle = 0;
+		list->Start = 0;
+		list->Current.assign(list->Length, 0);
+		list->Data.assign((size_t)capacity * list->Length, 0);
+		list->Stamps.assign(capacity, 0);
+		list->Cycles.assign(capacity, 0);
+		list->Head = 0;
+		list->Tail = 0;
+		list->Complete = 0;
+		list->Torn = 0;
+		list->Incomplete = 0;
+		list->Overruns = 0;
+		m_LayoutList[i] = (BYTE)m_Lists.size();
+		m_Lists.push_back(std::move(list));
+	}
+}
+
+//------------------------------
+// Receive thread
+//------------------------------
+
+bool CCcpDaqAssembler::OnDto(const TCcpOdtStep &Step, const BYTE *Data, UINT64 Nanos)
+{
+	BYTE index = m_LayoutList[Step.List];
+
+	if (index == 0xFF)
+		return false;
+
+	TList &list = *m_Lists[index];
+
+	// A cycle whose ODT 0 was lost is counted at its first ODT
+	if (Step.Flags & CCP_ODT_CUT)
+		Count(list.Incomplete);
+	if (Step.Flags & (CCP_ODT_TORN | CCP_ODT_ORPHAN))
+		Count(list.Torn);
+	if (Step.Flags & CCP_ODT_DROPPED)
+		return true;
+	if (Step.Flags & CCP_ODT_BEGIN)
+	{
+		list.Start = Nanos;
+		list.Cycle = Step.Cycle;
+	}
+
+	memcpy(&list.Current[Step.Odt * CCP_ODT_DATA_SIZE], &Data[1], CCP_ODT_DATA_SIZE);
+	if (Step.Flags & CCP_ODT_END)
+		Publish(list);
+	return true;
+}
+
+void CCcpDaqAssembler::Count(std::atomic<UINT64> &Counter)
+{
+	Counter.store(Counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void CCcpDaqAssembler::Publish(TList &List)
+{
+	UINT64 head = List.Head.load(std::memory_order_relaxed);
+	size_t slot = (size_t)(head & m_Mask);
+
+	Count(List.Complete);
+	if (head - List.Tail.load(std::memory_order_acquire) > m_Mask)
+	{
+		Count(List.Overruns);
+		return;
+	}
+
+	memcpy(&List.Data[slot * List.Length], &List.Current[0], List.Length);
+	List.Stamps[slot] = List.Start;
+	List.Cycles[slot] = List.Cycle;
+	List.Head.store(head + 1, std::memory_order_release);
+}
+
+//------------------------------
+// Readers
+//------------------------------
+
+int CCcpDaqAssembler::FindList(BYTE ListNumber) const
+{
+	for (size_t i = 0; i < m_Lists.size(); i++)
+	{
+		if (m_Lists[i]->ListNumber == ListNumber)
+			return (int)i;
+	}
+	return -1;
+}
+
+TCCPResult CCcpDaqAssembler::ReadSample(BYTE ListNumber, BYTE *Data, WORD Size, TCCPDaqSampleInfo *Info)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+	int index = FindList(ListNumber);
+	UINT64 tail;
+	size_t slot;
+
+	if (index < 0)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	TList &list = *m_Lists[index];
+
+	if (Size < list.Length)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	tail = list.Tail.load(std::memory_order_relaxed);
+	if (tail == list.Head.load(std::memory_order_acquire))
+		return CCP_RESULT_PCAN(PCAN_ERROR_QRCVEMPTY);
+
+	slot = (size_t)(tail & m_Mask);
+	memcpy(Data, &list.Data[slot * list.Length], list.Length);
+	Info->Timestamp = list.Stamps[slot];
+	Info->Cycle = list.Cycles[slot];
+	Info->Length = list.Length;
+	list.Tail.store(tail + 1, std::memory_order_release);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+bool CCcpDaqAssembler::GetStats(BYTE ListNumber, TCCPDaqCycleStats *Stats)
+{
+	int index = FindList(ListNumber);
+
+	if (ListNumber != CCP_DAQ_ALL_LISTS && index < 0)
+		return false;
+
+	memset(Stats, 0, sizeof(TCCPDaqCycleStats));
+	for (size_t i = 0; i < m_Lists.size(); i++)
+	{
+		const TList &list = *m_Lists[i];
+
+		if (ListNumber != CCP_DAQ_ALL_LISTS && (int)i != index)
+			continue;
+		Stats->Complete += list.Complete.load(std::memory_order_relaxed);
+		Stats->Torn += list.Torn.load(std::memory_order_relaxed);
+		Stats->Incomplete += list.Incomplete.load(std::memory_order_relaxed);
+		Stats->Overruns += list.Overruns.load(std::memory_order_relaxed);
+	}
+	return true;
+}
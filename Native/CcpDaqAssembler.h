@@ -0,0 +1,113 @@
+//  CcpDaqAssembler.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Reassembly of the DTOs of a DAQ cycle into one consistent sample
+//
+//  ~~~~~~~~~~~~
+//
+//  The receive thread is the only writer: it collects the ODTs of each list
+//  as placed by the ODT sequence of the DAQ monitor, and publishes
+//  complete cycles into a single producer / single consumer ring per list. Readers only take a lock among themselves, so a
+//  slow reader never holds up the receive thread; a full ring drops the new
+//  cycle and counts it as an overrun.
+//
+#ifndef __CCPDAQASSEMBLERH__
+#define __CCPDAQASSEMBLERH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpProtocol.h"
+#include "CcpDaqConfig.h"
+#include "CcpOdtSequence.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define CCP_DAQ_MAX_CAPACITY                   0x10000   // Upper bound of the samples kept per list
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+class CCcpDaqAssembler
+{
+public:
+	/// <summary>
+	/// Prepares the reassembly of the lists of a DAQ layout
+	/// </summary>
+	/// <param name="Capacity">Samples kept per list, rounded up to a power of 2 (at least 1)</param>
+	CCcpDaqAssembler(const std::shared_ptr<const TCcpDaqLayout> &Layout, DWORD Capacity);
+
+	/// <summary>
+	/// The layout the assembler was prepared for: it must be fed the steps of
+	/// the DAQ monitor of the same layout
+	/// </summary>
+	const std::shared_ptr<const TCcpDaqLayout> &GetLayout() const { return m_Layout; }
+
+	/// <summary>
+	/// Takes a DTO. Called by the channel receive thread only
+	/// </summary>
+	/// <param name="Step">Where the DTO falls in its cycle, as returned by CCcpDaqMonitor::OnDto</param>
+	/// <param name="Data">The 8 bytes of the DTO</param>
+	/// <param name="Nanos">Receive time of the DTO</param>
+	/// <returns>False if the PID is no ODT of the layout</returns>
+	bool OnDto(const TCcpOdtStep &Step, const BYTE *Data, UINT64 Nanos);
+
+	/// <summary>
+	/// Moves the oldest complete cycle of a list into a buffer (see CCP_ReadDaqSample)
+	/// </summary>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult ReadSample(BYTE ListNumber, BYTE *Data, WORD Size, TCCPDaqSampleInfo *Info);
+
+	/// <summary>
+	/// Returns the counters of a list, or the totals (CCP_DAQ_ALL_LISTS)
+	/// </summary>
+	/// <returns>False if the list is not part of the layout</returns>
+	bool GetStats(BYTE ListNumber, TCCPDaqCycleStats *Stats);
+
+private:
+	struct TList
+	{
+		BYTE ListNumber;
+		BYTE LastOdt;
+		WORD Length;                                       // 7 bytes per ODT
+
+		// Cycle being collected (receive thread only)
+		DWORD Cycle;
+		UINT64 Start;
+		std::vector<BYTE> Current;
+
+		// Ring of complete cycles: m_Head is written by the receive thread,
+		// m_Tail by the readers
+		std::vector<BYTE> Data;
+		std::vector<UINT64> Stamps;
+		std::vector<DWORD> Cycles;
+		std::atomic<UINT64> Head;
+		std::atomic<UINT64> Tail;
+
+		// Counters (written by the receive thread)
+		std::atomic<UINT64> Complete;
+		std::atomic<UINT64> Torn;
+		std::atomic<UINT64> Incomplete;
+		std::atomic<UINT64> Overruns;
+	};
+
+	static void Count(std::atomic<UINT64> &Counter);
+	void Publish(TList &List);
+	int FindList(BYTE ListNumber) const;
+
+	std::shared_ptr<const TCcpDaqLayout> m_Layout;
+	std::vector<std::unique_ptr<TList> > m_Lists;
+	BYTE m_LayoutList[256];                                // Index in m_Lists of each list of the layout (TCcpOdtStep.List), 0xFF if none
+	DWORD m_Mask;                                          // Capacity - 1
+	std::mutex m_ReadLock;                                 // Serializes the readers
+};
+
+#endif
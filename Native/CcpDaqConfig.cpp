@@ -0,0 +1,527 @@
+//  CcpDaqConfig.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Configuration of the DAQ lists of a slave from a set of signals
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpDaqConfig.h"
+#include "CcpChannel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <map>
+#include <memory>
+#include <string.h>
+#include <thread>
+#include <utility>
+
+//------------------------------
+// CRO lists
+//------------------------------
+
+CCcpCroListSource::CCcpCroListSource(const std::vector<TCcpPacket> &Cros)
+	: m_Cros(Cros)
+	, m_Next(0)
+{
+	m_Crms.reserve(Cros.size());
+}
+
+bool CCcpCroListSource::NextCommand(BYTE *Cro)
+{
+	if (m_Next >= m_Cros.size())
+		return false;
+	memcpy(Cro, m_Cros[m_Next++].Bytes, CCP_PACKET_SIZE);
+	return true;
+}
+
+void CCcpCroListSource::OnResponse(const BYTE *, const BYTE *Crm)
+{
+	TCcpPacket crm;
+
+	memcpy(crm.Bytes, Crm, CCP_PACKET_SIZE);
+	m_Crms.push_back(crm);
+}
+
+//------------------------------
+// Packing
+//------------------------------
+
+// The signals sampled at one rate and their ODTs
+//
+typedef struct
+{
+	BYTE EventChannel;
+	WORD Prescaler;
+	std::vector<DWORD> Signals;
+	std::vector<TCcpDaqOdt> Odts;
+}TCcpDaqGroup;
+
+DWORD CCcpDaqConfigurator::MinOdts(DWORD Fours, DWORD Twos, DWORD Ones)
+{
+	DWORD bySize, byBytes;
+
+	// An ODT holds one 4 byte element plus one 2 byte element, or three 2 byte elements
+	bySize = Fours;
+	if (Twos > Fours)
+		bySize += (Twos - Fours + 2) / 3;
+	byBytes = (4 * Fours + 2 * Twos + Ones + CCP_ODT_DATA_SIZE - 1) / CCP_ODT_DATA_SIZE;
+	return std::max(bySize, byBytes);
+}
+
+void CCcpDaqConfigurator::PackOdts(const TCCPDaqSignal *Signals, const std::vector<DWORD> &Group, std::vector<TCcpDaqOdt> &Odts)
+{
+	std::vector<DWORD> fours, twos, ones;
+	std::vector<BYTE> used;
+	size_t odt, i;
+
+	for (i = 0; i < Group.size(); i++)
+	{
+		switch (Signals[Group[i]].Size)
+		{
+			case 4:     fours.push_back(Group[i]); break;
+			case 2:     twos.push_back(Group[i]); break;
+			default:    ones.push_back(Group[i]); break;
+		}
+	}
+
+	Odts.assign(MinOdts((DWORD)fours.size(), (DWORD)twos.size(), (DWORD)ones.size()), TCcpDaqOdt());
+	used.assign(Odts.size(), 0);
+
+	auto place = [&](size_t Odt, DWORD Signal)
+	{
+		TCcpDaqElement element;
+
+		element.Signal = Signal;
+		element.Offset = used[Odt];
+		element.Size = Signals[Signal].Size;
+		element.AddrExtension = Signals[Signal].AddrExtension;
+		element.Addr = Signals[Signal].Addr;
+		Odts[Odt].push_back(element);
+		used[Odt] += element.Size;
+	};
+
+	// One 4 byte element per ODT, each followed by a 2 byte element, then
+	// three 2 byte elements per ODT. The 1 byte elements fill the gaps: the
+	// free bytes left are enough by the count of MinOdts
+	for (i = 0; i < fours.size(); i++)
+		place(i, fours[i]);
+	i = 0;
+	for (odt = 0; odt < fours.size() && i < twos.size(); odt++)
+		place(odt, twos[i++]);
+	for (odt = fours.size(); i < twos.size(); odt++)
+	{
+		for (int k = 0; k < 3 && i < twos.size(); k++)
+			place(odt, twos[i++]);
+	}
+	odt = 0;
+	for (i = 0; i < ones.size(); i++)
+	{
+		while (used[odt] >= CCP_ODT_DATA_SIZE)
+			odt++;
+		place(odt, ones[i]);
+	}
+}
+
+TCCPResult CCcpDaqConfigurator::Pack(const TCCPDaqSignal *Signals, DWORD Count, const std::vector<TCcpDaqListSize> &Sizes, TCcpDaqLayout *Layout)
+{
+	std::map<std::pair<BYTE, WORD>, size_t> rates;
+	std::vector<TCcpDaqGroup> groups;
+	std::vector<TCcpDaqListSize> available;
+
+	for (DWORD i = 0; i < Count; i++)
+	{
+		BYTE size = Signals[i].Size;
+		WORD prescaler = Signals[i].Prescaler ? Signals[i].Prescaler : 1;
+
+		if (size != 1 && size != 2 && size != 4)
+			return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+		auto rate = rates.insert(std::make_pair(std::make_pair(Signals[i].EventChannel, prescaler), groups.size()));
+		if (rate.second)
+		{
+			groups.push_back(TCcpDaqGroup());
+			groups.back().EventChannel = Signals[i].EventChannel;
+			groups.back().Prescaler = prescaler;
+		}
+		groups[rate.first->second].Signals.push_back(i);
+	}
+
+	// The ODTs a list can take: its size, as far as the PIDs stay below the event PID
+	for (size_t i = 0; i < Sizes.size(); i++)
+	{
+		TCcpDaqListSize list = Sizes[i];
+
+		if (list.FirstPid > CCP_PID_DAQ_MAX)
+			continue;
+		list.Size = (BYTE)std::min<DWORD>(list.Size, CCP_PID_DAQ_MAX + 1 - list.FirstPid);
+		if (list.Size)
+			available.push_back(list);
+	}
+
+	for (size_t i = 0; i < groups.size(); i++)
+		PackOdts(Signals, groups[i].Signals, groups[i].Odts);
+	std::stable_sort(groups.begin(), groups.end(), [](const TCcpDaqGroup &A, const TCcpDaqGroup &B)
+	{
+		return A.Odts.size() > B.Odts.size();
+	});
+
+	Layout->Lists.clear();
+	Layout->Signals.assign(Signals, Signals + Count);
+	Layout->Placements.assign(Count, TCCPDaqPlacement());
+
+	// A list serves one rate. The rates needing most ODTs are placed first,
+	// each into the smallest list it fits in, or spread over the largest ones
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		const TCcpDaqGroup &group = groups[i];
+		size_t next = 0;
+
+		while (next < group.Odts.size())
+		{
+			size_t remaining = group.Odts.size() - next;
+			size_t best = available.size();
+			size_t take;
+
+			for (size_t j = 0; j < available.size(); j++)
+			{
+				if (best == available.size())
+					best = j;
+				else if (available[j].Size >= remaining)
+				{
+					if (available[best].Size < remaining || available[j].Size < available[best].Size)
+						best = j;
+				}
+				else if (available[best].Size < remaining && available[j].Size > available[best].Size)
+					best = j;
+			}
+			if (best == available.size())
+				return CCP_ERROR_DAQ_CAPACITY;
+
+			TCcpDaqList list;
+
+			take = std::min<size_t>(remaining, available[best].Size);
+			list.ListNumber = available[best].ListNumber;
+			list.FirstPid = available[best].FirstPid;
+			list.EventChannel = group.EventChannel;
+			list.Prescaler = group.Prescaler;
+			list.Odts.assign(group.Odts.begin() + next, group.Odts.begin() + next + take);
+			for (size_t odt = 0; odt < list.Odts.size(); odt++)
+			{
+				for (size_t e = 0; e < list.Odts[odt].size(); e++)
+				{
+					TCCPDaqPlacement &placement = Layout->Placements[list.Odts[odt][e].Signal];
+
+					placement.ListNumber = list.ListNumber;
+					placement.OdtNumber = (BYTE)odt;
+					placement.Pid = (BYTE)(list.FirstPid + odt);
+					placement.Offset = list.Odts[odt][e].Offset;
+				}
+			}
+			Layout->Lists.push_back(list);
+			available.erase(available.begin() + best);
+			next += take;
+		}
+	}
+
+	std::sort(Layout->Lists.begin(), Layout->Lists.end(), [](const TCcpDaqList &A, const TCcpDaqList &B)
+	{
+		return A.ListNumber < B.ListNumber;
+	});
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Configuration
+//------------------------------
+
+CCcpDaqConfigurator::CCcpDaqConfigurator(CCcpSession *Session)
+	: m_Session(Session)
+{
+}
+
+TCCPResult CCcpDaqConfigurator::Configure(BYTE DaqLists, const TCCPDaqSignal *Signals, DWORD Count, TCCPDaqPlacement *Placements, TCCPDaqConfigStats *Stats, WORD TimeOut)
+{
+	const TCCPSlaveData &slave = m_Session->GetSlaveData();
+	std::shared_ptr<TCcpDaqLayout> layout(new TCcpDaqLayout());
+	std::vector<TCcpDaqListSize> sizes;
+	std::vector<TCcpPacket> cros;
+	TCcpPacket cro;
+	TCCPResult result;
+	DWORD commands, total;
+
+	if (!DaqLists || (Count && !Signals))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	// GET_DAQ_SIZE clears and stops each list, and tells its size and first PID
+	for (BYTE list = 0; list < DaqLists; list++)
+	{
+		memset(&cro, 0, sizeof(cro));
+		cro.Bytes[0] = CCP_CMD_GET_DAQ_SIZE;
+		cro.Bytes[2] = list;
+		CcpPutDword(&cro.Bytes[4], slave.IdDTO, slave.IntelFormat);
+		cros.push_back(cro);
+	}
+	m_Session->SetDaqLayout(std::shared_ptr<const TCcpDaqLayout>());
+
+	CCcpCroListSource sizeSource(cros);
+
+	result = m_Session->CommandSequence(&sizeSource, TimeOut, &total);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+	for (BYTE list = 0; list < DaqLists; list++)
+	{
+		TCcpDaqListSize size;
+
+		size.ListNumber = list;
+		size.Size = sizeSource.GetCrms()[list].Bytes[3];
+		size.FirstPid = sizeSource.GetCrms()[list].Bytes[4];
+		sizes.push_back(size);
+	}
+
+	result = Pack(Signals, Count, sizes, layout.get());
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+
+	// SET_DAQ_PTR + WRITE_DAQ for each element, back to back
+	cros.clear();
+	for (size_t i = 0; i < layout->Lists.size(); i++)
+	{
+		const TCcpDaqList &list = layout->Lists[i];
+
+		for (size_t odt = 0; odt < list.Odts.size(); odt++)
+		{
+			for (size_t e = 0; e < list.Odts[odt].size(); e++)
+			{
+				const TCcpDaqElement &element = list.Odts[odt][e];
+
+				memset(&cro, 0, sizeof(cro));
+				cro.Bytes[0] = CCP_CMD_SET_DAQ_PTR;
+				cro.Bytes[2] = list.ListNumber;
+				cro.Bytes[3] = (BYTE)odt;
+				cro.Bytes[4] = element.Offset;
+				cros.push_back(cro);
+
+				memset(&cro, 0, sizeof(cro));
+				cro.Bytes[0] = CCP_CMD_WRITE_DAQ;
+				cro.Bytes[2] = element.Size;
+				cro.Bytes[3] = element.AddrExtension;
+				CcpPutDword(&cro.Bytes[4], element.Addr, slave.IntelFormat);
+				cros.push_back(cro);
+			}
+		}
+	}
+
+	CCcpCroListSource writeSource(cros);
+
+	result = m_Session->CommandSequence(&writeSource, TimeOut, &commands);
+	total += commands;
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+	m_Session->SetDaqLayout(layout);
+
+	if (Placements && Count)
+		memcpy(Placements, &layout->Placements[0], Count * sizeof(TCCPDaqPlacement));
+	if (Stats)
+	{
+		memset(Stats, 0, sizeof(TCCPDaqConfigStats));
+		Stats->Lists = (BYTE)layout->Lists.size();
+		for (size_t i = 0; i < layout->Lists.size(); i++)
+			Stats->Odts += (WORD)layout->Lists[i].Odts.size();
+		for (DWORD i = 0; i < Count; i++)
+			Stats->Bytes += Signals[i].Size;
+		Stats->Elements = Count;
+		if (Stats->Odts)
+			Stats->Fill = (WORD)(Stats->Bytes * 1000 / (Stats->Odts * CCP_ODT_DATA_SIZE));
+		Stats->Commands = total;
+	}
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpDaqConfigurator::StartStop(BYTE Mode, WORD TimeOut)
+{
+	const TCCPSlaveData &slave = m_Session->GetSlaveData();
+	std::shared_ptr<const TCcpDaqLayout> layout = m_Session->GetDaqLayout();
+	std::vector<TCcpPacket> cros;
+	TCcpPacket cro;
+
+	if (Mode > CCP_SSM_PREPARE_START)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	if (!layout)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+
+	for (size_t i = 0; i < layout->Lists.size(); i++)
+	{
+		const TCcpDaqList &list = layout->Lists[i];
+
+		memset(&cro, 0, sizeof(cro));
+		cro.Bytes[0] = CCP_CMD_START_STOP;
+		cro.Bytes[2] = Mode;
+		cro.Bytes[3] = list.ListNumber;
+		cro.Bytes[4] = (BYTE)(list.Odts.size() - 1);
+		cro.Bytes[5] = list.EventChannel;
+		CcpPutWord(&cro.Bytes[6], list.Prescaler, slave.IntelFormat);
+		cros.push_back(cro);
+	}
+
+	CCcpCroListSource source(cros);
+
+	return m_Session->CommandSequence(&source, TimeOut, NULL);
+}
+
+//------------------------------
+// Synchronized start
+//------------------------------
+
+TCCPResult CCcpDaqConfigurator::StartStopAll(const std::vector<std::shared_ptr<CCcpSession> > &Sessions, bool Start)
+{
+	std::vector<std::future<TCcpReply> > replies;
+	std::vector<CCcpSession*> senders;
+	std::vector<TPCANMsg> msgs, batch;
+	std::vector<size_t> members;
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_START_STOP_ALL};
+	TCCPResult result = CCP_ERROR_ACKNOWLEDGE_OK;
+	TPCANStatus status;
+	TPCANMsg msg;
+	int sent;
+
+	// Queued on every connection before waiting for any. The CROs of the idle
+	// connections go out back to back, in one write per channel; the others
+	// as soon as their connection is idle
+	cro[2] = Start ? 0x01 : 0x00;
+	for (size_t i = 0; i < Sessions.size(); i++)
+	{
+		std::shared_ptr<std::promise<TCcpReply> > reply = std::make_shared<std::promise<TCcpReply> >();
+
+		replies.push_back(reply->get_future());
+		if (Sessions[i]->CommandDeferred(cro, 0, [reply](TCCPResult Result, const BYTE *Crm, DWORD Count)
+		{
+			TCcpReply value;
+
+			value.Result = Result;
+			value.Commands = Count;
+			memcpy(value.Crm, Crm, CCP_PACKET_SIZE);
+			reply->set_value(value);
+		}, &msg))
+		{
+			senders.push_back(Sessions[i].get());
+			msgs.push_back(msg);
+		}
+	}
+	for (size_t i = 0; i < msgs.size(); i++)
+	{
+		// Sent already with the batch of an earlier connection
+		if (!senders[i])
+			continue;
+
+		CCcpChannel *channel = senders[i]->GetChannel();
+
+		batch.clear();
+		members.clear();
+		for (size_t j = i; j < msgs.size(); j++)
+		{
+			if (senders[j] && senders[j]->GetChannel() == channel)
+			{
+				batch.push_back(msgs[j]);
+				members.push_back(j);
+			}
+		}
+		status = channel->Send(batch.data(), (int)batch.size(), &sent);
+		for (size_t k = 0; k < members.size(); k++)
+		{
+			senders[members[k]]->Transmitted(batch[k], (int)k < sent ? PCAN_ERROR_OK : status != PCAN_ERROR_OK ? status : PCAN_ERROR_UNKNOWN);
+			senders[members[k]] = NULL;
+		}
+	}
+	for (size_t i = 0; i < replies.size(); i++)
+	{
+		TCcpReply reply = replies[i].get();
+
+		if (reply.Result != CCP_ERROR_ACKNOWLEDGE_OK && result == CCP_ERROR_ACKNOWLEDGE_OK)
+			result = reply.Result;
+	}
+	return result;
+}
+
+TCCPResult CCcpDaqConfigurator::StartSynchronized(const std::vector<std::shared_ptr<CCcpSession> > &Sessions, WORD WaitTime,
+	std::vector<TCCPDaqStartReport> &Reports, TCCPDaqStartStats *Stats)
+{
+	std::vector<std::shared_ptr<const TCcpDaqLayout> > layouts;
+	std::vector<BYTE> pids;
+	std::vector<UINT64> firsts;
+	std::chrono::steady_clock::time_point fired, deadline;
+	TCCPResult result;
+	UINT64 earliest = 0;
+	bool all;
+
+	memset(Stats, 0, sizeof(TCCPDaqStartStats));
+	Reports.clear();
+
+	// Preparing takes one round trip per list and is not time critical
+	for (size_t i = 0; i < Sessions.size(); i++)
+	{
+		layouts.push_back(Sessions[i]->GetDaqLayout());
+		result = CCcpDaqConfigurator(Sessions[i].get()).StartStop(CCP_SSM_PREPARE_START, 0);
+		if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+			return result;
+		for (size_t l = 0; l < layouts[i]->Lists.size(); l++)
+		{
+			TCCPDaqStartReport report;
+
+			report.CcpHandle = Sessions[i]->GetHandle();
+			report.ListNumber = layouts[i]->Lists[l].ListNumber;
+			report.Started = 0;
+			report.SkewUs = 0;
+			Reports.push_back(report);
+			pids.push_back(layouts[i]->Lists[l].FirstPid);
+		}
+		Sessions[i]->ArmFirstDto();
+	}
+
+	fired = std::chrono::steady_clock::now();
+	result = StartStopAll(Sessions, true);
+	Stats->FireSpreadUs = (DWORD)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - fired).count();
+	Stats->Ecus = (BYTE)Sessions.size();
+	Stats->Lists = (WORD)Reports.size();
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+
+	// The first DTO (ODT 0) of each list, until all arrived or the wait is over
+	firsts.assign(Reports.size(), 0);
+	deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(WaitTime);
+	do
+	{
+		size_t report = 0;
+
+		all = true;
+		for (size_t i = 0; i < Sessions.size(); i++)
+		{
+			for (size_t l = 0; l < layouts[i]->Lists.size(); l++, report++)
+			{
+				if (!Reports[report].Started && Sessions[i]->GetFirstDto(pids[report], &firsts[report]))
+					Reports[report].Started = 1;
+				all = all && Reports[report].Started;
+			}
+		}
+		if (all || !WaitTime)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	while (std::chrono::steady_clock::now() < deadline);
+
+	for (size_t i = 0; i < Reports.size(); i++)
+	{
+		if (Reports[i].Started && (!earliest || firsts[i] < earliest))
+			earliest = firsts[i];
+	}
+	for (size_t i = 0; i < Reports.size(); i++)
+	{
+		if (!Reports[i].Started)
+			continue;
+		Reports[i].SkewUs = (DWORD)((firsts[i] - earliest) / 1000);
+		Stats->MaxSkewUs = std::max(Stats->MaxSkewUs, Reports[i].SkewUs);
+	}
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
@@ -0,0 +1,176 @@
+//  CcpDaqConfig.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Configuration of the DAQ lists of a slave from a set of signals
+//
+//  ~~~~~~~~~~~~
+//
+//  Each DTO of a DAQ list carries one ODT: up to 7 bytes of signals. The DTOs
+//  sent per cycle is the number of ODTs, so the signals sampled at the same
+//  rate (event channel and prescaler) are packed into as few ODTs as the
+//  element sizes allow. With elements of 1, 2 and 4 bytes only, a 4 byte
+//  element leaves room for one 2 byte element or three 1 byte ones, and an
+//  ODT without one holds three 2 byte elements and one 1 byte element. The
+//  packing below fills the ODTs in that order, which reaches the lower bound
+//
+//      max(n4 + ceil(max(0, n2 - n4) / 3), ceil((4 n4 + 2 n2 + n1) / 7))
+//
+//  exactly. The ODTs of each rate are then placed into the DAQ lists of the
+//  slave, best fit first, within the sizes and first PIDs GET_DAQ_SIZE reports.
+//
+#ifndef __CCPDAQCONFIGH__
+#define __CCPDAQCONFIGH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpProtocol.h"
+#include "CcpSession.h"
+
+#include <memory>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+// A CRO or CRM
+//
+typedef struct
+{
+	BYTE Bytes[CCP_PACKET_SIZE];
+}TCcpPacket;
+
+// A DAQ element: one signal at a byte position of the DTO data
+//
+typedef struct
+{
+	DWORD Signal;                                          // Index of the signal in the configuration
+	BYTE Offset;                                           // Position within the 7 data bytes (element number)
+	BYTE Size;
+	BYTE AddrExtension;
+	DWORD Addr;
+}TCcpDaqElement;
+
+// The elements of an ODT, by offset
+//
+typedef std::vector<TCcpDaqElement> TCcpDaqOdt;
+
+// A configured DAQ list. ODT n is sent with PID FirstPid + n
+//
+typedef struct
+{
+	BYTE ListNumber;
+	BYTE FirstPid;
+	BYTE EventChannel;
+	WORD Prescaler;
+	std::vector<TCcpDaqOdt> Odts;
+}TCcpDaqList;
+
+// ODTs a slave offers in a DAQ list (GET_DAQ_SIZE)
+//
+typedef struct
+{
+	BYTE ListNumber;
+	BYTE Size;
+	BYTE FirstPid;
+}TCcpDaqListSize;
+
+// DAQ configuration of a connection: the lists in use and where each signal
+// is transmitted
+//
+struct TCcpDaqLayout
+{
+	std::vector<TCcpDaqList> Lists;
+	std::vector<TCCPDaqSignal> Signals;
+	std::vector<TCCPDaqPlacement> Placements;              // One per signal
+};
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+// Sends a prepared list of CROs back to back and keeps their CRMs
+//
+class CCcpCroListSource : public ICcpCommandSource
+{
+public:
+	explicit CCcpCroListSource(const std::vector<TCcpPacket> &Cros);
+
+	virtual bool NextCommand(BYTE *Cro);
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm);
+
+	/// <summary>
+	/// CRMs of the acknowledged commands, in order
+	/// </summary>
+	const std::vector<TCcpPacket> &GetCrms() const { return m_Crms; }
+
+private:
+	const std::vector<TCcpPacket> &m_Cros;
+	size_t m_Next;
+	std::vector<TCcpPacket> m_Crms;
+};
+
+class CCcpDaqConfigurator
+{
+public:
+	explicit CCcpDaqConfigurator(CCcpSession *Session);
+
+	/// <summary>
+	/// Configures the DAQ lists of the slave for a set of signals (see CCP_ConfigureDaq).
+	/// The layout is kept by the session
+	/// </summary>
+	/// <param name="DaqLists">Number of DAQ lists of the slave</param>
+	/// <param name="Signals">The signals to be measured</param>
+	/// <param name="Count">Number of signals</param>
+	/// <param name="Placements">Buffer for the placement of each signal (may be NULL)</param>
+	/// <param name="Stats">Buffer for the figures of the configuration (may be NULL)</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult Configure(BYTE DaqLists, const TCCPDaqSignal *Signals, DWORD Count, TCCPDaqPlacement *Placements, TCCPDaqConfigStats *Stats, WORD TimeOut);
+
+	/// <summary>
+	/// Sends START_STOP for each list of the layout kept by the session (see CCP_StartStopDaq)
+	/// </summary>
+	/// <returns>A TCCPResult result code. PCAN_ERROR_ILLOPERATION if no DAQ lists are configured</returns>
+	TCCPResult StartStop(BYTE Mode, WORD TimeOut);
+
+	/// <summary>
+	/// Prepares the lists of several connections and starts them with
+	/// START_STOP_ALL sent back to back (see CCP_StartDaqSynchronized)
+	/// </summary>
+	/// <param name="Sessions">Connections with a DAQ layout</param>
+	/// <param name="WaitTime">Wait time (millis) for the first DTO of each list</param>
+	/// <param name="Reports">Buffer for the start of each list</param>
+	/// <param name="Stats">Buffer for the figures of the start</param>
+	/// <returns>A TCCPResult result code</returns>
+	static TCCPResult StartSynchronized(const std::vector<std::shared_ptr<CCcpSession> > &Sessions, WORD WaitTime,
+		std::vector<TCCPDaqStartReport> &Reports, TCCPDaqStartStats *Stats);
+
+	/// <summary>
+	/// Sends START_STOP_ALL to several connections back to back
+	/// </summary>
+	/// <param name="Start">True to start the prepared lists, false to stop all the lists</param>
+	/// <returns>A TCCPResult result code: the first error, if any</returns>
+	static TCCPResult StartStopAll(const std::vector<std::shared_ptr<CCcpSession> > &Sessions, bool Start);
+
+	/// <summary>
+	/// Packs signals into ODTs and places them into DAQ lists
+	/// </summary>
+	/// <param name="Sizes">The DAQ lists of the slave</param>
+	/// <param name="Layout">Buffer for the lists in use and the placements</param>
+	/// <returns>A TCCPResult result code. CCP_ERROR_DAQ_CAPACITY if the lists are too small</returns>
+	static TCCPResult Pack(const TCCPDaqSignal *Signals, DWORD Count, const std::vector<TCcpDaqListSize> &Sizes, TCcpDaqLayout *Layout);
+
+	/// <summary>
+	/// Returns the least number of ODTs holding elements of 4, 2 and 1 bytes
+	/// </summary>
+	static DWORD MinOdts(DWORD Fours, DWORD Twos, DWORD Ones);
+
+private:
+	static void PackOdts(const TCCPDaqSignal *Signals, const std::vector<DWORD> &Group, std::vector<TCcpDaqOdt> &Odts);
+
+	CCcpSession *m_Session;
+};
+
+#endif
@@ -0,0 +1,259 @@
+//  CcpDaqMonitor.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Counters of the measurement quality of a connection: lost and torn DAQ
+//  cycles, overload events, cycle jitter and receive queue fill
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpDaqMonitor.h"
+#include "CcpProtocol.h"
+#include "CcpDaqConfig.h"
+#include "PCCP.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Reads a counter for a snapshot, zeroing it on a reset: increments made
+// meanwhile go to the next snapshot
+//
+template <class T> static T Take(std::atomic<T> &Counter, bool Reset)
+{
+	return Reset ? Counter.exchange(0, std::memory_order_relaxed) : Counter.load(std::memory_order_relaxed);
+}
+
+// Raises a maximum unless a snapshot reset it meanwhile to something higher
+//
+static void Raise(std::atomic<DWORD> &Maximum, DWORD Value)
+{
+	DWORD current = Maximum.load(std::memory_order_relaxed);
+
+	while (Value > current && !Maximum.compare_exchange_weak(current, Value, std::memory_order_relaxed))
+		;
+}
+
+CCcpDaqMonitor::CCcpDaqMonitor(const TCcpDaqLayout *Layout)
+	: m_Sequence(Layout)
+	, m_Dtos(0)
+	, m_Events(0)
+	, m_Overloads(0)
+	, m_QueuePeak(0)
+	, m_QueueDrops(0)
+	, m_Since(std::chrono::steady_clock::now())
+{
+	memset(m_LayoutList, 0xFF, sizeof(m_LayoutList));
+	memset(m_NumberList, 0xFF, sizeof(m_NumberList));
+
+	for (size_t i = 0; Layout && i < Layout->Lists.size() && i < CCP_ODT_NO_LIST; i++)
+	{
+		const TCcpDaqList &layout = Layout->Lists[i];
+		std::unique_ptr<TList> list(new TList());
+		size_t histogram;
+
+		if (layout.Odts.empty())
+			continue;
+		for (histogram = 0; histogram < m_Histograms.size(); histogram++)
+		{
+			if (m_Histograms[histogram]->EventChannel == layout.EventChannel)
+				break;
+		}
+		if (histogram == m_Histograms.size())
+		{
+			std::unique_ptr<THistogram> channel(new THistogram());
+
+			channel->EventChannel = layout.EventChannel;
+			channel->Intervals = 0;
+			channel->MaxJitterUs = 0;
+			for (int bucket = 0; bucket < CCP_JITTER_BUCKETS; bucket++)
+				channel->Buckets[bucket] = 0;
+			m_Histograms.push_back(std::move(channel));
+		}
+
+		list->ListNumber = layout.ListNumber;
+		list->EventChannel = layout.EventChannel;
+		list->Histogram = (BYTE)histogram;
+		list->LastStart = 0;
+		list->MeanUs = 0;
+		list->Learnt = 0;
+		list->LongRun = 0;
+		list->Dtos = 0;
+		list->Cycles = 0;
+		list->LostCycles = 0;
+		list->TornCycles = 0;
+		list->Overloads = 0;
+		list->PeriodUs = 0;
+		m_LayoutList[i] = (BYTE)m_Lists.size();
+		m_NumberList[layout.ListNumber] = (BYTE)m_Lists.size();
+		m_Lists.push_back(std::move(list));
+	}
+}
+
+//------------------------------
+// Receive thread
+//------------------------------
+
+void CCcpDaqMonitor::Restart()
+{
+	m_Sequence.Restart();
+	for (size_t i = 0; i < m_Lists.size(); i++)
+	{
+		m_Lists[i]->LastStart = 0;
+		m_Lists[i]->MeanUs = 0;
+		m_Lists[i]->Learnt = 0;
+		m_Lists[i]->LongRun = 0;
+	}
+}
+
+const TCcpOdtStep &CCcpDaqMonitor::OnDto(const BYTE *Data, UINT64 Micros)
+{
+	const TCcpOdtStep &step = m_Sequence.OnDto(Data[0]);
+	BYTE index = m_LayoutList[step.List];
+
+	m_Dtos.fetch_add(1, std::memory_order_relaxed);
+	if (index == 0xFF)
+		return step;
+
+	TList &list = *m_Lists[index];
+
+	// A cycle whose ODT 0 was lost shows as a gap of the next ODT 0
+	list.Dtos.fetch_add(1, std::memory_order_relaxed);
+	if (step.Flags & (CCP_ODT_CUT | CCP_ODT_TORN))
+		list.TornCycles.fetch_add(1, std::memory_order_relaxed);
+	if (step.Flags & CCP_ODT_BEGIN)
+	{
+		list.Cycles.fetch_add(1, std::memory_order_relaxed);
+		if (list.LastStart && Micros > list.LastStart)
+			Interval(list, Micros - list.LastStart);
+		list.LastStart = Micros;
+	}
+	return step;
+}
+
+void CCcpDaqMonitor::Interval(TList &List, UINT64 Micros)
+{
+	UINT64 sorted[CCP_MONITOR_LEARN_INTERVALS];
+
+	if (List.MeanUs)
+	{
+		Measure(List, Micros);
+		return;
+	}
+
+	// The median of the first intervals is the period: neither ODT 0 received
+	// in a bunch nor a few lost cycles move it. The intervals learnt from are
+	// then measured against it
+	List.Learning[List.Learnt++] = Micros;
+	if (List.Learnt < CCP_MONITOR_LEARN_INTERVALS)
+		return;
+	memcpy(sorted, List.Learning, sizeof(sorted));
+	std::nth_element(sorted, sorted + CCP_MONITOR_LEARN_INTERVALS / 2, sorted + CCP_MONITOR_LEARN_INTERVALS);
+	List.MeanUs = (double)std::max(sorted[CCP_MONITOR_LEARN_INTERVALS / 2], (UINT64)1);
+	List.PeriodUs.store((DWORD)std::min(List.MeanUs + 0.5, 4294967295.0), std::memory_order_relaxed);
+	List.Learnt = 0;
+	for (int i = 0; i < CCP_MONITOR_LEARN_INTERVALS && List.MeanUs; i++)
+		Measure(List, List.Learning[i]);
+}
+
+void CCcpDaqMonitor::Measure(TList &List, UINT64 Micros)
+{
+	THistogram &histogram = *m_Histograms[List.Histogram];
+	double cycles, deviation;
+	int bucket;
+
+	cycles = std::max(1.0, (double)(UINT64)(Micros / List.MeanUs + 0.5));
+	List.LostCycles.fetch_add((UINT64)cycles - 1, std::memory_order_relaxed);
+	deviation = Micros > cycles * List.MeanUs ? Micros - cycles * List.MeanUs : cycles * List.MeanUs - Micros;
+	List.MeanUs += (Micros / cycles - List.MeanUs) / 16;
+	List.PeriodUs.store((DWORD)std::min(List.MeanUs + 0.5, 4294967295.0), std::memory_order_relaxed);
+
+	for (bucket = 0; bucket < CCP_JITTER_BUCKETS - 1 && deviation >= (double)(1u << bucket); bucket++)
+		;
+	histogram.Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	histogram.Intervals.fetch_add(1, std::memory_order_relaxed);
+	Raise(histogram.MaxJitterUs, (DWORD)std::min(deviation + 0.5, 4294967295.0));
+
+	// Cycles are rarely lost that regularly: the period is too short
+	List.LongRun = cycles >= 2 ? List.LongRun + 1 : 0;
+	if (List.LongRun >= CCP_MONITOR_LEARN_INTERVALS)
+	{
+		List.MeanUs = 0;
+		List.LongRun = 0;
+	}
+}
+
+void CCcpDaqMonitor::OnEvent(const BYTE *Data)
+{
+	m_Events.fetch_add(1, std::memory_order_relaxed);
+	if (Data[1] != CCP_ERROR_DAQ_OVERLOAD)
+		return;
+
+	// Slaves naming the overloaded list put its number after the error code
+	m_Overloads.fetch_add(1, std::memory_order_relaxed);
+	if (m_NumberList[Data[2]] != 0xFF)
+		m_Lists[m_NumberList[Data[2]]]->Overloads.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CCcpDaqMonitor::OnQueued(DWORD Fill)
+{
+	Raise(m_QueuePeak, Fill);
+}
+
+//------------------------------
+// Snapshots
+//------------------------------
+
+void CCcpDaqMonitor::Snapshot(DWORD Fill, DWORD Capacity, bool Reset, TCCPDaqHealth *Health, TCCPDaqListHealth *Lists, BYTE MaxLists,
+	TCCPDaqJitterHistogram *Histograms, BYTE MaxHistograms)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	memset(Health, 0, sizeof(TCCPDaqHealth));
+	Health->Dtos = Take(m_Dtos, Reset);
+	Health->Events = Take(m_Events, Reset);
+	Health->Overloads = Take(m_Overloads, Reset);
+	Health->QueueFill = Fill;
+	Health->QueuePeak = std::max(Take(m_QueuePeak, Reset), Fill);
+	Health->QueueCapacity = Capacity;
+	Health->QueueDrops = Take(m_QueueDrops, Reset);
+	Health->PeriodUs = (UINT64)std::chrono::duration_cast<std::chrono::microseconds>(now - m_Since).count();
+	if (Reset)
+		m_Since = now;
+
+	// Lists and histograms left out of the buffers are reset all the same
+	for (size_t i = 0; i < m_Lists.size(); i++)
+	{
+		TList &list = *m_Lists[i];
+		TCCPDaqListHealth health;
+
+		health.ListNumber = list.ListNumber;
+		health.EventChannel = list.EventChannel;
+		health.Dtos = Take(list.Dtos, Reset);
+		health.Cycles = Take(list.Cycles, Reset);
+		health.LostCycles = Take(list.LostCycles, Reset);
+		health.TornCycles = Take(list.TornCycles, Reset);
+		health.Overloads = Take(list.Overloads, Reset);
+		health.PeriodUs = list.PeriodUs.load(std::memory_order_relaxed);
+		if (Lists && i < MaxLists)
+		{
+			Lists[i] = health;
+			Health->Lists++;
+		}
+	}
+	for (size_t i = 0; i < m_Histograms.size(); i++)
+	{
+		THistogram &histogram = *m_Histograms[i];
+		TCCPDaqJitterHistogram channel;
+
+		channel.EventChannel = histogram.EventChannel;
+		channel.Intervals = Take(histogram.Intervals, Reset);
+		channel.MaxJitterUs = Take(histogram.MaxJitterUs, Reset);
+		for (int bucket = 0; bucket < CCP_JITTER_BUCKETS; bucket++)
+			channel.Buckets[bucket] = Take(histogram.Buckets[bucket], Reset);
+		if (Histograms && i < MaxHistograms)
+		{
+			Histograms[i] = channel;
+			Health->Channels++;
+		}
+	}
+}
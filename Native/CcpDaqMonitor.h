@@ -0,0 +1,152 @@
+//  CcpDaqMonitor.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Counters of the measurement quality of a connection: lost and torn DAQ
+//  cycles, overload events, cycle jitter and receive queue fill
+//
+//  ~~~~~~~~~~~~
+//
+//  The monitor is fed by the receive thread for each DTO, without any lock,
+//  and read by the snapshots: the counters are relaxed atomics the snapshots
+//  take (and reset) one by one, the cycle state is the receive thread's own.
+//  A new DAQ layout gets a new monitor. The ODT sequence of the lists is
+//  followed once, by the CCcpOdtSequence of the monitor, whose steps feed
+//  the reassembly stage as well. The period of a list is learnt from the
+//  intervals between its ODT 0: the median of the first
+//  CCP_MONITOR_LEARN_INTERVALS, then a moving average. An interval of n
+//  periods (n >= 2) means n - 1 lost cycles, and the deviation from the
+//  nearest multiple of the period is the jitter. A run of intervals of 2
+//  periods or more means a period learnt too short, which is learnt again.
+//
+#ifndef __CCPDAQMONITORH__
+#define __CCPDAQMONITORH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpOdtSequence.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stddef.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define CCP_MONITOR_LEARN_INTERVALS            8         // Intervals of ODT 0 the period is learnt from (median), and run of long ones that learns it again
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+struct TCcpDaqLayout;
+
+class CCcpDaqMonitor
+{
+public:
+	/// <summary>
+	/// Follows the lists of a DAQ layout (NULL: none)
+	/// </summary>
+	CCcpDaqMonitor(const TCcpDaqLayout *Layout);
+
+	//------------------------------
+	// Receive thread
+	//------------------------------
+
+	/// <summary>
+	/// Forgets the cycle open and the last ODT 0 of each list, so the pause of
+	/// a DAQ restart does not count as torn or lost cycles. The periods are
+	/// learnt again: the lists may have been started at other rates
+	/// </summary>
+	void Restart();
+
+	/// <summary>
+	/// Takes a DAQ DTO
+	/// </summary>
+	/// <param name="Data">The 8 bytes of the DTO</param>
+	/// <param name="Micros">Receive time of the DTO</param>
+	/// <returns>Where the DTO falls in its cycle, valid until the next DTO (see CCcpDaqAssembler::OnDto)</returns>
+	const TCcpOdtStep &OnDto(const BYTE *Data, UINT64 Micros);
+
+	/// <summary>
+	/// Takes an event message
+	/// </summary>
+	/// <param name="Data">The 8 bytes of the message</param>
+	void OnEvent(const BYTE *Data);
+
+	/// <summary>
+	/// Takes the fill of the receive queue after a message was queued
+	/// </summary>
+	void OnQueued(DWORD Fill);
+
+	/// <summary>
+	/// Counts a message lost to a full receive queue (any thread)
+	/// </summary>
+	void OnQueueFull() { m_QueueDrops.fetch_add(1, std::memory_order_relaxed); }
+
+	//------------------------------
+	// Snapshots (serialized by the caller)
+	//------------------------------
+
+	/// <summary>
+	/// Copies the counters (see CCP_GetDaqHealth). The periods learnt are
+	/// kept on a reset
+	/// </summary>
+	/// <param name="Fill">Messages waiting in the receive queue</param>
+	/// <param name="Capacity">Messages the receive queue can hold</param>
+	/// <param name="Reset">Start the counters afresh</param>
+	void Snapshot(DWORD Fill, DWORD Capacity, bool Reset, TCCPDaqHealth *Health, TCCPDaqListHealth *Lists, BYTE MaxLists,
+		TCCPDaqJitterHistogram *Histograms, BYTE MaxHistograms);
+
+private:
+	struct TList
+	{
+		BYTE ListNumber;
+		BYTE EventChannel;
+		BYTE Histogram;                                    // Index in m_Histograms
+
+		// Cycle state (receive thread only)
+		UINT64 LastStart;                                  // Receive time of the last ODT 0, 0 if none
+		double MeanUs;                                     // Mean interval of ODT 0, 0 while learnt
+		UINT64 Learning[CCP_MONITOR_LEARN_INTERVALS];      // Intervals the period is learnt from
+		BYTE Learnt;                                       // Intervals in Learning
+		BYTE LongRun;                                      // Intervals of 2 periods or more in a row
+
+		// Counters (written by the receive thread)
+		std::atomic<UINT64> Dtos;
+		std::atomic<UINT64> Cycles;
+		std::atomic<UINT64> LostCycles;
+		std::atomic<UINT64> TornCycles;
+		std::atomic<UINT64> Overloads;
+		std::atomic<DWORD> PeriodUs;                       // MeanUs, rounded
+	};
+
+	struct THistogram
+	{
+		BYTE EventChannel;
+		std::atomic<UINT64> Intervals;
+		std::atomic<DWORD> MaxJitterUs;
+		std::atomic<UINT64> Buckets[CCP_JITTER_BUCKETS];
+	};
+
+	void Interval(TList &List, UINT64 Micros);
+	void Measure(TList &List, UINT64 Micros);
+
+	CCcpOdtSequence m_Sequence;                            // Receive thread only
+	std::vector<std::unique_ptr<TList> > m_Lists;
+	std::vector<std::unique_ptr<THistogram> > m_Histograms;
+	BYTE m_LayoutList[256];                                // Index in m_Lists of each list of the layout (TCcpOdtStep.List), 0xFF if none
+	BYTE m_NumberList[256];                                // Index in m_Lists of each list number, 0xFF if none
+
+	std::atomic<UINT64> m_Dtos;
+	std::atomic<UINT64> m_Events;
+	std::atomic<UINT64> m_Overloads;
+	std::atomic<DWORD> m_QueuePeak;
+	std::atomic<UINT64> m_QueueDrops;
+	std::chrono::steady_clock::time_point m_Since;         // Snapshots only
+};
+
+#endif
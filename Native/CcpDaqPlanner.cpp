@@ -0,0 +1,193 @@
+//  CcpDaqPlanner.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Choice of the event channels and prescalers of a set of DAQ signals and
+//  prediction of their bus load
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpDaqPlanner.h"
+#include "CcpProtocol.h"
+#include "CcpDaqConfig.h"
+#include "CanTransport.h"
+
+#include <algorithm>
+#include <map>
+#include <string.h>
+
+DWORD CCcpDaqPlanner::Odts(const TRate &Rate)
+{
+	return CCcpDaqConfigurator::MinOdts(Rate.Fours, Rate.Twos, Rate.Ones);
+}
+
+void CCcpDaqPlanner::Add(TRate &Rate, DWORD Signal, BYTE Size)
+{
+	Rate.Signals.push_back(Signal);
+	switch (Size)
+	{
+		case 4:     Rate.Fours++; break;
+		case 2:     Rate.Twos++; break;
+		default:    Rate.Ones++; break;
+	}
+}
+
+void CCcpDaqPlanner::Remove(TRate &Rate, size_t Index, BYTE Size)
+{
+	Rate.Signals.erase(Rate.Signals.begin() + Index);
+	switch (Size)
+	{
+		case 4:     Rate.Fours--; break;
+		case 2:     Rate.Twos--; break;
+		default:    Rate.Ones--; break;
+	}
+}
+
+double CCcpDaqPlanner::Frames(const TRate &Rate)
+{
+	return Odts(Rate) * 1000000.0 / Rate.PeriodUs;
+}
+
+bool CCcpDaqPlanner::Improve(std::vector<TRate> &Rates, const TCCPDaqRequest *Requests, WORD *Upsampled)
+{
+	static const BYTE s_Sizes[3] = {4, 2, 1};
+
+	// Rates are sorted from the fastest: any rate before a slower one meets
+	// the periods of its signals. Each change lowers the DTOs per second
+	for (size_t slow = Rates.size(); slow-- > 1; )
+	{
+		for (size_t fast = slow; fast-- > 0; )
+		{
+			TRate merged = Rates[fast];
+
+			for (size_t i = 0; i < Rates[slow].Signals.size(); i++)
+				Add(merged, Rates[slow].Signals[i], Requests[Rates[slow].Signals[i]].Size);
+			if (Frames(merged) - Frames(Rates[fast]) < Frames(Rates[slow]) - 1e-9)
+			{
+				*Upsampled += (WORD)Rates[slow].Signals.size();
+				Rates[fast] = merged;
+				Rates.erase(Rates.begin() + slow);
+				return true;
+			}
+
+			// Spare bytes of the faster ODTs, filled with the largest elements first
+			TRate faster = Rates[fast];
+			TRate slower = Rates[slow];
+			DWORD odts = Odts(faster);
+
+			for (int k = 0; k < 3; k++)
+			{
+				for (size_t i = slower.Signals.size(); i-- > 0; )
+				{
+					DWORD signal = slower.Signals[i];
+
+					if (Requests[signal].Size != s_Sizes[k])
+						continue;
+					Add(faster, signal, s_Sizes[k]);
+					if (Odts(faster) > odts)
+						Remove(faster, faster.Signals.size() - 1, s_Sizes[k]);
+					else
+						Remove(slower, i, s_Sizes[k]);
+				}
+			}
+			if (Odts(slower) < Odts(Rates[slow]))
+			{
+				*Upsampled += (WORD)(Rates[slow].Signals.size() - slower.Signals.size());
+				Rates[fast] = faster;
+				Rates[slow] = slower;
+				if (slower.Signals.empty())
+					Rates.erase(Rates.begin() + slow);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+TCCPResult CCcpDaqPlanner::Plan(const TCCPDaqRequest *Requests, DWORD Count, const DWORD *EventPeriodsUs, BYTE EventChannels,
+	DWORD Bitrate, bool Extended, WORD Budget, TCCPDaqSignal *Signals, TCCPDaqPlanStats *Stats)
+{
+	std::map<UINT64, size_t> periods;
+	std::vector<TRate> rates;
+	TCCPDaqPlanStats stats;
+	double frames = 0;
+
+	if (!EventChannels || !Bitrate)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	memset(&stats, 0, sizeof(stats));
+
+	// The slowest rate of the event channels meeting each period. Signals of
+	// equal periods share the pair chosen first
+	for (DWORD i = 0; i < Count; i++)
+	{
+		UINT64 best = 0;
+		BYTE channel = 0;
+		WORD prescaler = 0;
+
+		if (Requests[i].Size != 1 && Requests[i].Size != 2 && Requests[i].Size != 4)
+			return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+		for (BYTE c = 0; c < EventChannels; c++)
+		{
+			DWORD factor;
+
+			if (!EventPeriodsUs[c] || EventPeriodsUs[c] > Requests[i].PeriodUs)
+				continue;
+			// Equal rates: the smaller prescaler, i.e. the channel closest to the period
+			factor = std::min<DWORD>(Requests[i].PeriodUs / EventPeriodsUs[c], 0xFFFF);
+			if ((UINT64)EventPeriodsUs[c] * factor > best || ((UINT64)EventPeriodsUs[c] * factor == best && factor < prescaler))
+			{
+				best = (UINT64)EventPeriodsUs[c] * factor;
+				channel = c;
+				prescaler = (WORD)factor;
+			}
+		}
+		// No event channel is fast enough
+		if (!best)
+			return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+		auto period = periods.insert(std::make_pair(best, rates.size()));
+		if (period.second)
+		{
+			TRate rate;
+
+			rate.PeriodUs = best;
+			rate.EventChannel = channel;
+			rate.Prescaler = prescaler;
+			rate.Fours = rate.Twos = rate.Ones = 0;
+			rates.push_back(rate);
+		}
+		Add(rates[period.first->second], i, Requests[i].Size);
+	}
+
+	std::sort(rates.begin(), rates.end(), [](const TRate &A, const TRate &B)
+	{
+		return A.PeriodUs < B.PeriodUs;
+	});
+	while (Improve(rates, Requests, &stats.Upsampled))
+		;
+
+	for (size_t r = 0; r < rates.size(); r++)
+	{
+		for (size_t i = 0; i < rates[r].Signals.size(); i++)
+		{
+			const TCCPDaqRequest &request = Requests[rates[r].Signals[i]];
+			TCCPDaqSignal &signal = Signals[rates[r].Signals[i]];
+
+			signal.AddrExtension = request.AddrExtension;
+			signal.Addr = request.Addr;
+			signal.Size = request.Size;
+			signal.EventChannel = rates[r].EventChannel;
+			signal.Prescaler = rates[r].Prescaler;
+		}
+		stats.Odts += (WORD)Odts(rates[r]);
+		frames += Frames(rates[r]);
+	}
+
+	stats.Rates = (BYTE)std::min<size_t>(rates.size(), 0xFF);
+	stats.FramesPerSecond = (DWORD)(frames + 0.5);
+	stats.Bitrate = Bitrate;
+	stats.BusLoad = (WORD)std::min(frames * CanGetFrameBits(Extended, CCP_PACKET_SIZE) * 1000.0 / Bitrate + 0.5, 65535.0);
+	if (Stats)
+		*Stats = stats;
+	return stats.BusLoad > Budget ? CCP_ERROR_DAQ_BUSLOAD : CCP_ERROR_ACKNOWLEDGE_OK;
+}
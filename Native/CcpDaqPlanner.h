@@ -0,0 +1,65 @@
+//  CcpDaqPlanner.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Choice of the event channels and prescalers of a set of DAQ signals and
+//  prediction of their bus load
+//
+//  ~~~~~~~~~~~~
+//
+//  A signal is sampled at the slowest rate (event channel period times
+//  prescaler) that meets its period. Signals of equal rates share one event
+//  channel / prescaler pair, hence one DAQ list. Since a partly filled ODT
+//  costs a whole DTO, a slower signal that fits into the spare bytes of a
+//  faster rate is moved there when this removes ODTs of its own rate; a whole
+//  rate is merged into a faster one when this sends fewer DTOs per second.
+//
+#ifndef __CCPDAQPLANNERH__
+#define __CCPDAQPLANNERH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+#include <stddef.h>
+#include <vector>
+
+class CCcpDaqPlanner
+{
+public:
+	/// <summary>
+	/// Plans the rates of a set of signals (see CCP_PlanDaq)
+	/// </summary>
+	/// <param name="Requests">The signals and their periods</param>
+	/// <param name="Count">Number of signals</param>
+	/// <param name="EventPeriodsUs">Period of each event channel (micros). 0: not available</param>
+	/// <param name="EventChannels">Number of event channels</param>
+	/// <param name="Bitrate">Bit rate of the channel (bit/s)</param>
+	/// <param name="Extended">The DTOs have 29 bit identifiers</param>
+	/// <param name="Budget">Share of the bit rate the DAQ may use (per mille)</param>
+	/// <param name="Signals">Buffer for the planned signals (Count entries)</param>
+	/// <param name="Stats">Buffer for the figures of the plan (may be NULL)</param>
+	/// <returns>A TCCPResult result code</returns>
+	static TCCPResult Plan(const TCCPDaqRequest *Requests, DWORD Count, const DWORD *EventPeriodsUs, BYTE EventChannels,
+		DWORD Bitrate, bool Extended, WORD Budget, TCCPDaqSignal *Signals, TCCPDaqPlanStats *Stats);
+
+private:
+	// Signals sampled by one event channel / prescaler pair
+	struct TRate
+	{
+		UINT64 PeriodUs;
+		BYTE EventChannel;
+		WORD Prescaler;
+		std::vector<DWORD> Signals;
+		DWORD Fours;
+		DWORD Twos;
+		DWORD Ones;
+	};
+
+	static DWORD Odts(const TRate &Rate);
+	static void Add(TRate &Rate, DWORD Signal, BYTE Size);
+	static void Remove(TRate &Rate, size_t Index, BYTE Size);
+	static double Frames(const TRate &Rate);
+	static bool Improve(std::vector<TRate> &Rates, const TCCPDaqRequest *Requests, WORD *Upsampled);
+};
+
+#endif
@@ -0,0 +1,148 @@
+//  CcpDtoDecoder.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Decoding of DAQ DTOs into one sample column per signal
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpDtoDecoder.h"
+
+#include <algorithm>
+#include <string.h>
+
+CCcpDtoDecoder::CCcpDtoDecoder()
+	: m_Columns(0)
+	, m_Mask(0)
+{
+	memset(m_Plans, 0, sizeof(m_Plans));
+	memset(m_Known, 0, sizeof(m_Known));
+}
+
+bool CCcpDtoDecoder::Compile(const TCcpDaqLayout &Layout, bool IntelFormat, DWORD Capacity)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	DWORD capacity = 1;
+
+	if (!Capacity)
+		Capacity = CCP_DECODER_DEFAULT_CAPACITY;
+	if (Capacity > CCP_DECODER_MAX_CAPACITY)
+		return false;
+	while (capacity < Capacity)
+		capacity <<= 1;
+
+	memset(m_Plans, 0, sizeof(m_Plans));
+	memset(m_Known, 0, sizeof(m_Known));
+	m_Steps.clear();
+	for (size_t i = 0; i < Layout.Lists.size(); i++)
+	{
+		const TCcpDaqList &list = Layout.Lists[i];
+
+		for (size_t odt = 0; odt < list.Odts.size(); odt++)
+		{
+			TPlan &plan = m_Plans[(BYTE)(list.FirstPid + odt)];
+
+			plan.First = (DWORD)m_Steps.size();
+			plan.Count = (DWORD)list.Odts[odt].size();
+			m_Known[(BYTE)(list.FirstPid + odt)] = 1;
+			for (size_t e = 0; e < list.Odts[odt].size(); e++)
+			{
+				const TCcpDaqElement &element = list.Odts[odt][e];
+				TStep step;
+
+				// The element data starts after the PID
+				for (BYTE k = 0; k < 4; k++)
+				{
+					if (k >= element.Size)
+						step.Bytes[k] = CCP_PACKET_SIZE;
+					else if (IntelFormat)
+						step.Bytes[k] = 1 + element.Offset + k;
+					else
+						step.Bytes[k] = 1 + element.Offset + element.Size - 1 - k;
+				}
+				step.Column = element.Signal;
+				m_Steps.push_back(step);
+			}
+		}
+	}
+
+	m_Columns = (DWORD)Layout.Signals.size();
+	m_Mask = capacity - 1;
+	m_Samples.assign((size_t)m_Columns * capacity, 0);
+	m_Stamps.assign((size_t)m_Columns * capacity, 0);
+	m_Head.assign(m_Columns, 0);
+	m_Tail.assign(m_Columns, 0);
+	return true;
+}
+
+DWORD CCcpDtoDecoder::Decode(const TCCPMsg *Msgs, const UINT64 *Stamps, DWORD Count)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	const TStep *steps = m_Steps.data();
+	DWORD *samples = m_Samples.data();
+	UINT64 *stamps = m_Stamps.data();
+	UINT64 *head = m_Head.data();
+	DWORD decoded = 0;
+	BYTE frame[CCP_PACKET_SIZE + 1];
+
+	frame[CCP_PACKET_SIZE] = 0;
+	for (DWORD i = 0; i < Count; i++)
+	{
+		const TPlan &plan = m_Plans[Msgs[i].Data[0]];
+		UINT64 stamp = Stamps ? Stamps[i] : 0;
+
+		memcpy(frame, Msgs[i].Data, CCP_PACKET_SIZE);
+		decoded += m_Known[frame[0]];
+		for (DWORD s = plan.First; s < plan.First + plan.Count; s++)
+		{
+			const TStep &step = steps[s];
+			DWORD value = (DWORD)frame[step.Bytes[0]]
+				| ((DWORD)frame[step.Bytes[1]] << 8)
+				| ((DWORD)frame[step.Bytes[2]] << 16)
+				| ((DWORD)frame[step.Bytes[3]] << 24);
+
+			size_t slot = ((size_t)step.Column * (m_Mask + 1)) + (head[step.Column] & m_Mask);
+
+			samples[slot] = value;
+			stamps[slot] = stamp;
+			head[step.Column]++;
+		}
+	}
+	return decoded;
+}
+
+bool CCcpDtoDecoder::ReadSamples(DWORD Signal, DWORD *Samples, UINT64 *Stamps, DWORD Count, DWORD *Read, DWORD *Lost)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	const DWORD *column;
+	const UINT64 *stamps;
+	UINT64 available, lost = 0;
+	DWORD read;
+
+	if (Signal >= m_Columns)
+		return false;
+
+	// Samples overwritten since the last read are skipped
+	column = &m_Samples[(size_t)Signal * (m_Mask + 1)];
+	stamps = &m_Stamps[(size_t)Signal * (m_Mask + 1)];
+	available = m_Head[Signal] - m_Tail[Signal];
+	if (available > (UINT64)m_Mask + 1)
+	{
+		lost = available - (m_Mask + 1);
+		m_Tail[Signal] += lost;
+		available = m_Mask + 1;
+	}
+
+	read = (DWORD)std::min<UINT64>(available, Count);
+	for (DWORD i = 0; i < read; i++)
+		Samples[i] = column[(m_Tail[Signal] + i) & m_Mask];
+	for (DWORD i = 0; Stamps && i < read; i++)
+		Stamps[i] = stamps[(m_Tail[Signal] + i) & m_Mask];
+	m_Tail[Signal] += read;
+
+	if (Read)
+		*Read = read;
+	if (Lost)
+		*Lost = (DWORD)std::min<UINT64>(lost, 0xFFFFFFFFU);
+	return true;
+}
@@ -0,0 +1,101 @@
+//  CcpDtoDecoder.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Decoding of DAQ DTOs into one sample column per signal
+//
+//  ~~~~~~~~~~~~
+//
+//  The DAQ layout of a connection is compiled into a decode plan per PID:
+//  for each element, the 4 frame bytes that make up its value, least
+//  significant first. Bytes beyond the width of the element and the byte
+//  order (TCCPSlaveData::IntelFormat) are resolved at compile time by pointing
+//  at a zero byte, so every element decodes with the same four loads and
+//  shifts. Frames of unknown PIDs have an empty plan. Each column is a ring
+//  of Capacity samples, each with the receive time of its DTO; a column not
+//  read in time loses its oldest samples.
+//
+#ifndef __CCPDTODECODERH__
+#define __CCPDTODECODERH__
+
+#include "WinTypes.h"
+#include "PCCP.h"
+#include "CcpProtocol.h"
+#include "CcpDaqConfig.h"
+
+#include <mutex>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define CCP_DECODER_DEFAULT_CAPACITY           4096      // Samples kept per signal when Capacity is 0
+#define CCP_DECODER_MAX_CAPACITY               0x100000  // Upper bound of the samples kept per signal
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+class CCcpDtoDecoder
+{
+public:
+	CCcpDtoDecoder();
+
+	/// <summary>
+	/// Builds the decode plans of a DAQ layout and allocates the columns
+	/// </summary>
+	/// <param name="Layout">The DAQ lists configured on the slave</param>
+	/// <param name="IntelFormat">Byte order of the slave</param>
+	/// <param name="Capacity">Samples kept per signal, rounded up to a power of 2. Zero(0) for the default</param>
+	/// <returns>False if the capacity is invalid</returns>
+	bool Compile(const TCcpDaqLayout &Layout, bool IntelFormat, DWORD Capacity);
+
+	/// <summary>
+	/// Decodes a batch of messages (see CCP_DecodeMsgs)
+	/// </summary>
+	/// <param name="Stamps">Receive time of each message (may be NULL: 0)</param>
+	/// <returns>The number of DAQ DTOs of the layout within the batch</returns>
+	DWORD Decode(const TCCPMsg *Msgs, const UINT64 *Stamps, DWORD Count);
+
+	/// <summary>
+	/// Moves the oldest samples of a signal out of its column (see CCP_ReadSamples)
+	/// </summary>
+	/// <param name="Stamps">Buffer for the receive times of the samples (may be NULL)</param>
+	/// <returns>False if the signal is unknown</returns>
+	bool ReadSamples(DWORD Signal, DWORD *Samples, UINT64 *Stamps, DWORD Count, DWORD *Read, DWORD *Lost);
+
+	DWORD GetColumns() const { return m_Columns; }
+
+private:
+	// An element of a plan: the frame bytes of its value, least significant
+	// first (CCP_PACKET_SIZE: the zero byte), and its column
+	struct TStep
+	{
+		BYTE Bytes[4];
+		DWORD Column;
+	};
+
+	// The steps of a PID within m_Steps
+	struct TPlan
+	{
+		DWORD First;
+		DWORD Count;
+	};
+
+	std::mutex m_Lock;
+	TPlan m_Plans[256];
+	BYTE m_Known[256];                                     // 1 for the PIDs of the layout
+	std::vector<TStep> m_Steps;
+	DWORD m_Columns;
+	DWORD m_Mask;                                          // Capacity - 1
+
+	// Columns one after the other, Capacity samples each. m_Head counts the
+	// samples written to a column, m_Tail the ones read (or lost)
+	std::vector<DWORD> m_Samples;
+	std::vector<UINT64> m_Stamps;
+	std::vector<UINT64> m_Head;
+	std::vector<UINT64> m_Tail;
+};
+
+#endif
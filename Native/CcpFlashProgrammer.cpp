@@ -0,0 +1,461 @@
+//  CcpFlashProgrammer.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Flash programming of Intel HEX / S-record images over a PCAN-CCP
+//  connection (CLEAR_MEMORY, PROGRAM_6 / PROGRAM, BUILD_CHKSUM)
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpFlashProgrammer.h"
+#include "CcpImageReader.h"
+#include "CcpChecksum.h"
+#include "CcpProtocol.h"
+
+#include <algorithm>
+#include <string.h>
+
+// Command sequence of one block: clear, program, verify
+//
+class CCcpFlashBlockSource : public ICcpCommandSource
+{
+public:
+	CCcpFlashBlockSource(const std::vector<TCcpMemoryRange> &Block, bool Clear, DWORD ClearAddr, DWORD ClearSize, BYTE ChecksumType, bool IntelFormat)
+		: m_Block(Block[0]), m_Program(Block, CCP_CMD_PROGRAM, CCP_CMD_PROGRAM_6, IntelFormat)
+		, m_Phase(Clear ? PhaseClearMta : PhaseProgram), m_ClearAddr(ClearAddr), m_ClearSize(ClearSize)
+		, m_Verify(ChecksumType != 0), m_IntelFormat(IntelFormat), m_Cleared(false), m_Verified(false)
+	{
+		// The expected checksum is computed up front, before the block is sent
+		if (m_Verify && m_Checksum.Reset(ChecksumType, IntelFormat))
+			m_Checksum.Update(m_Block.Data.data(), m_Block.Data.size());
+	}
+
+	virtual bool NextCommand(BYTE *Cro)
+	{
+		switch (m_Phase)
+		{
+			case PhaseClearMta:
+				SetMta(Cro, m_ClearAddr);
+				m_Phase = PhaseClear;
+				return true;
+
+			case PhaseClear:
+				Cro[0] = CCP_CMD_CLEAR_MEMORY;
+				CcpPutDword(&Cro[2], m_ClearSize, m_IntelFormat);
+				m_Phase = PhaseProgram;
+				return true;
+
+			case PhaseProgram:
+				if (m_Program.NextCommand(Cro))
+					return true;
+				if (!m_Verify)
+					break;
+				SetMta(Cro, m_Block.Addr);
+				m_Phase = PhaseChecksum;
+				return true;
+
+			case PhaseChecksum:
+				Cro[0] = CCP_CMD_BUILD_CHKSUM;
+				CcpPutDword(&Cro[2], (DWORD)m_Block.Data.size(), m_IntelFormat);
+				m_Phase = PhaseDone;
+				return true;
+
+			default:
+				break;
+		}
+		m_Phase = PhaseDone;
+		return false;
+	}
+
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm)
+	{
+		switch (Cro[0])
+		{
+			case CCP_CMD_CLEAR_MEMORY:
+				m_Cleared = true;
+				break;
+
+			case CCP_CMD_BUILD_CHKSUM:
+				m_Verified = m_Checksum.Matches(&Crm[CCP_CRM_DATA_OFFSET + 1], Crm[CCP_CRM_DATA_OFFSET]);
+				break;
+
+			case CCP_CMD_SET_MTA:
+				if (m_Phase == PhaseProgram)
+					m_Program.OnResponse(Cro, Crm);
+				break;
+
+			default:
+				m_Program.OnResponse(Cro, Crm);
+				break;
+		}
+	}
+
+	bool IsCleared() const { return m_Cleared; }
+	bool IsVerified() const { return m_Verified; }
+	const CCcpRangeWriteSource &GetProgram() const { return m_Program; }
+
+private:
+	enum TPhase { PhaseClearMta, PhaseClear, PhaseProgram, PhaseChecksum, PhaseDone };
+
+	void SetMta(BYTE *Cro, DWORD Addr)
+	{
+		Cro[0] = CCP_CMD_SET_MTA;
+		Cro[2] = 0;
+		Cro[3] = m_Block.Ext;
+		CcpPutDword(&Cro[4], Addr, m_IntelFormat);
+	}
+
+	const TCcpMemoryRange &m_Block;
+	CCcpRangeWriteSource m_Program;
+	CCcpChecksum m_Checksum;
+	TPhase m_Phase;
+	DWORD m_ClearAddr;
+	DWORD m_ClearSize;
+	bool m_Verify;
+	bool m_IntelFormat;
+	bool m_Cleared;
+	bool m_Verified;
+};
+
+// SET_MTA + BUILD_CHKSUM for each range, stopping at the first range whose
+// checksum differs from the local one
+//
+class CCcpChecksumCompareSource : public ICcpCommandSource
+{
+public:
+	CCcpChecksumCompareSource(const std::vector<TCcpMemoryRange> &Ranges, BYTE ChecksumType, bool IntelFormat)
+		: m_Ranges(Ranges), m_ChecksumType(ChecksumType), m_IntelFormat(IntelFormat)
+		, m_Range(0), m_MtaSet(false), m_Match(true), m_Mta0Addr(0)
+	{
+	}
+
+	virtual bool NextCommand(BYTE *Cro)
+	{
+		if (!m_Match || m_Range == m_Ranges.size())
+			return false;
+
+		const TCcpMemoryRange &range = m_Ranges[m_Range];
+
+		if (!m_MtaSet)
+		{
+			Cro[0] = CCP_CMD_SET_MTA;
+			Cro[2] = 0;
+			Cro[3] = range.Ext;
+			CcpPutDword(&Cro[4], range.Addr, m_IntelFormat);
+			m_MtaSet = true;
+			return true;
+		}
+
+		// The local checksum is computed once the SET_MTA is answered, with
+		// the BUILD_CHKSUM that checks it
+		m_Checksum.Reset(m_ChecksumType, m_IntelFormat);
+		m_Checksum.Update(range.Data.data(), range.Data.size());
+		Cro[0] = CCP_CMD_BUILD_CHKSUM;
+		CcpPutDword(&Cro[2], (DWORD)range.Data.size(), m_IntelFormat);
+		m_MtaSet = false;
+		m_Range++;
+		return true;
+	}
+
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm)
+	{
+		if (Cro[0] == CCP_CMD_SET_MTA)
+			m_Mta0Addr = CcpGetDword(&Cro[4], m_IntelFormat);
+		else
+			m_Match = m_Checksum.Matches(&Crm[CCP_CRM_DATA_OFFSET + 1], Crm[CCP_CRM_DATA_OFFSET]);
+	}
+
+	bool IsMatch() const { return m_Match; }
+	DWORD GetMta0() const { return m_Mta0Addr; }
+
+private:
+	const std::vector<TCcpMemoryRange> &m_Ranges;
+	BYTE m_ChecksumType;
+	bool m_IntelFormat;
+	size_t m_Range;
+	bool m_MtaSet;
+	bool m_Match;
+	DWORD m_Mta0Addr;
+	CCcpChecksum m_Checksum;
+};
+
+CCcpFlashProgrammer::CCcpFlashProgrammer(CCcpSession *Session)
+	: m_Session(Session)
+	, m_SectorAddr(0)
+{
+	memset(&m_Params, 0, sizeof(m_Params));
+	memset(&m_Progress, 0, sizeof(m_Progress));
+	m_Block.Ext = 0;
+	m_Block.Addr = 0;
+}
+
+void CCcpFlashProgrammer::UpdateProgress()
+{
+	UINT64 elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_Start).count();
+
+	m_Progress.ElapsedMicros = (DWORD)elapsed;
+	m_Progress.BytesPerSecond = elapsed ? (DWORD)((UINT64)m_Progress.BytesProgrammed * 1000000 / elapsed) : 0;
+}
+
+TCCPResult CCcpFlashProgrammer::FlushBlock(TCcpMemoryRange &Block, TCCPFlashProgressCallback Callback, void *Context, WORD TimeOut)
+{
+	std::vector<TCcpMemoryRange> block(1);
+	DWORD clearAddr, clearSize, commands;
+	TCCPResult result;
+	bool clear;
+	BYTE mta0Ext;
+	DWORD mta0Addr;
+
+	if (Block.Data.empty())
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	block[0].Ext = Block.Ext;
+	block[0].Addr = Block.Addr;
+	block[0].Data.swap(Block.Data);
+
+	// Blocks never span sectors: at most one sector to clear
+	if (m_Params.SectorSize)
+	{
+		clearAddr = block[0].Addr - block[0].Addr % m_Params.SectorSize;
+		clearSize = m_Params.SectorSize;
+		clear = m_ClearedSectors.insert(clearAddr).second;
+	}
+	else
+	{
+		clearAddr = block[0].Addr;
+		clearSize = (DWORD)block[0].Data.size();
+		clear = true;
+	}
+
+	CCcpFlashBlockSource source(block, clear, clearAddr, clearSize, m_Params.Verify ? m_Params.ChecksumType : 0, m_Session->GetSlaveData().IntelFormat);
+
+	result = m_Session->CommandSequence(&source, TimeOut, &commands);
+	m_Progress.Commands += commands;
+	m_Progress.BytesProgrammed += source.GetProgram().GetWritten();
+	if (source.IsCleared())
+		m_Progress.SectorsCleared++;
+	if (commands)
+	{
+		source.GetProgram().GetMta0(&mta0Ext, &mta0Addr);
+		m_Session->SetMta0(mta0Ext, mta0Addr);
+	}
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+
+	if (m_Params.Verify)
+	{
+		if (!source.IsVerified())
+			return CCP_ERROR_VERIFY_FAILED;
+		m_Progress.BlocksVerified++;
+	}
+	if (Callback)
+	{
+		UpdateProgress();
+		Callback(Context, &m_Progress);
+	}
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpFlashProgrammer::CompareSector(bool *Match, WORD TimeOut)
+{
+	CCcpChecksumCompareSource source(m_Sector, m_Params.ChecksumType, m_Session->GetSlaveData().IntelFormat);
+	TCCPResult result;
+	DWORD commands;
+
+	result = m_Session->CommandSequence(&source, TimeOut, &commands);
+	m_Progress.Commands += commands;
+	if (commands)
+		m_Session->SetMta0(m_Params.AddrExtension, source.GetMta0());
+
+	// A checksum the slave refuses to build (unaligned word sum, range not
+	// readable) just means the sector has to be programmed
+	if (result == CCP_ERROR_PARAM_OUT_OF_RANGE || result == CCP_ERROR_ACCESS_DENIED)
+	{
+		*Match = false;
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+	*Match = result == CCP_ERROR_ACKNOWLEDGE_OK && source.IsMatch();
+	return result;
+}
+
+TCCPResult CCcpFlashProgrammer::FlushSector(TCCPFlashProgressCallback Callback, void *Context, WORD TimeOut)
+{
+	std::map<DWORD, std::vector<std::pair<DWORD, DWORD>>>::iterator skipped;
+	TCCPResult result;
+	DWORD bytes = 0;
+	bool match;
+	size_t i;
+
+	if (m_Sector.empty())
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+
+	result = CompareSector(&match, TimeOut);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+
+	if (match)
+	{
+		// Sectors cleared earlier in the image are not counted as skipped,
+		// and sectors are only visited again with sector sizes
+		//
+		if (m_Params.SectorSize && !m_ClearedSectors.count(m_SectorAddr))
+		{
+			std::vector<std::pair<DWORD, DWORD>> &ranges = m_SkippedRanges[m_SectorAddr];
+
+			if (ranges.empty())
+				m_Progress.SectorsSkipped++;
+			for (i = 0; i < m_Sector.size(); i++)
+				ranges.push_back(std::make_pair(m_Sector[i].Addr, (DWORD)m_Sector[i].Data.size()));
+		}
+		else if (!m_Params.SectorSize)
+			m_Progress.SectorsSkipped++;
+
+		for (i = 0; i < m_Sector.size(); i++)
+			bytes += (DWORD)m_Sector[i].Data.size();
+		m_Sector.clear();
+		m_Progress.BytesSkipped += bytes;
+		if (Callback)
+		{
+			UpdateProgress();
+			Callback(Context, &m_Progress);
+		}
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+
+	// Clearing a sector skipped earlier in the image would lose the ranges
+	// found equal then: they are read back and programmed again
+	//
+	skipped = m_SkippedRanges.find(m_SectorAddr);
+	if (skipped != m_SkippedRanges.end())
+	{
+		for (i = 0; i < skipped->second.size() && result == CCP_ERROR_ACKNOWLEDGE_OK; i++)
+		{
+			TCcpMemoryRange range;
+
+			range.Ext = m_Params.AddrExtension;
+			range.Addr = skipped->second[i].first;
+			range.Data.resize(skipped->second[i].second);
+			result = CCcpMemoryTransfer(m_Session).Read(range.Ext, range.Addr, (DWORD)range.Data.size(), range.Data.data(), NULL, TimeOut);
+			bytes += (DWORD)range.Data.size();
+			m_Sector.push_back(std::move(range));
+		}
+		if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+			return result;
+		m_Progress.BytesSkipped -= bytes;
+		m_Progress.SectorsSkipped--;
+		m_SkippedRanges.erase(skipped);
+	}
+
+	for (i = 0; i < m_Sector.size() && result == CCP_ERROR_ACKNOWLEDGE_OK; i++)
+		result = FlushBlock(m_Sector[i], Callback, Context, TimeOut);
+	m_Sector.clear();
+	return result;
+}
+
+TCCPResult CCcpFlashProgrammer::QueueBlock(TCCPFlashProgressCallback Callback, void *Context, WORD TimeOut)
+{
+	TCCPResult result;
+	DWORD sector;
+
+	if (!m_Params.Delta)
+		return FlushBlock(m_Block, Callback, Context, TimeOut);
+	if (m_Block.Data.empty())
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+
+	// Blocks are collected per sector; without sectors each block is compared
+	// and programmed on its own
+	//
+	sector = m_Params.SectorSize ? m_Block.Addr - m_Block.Addr % m_Params.SectorSize : m_Block.Addr;
+	if (!m_Sector.empty() && sector != m_SectorAddr)
+	{
+		result = FlushSector(Callback, Context, TimeOut);
+		if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+			return result;
+	}
+	m_SectorAddr = sector;
+	m_Sector.push_back(TCcpMemoryRange());
+	m_Sector.back().Ext = m_Block.Ext;
+	m_Sector.back().Addr = m_Block.Addr;
+	m_Sector.back().Data.swap(m_Block.Data);
+
+	if (!m_Params.SectorSize)
+		return FlushSector(Callback, Context, TimeOut);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpFlashProgrammer::Program(LPCSTR FileName, const TCCPFlashParams *Params, TCCPFlashProgressCallback Callback, void *Context, TCCPFlashProgress *Progress, WORD TimeOut)
+{
+	CCcpImageReader reader;
+	BYTE data[CCP_IMAGE_MAX_RECORD];
+	DWORD addr, length, offset, chunk;
+	UINT64 next, boundary;
+	TCCPResult result;
+
+	if (Params)
+		m_Params = *Params;
+	else
+	{
+		memset(&m_Params, 0, sizeof(m_Params));
+		m_Params.Verify = true;
+	}
+	if (!m_Params.BlockSize)
+		m_Params.BlockSize = CCP_FLASH_DEFAULT_BLOCK;
+	if (!m_Params.ChecksumType)
+		m_Params.ChecksumType = CCP_CHECKSUM_CRC_16_CITT;
+	if (!CCcpChecksum::GetSize(m_Params.ChecksumType))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	memset(&m_Progress, 0, sizeof(m_Progress));
+	m_Start = std::chrono::steady_clock::now();
+	m_ClearedSectors.clear();
+	m_Sector.clear();
+	m_SkippedRanges.clear();
+	m_Block.Ext = m_Params.AddrExtension;
+	m_Block.Data.clear();
+
+	result = reader.Open(FileName);
+	m_Progress.ImageSize = reader.GetSize();
+
+	while (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		result = reader.ReadRecord(&addr, data, &length);
+		if (result != CCP_ERROR_ACKNOWLEDGE_OK || !length)
+			break;
+		m_Progress.ImageBytesRead = reader.GetPosition();
+
+		// Records are appended to the current block while contiguous; blocks
+		// are cut at the block size and sector boundaries
+		//
+		for (offset = 0; offset < length && result == CCP_ERROR_ACKNOWLEDGE_OK; offset += chunk)
+		{
+			next = (UINT64)addr + offset;
+			if (!m_Block.Data.empty() && next != m_Block.Addr + (UINT64)m_Block.Data.size())
+			{
+				result = QueueBlock(Callback, Context, TimeOut);
+				if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+					break;
+			}
+			if (m_Block.Data.empty())
+				m_Block.Addr = (DWORD)next;
+
+			boundary = (next / m_Params.BlockSize + 1) * m_Params.BlockSize;
+			if (m_Params.SectorSize)
+				boundary = std::min(boundary, (next / m_Params.SectorSize + 1) * m_Params.SectorSize);
+			chunk = (DWORD)std::min((UINT64)(length - offset), boundary - next);
+			m_Block.Data.insert(m_Block.Data.end(), &data[offset], &data[offset + chunk]);
+
+			if (next + chunk == boundary)
+				result = QueueBlock(Callback, Context, TimeOut);
+		}
+	}
+
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		result = QueueBlock(Callback, Context, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		result = FlushSector(Callback, Context, TimeOut);
+
+	m_Progress.ImageBytesRead = reader.GetPosition();
+	UpdateProgress();
+	if (Progress)
+		*Progress = m_Progress;
+	return result;
+}
@@ -0,0 +1,64 @@
+//  CcpFlashProgrammer.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Flash programming of Intel HEX / S-record images over a PCAN-CCP
+//  connection (CLEAR_MEMORY, PROGRAM_6 / PROGRAM, BUILD_CHKSUM)
+//
+//  ~~~~~~~~~~~~
+//
+#ifndef __CCPFLASHPROGRAMMERH__
+#define __CCPFLASHPROGRAMMERH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpMemoryTransfer.h"
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <vector>
+
+class CCcpFlashProgrammer
+{
+public:
+	explicit CCcpFlashProgrammer(CCcpSession *Session);
+
+	/// <summary>
+	/// Programs an image file (see CCP_FlashImage)
+	/// </summary>
+	/// <param name="FileName">Path of the Intel HEX / S-record image</param>
+	/// <param name="Params">Programming parameters (NULL for defaults)</param>
+	/// <param name="Callback">Progress callback (may be NULL)</param>
+	/// <param name="Context">User value passed to the callback</param>
+	/// <param name="Progress">Buffer for the final progress figures (may be NULL)</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult Program(LPCSTR FileName, const TCCPFlashParams *Params, TCCPFlashProgressCallback Callback, void *Context, TCCPFlashProgress *Progress, WORD TimeOut);
+
+private:
+	TCCPResult QueueBlock(TCCPFlashProgressCallback Callback, void *Context, WORD TimeOut);
+	TCCPResult FlushBlock(TCcpMemoryRange &Block, TCCPFlashProgressCallback Callback, void *Context, WORD TimeOut);
+	TCCPResult FlushSector(TCCPFlashProgressCallback Callback, void *Context, WORD TimeOut);
+	TCCPResult CompareSector(bool *Match, WORD TimeOut);
+	void UpdateProgress();
+
+	CCcpSession *m_Session;
+	TCCPFlashParams m_Params;
+	TCCPFlashProgress m_Progress;
+	std::chrono::steady_clock::time_point m_Start;
+
+	// Block being assembled from the image records
+	//
+	TCcpMemoryRange m_Block;
+	std::set<DWORD> m_ClearedSectors;
+
+	// Delta: blocks of the sector being assembled, and the ranges of the
+	// sectors skipped so far (read back if the sector is visited again)
+	//
+	std::vector<TCcpMemoryRange> m_Sector;
+	DWORD m_SectorAddr;
+	std::map<DWORD, std::vector<std::pair<DWORD, DWORD>>> m_SkippedRanges;
+};
+
+#endif
@@ -0,0 +1,253 @@
+//  CcpImageReader.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Streaming reader of Intel HEX and Motorola S-record memory images
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpImageReader.h"
+
+#include <ctype.h>
+#include <string.h>
+
+// Longest text line: S3 record with 255 bytes, plus end of line
+//
+#define CCP_IMAGE_MAX_LINE                     (4 + 2 * 256 + 8)
+
+static int HexNibble(char Char)
+{
+	if (Char >= '0' && Char <= '9')
+		return Char - '0';
+	if (Char >= 'A' && Char <= 'F')
+		return Char - 'A' + 10;
+	if (Char >= 'a' && Char <= 'f')
+		return Char - 'a' + 10;
+	return -1;
+}
+
+// Decodes a string of hex digit pairs. Returns the byte count, or -1
+//
+static int HexDecode(const char *Text, BYTE *Bytes, int MaxCount)
+{
+	int count = 0, high, low;
+
+	while (Text[0])
+	{
+		high = HexNibble(Text[0]);
+		low = HexNibble(Text[1]);
+		if (high < 0 || low < 0 || count == MaxCount)
+			return -1;
+		Bytes[count++] = (BYTE)((high << 4) | low);
+		Text += 2;
+	}
+	return count;
+}
+
+CCcpImageReader::CCcpImageReader()
+	: m_File(NULL)
+	, m_Format(FormatUnknown)
+	, m_Base(0)
+	, m_End(false)
+	, m_Position(0)
+	, m_Size(0)
+{
+}
+
+CCcpImageReader::~CCcpImageReader()
+{
+	Close();
+}
+
+TCCPResult CCcpImageReader::Open(LPCSTR FileName)
+{
+	long size;
+
+	Close();
+	if (!FileName)
+		return CCP_ERROR_IMAGE_FILE;
+	m_File = fopen(FileName, "rb");
+	if (!m_File)
+		return CCP_ERROR_IMAGE_FILE;
+
+	if (fseek(m_File, 0, SEEK_END) == 0 && (size = ftell(m_File)) >= 0)
+		m_Size = (UINT64)size;
+	fseek(m_File, 0, SEEK_SET);
+
+	m_Format = FormatUnknown;
+	m_Base = 0;
+	m_End = false;
+	m_Position = 0;
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+void CCcpImageReader::Close()
+{
+	if (m_File)
+		fclose(m_File);
+	m_File = NULL;
+}
+
+TCCPResult CCcpImageReader::ReadRecord(DWORD *Addr, BYTE *Data, DWORD *Length)
+{
+	char line[CCP_IMAGE_MAX_LINE];
+	BYTE bytes[CCP_IMAGE_MAX_RECORD + 8];
+	TCCPResult result;
+	bool isData;
+	size_t size;
+	long position;
+	int count;
+
+	*Length = 0;
+	if (!m_File)
+		return CCP_ERROR_IMAGE_FILE;
+
+	while (!m_End)
+	{
+		if (!fgets(line, sizeof(line), m_File))
+		{
+			// A missing end record is tolerated
+			if (ferror(m_File))
+				return CCP_ERROR_IMAGE_FILE;
+			m_End = true;
+			break;
+		}
+		position = ftell(m_File);
+		if (position >= 0)
+			m_Position = (UINT64)position;
+
+		size = strlen(line);
+		if (size == sizeof(line) - 1 && line[size - 1] != '\n' && !feof(m_File))
+			return CCP_ERROR_IMAGE_FORMAT;
+		while (size && isspace((unsigned char)line[size - 1]))
+			line[--size] = '\0';
+		if (!size)
+			continue;
+
+		if (m_Format == FormatUnknown)
+			m_Format = line[0] == ':' ? FormatIntelHex : (line[0] == 'S' ? FormatSRecord : FormatUnknown);
+
+		if (m_Format == FormatIntelHex && line[0] == ':' && (size & 1))
+		{
+			count = HexDecode(&line[1], bytes, sizeof(bytes));
+			result = count < 0 ? CCP_ERROR_IMAGE_FORMAT : ParseIntelHex(bytes, count, Addr, Data, Length, &isData);
+		}
+		else if (m_Format == FormatSRecord && line[0] == 'S' && size >= 4 && !(size & 1))
+		{
+			count = HexDecode(&line[2], bytes, sizeof(bytes));
+			result = count < 0 ? CCP_ERROR_IMAGE_FORMAT : ParseSRecord(line[1], bytes, count, Addr, Data, Length, &isData);
+		}
+		else
+			result = CCP_ERROR_IMAGE_FORMAT;
+
+		if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+			return result;
+		if (isData && *Length)
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+
+	*Length = 0;
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpImageReader::ParseIntelHex(const BYTE *Bytes, int Count, DWORD *Addr, BYTE *Data, DWORD *Length, bool *IsData)
+{
+	BYTE sum = 0;
+	int length, i;
+
+	// LL AAAA TT [DD...] CC, all bytes summing up to 0
+	*IsData = false;
+	if (Count < 5 || Bytes[0] + 5 != Count)
+		return CCP_ERROR_IMAGE_FORMAT;
+	for (i = 0; i < Count; i++)
+		sum += Bytes[i];
+	if (sum != 0)
+		return CCP_ERROR_IMAGE_FORMAT;
+
+	length = Bytes[0];
+	switch (Bytes[3])
+	{
+		case 0x00:
+			*Addr = m_Base + (((DWORD)Bytes[1] << 8) | Bytes[2]);
+			memcpy(Data, &Bytes[4], length);
+			*Length = length;
+			*IsData = true;
+			break;
+
+		case 0x01:
+			m_End = true;
+			break;
+
+		case 0x02:
+			if (length != 2)
+				return CCP_ERROR_IMAGE_FORMAT;
+			m_Base = (((DWORD)Bytes[4] << 8) | Bytes[5]) << 4;
+			break;
+
+		case 0x04:
+			if (length != 2)
+				return CCP_ERROR_IMAGE_FORMAT;
+			m_Base = (((DWORD)Bytes[4] << 8) | Bytes[5]) << 16;
+			break;
+
+		case 0x03:
+		case 0x05:
+			// Start address: not relevant for programming
+			break;
+
+		default:
+			return CCP_ERROR_IMAGE_FORMAT;
+	}
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpImageReader::ParseSRecord(char Type, const BYTE *Bytes, int Count, DWORD *Addr, BYTE *Data, DWORD *Length, bool *IsData)
+{
+	BYTE sum = 0;
+	int addrSize, i;
+
+	// Sn CC [AAAA..] [DD...] KK, KK being the one's complement of the sum
+	*IsData = false;
+	if (Count < 2 || Bytes[0] + 1 != Count)
+		return CCP_ERROR_IMAGE_FORMAT;
+	for (i = 0; i < Count; i++)
+		sum += Bytes[i];
+	if (sum != 0xFF)
+		return CCP_ERROR_IMAGE_FORMAT;
+
+	switch (Type)
+	{
+		case '1': case '5': case '9': addrSize = 2; break;
+		case '2': case '6': case '8': addrSize = 3; break;
+		case '3': case '7': addrSize = 4; break;
+		case '0': addrSize = 2; break;
+		default: return CCP_ERROR_IMAGE_FORMAT;
+	}
+	if (Count < 1 + addrSize + 1)
+		return CCP_ERROR_IMAGE_FORMAT;
+
+	switch (Type)
+	{
+		case '1':
+		case '2':
+		case '3':
+			*Addr = 0;
+			for (i = 0; i < addrSize; i++)
+				*Addr = (*Addr << 8) | Bytes[1 + i];
+			*Length = Count - 2 - addrSize;
+			memcpy(Data, &Bytes[1 + addrSize], *Length);
+			*IsData = true;
+			break;
+
+		case '7':
+		case '8':
+		case '9':
+			m_End = true;
+			break;
+
+		default:
+			// S0 header, S5/S6 record count
+			break;
+	}
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
@@ -0,0 +1,63 @@
+//  CcpImageReader.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Streaming reader of Intel HEX and Motorola S-record memory images
+//
+//  ~~~~~~~~~~~~
+//
+//  Records are returned one at a time, so images of any size are read in
+//  constant memory. The format is detected from the first record.
+//
+#ifndef __CCPIMAGEREADERH__
+#define __CCPIMAGEREADERH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+#include <stdio.h>
+
+// Longest data record (Intel HEX and S-record byte counts are 8 bit)
+//
+#define CCP_IMAGE_MAX_RECORD                   255
+
+class CCcpImageReader
+{
+public:
+	CCcpImageReader();
+	~CCcpImageReader();
+
+	/// <summary>
+	/// Opens an image file
+	/// </summary>
+	/// <returns>CCP_ERROR_ACKNOWLEDGE_OK or CCP_ERROR_IMAGE_FILE</returns>
+	TCCPResult Open(LPCSTR FileName);
+	void Close();
+
+	/// <summary>
+	/// Reads the next data record
+	/// </summary>
+	/// <param name="Addr">Buffer for the absolute address of the data</param>
+	/// <param name="Data">Buffer for the data (at least CCP_IMAGE_MAX_RECORD bytes)</param>
+	/// <param name="Length">Buffer for the data length. 0 at the end of the image</param>
+	/// <returns>CCP_ERROR_ACKNOWLEDGE_OK, CCP_ERROR_IMAGE_FORMAT or CCP_ERROR_IMAGE_FILE</returns>
+	TCCPResult ReadRecord(DWORD *Addr, BYTE *Data, DWORD *Length);
+
+	UINT64 GetPosition() const { return m_Position; }
+	UINT64 GetSize() const { return m_Size; }
+
+private:
+	enum TFormat { FormatUnknown, FormatIntelHex, FormatSRecord };
+
+	TCCPResult ParseIntelHex(const BYTE *Bytes, int Count, DWORD *Addr, BYTE *Data, DWORD *Length, bool *IsData);
+	TCCPResult ParseSRecord(char Type, const BYTE *Bytes, int Count, DWORD *Addr, BYTE *Data, DWORD *Length, bool *IsData);
+
+	FILE *m_File;
+	TFormat m_Format;
+	DWORD m_Base;                                          // Intel HEX segment / linear base address
+	bool m_End;
+	UINT64 m_Position;
+	UINT64 m_Size;
+};
+
+#endif
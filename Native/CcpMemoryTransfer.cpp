@@ -0,0 +1,421 @@
+//  CcpMemoryTransfer.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Bulk memory transfers over a PCAN-CCP connection, built on the
+//  5/6 byte CCP memory commands
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpMemoryTransfer.h"
+#include "CcpProtocol.h"
+#include "CcpChecksum.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string.h>
+
+// SET_MTA followed by the UPLOAD commands reading a contiguous range
+//
+class CCcpUploadSource : public ICcpCommandSource
+{
+public:
+	CCcpUploadSource(BYTE *Buffer, DWORD Length, BYTE AddrExtension, DWORD Addr, bool IntelFormat)
+		: m_Buffer(Buffer), m_Length(Length), m_Requested(0), m_Received(0)
+		, m_SetMta(true), m_MtaExt(AddrExtension), m_MtaAddr(Addr), m_IntelFormat(IntelFormat)
+	{
+	}
+
+	virtual bool NextCommand(BYTE *Cro)
+	{
+		DWORD size = m_Length - m_Requested;
+
+		if (m_SetMta)
+		{
+			Cro[0] = CCP_CMD_SET_MTA;
+			Cro[2] = 0;
+			Cro[3] = m_MtaExt;
+			CcpPutDword(&Cro[4], m_MtaAddr, m_IntelFormat);
+			m_SetMta = false;
+			return true;
+		}
+
+		if (size == 0)
+			return false;
+		if (size > CCP_MAX_UPLOAD)
+			size = CCP_MAX_UPLOAD;
+		Cro[0] = CCP_CMD_UPLOAD;
+		Cro[2] = (BYTE)size;
+		m_Requested += size;
+		return true;
+	}
+
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm)
+	{
+		if (Cro[0] != CCP_CMD_UPLOAD)
+			return;
+		memcpy(m_Buffer + m_Received, &Crm[CCP_CRM_DATA_OFFSET], Cro[2]);
+		m_Received += Cro[2];
+	}
+
+	DWORD GetReceived() const { return m_Received; }
+
+private:
+	BYTE *m_Buffer;
+	DWORD m_Length;
+	DWORD m_Requested;
+	DWORD m_Received;
+	bool m_SetMta;
+	BYTE m_MtaExt;
+	DWORD m_MtaAddr;
+	bool m_IntelFormat;
+};
+
+// State of a CCcpMemoryTransfer::WriteAsync, alive until its completion
+//
+struct TCcpAsyncWrite
+{
+	std::vector<TCcpMemoryRange> Ranges;
+	std::unique_ptr<CCcpRangeWriteSource> Source;
+};
+
+static void FinishStats(TCCPTransferStats *Stats, std::chrono::steady_clock::time_point Start)
+{
+	UINT64 elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - Start).count();
+
+	Stats->ElapsedMicros = (DWORD)elapsed;
+	Stats->BytesPerSecond = elapsed ? (DWORD)((UINT64)Stats->Bytes * 1000000 / elapsed) : 0;
+}
+
+//------------------------------
+// CCcpRangeWriteSource
+//------------------------------
+
+CCcpRangeWriteSource::CCcpRangeWriteSource(const std::vector<TCcpMemoryRange> &Ranges, BYTE Code, BYTE Code6, bool IntelFormat)
+	: m_Ranges(Ranges), m_Code(Code), m_Code6(Code6), m_IntelFormat(IntelFormat)
+	, m_Range(0), m_Offset(0), m_MtaSet(false), m_Written(0), m_Mta0Ext(0), m_Mta0Addr(0)
+{
+}
+
+bool CCcpRangeWriteSource::NextCommand(BYTE *Cro)
+{
+	DWORD size;
+
+	// Empty ranges are skipped
+	while (m_Range < m_Ranges.size() && m_Offset == m_Ranges[m_Range].Data.size())
+	{
+		m_Range++;
+		m_Offset = 0;
+		m_MtaSet = false;
+	}
+	if (m_Range == m_Ranges.size())
+		return false;
+
+	const TCcpMemoryRange &range = m_Ranges[m_Range];
+	if (!m_MtaSet)
+	{
+		Cro[0] = CCP_CMD_SET_MTA;
+		Cro[2] = 0;
+		Cro[3] = range.Ext;
+		CcpPutDword(&Cro[4], range.Addr, m_IntelFormat);
+		m_MtaSet = true;
+		return true;
+	}
+
+	size = (DWORD)range.Data.size() - m_Offset;
+	if (size >= CCP_BLOCK_6)
+	{
+		Cro[0] = m_Code6;
+		memcpy(&Cro[2], &range.Data[m_Offset], CCP_BLOCK_6);
+		m_Offset += CCP_BLOCK_6;
+	}
+	else
+	{
+		Cro[0] = m_Code;
+		Cro[2] = (BYTE)size;
+		memcpy(&Cro[3], &range.Data[m_Offset], size);
+		m_Offset += size;
+	}
+	return true;
+}
+
+void CCcpRangeWriteSource::OnResponse(const BYTE *Cro, const BYTE *Crm)
+{
+	if (Cro[0] == CCP_CMD_SET_MTA)
+	{
+		m_Mta0Ext = Cro[3];
+		m_Mta0Addr = CcpGetDword(&Cro[4], m_IntelFormat);
+		return;
+	}
+	m_Written += Cro[0] == m_Code6 ? CCP_BLOCK_6 : Cro[2];
+	m_Mta0Ext = Crm[3];
+	m_Mta0Addr = CcpGetDword(&Crm[4], m_IntelFormat);
+}
+
+//------------------------------
+// CCcpMemoryTransfer
+//------------------------------
+
+CCcpMemoryTransfer::CCcpMemoryTransfer(CCcpSession *Session)
+	: m_Session(Session)
+{
+}
+
+TCCPResult CCcpMemoryTransfer::Read(BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, TCCPTransferStats *Stats, WORD TimeOut)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	TCCPTransferStats stats;
+	TCCPResult result;
+	DWORD commands;
+
+	if (!Buffer && Length)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	memset(&stats, 0, sizeof(stats));
+
+	// A single SHORT_UP is one round trip instead of SET_MTA + UPLOAD. It is
+	// optional in CCP 2.1: slaves without it get the MTA0 path
+	//
+	result = Length ? CCP_ERROR_UNKNOWN_COMMAND : CCP_ERROR_ACKNOWLEDGE_OK;
+	if (Length && Length <= CCP_MAX_UPLOAD)
+	{
+		result = m_Session->ShortUpload((BYTE)Length, AddrExtension, Addr, Buffer, TimeOut);
+		if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		{
+			stats.Bytes = Length;
+			stats.Commands = 1;
+		}
+	}
+
+	if (result == CCP_ERROR_UNKNOWN_COMMAND)
+	{
+		// SET_MTA and the UPLOADs form one sequence: no other command of the
+		// session can move MTA0 in between
+		CCcpUploadSource source(Buffer, Length, AddrExtension, Addr, m_Session->GetSlaveData().IntelFormat);
+
+		result = m_Session->CommandSequence(&source, TimeOut, &commands);
+		stats.Commands = commands;
+		stats.Bytes = source.GetReceived();
+		if (commands)
+			m_Session->SetMta0(AddrExtension, Addr + stats.Bytes);
+	}
+
+	if (Stats)
+	{
+		FinishStats(&stats, start);
+		*Stats = stats;
+	}
+	return result;
+}
+
+TCCPResult CCcpMemoryTransfer::Verify(BYTE ChecksumType, BYTE AddrExtension, DWORD Addr, DWORD Length, const BYTE *Expected, bool *Match, WORD TimeOut)
+{
+	CCcpChecksum checksum;
+	BYTE checksumData[4];
+	BYTE checksumSize;
+	TCCPResult result;
+
+	if (!Match || (!Expected && Length) || !checksum.Reset(ChecksumType, m_Session->GetSlaveData().IntelFormat))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	*Match = false;
+
+	result = m_Session->SetMemoryTransferAddress(0, AddrExtension, Addr, TimeOut);
+	if (result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return result;
+
+	checksum.Update(Expected, Length);
+	result = m_Session->BuildChecksum(Length, checksumData, &checksumSize, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		*Match = checksum.Matches(checksumData, checksumSize);
+	return result;
+}
+
+bool CCcpMemoryTransfer::MergeBlocks(const TCCPMemoryBlock *Blocks, DWORD Count, std::vector<TCcpMemoryRange> &Ranges)
+{
+	std::vector<DWORD> order(Count);
+	size_t first, last, i;
+	UINT64 end;
+
+	Ranges.clear();
+	for (i = 0; i < Count; i++)
+	{
+		if ((Blocks[i].Length && !Blocks[i].Data) || (UINT64)Blocks[i].Addr + Blocks[i].Length > 0x100000000ULL)
+			return false;
+		order[i] = (DWORD)i;
+	}
+
+	std::stable_sort(order.begin(), order.end(), [Blocks](DWORD A, DWORD B)
+	{
+		if (Blocks[A].AddrExtension != Blocks[B].AddrExtension)
+			return Blocks[A].AddrExtension < Blocks[B].AddrExtension;
+		return Blocks[A].Addr < Blocks[B].Addr;
+	});
+
+	for (first = 0; first < order.size(); first = last)
+	{
+		const TCCPMemoryBlock &head = Blocks[order[first]];
+		TCcpMemoryRange range;
+
+		// Blocks touching or overlapping the growing range join it
+		end = (UINT64)head.Addr + head.Length;
+		for (last = first + 1; last < order.size(); last++)
+		{
+			const TCCPMemoryBlock &block = Blocks[order[last]];
+
+			if (block.AddrExtension != head.AddrExtension || block.Addr > end)
+				break;
+			end = std::max(end, (UINT64)block.Addr + block.Length);
+		}
+
+		range.Ext = head.AddrExtension;
+		range.Addr = head.Addr;
+		range.Data.resize((size_t)(end - head.Addr));
+
+		// Copied in the caller's order, so the block given last wins
+		std::sort(order.begin() + first, order.begin() + last);
+		for (i = first; i < last; i++)
+		{
+			const TCCPMemoryBlock &block = Blocks[order[i]];
+
+			if (block.Length)
+				memcpy(&range.Data[block.Addr - range.Addr], block.Data, block.Length);
+		}
+		if (!range.Data.empty())
+			Ranges.push_back(range);
+	}
+	return true;
+}
+
+TCCPResult CCcpMemoryTransfer::Write(const TCCPMemoryBlock *Blocks, DWORD Count, TCCPTransferStats *Stats, WORD TimeOut)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<TCcpMemoryRange> ranges;
+	TCCPTransferStats stats;
+	TCCPResult result;
+	BYTE mta0Ext;
+	DWORD mta0Addr;
+
+	if ((!Blocks && Count) || !MergeBlocks(Blocks, Count, ranges))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	memset(&stats, 0, sizeof(stats));
+	{
+		CCcpRangeWriteSource source(ranges, CCP_CMD_DNLOAD, CCP_CMD_DNLOAD_6, m_Session->GetSlaveData().IntelFormat);
+
+		result = m_Session->CommandSequence(&source, TimeOut, &stats.Commands);
+		stats.Bytes = source.GetWritten();
+		if (stats.Commands)
+		{
+			source.GetMta0(&mta0Ext, &mta0Addr);
+			m_Session->SetMta0(mta0Ext, mta0Addr);
+		}
+	}
+
+	if (Stats)
+	{
+		FinishStats(&stats, start);
+		*Stats = stats;
+	}
+	return result;
+}
+
+TCCPResult CCcpMemoryTransfer::ReadAsync(BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, WORD TimeOut, const TCcpTransferCompletion &Completion)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CCcpSession *session = m_Session;
+	TCCPTransferStats stats;
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SHORT_UP};
+
+	if (!Buffer || !Length)
+	{
+		if (Length)
+			return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+		memset(&stats, 0, sizeof(stats));
+		Completion(CCP_ERROR_ACKNOWLEDGE_OK, &stats);
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+	if (Length > CCP_MAX_UPLOAD)
+	{
+		UploadAsync(m_Session, AddrExtension, Addr, Length, Buffer, TimeOut, start, Completion);
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+
+	// As Read: a single SHORT_UP, the MTA0 path for slaves without it
+	cro[2] = (BYTE)Length;
+	cro[3] = AddrExtension;
+	CcpPutDword(&cro[4], Addr, m_Session->GetSlaveData().IntelFormat);
+	m_Session->CommandAsync(cro, TimeOut, [session, start, AddrExtension, Addr, Length, Buffer, TimeOut, Completion](TCCPResult Result, const BYTE *Crm, DWORD)
+	{
+		TCCPTransferStats stats;
+
+		if (Result == CCP_ERROR_UNKNOWN_COMMAND)
+		{
+			UploadAsync(session, AddrExtension, Addr, Length, Buffer, TimeOut, start, Completion);
+			return;
+		}
+		memset(&stats, 0, sizeof(stats));
+		if (Result == CCP_ERROR_ACKNOWLEDGE_OK)
+		{
+			memcpy(Buffer, &Crm[CCP_CRM_DATA_OFFSET], Length);
+			stats.Bytes = Length;
+			stats.Commands = 1;
+		}
+		FinishStats(&stats, start);
+		Completion(Result, &stats);
+	});
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+void CCcpMemoryTransfer::UploadAsync(CCcpSession *Session, BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, WORD TimeOut,
+	std::chrono::steady_clock::time_point Start, const TCcpTransferCompletion &Completion)
+{
+	std::shared_ptr<CCcpUploadSource> source;
+
+	// SET_MTA and the UPLOADs form one sequence: no other command of the
+	// session can move MTA0 in between
+	source = std::make_shared<CCcpUploadSource>(Buffer, Length, AddrExtension, Addr, Session->GetSlaveData().IntelFormat);
+	Session->CommandSequenceAsync(source.get(), TimeOut, [source, Session, Start, AddrExtension, Addr, Completion](TCCPResult Result, const BYTE*, DWORD Commands)
+	{
+		TCCPTransferStats stats;
+
+		memset(&stats, 0, sizeof(stats));
+		stats.Commands = Commands;
+		stats.Bytes = source->GetReceived();
+		if (Commands)
+			Session->SetMta0(AddrExtension, Addr + stats.Bytes);
+		FinishStats(&stats, Start);
+		Completion(Result, &stats);
+	});
+}
+
+TCCPResult CCcpMemoryTransfer::WriteAsync(const TCCPMemoryBlock *Blocks, DWORD Count, WORD TimeOut, const TCcpTransferCompletion &Completion)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::shared_ptr<TCcpAsyncWrite> write = std::make_shared<TCcpAsyncWrite>();
+	CCcpSession *session = m_Session;
+
+	// The data is copied here: the blocks may be released once this returns
+	if ((!Blocks && Count) || !MergeBlocks(Blocks, Count, write->Ranges))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	write->Source.reset(new CCcpRangeWriteSource(write->Ranges, CCP_CMD_DNLOAD, CCP_CMD_DNLOAD_6, m_Session->GetSlaveData().IntelFormat));
+	m_Session->CommandSequenceAsync(write->Source.get(), TimeOut, [write, session, start, Completion](TCCPResult Result, const BYTE*, DWORD Commands)
+	{
+		TCCPTransferStats stats;
+		BYTE mta0Ext;
+		DWORD mta0Addr;
+
+		memset(&stats, 0, sizeof(stats));
+		stats.Commands = Commands;
+		stats.Bytes = write->Source->GetWritten();
+		if (Commands)
+		{
+			write->Source->GetMta0(&mta0Ext, &mta0Addr);
+			session->SetMta0(mta0Ext, mta0Addr);
+		}
+		FinishStats(&stats, start);
+		Completion(Result, &stats);
+	});
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
@@ -0,0 +1,145 @@
+//  CcpMemoryTransfer.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Bulk memory transfers over a PCAN-CCP connection, built on the
+//  5/6 byte CCP memory commands
+//
+//  ~~~~~~~~~~~~
+//
+#ifndef __CCPMEMORYTRANSFERH__
+#define __CCPMEMORYTRANSFERH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpSession.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+// A contiguous range of slave memory
+//
+typedef struct
+{
+	BYTE Ext;
+	DWORD Addr;
+	std::vector<BYTE> Data;
+}TCcpMemoryRange;
+
+// Completion of an asynchronous memory transfer, called once in the context
+// of the channel receive thread (see TCcpCompletion)
+//
+typedef std::function<void(TCCPResult Result, const TCCPTransferStats *Stats)> TCcpTransferCompletion;
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+// SET_MTA + data commands for each range: full 6 byte chunks with the _6
+// command, the rest with the sized one (DNLOAD/DNLOAD_6 or PROGRAM/PROGRAM_6)
+//
+class CCcpRangeWriteSource : public ICcpCommandSource
+{
+public:
+	CCcpRangeWriteSource(const std::vector<TCcpMemoryRange> &Ranges, BYTE Code, BYTE Code6, bool IntelFormat);
+
+	virtual bool NextCommand(BYTE *Cro);
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm);
+
+	/// <summary>
+	/// Data bytes acknowledged by the slave
+	/// </summary>
+	DWORD GetWritten() const { return m_Written; }
+
+	/// <summary>
+	/// MTA0 as reported by the last acknowledged command
+	/// </summary>
+	void GetMta0(BYTE *Ext, DWORD *Addr) const { *Ext = m_Mta0Ext; *Addr = m_Mta0Addr; }
+
+private:
+	const std::vector<TCcpMemoryRange> &m_Ranges;
+	BYTE m_Code;
+	BYTE m_Code6;
+	bool m_IntelFormat;
+	size_t m_Range;
+	DWORD m_Offset;
+	bool m_MtaSet;
+	DWORD m_Written;
+	BYTE m_Mta0Ext;
+	DWORD m_Mta0Addr;
+};
+
+class CCcpMemoryTransfer
+{
+public:
+	explicit CCcpMemoryTransfer(CCcpSession *Session);
+
+	/// <summary>
+	/// Reads a memory range of any length (see CCP_ReadMemory)
+	/// </summary>
+	/// <param name="AddrExtension">Address extension of the range</param>
+	/// <param name="Addr">Start address of the range</param>
+	/// <param name="Length">Size of the range, in bytes</param>
+	/// <param name="Buffer">Buffer for the data</param>
+	/// <param name="Stats">Buffer for the transfer figures (may be NULL)</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult Read(BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, TCCPTransferStats *Stats, WORD TimeOut);
+
+	/// <summary>
+	/// Writes a scatter list of memory blocks (see CCP_WriteMemory)
+	/// </summary>
+	/// <param name="Blocks">The blocks to be written</param>
+	/// <param name="Count">Number of blocks</param>
+	/// <param name="Stats">Buffer for the transfer figures (may be NULL)</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult Write(const TCCPMemoryBlock *Blocks, DWORD Count, TCCPTransferStats *Stats, WORD TimeOut);
+
+	/// <summary>
+	/// Queues the read of a memory range (SHORT_UP, or SET_MTA + UPLOADs) and
+	/// returns at once. The buffer must stay valid until the completion is called
+	/// </summary>
+	/// <returns>CCP_ERROR_ACKNOWLEDGE_OK if queued (the completion follows), else the error</returns>
+	TCCPResult ReadAsync(BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, WORD TimeOut, const TCcpTransferCompletion &Completion);
+
+	/// <summary>
+	/// Queues the write of a scatter list of memory blocks and returns at once.
+	/// The data of the blocks is copied
+	/// </summary>
+	/// <returns>CCP_ERROR_ACKNOWLEDGE_OK if queued (the completion follows), else the error</returns>
+	TCCPResult WriteAsync(const TCCPMemoryBlock *Blocks, DWORD Count, WORD TimeOut, const TCcpTransferCompletion &Completion);
+
+	/// <summary>
+	/// Compares a memory range with the expected data through BUILD_CHKSUM (see CCP_VerifyMemory)
+	/// </summary>
+	/// <param name="ChecksumType">Checksum type implemented by the slave (CCP_CHECKSUM_*)</param>
+	/// <param name="AddrExtension">Address extension of the range</param>
+	/// <param name="Addr">Start address of the range</param>
+	/// <param name="Length">Size of the range, in bytes</param>
+	/// <param name="Expected">The data expected in the range</param>
+	/// <param name="Match">Buffer for the comparison result</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult Verify(BYTE ChecksumType, BYTE AddrExtension, DWORD Addr, DWORD Length, const BYTE *Expected, bool *Match, WORD TimeOut);
+
+	/// <summary>
+	/// Sorts the blocks by address and merges adjacent or overlapping ones.
+	/// On overlaps, the block given last wins
+	/// </summary>
+	/// <returns>False if a block is invalid (no data, or past the 32 bit address space)</returns>
+	static bool MergeBlocks(const TCCPMemoryBlock *Blocks, DWORD Count, std::vector<TCcpMemoryRange> &Ranges);
+
+private:
+	static void UploadAsync(CCcpSession *Session, BYTE AddrExtension, DWORD Addr, DWORD Length, BYTE *Buffer, WORD TimeOut,
+		std::chrono::steady_clock::time_point Start, const TCcpTransferCompletion &Completion);
+
+	CCcpSession *m_Session;
+};
+
+#endif
@@ -0,0 +1,83 @@
+//  CcpMsgRing.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Receive queue of a connection: a preallocated single producer / single
+//  consumer ring of messages and their receive times
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpMsgRing.h"
+
+#include <new>
+#include <string.h>
+
+CCcpMsgRing::CCcpMsgRing(DWORD Capacity)
+	: m_Head(0)
+	, m_Tail(0)
+{
+	DWORD slots = 1;
+
+	while (slots < Capacity)
+		slots <<= 1;
+	m_Mask = slots - 1;
+	m_Capacity = Capacity ? Capacity : 1;
+
+	// Whole cache lines, so no neighbouring data shares the ends of the buffers
+	m_Msgs = static_cast<TCCPMsg *>(::operator new(sizeof(TCCPMsg) * slots, std::align_val_t(CCP_CACHE_LINE)));
+	m_Stamps = static_cast<UINT64 *>(::operator new(sizeof(UINT64) * slots, std::align_val_t(CCP_CACHE_LINE)));
+	memset(m_Msgs, 0, sizeof(TCCPMsg) * slots);
+	memset(m_Stamps, 0, sizeof(UINT64) * slots);
+}
+
+CCcpMsgRing::~CCcpMsgRing()
+{
+	::operator delete(m_Msgs, std::align_val_t(CCP_CACHE_LINE));
+	::operator delete(m_Stamps, std::align_val_t(CCP_CACHE_LINE));
+}
+
+DWORD CCcpMsgRing::Peek(TCCPMsgSpan *Spans)
+{
+	UINT64 tail = m_Tail.load(std::memory_order_relaxed);
+	DWORD count = (DWORD)(m_Head.load(std::memory_order_acquire) - tail);
+	DWORD slot = (DWORD)tail & m_Mask;
+	DWORD first = count < m_Mask + 1 - slot ? count : m_Mask + 1 - slot;
+
+	// The messages up to the end of the buffer, then those from its start
+	Spans[0].Msgs = &m_Msgs[slot];
+	Spans[0].Timestamps = &m_Stamps[slot];
+	Spans[0].Count = first;
+	Spans[1].Msgs = m_Msgs;
+	Spans[1].Timestamps = m_Stamps;
+	Spans[1].Count = count - first;
+	return count;
+}
+
+bool CCcpMsgRing::Release(DWORD Count)
+{
+	UINT64 tail = m_Tail.load(std::memory_order_relaxed);
+
+	if (Count > m_Head.load(std::memory_order_acquire) - tail)
+		return false;
+	m_Tail.store(tail + Count, std::memory_order_release);
+	return true;
+}
+
+DWORD CCcpMsgRing::Read(TCCPMsg *Msgs, UINT64 *Stamps, DWORD Count)
+{
+	TCCPMsgSpan spans[CCP_MSG_SPANS];
+	DWORD read = 0;
+
+	Peek(spans);
+	for (int i = 0; i < CCP_MSG_SPANS && read < Count; i++)
+	{
+		DWORD count = spans[i].Count < Count - read ? spans[i].Count : Count - read;
+
+		memcpy(&Msgs[read], spans[i].Msgs, sizeof(TCCPMsg) * count);
+		if (Stamps)
+			memcpy(&Stamps[read], spans[i].Timestamps, sizeof(UINT64) * count);
+		read += count;
+	}
+	Release(read);
+	return read;
+}
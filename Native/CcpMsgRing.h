@@ -0,0 +1,117 @@
+//  CcpMsgRing.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Receive queue of a connection: a preallocated single producer / single
+//  consumer ring of messages and their receive times
+//
+//  ~~~~~~~~~~~~
+//
+//  The channel receive thread is the only producer, the readers of the
+//  connection (serialized by the session) the only consumer. Each side owns
+//  one index, kept on a cache line of its own, and only reads the other:
+//  neither side ever waits for the other. A full ring refuses the new
+//  message, which the caller counts as lost.
+//
+#ifndef __CCPMSGRINGH__
+#define __CCPMSGRINGH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+#include <atomic>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define CCP_CACHE_LINE                         64        // Bytes of a cache line, to keep the indexes apart
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+class CCcpMsgRing
+{
+public:
+	/// <summary>
+	/// Allocates a ring for Capacity messages (at least 1)
+	/// </summary>
+	CCcpMsgRing(DWORD Capacity);
+	CCcpMsgRing(const CCcpMsgRing&) = delete;
+	~CCcpMsgRing();
+	CCcpMsgRing &operator=(const CCcpMsgRing&) = delete;
+
+	/// <summary>
+	/// Queues a message. Called by the producer only
+	/// </summary>
+	/// <param name="Nanos">Receive time of the message</param>
+	/// <returns>The messages waiting including this one, 0 if the ring is full</returns>
+	DWORD Push(const TCCPMsg &Msg, UINT64 Nanos)
+	{
+		UINT64 head = m_Head.load(std::memory_order_relaxed);
+		UINT64 fill = head - m_Tail.load(std::memory_order_acquire);
+		DWORD slot;
+
+		if (fill >= m_Capacity)
+			return 0;
+		slot = (DWORD)head & m_Mask;
+		m_Msgs[slot] = Msg;
+		m_Stamps[slot] = Nanos;
+		m_Head.store(head + 1, std::memory_order_release);
+		return (DWORD)fill + 1;
+	}
+
+	/// <summary>
+	/// Returns the messages waiting as up to CCP_MSG_SPANS contiguous spans,
+	/// without taking them from the ring. Called by the consumer only
+	/// </summary>
+	/// <returns>Number of messages in the spans</returns>
+	DWORD Peek(TCCPMsgSpan *Spans);
+
+	/// <summary>
+	/// Takes the first Count messages returned by Peek from the ring
+	/// </summary>
+	/// <returns>False if fewer messages are waiting</returns>
+	bool Release(DWORD Count);
+
+	/// <summary>
+	/// Moves up to Count messages out of the ring. Called by the consumer only
+	/// </summary>
+	/// <param name="Stamps">Buffer for the receive times (may be NULL)</param>
+	/// <returns>Number of messages read</returns>
+	DWORD Read(TCCPMsg *Msgs, UINT64 *Stamps, DWORD Count);
+
+	/// <summary>
+	/// Discards the messages waiting. Called by the consumer only
+	/// </summary>
+	void Clear() { m_Tail.store(m_Head.load(std::memory_order_acquire), std::memory_order_release); }
+
+	/// <summary>
+	/// Returns the messages waiting (any thread: a recent value)
+	/// </summary>
+	DWORD GetFill() const
+	{
+		// The tail first: the head read later is never behind it
+		UINT64 tail = m_Tail.load(std::memory_order_acquire);
+
+		return (DWORD)(m_Head.load(std::memory_order_acquire) - tail);
+	}
+
+	DWORD GetCapacity() const { return m_Capacity; }
+
+private:
+	// Written by the producer
+	alignas(CCP_CACHE_LINE) std::atomic<UINT64> m_Head;
+
+	// Written by the consumer
+	alignas(CCP_CACHE_LINE) std::atomic<UINT64> m_Tail;
+
+	// Read only
+	alignas(CCP_CACHE_LINE) TCCPMsg *m_Msgs;
+	UINT64 *m_Stamps;
+	DWORD m_Mask;                                          // Slots - 1 (slots: Capacity rounded up to a power of 2)
+	DWORD m_Capacity;
+};
+
+#endif
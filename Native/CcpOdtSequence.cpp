@@ -0,0 +1,87 @@
+//  CcpOdtSequence.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  ODT sequence of the DAQ lists of a connection: where each DTO falls in
+//  the cycle of its list
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpOdtSequence.h"
+#include "CcpDaqConfig.h"
+
+#include <string.h>
+
+CCcpOdtSequence::CCcpOdtSequence(const TCcpDaqLayout *Layout)
+{
+	memset(m_PidList, CCP_ODT_NO_LIST, sizeof(m_PidList));
+	memset(m_PidOdt, 0, sizeof(m_PidOdt));
+	memset(&m_Step, 0, sizeof(m_Step));
+
+	for (size_t i = 0; Layout && i < Layout->Lists.size() && i < CCP_ODT_NO_LIST; i++)
+	{
+		const TCcpDaqList &layout = Layout->Lists[i];
+		TList list;
+
+		list.LastOdt = (BYTE)(layout.Odts.empty() ? 0 : layout.Odts.size() - 1);
+		list.Open = false;
+		list.Skipping = false;
+		list.NextOdt = 0;
+		list.Cycle = 0;
+		for (size_t odt = 0; odt < layout.Odts.size(); odt++)
+		{
+			m_PidList[(BYTE)(layout.FirstPid + odt)] = (BYTE)i;
+			m_PidOdt[(BYTE)(layout.FirstPid + odt)] = (BYTE)odt;
+		}
+		m_Lists.push_back(list);
+	}
+}
+
+void CCcpOdtSequence::Restart()
+{
+	for (size_t i = 0; i < m_Lists.size(); i++)
+	{
+		m_Lists[i].Open = false;
+		m_Lists[i].Skipping = false;
+	}
+}
+
+const TCcpOdtStep &CCcpOdtSequence::OnDto(BYTE Pid)
+{
+	m_Step.List = m_PidList[Pid];
+	m_Step.Odt = m_PidOdt[Pid];
+	m_Step.Flags = 0;
+	m_Step.Cycle = 0;
+	if (m_Step.List == CCP_ODT_NO_LIST)
+		return m_Step;
+
+	TList &list = m_Lists[m_Step.List];
+
+	if (m_Step.Odt == 0)
+	{
+		// A new cycle ends the one still open
+		m_Step.Flags = CCP_ODT_BEGIN | (list.Open ? CCP_ODT_CUT : 0);
+		list.Open = true;
+		list.Skipping = false;
+		list.Cycle++;
+	}
+	else if (m_Step.Odt != list.NextOdt || !list.Open)
+	{
+		// ODT lost or out of order: the rest of the cycle is worthless. A
+		// cycle whose ODT 0 was lost is reported at its first ODT
+		m_Step.Flags = list.Open ? CCP_ODT_TORN : list.Skipping ? CCP_ODT_SKIP : CCP_ODT_ORPHAN;
+		m_Step.Cycle = list.Cycle;
+		list.Open = false;
+		list.Skipping = true;
+		return m_Step;
+	}
+
+	m_Step.Cycle = list.Cycle;
+	list.NextOdt = m_Step.Odt + 1;
+	if (m_Step.Odt == list.LastOdt)
+	{
+		m_Step.Flags |= CCP_ODT_END;
+		list.Open = false;
+	}
+	return m_Step;
+}
@@ -0,0 +1,98 @@
+//  CcpOdtSequence.h
+//
+//  ~~~~~~~~~~~~
+//
+//  ODT sequence of the DAQ lists of a connection: where each DTO falls in
+//  the cycle of its list
+//
+//  ~~~~~~~~~~~~
+//
+//  One sequence per DAQ layout, kept by the DAQ monitor and fed by the
+//  receive thread for each DTO. The monitor and the reassembly stage both
+//  count the cycles from the steps it returns, so their counts cannot drift
+//  apart: a cycle cut short by the next ODT 0 is Incomplete for the
+//  reassembly and torn for the monitor, an ODT missing or out of order is
+//  Torn for both. A cycle whose ODT 0 was lost is Torn for the reassembly
+//  only: the monitor sees it as a lost cycle (gap between two ODT 0).
+//
+#ifndef __CCPODTSEQUENCEH__
+#define __CCPODTSEQUENCEH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define CCP_ODT_BEGIN                          0x01      // ODT 0: a cycle begins
+#define CCP_ODT_END                            0x02      // Last ODT, all of the cycle in order: the cycle is complete
+#define CCP_ODT_CUT                            0x04      // ODT 0 came before the last ODT of the cycle open, which is dropped
+#define CCP_ODT_TORN                           0x08      // ODT missing or out of order: the cycle open is dropped
+#define CCP_ODT_ORPHAN                         0x10      // First ODT of a cycle whose ODT 0 was lost: the cycle is dropped
+#define CCP_ODT_SKIP                           0x20      // ODT of a cycle already dropped
+
+#define CCP_ODT_DROPPED                        (CCP_ODT_TORN | CCP_ODT_ORPHAN | CCP_ODT_SKIP)
+
+#define CCP_ODT_NO_LIST                        0xFF      // TCcpOdtStep.List of a PID no list of the layout uses
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+struct TCcpDaqLayout;
+
+// Where a DTO falls in the cycle of its list
+//
+typedef struct
+{
+	BYTE List;                                             // Index of the list in TCcpDaqLayout.Lists, CCP_ODT_NO_LIST if none
+	BYTE Odt;                                              // ODT of the DTO in its list
+	BYTE Flags;                                            // CCP_ODT_* flags
+	DWORD Cycle;                                           // Cycles begun by the list up to this DTO
+}TCcpOdtStep;
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+class CCcpOdtSequence
+{
+public:
+	/// <summary>
+	/// Follows the lists of a DAQ layout (NULL: none)
+	/// </summary>
+	CCcpOdtSequence(const TCcpDaqLayout *Layout);
+
+	/// <summary>
+	/// Leaves the cycle open of each list, without counting it as dropped: a
+	/// DAQ restart ends the cycles of the last measurement. Receive thread only
+	/// </summary>
+	void Restart();
+
+	/// <summary>
+	/// Places a DTO in the cycle of its list. Receive thread only
+	/// </summary>
+	/// <param name="Pid">The PID of the DTO</param>
+	/// <returns>The step, valid until the next call</returns>
+	const TCcpOdtStep &OnDto(BYTE Pid);
+
+private:
+	struct TList
+	{
+		BYTE LastOdt;
+		bool Open;                                         // ODT 0 received, last ODT not yet
+		bool Skipping;                                     // A dropped cycle is still arriving
+		BYTE NextOdt;
+		DWORD Cycle;
+	};
+
+	std::vector<TList> m_Lists;                            // One per list of the layout
+	BYTE m_PidList[256];                                   // Index in m_Lists of the list of each PID, CCP_ODT_NO_LIST if none
+	BYTE m_PidOdt[256];
+	TCcpOdtStep m_Step;
+};
+
+#endif
@@ -0,0 +1,225 @@
+//  CcpProtocol.h
+//
+//  ~~~~~~~~~~~~
+//
+//  CCP 2.1 wire format: command codes, packet layout and byte order helpers
+//
+//  ~~~~~~~~~~~~
+//
+//  CRO (Command Receive Object, master -> slave):
+//      [CMD] [CTR] [parameters (6 bytes)]
+//  DTO (Data Transmission Object, slave -> master):
+//      [PID=0xFF] [ERR] [CTR] [return data (5 bytes)]   Command Return Message
+//      [PID=0xFE] [ERR] [data (6 bytes)]                Event Message
+//      [PID=0..0xFD] [data (7 bytes)]                   DAQ Message (ODT)
+//
+#ifndef __CCPPROTOCOLH__
+#define __CCPPROTOCOLH__
+
+#include "WinTypes.h"
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+// CRO command codes
+//
+#define CCP_CMD_CONNECT                        0x01
+#define CCP_CMD_SET_MTA                        0x02
+#define CCP_CMD_DNLOAD                         0x03
+#define CCP_CMD_UPLOAD                         0x04
+#define CCP_CMD_TEST                           0x05
+#define CCP_CMD_START_STOP                     0x06
+#define CCP_CMD_DISCONNECT                     0x07
+#define CCP_CMD_START_STOP_ALL                 0x08
+#define CCP_CMD_GET_ACTIVE_CAL_PAGE            0x09
+#define CCP_CMD_SET_S_STATUS                   0x0C
+#define CCP_CMD_GET_S_STATUS                   0x0D
+#define CCP_CMD_BUILD_CHKSUM                   0x0E
+#define CCP_CMD_SHORT_UP                       0x0F
+#define CCP_CMD_CLEAR_MEMORY                   0x10
+#define CCP_CMD_SELECT_CAL_PAGE                0x11
+#define CCP_CMD_GET_SEED                       0x12
+#define CCP_CMD_UNLOCK                         0x13
+#define CCP_CMD_GET_DAQ_SIZE                   0x14
+#define CCP_CMD_SET_DAQ_PTR                    0x15
+#define CCP_CMD_WRITE_DAQ                      0x16
+#define CCP_CMD_EXCHANGE_ID                    0x17
+#define CCP_CMD_PROGRAM                        0x18
+#define CCP_CMD_MOVE                           0x19
+#define CCP_CMD_GET_CCP_VERSION                0x1B
+#define CCP_CMD_DIAG_SERVICE                   0x20
+#define CCP_CMD_ACTION_SERVICE                 0x21
+#define CCP_CMD_PROGRAM_6                      0x22
+#define CCP_CMD_DNLOAD_6                       0x23
+
+// DTO packet identifiers
+//
+#define CCP_PID_CRM                            0xFF      // Command Return Message
+#define CCP_PID_EVENT                          0xFE      // Event Message
+#define CCP_PID_DAQ_MAX                        0xFD      // Highest PID usable by a DAQ ODT
+
+// Packet layout
+//
+#define CCP_PACKET_SIZE                        8         // CRO and DTO are always 8 bytes
+#define CCP_CRO_PARAM_OFFSET                   2         // First parameter byte within a CRO
+#define CCP_CRM_DATA_OFFSET                    3         // First return data byte within a CRM
+#define CCP_CRM_DATA_SIZE                      5         // Return data bytes within a CRM
+#define CCP_ODT_DATA_SIZE                      7         // Data bytes within a DAQ DTO
+#define CCP_MAX_UPLOAD                         5         // Max. bytes of an UPLOAD / SHORT_UP
+#define CCP_MAX_DNLOAD                         5         // Max. bytes of a DNLOAD / PROGRAM
+#define CCP_BLOCK_6                            6         // Bytes of a DNLOAD_6 / PROGRAM_6
+#define CCP_SEED_SIZE                          4         // Seed bytes of a GET_SEED CRM
+#define CCP_MAX_KEY_SIZE                       6         // Max. key bytes of an UNLOCK
+
+// Protected resources (CCP_RSM_* of PCCP.h), unlocked in this order
+//
+#define CCP_RSM_ALL                            (CCP_RSM_CALIBRATION | CCP_RSM_DATA_ADQUISITION | CCP_RSM_MEMORY_PROGRAMMING)
+#define CCP_RSM_COUNT                          3
+
+// Default command timeouts (millis), used when a caller passes TimeOut = 0.
+// The CCP 2.1 specification allows up to 25 ms for most commands; a margin
+// is added for USB adapters and gateways. Flash and checksum commands may run
+// for seconds on the slave
+//
+#define CCP_DEFAULT_TIMEOUT                    100
+#define CCP_DEFAULT_LONG_TIMEOUT               30000
+
+// Maps a PCAN-Basic TPCANStatus to a TCCPResult (see CCP_ERROR_PCAN in PCCP.h)
+//
+#define CCP_RESULT_PCAN(Status)                (CCP_ERROR_PCAN | (DWORD)(Status))
+
+// Result returned for an unknown or already released TCCPHandle
+//
+#define CCP_RESULT_ILLHANDLE                   CCP_RESULT_PCAN(PCAN_ERROR_ILLCLIENT)
+
+// The 29-bit flag of TCCPSlaveData::IdCRO / IdDTO
+//
+#define CCP_ID_EXTENDED                        0x80000000U
+#define CCP_ID_MASK                            0x1FFFFFFFU
+
+////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////
+
+/// <summary>
+/// Returns the default timeout of a CRO command, used when TimeOut is zero
+/// </summary>
+inline DWORD CcpDefaultTimeout(BYTE Command)
+{
+	switch (Command)
+	{
+		case CCP_CMD_CLEAR_MEMORY:
+		case CCP_CMD_PROGRAM:
+		case CCP_CMD_PROGRAM_6:
+		case CCP_CMD_BUILD_CHKSUM:
+		case CCP_CMD_MOVE:
+		case CCP_CMD_DIAG_SERVICE:
+		case CCP_CMD_ACTION_SERVICE:
+			return CCP_DEFAULT_LONG_TIMEOUT;
+		default:
+			return CCP_DEFAULT_TIMEOUT;
+	}
+}
+
+// How a command that got no answer may be sent again (see CcpGetRetryMode)
+//
+enum TCcpRetryMode
+{
+	CcpRetryNone,                                          // Not idempotent: never resent
+	CcpRetryResend,                                        // Idempotent: resent as is
+	CcpRetryRestoreMta                                     // Moves MTA0: resent after a SET_MTA back to its start
+};
+
+/// <summary>
+/// Returns whether a short command can be resent after a lost CRO or CRM.
+/// Long running commands (flash, checksum, services) are never resent
+/// </summary>
+inline TCcpRetryMode CcpGetRetryMode(BYTE Command)
+{
+	switch (Command)
+	{
+		case CCP_CMD_CONNECT:
+		case CCP_CMD_SET_MTA:
+		case CCP_CMD_TEST:
+		case CCP_CMD_START_STOP:
+		case CCP_CMD_START_STOP_ALL:
+		case CCP_CMD_GET_ACTIVE_CAL_PAGE:
+		case CCP_CMD_SET_S_STATUS:
+		case CCP_CMD_GET_S_STATUS:
+		case CCP_CMD_SHORT_UP:
+		case CCP_CMD_SELECT_CAL_PAGE:
+		case CCP_CMD_GET_SEED:
+		case CCP_CMD_GET_DAQ_SIZE:
+		case CCP_CMD_SET_DAQ_PTR:
+		case CCP_CMD_EXCHANGE_ID:
+		case CCP_CMD_GET_CCP_VERSION:
+			return CcpRetryResend;
+		case CCP_CMD_UPLOAD:
+		case CCP_CMD_DNLOAD:
+		case CCP_CMD_DNLOAD_6:
+			return CcpRetryRestoreMta;
+		default:
+			return CcpRetryNone;
+	}
+}
+
+/// <summary>
+/// Writes a 16 bit value in the byte order of the slave
+/// </summary>
+inline void CcpPutWord(BYTE *Buffer, WORD Value, bool IntelFormat)
+{
+	if (IntelFormat)
+	{
+		Buffer[0] = (BYTE)Value;
+		Buffer[1] = (BYTE)(Value >> 8);
+	}
+	else
+	{
+		Buffer[0] = (BYTE)(Value >> 8);
+		Buffer[1] = (BYTE)Value;
+	}
+}
+
+/// <summary>
+/// Writes a 32 bit value in the byte order of the slave
+/// </summary>
+inline void CcpPutDword(BYTE *Buffer, DWORD Value, bool IntelFormat)
+{
+	if (IntelFormat)
+	{
+		Buffer[0] = (BYTE)Value;
+		Buffer[1] = (BYTE)(Value >> 8);
+		Buffer[2] = (BYTE)(Value >> 16);
+		Buffer[3] = (BYTE)(Value >> 24);
+	}
+	else
+	{
+		Buffer[0] = (BYTE)(Value >> 24);
+		Buffer[1] = (BYTE)(Value >> 16);
+		Buffer[2] = (BYTE)(Value >> 8);
+		Buffer[3] = (BYTE)Value;
+	}
+}
+
+/// <summary>
+/// Reads a 16 bit value stored in the byte order of the slave
+/// </summary>
+inline WORD CcpGetWord(const BYTE *Buffer, bool IntelFormat)
+{
+	if (IntelFormat)
+		return (WORD)(Buffer[0] | (Buffer[1] << 8));
+	return (WORD)((Buffer[0] << 8) | Buffer[1]);
+}
+
+/// <summary>
+/// Reads a 32 bit value stored in the byte order of the slave
+/// </summary>
+inline DWORD CcpGetDword(const BYTE *Buffer, bool IntelFormat)
+{
+	if (IntelFormat)
+		return (DWORD)Buffer[0] | ((DWORD)Buffer[1] << 8) | ((DWORD)Buffer[2] << 16) | ((DWORD)Buffer[3] << 24);
+	return ((DWORD)Buffer[0] << 24) | ((DWORD)Buffer[1] << 16) | ((DWORD)Buffer[2] << 8) | (DWORD)Buffer[3];
+}
+
+#endif
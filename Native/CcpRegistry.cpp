@@ -0,0 +1,270 @@
+//  CcpRegistry.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Process wide tables of the initialized channels (TPCANHandle) and the
+//  open connections (TCCPHandle) of the native PCAN-CCP engine
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpRegistry.h"
+#include "CcpChannel.h"
+#include "CcpSession.h"
+#include "CcpStationMux.h"
+#include "CcpProtocol.h"
+
+#ifdef PCCP_WITH_PCANBASIC
+#include "PcanBasicTransport.h"
+#endif
+#ifdef PCCP_WITH_SOCKETCAN
+#include "SocketCanTransport.h"
+#endif
+
+#include <vector>
+
+CCcpRegistry &CCcpRegistry::Instance()
+{
+	static CCcpRegistry registry;
+
+	return registry;
+}
+
+CCcpRegistry::CCcpRegistry()
+	: m_NextHandle(1)
+{
+}
+
+void CCcpRegistry::AttachTransport(TPCANHandle Channel, const std::shared_ptr<ICanTransport> &Transport)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	if (Transport)
+		m_Transports[Channel] = Transport;
+	else
+		m_Transports.erase(Channel);
+}
+
+std::shared_ptr<ICanTransport> CCcpRegistry::CreateDefaultTransport(TPCANHandle Channel, TPCANType HwType, DWORD IOPort, WORD Interrupt)
+{
+#if defined(PCCP_WITH_PCANBASIC)
+	return std::make_shared<CPcanBasicTransport>(Channel, HwType, IOPort, Interrupt);
+#elif defined(PCCP_WITH_SOCKETCAN)
+	std::string name = CSocketCanTransport::DefaultInterface(Channel);
+
+	(void)HwType; (void)IOPort; (void)Interrupt;
+	if (name.empty())
+		return std::shared_ptr<ICanTransport>();
+	return std::make_shared<CSocketCanTransport>(name.c_str());
+#else
+	(void)Channel; (void)HwType; (void)IOPort; (void)Interrupt;
+	return std::shared_ptr<ICanTransport>();
+#endif
+}
+
+TCCPResult CCcpRegistry::InitializeChannel(TPCANHandle Channel, TPCANBaudrate Btr0Btr1, TPCANType HwType, DWORD IOPort, WORD Interrupt)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::shared_ptr<ICanTransport> transport;
+	std::shared_ptr<CCcpChannel> channel;
+	std::map<TPCANHandle, std::shared_ptr<ICanTransport> >::iterator it;
+	TPCANStatus status;
+
+	if (m_Channels.count(Channel))
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+
+	it = m_Transports.find(Channel);
+	if (it != m_Transports.end())
+		transport = it->second;
+	else
+		transport = CreateDefaultTransport(Channel, HwType, IOPort, Interrupt);
+	if (!transport)
+		return CCP_RESULT_PCAN(PCAN_ERROR_NODRIVER);
+
+	channel = std::make_shared<CCcpChannel>(Channel, transport);
+	status = channel->Open(Btr0Btr1);
+	if (status != PCAN_ERROR_OK)
+		return CCP_RESULT_PCAN(status);
+
+	m_Channels[Channel] = channel;
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpRegistry::UninitializeChannel(TPCANHandle Channel)
+{
+	std::vector<std::shared_ptr<CCcpSession> > sessions;
+	std::vector<std::shared_ptr<CCcpStationMux> > muxes;
+	std::shared_ptr<CCcpChannel> channel;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::map<TPCANHandle, std::shared_ptr<CCcpChannel> >::iterator it;
+		std::map<TCCPHandle, std::shared_ptr<CCcpSession> >::iterator session;
+		std::map<TCCPHandle, std::shared_ptr<CCcpStationMux> >::iterator mux;
+
+		it = m_Channels.find(Channel);
+		if (it == m_Channels.end())
+			return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+		channel = it->second;
+		m_Channels.erase(it);
+
+		// Connections on the channel become invalid
+		for (session = m_Sessions.begin(); session != m_Sessions.end();)
+		{
+			if (session->second->GetChannel() == channel.get())
+			{
+				sessions.push_back(session->second);
+				session = m_Sessions.erase(session);
+			}
+			else
+				++session;
+		}
+		for (mux = m_Muxes.begin(); mux != m_Muxes.end();)
+		{
+			if (mux->second->GetChannel() == channel.get())
+			{
+				muxes.push_back(mux->second);
+				mux = m_Muxes.erase(mux);
+			}
+			else
+				++mux;
+		}
+	}
+
+	// Released outside the lock: a session may still be finishing a command.
+	// The multiplexers go once the channel has failed the command on the bus
+	sessions.clear();
+	for (size_t i = 0; i < muxes.size(); i++)
+		muxes[i]->Close();
+	channel->Close();
+	muxes.clear();
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+std::shared_ptr<CCcpChannel> CCcpRegistry::FindChannel(TPCANHandle Channel)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<TPCANHandle, std::shared_ptr<CCcpChannel> >::iterator it;
+
+	it = m_Channels.find(Channel);
+	if (it == m_Channels.end())
+		return std::shared_ptr<CCcpChannel>();
+	return it->second;
+}
+
+TCCPHandle CCcpRegistry::NextHandle()
+{
+	TCCPHandle handle;
+
+	// Called with m_Lock held
+	handle = m_NextHandle++;
+	if (m_NextHandle == 0)
+		m_NextHandle = 1;
+	return handle;
+}
+
+TCCPHandle CCcpRegistry::AddSession(const std::shared_ptr<CCcpSession> &Session)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TCCPHandle handle;
+
+	handle = NextHandle();
+	Session->SetHandle(handle);
+	m_Sessions[handle] = Session;
+	return handle;
+}
+
+void CCcpRegistry::RemoveSession(TCCPHandle CcpHandle)
+{
+	std::shared_ptr<CCcpSession> session;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::map<TCCPHandle, std::shared_ptr<CCcpSession> >::iterator it;
+
+		it = m_Sessions.find(CcpHandle);
+		if (it == m_Sessions.end())
+			return;
+		session = it->second;
+		m_Sessions.erase(it);
+	}
+}
+
+std::shared_ptr<CCcpSession> CCcpRegistry::FindSession(TCCPHandle CcpHandle)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<TCCPHandle, std::shared_ptr<CCcpSession> >::iterator it;
+
+	it = m_Sessions.find(CcpHandle);
+	if (it == m_Sessions.end())
+		return std::shared_ptr<CCcpSession>();
+	return it->second;
+}
+
+std::shared_ptr<CCcpSession> CCcpRegistry::FindSession(TPCANHandle Channel, const TCCPSlaveData &SlaveData)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<TCCPHandle, std::shared_ptr<CCcpSession> >::iterator it;
+
+	for (it = m_Sessions.begin(); it != m_Sessions.end(); ++it)
+	{
+		const TCCPSlaveData &data = it->second->GetSlaveData();
+
+		if (it->second->GetChannel()->GetHandle() == Channel &&
+			data.EcuAddress == SlaveData.EcuAddress &&
+			data.IdCRO == SlaveData.IdCRO &&
+			data.IdDTO == SlaveData.IdDTO)
+			return it->second;
+	}
+	return std::shared_ptr<CCcpSession>();
+}
+
+void CCcpRegistry::GetSessions(TPCANHandle Channel, std::vector<std::shared_ptr<CCcpSession> > &Sessions)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<TCCPHandle, std::shared_ptr<CCcpSession> >::iterator it;
+
+	Sessions.clear();
+	for (it = m_Sessions.begin(); it != m_Sessions.end(); ++it)
+	{
+		if (it->second->GetChannel()->GetHandle() == Channel)
+			Sessions.push_back(it->second);
+	}
+}
+
+TCCPHandle CCcpRegistry::AddMux(const std::shared_ptr<CCcpStationMux> &Mux)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TCCPHandle handle;
+
+	handle = NextHandle();
+	Mux->SetHandle(handle);
+	m_Muxes[handle] = Mux;
+	return handle;
+}
+
+void CCcpRegistry::RemoveMux(TCCPHandle MuxHandle)
+{
+	std::shared_ptr<CCcpStationMux> mux;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		std::map<TCCPHandle, std::shared_ptr<CCcpStationMux> >::iterator it;
+
+		it = m_Muxes.find(MuxHandle);
+		if (it == m_Muxes.end())
+			return;
+		mux = it->second;
+		m_Muxes.erase(it);
+	}
+}
+
+std::shared_ptr<CCcpStationMux> CCcpRegistry::FindMux(TCCPHandle MuxHandle)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	std::map<TCCPHandle, std::shared_ptr<CCcpStationMux> >::iterator it;
+
+	it = m_Muxes.find(MuxHandle);
+	if (it == m_Muxes.end())
+		return std::shared_ptr<CCcpStationMux>();
+	return it->second;
+}
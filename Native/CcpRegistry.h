@@ -0,0 +1,81 @@
+//  CcpRegistry.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Process wide tables of the initialized channels (TPCANHandle) and the
+//  open connections (TCCPHandle) of the native PCAN-CCP engine
+//
+//  ~~~~~~~~~~~~
+//
+#ifndef __CCPREGISTRYH__
+#define __CCPREGISTRYH__
+
+#include "WinTypes.h"
+#include "PCCP.h"
+#include "CanTransport.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class CCcpChannel;
+class CCcpSession;
+class CCcpStationMux;
+
+class CCcpRegistry
+{
+public:
+	static CCcpRegistry &Instance();
+
+	/// <summary>
+	/// Selects the transport used for a channel by the next CCP_InitializeChannel call,
+	/// instead of the default backend of the platform
+	/// </summary>
+	/// <param name="Channel">The handle of a PCAN Channel</param>
+	/// <param name="Transport">The transport backend. NULL restores the default backend</param>
+	void AttachTransport(TPCANHandle Channel, const std::shared_ptr<ICanTransport> &Transport);
+
+	TCCPResult InitializeChannel(TPCANHandle Channel, TPCANBaudrate Btr0Btr1, TPCANType HwType, DWORD IOPort, WORD Interrupt);
+	TCCPResult UninitializeChannel(TPCANHandle Channel);
+	std::shared_ptr<CCcpChannel> FindChannel(TPCANHandle Channel);
+
+	/// <summary>
+	/// Registers a connection and assigns its TCCPHandle
+	/// </summary>
+	TCCPHandle AddSession(const std::shared_ptr<CCcpSession> &Session);
+	void RemoveSession(TCCPHandle CcpHandle);
+	std::shared_ptr<CCcpSession> FindSession(TCCPHandle CcpHandle);
+
+	/// <summary>
+	/// Returns the connection already opened for a slave on a channel, if any
+	/// </summary>
+	std::shared_ptr<CCcpSession> FindSession(TPCANHandle Channel, const TCCPSlaveData &SlaveData);
+
+	/// <summary>
+	/// Returns the connections opened on a channel, by handle
+	/// </summary>
+	void GetSessions(TPCANHandle Channel, std::vector<std::shared_ptr<CCcpSession> > &Sessions);
+
+	/// <summary>
+	/// Registers a station multiplexer and assigns its handle, taken from the
+	/// same range as the connection handles
+	/// </summary>
+	TCCPHandle AddMux(const std::shared_ptr<CCcpStationMux> &Mux);
+	void RemoveMux(TCCPHandle MuxHandle);
+	std::shared_ptr<CCcpStationMux> FindMux(TCCPHandle MuxHandle);
+
+private:
+	CCcpRegistry();
+	std::shared_ptr<ICanTransport> CreateDefaultTransport(TPCANHandle Channel, TPCANType HwType, DWORD IOPort, WORD Interrupt);
+	TCCPHandle NextHandle();
+
+	std::mutex m_Lock;
+	std::map<TPCANHandle, std::shared_ptr<ICanTransport> > m_Transports;
+	std::map<TPCANHandle, std::shared_ptr<CCcpChannel> > m_Channels;
+	std::map<TCCPHandle, std::shared_ptr<CCcpSession> > m_Sessions;
+	std::map<TCCPHandle, std::shared_ptr<CCcpStationMux> > m_Muxes;
+	TCCPHandle m_NextHandle;
+};
+
+#endif
@@ -0,0 +1,104 @@
+//  CcpRttEstimator.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Round trip time estimation and adaptive command time outs of a PCAN-CCP
+//  connection
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpRttEstimator.h"
+#include "CcpProtocol.h"
+
+#include <string.h>
+#include <algorithm>
+
+// Resolution of the time outs: the receive thread sleeps in millis
+//
+#define CCP_RTT_GRANULARITY                    1000
+
+CCcpRttEstimator::CCcpRttEstimator()
+	: m_Params(DefaultParams())
+	, m_Srtt(0)
+	, m_RttVar(0)
+	, m_Samples(0)
+	, m_Retries(0)
+	, m_TimeOuts(0)
+{
+}
+
+TCCPRttParams CCcpRttEstimator::DefaultParams()
+{
+	TCCPRttParams params;
+
+	params.Adaptive = true;
+	params.MaxRetries = CCP_RTT_DEFAULT_RETRIES;
+	params.MinTimeOut = CCP_RTT_DEFAULT_MIN_TIMEOUT;
+	params.MaxTimeOut = CCP_RTT_DEFAULT_MAX_TIMEOUT;
+	return params;
+}
+
+bool CCcpRttEstimator::SetParams(const TCCPRttParams &Params)
+{
+	if (!Params.MinTimeOut || Params.MaxTimeOut < Params.MinTimeOut)
+		return false;
+	m_Params = Params;
+	return true;
+}
+
+void CCcpRttEstimator::AddSample(DWORD RttMicros)
+{
+	DWORD error;
+
+	if (!m_Samples)
+	{
+		m_Srtt = RttMicros;
+		m_RttVar = RttMicros / 2;
+	}
+	else
+	{
+		error = m_Srtt > RttMicros ? m_Srtt - RttMicros : RttMicros - m_Srtt;
+		m_RttVar = (DWORD)(((UINT64)m_RttVar * 3 + error) / 4);
+		m_Srtt = (DWORD)(((UINT64)m_Srtt * 7 + RttMicros) / 8);
+	}
+	m_Samples++;
+}
+
+void CCcpRttEstimator::AddTimeOut(bool Retried)
+{
+	m_TimeOuts++;
+	if (Retried)
+		m_Retries++;
+}
+
+DWORD CCcpRttEstimator::GetTimeOut(BYTE Retries) const
+{
+	UINT64 maximum = (UINT64)m_Params.MaxTimeOut * 1000;
+	UINT64 timeOut;
+
+	if (!m_Params.Adaptive)
+		return (DWORD)CCP_DEFAULT_TIMEOUT * 1000;
+
+	// Until an answer is measured, the fixed default applies
+	if (!m_Samples)
+		timeOut = (UINT64)CCP_DEFAULT_TIMEOUT * 1000;
+	else
+		timeOut = (UINT64)m_Srtt + std::max((UINT64)m_RttVar * 4, (UINT64)CCP_RTT_GRANULARITY);
+	timeOut = std::max(timeOut, (UINT64)m_Params.MinTimeOut * 1000);
+
+	// Exponential back off of resent commands
+	for (; Retries && timeOut < maximum; Retries--)
+		timeOut *= 2;
+	return (DWORD)std::min(timeOut, maximum);
+}
+
+void CCcpRttEstimator::GetStats(TCCPRttStats *Stats) const
+{
+	memset(Stats, 0, sizeof(*Stats));
+	Stats->SmoothedRtt = m_Srtt;
+	Stats->RttVariation = m_RttVar;
+	Stats->TimeOut = GetTimeOut(0);
+	Stats->Samples = m_Samples;
+	Stats->Retries = m_Retries;
+	Stats->TimeOuts = m_TimeOuts;
+}
@@ -0,0 +1,65 @@
+//  CcpRttEstimator.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Round trip time estimation and adaptive command time outs of a PCAN-CCP
+//  connection
+//
+//  ~~~~~~~~~~~~
+//
+//  The estimator follows RFC 6298 (TCP): smoothed RTT with gain 1/8, mean
+//  deviation with gain 1/4, time out = SRTT + 4 x deviation. Every CRM is a
+//  valid sample, even of a resent command: the command counter tells which
+//  transmission it answers.
+//
+#ifndef __CCPRTTESTIMATORH__
+#define __CCPRTTESTIMATORH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+
+class CCcpRttEstimator
+{
+public:
+	CCcpRttEstimator();
+
+	/// <summary>
+	/// Returns the default policy (adaptive, CCP_RTT_DEFAULT_* values)
+	/// </summary>
+	static TCCPRttParams DefaultParams();
+
+	/// <summary>
+	/// Changes the policy. The measures are kept
+	/// </summary>
+	/// <returns>False if the bounds are invalid</returns>
+	bool SetParams(const TCCPRttParams &Params);
+	const TCCPRttParams &GetParams() const { return m_Params; }
+
+	/// <summary>
+	/// Adds the round trip time of an answered short command
+	/// </summary>
+	void AddSample(DWORD RttMicros);
+
+	/// <summary>
+	/// Counts a command that got no answer in time
+	/// </summary>
+	void AddTimeOut(bool Retried);
+
+	/// <summary>
+	/// Returns the time out of a short command, in microseconds
+	/// </summary>
+	/// <param name="Retries">Number of times the command was already sent: the time out doubles with each one</param>
+	DWORD GetTimeOut(BYTE Retries) const;
+
+	void GetStats(TCCPRttStats *Stats) const;
+
+private:
+	TCCPRttParams m_Params;
+	DWORD m_Srtt;                                          // Microseconds
+	DWORD m_RttVar;                                        // Microseconds
+	DWORD m_Samples;
+	DWORD m_Retries;
+	DWORD m_TimeOuts;
+};
+
+#endif
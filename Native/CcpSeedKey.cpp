@@ -0,0 +1,220 @@
+//  CcpSeedKey.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Seed & key algorithms and the unlock of the protected resources of a slave
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpSeedKey.h"
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+#include <string.h>
+#include <map>
+#include <mutex>
+#include <string>
+
+//------------------------------
+// Built-in test algorithm
+//------------------------------
+
+void CCcpTestKeyAlgorithm::ComputeTestKey(const BYTE *Seed, BYTE *Key)
+{
+	for (int i = 0; i < CCP_SEED_SIZE; i++)
+	{
+		BYTE value = Seed[i] ^ 0xA5;
+		int shift = (i + 1) & 7;
+
+		Key[i] = (BYTE)(((value << shift) | (value >> (8 - shift))) + i);
+	}
+}
+
+bool CCcpTestKeyAlgorithm::ComputeKey(BYTE, const BYTE *Seed, BYTE *Key, BYTE *KeyLength)
+{
+	ComputeTestKey(Seed, Key);
+	*KeyLength = CCP_SEED_SIZE;
+	return true;
+}
+
+//------------------------------
+// Shared library algorithms
+//------------------------------
+
+CCcpLibraryKeyAlgorithm::CCcpLibraryKeyAlgorithm()
+	: m_Library(NULL)
+	, m_Asap1aComputeKey(NULL)
+	, m_XcpComputeKey(NULL)
+{
+}
+
+CCcpLibraryKeyAlgorithm::~CCcpLibraryKeyAlgorithm()
+{
+	if (!m_Library)
+		return;
+#ifdef _WIN32
+	FreeLibrary((HMODULE)m_Library);
+#else
+	dlclose(m_Library);
+#endif
+}
+
+std::shared_ptr<CCcpLibraryKeyAlgorithm> CCcpLibraryKeyAlgorithm::Load(LPCSTR Path)
+{
+	// Libraries in use, by path: a rack of identical ECUs loads its algorithm once
+	static std::mutex s_Lock;
+	static std::map<std::string, std::weak_ptr<CCcpLibraryKeyAlgorithm> > s_Loaded;
+	std::lock_guard<std::mutex> lock(s_Lock);
+	std::shared_ptr<CCcpLibraryKeyAlgorithm> algorithm;
+
+	algorithm = s_Loaded[Path].lock();
+	if (algorithm)
+		return algorithm;
+
+	algorithm.reset(new CCcpLibraryKeyAlgorithm());
+#ifdef _WIN32
+	algorithm->m_Library = LoadLibraryA(Path);
+	if (!algorithm->m_Library)
+		return std::shared_ptr<CCcpLibraryKeyAlgorithm>();
+	algorithm->m_Asap1aComputeKey = (TAsap1aComputeKey)GetProcAddress((HMODULE)algorithm->m_Library, "ASAP1A_CCP_ComputeKeyFromSeed");
+	algorithm->m_XcpComputeKey = (TXcpComputeKey)GetProcAddress((HMODULE)algorithm->m_Library, "XCP_ComputeKeyFromSeed");
+#else
+	algorithm->m_Library = dlopen(Path, RTLD_NOW | RTLD_LOCAL);
+	if (!algorithm->m_Library)
+		return std::shared_ptr<CCcpLibraryKeyAlgorithm>();
+	algorithm->m_Asap1aComputeKey = (TAsap1aComputeKey)dlsym(algorithm->m_Library, "ASAP1A_CCP_ComputeKeyFromSeed");
+	algorithm->m_XcpComputeKey = (TXcpComputeKey)dlsym(algorithm->m_Library, "XCP_ComputeKeyFromSeed");
+#endif
+	if (!algorithm->m_Asap1aComputeKey && !algorithm->m_XcpComputeKey)
+		return std::shared_ptr<CCcpLibraryKeyAlgorithm>();
+
+	s_Loaded[Path] = algorithm;
+	return algorithm;
+}
+
+bool CCcpLibraryKeyAlgorithm::ComputeKey(BYTE Resource, const BYTE *Seed, BYTE *Key, BYTE *KeyLength)
+{
+	BYTE seed[CCP_SEED_SIZE];
+
+	// The entry points take non-const seeds
+	memcpy(seed, Seed, CCP_SEED_SIZE);
+
+	// The XCP entry point knows the resource; ASAP1a libraries serve one resource each
+	if (m_XcpComputeKey)
+	{
+		BYTE length = CCP_MAX_KEY_SIZE;
+
+		if (m_XcpComputeKey(Resource, CCP_SEED_SIZE, seed, &length, Key) != 0 || !length || length > CCP_MAX_KEY_SIZE)
+			return false;
+		*KeyLength = length;
+		return true;
+	}
+	else
+	{
+		WORD length = 0;
+
+		if (!m_Asap1aComputeKey(seed, CCP_SEED_SIZE, Key, CCP_MAX_KEY_SIZE, &length) || !length || length > CCP_MAX_KEY_SIZE)
+			return false;
+		*KeyLength = (BYTE)length;
+		return true;
+	}
+}
+
+//------------------------------
+// Unlock sequence
+//------------------------------
+
+CCcpUnlockSource::CCcpUnlockSource(BYTE Resources, bool Probe, const std::shared_ptr<ICcpKeyAlgorithm> *Algorithms)
+	: m_Remaining(Resources & CCP_RSM_ALL)
+	, m_Probe(Probe)
+	, m_Resource(0)
+	, m_KeyLength(0)
+	, m_Privileges(0)
+	, m_Result(CCP_ERROR_ACKNOWLEDGE_OK)
+{
+	for (int i = 0; i < CCP_RSM_COUNT; i++)
+		m_Algorithms[i] = Algorithms[i];
+}
+
+int CCcpUnlockSource::ResourceIndex(BYTE Resource)
+{
+	switch (Resource)
+	{
+		case CCP_RSM_CALIBRATION:           return 0;
+		case CCP_RSM_DATA_ADQUISITION:      return 1;
+		case CCP_RSM_MEMORY_PROGRAMMING:    return 2;
+		default:                            return -1;
+	}
+}
+
+bool CCcpUnlockSource::NextCommand(BYTE *Cro)
+{
+	static const BYTE s_Order[CCP_RSM_COUNT] = {CCP_RSM_CALIBRATION, CCP_RSM_DATA_ADQUISITION, CCP_RSM_MEMORY_PROGRAMMING};
+
+	if (m_Result != CCP_ERROR_ACKNOWLEDGE_OK)
+		return false;
+
+	memset(Cro, 0, CCP_PACKET_SIZE);
+	if (m_Probe)
+	{
+		Cro[0] = CCP_CMD_EXCHANGE_ID;
+		return true;
+	}
+	if (m_KeyLength)
+	{
+		Cro[0] = CCP_CMD_UNLOCK;
+		memcpy(&Cro[2], m_Key, m_KeyLength);
+		return true;
+	}
+
+	for (int i = 0; i < CCP_RSM_COUNT; i++)
+	{
+		if (m_Remaining & s_Order[i])
+		{
+			m_Resource = s_Order[i];
+			m_Remaining &= ~s_Order[i];
+			Cro[0] = CCP_CMD_GET_SEED;
+			Cro[2] = m_Resource;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CCcpUnlockSource::OnResponse(const BYTE *Cro, const BYTE *Crm)
+{
+	ICcpKeyAlgorithm *algorithm;
+
+	switch (Cro[0])
+	{
+		case CCP_CMD_EXCHANGE_ID:
+			// Resources no longer protected need no seed & key
+			m_Probe = false;
+			m_Privileges |= m_Remaining & ~Crm[6];
+			m_Remaining &= Crm[6];
+			break;
+
+		case CCP_CMD_GET_SEED:
+			// Protection status 0: already unlocked
+			if (!Crm[3])
+			{
+				m_Privileges |= m_Resource;
+				break;
+			}
+			algorithm = m_Algorithms[ResourceIndex(m_Resource)].get();
+			if (!algorithm || !algorithm->ComputeKey(m_Resource, &Crm[4], m_Key, &m_KeyLength))
+			{
+				m_KeyLength = 0;
+				m_Result = CCP_ERROR_KEY_ALGORITHM;
+			}
+			break;
+
+		case CCP_CMD_UNLOCK:
+			// The CRM holds the current privilege status of all resources
+			m_KeyLength = 0;
+			m_Privileges |= Crm[3] & CCP_RSM_ALL;
+			break;
+	}
+}
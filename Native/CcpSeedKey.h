@@ -0,0 +1,130 @@
+//  CcpSeedKey.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Seed & key algorithms and the unlock of the protected resources of a slave
+//  (CCP_RSM_CALIBRATION, CCP_RSM_DATA_ADQUISITION, CCP_RSM_MEMORY_PROGRAMMING)
+//
+//  ~~~~~~~~~~~~
+//
+//  Key algorithms are supplied by the ECU vendor as shared libraries that
+//  export the ASAP1a function ASAP1A_CCP_ComputeKeyFromSeed, or the XCP style
+//  XCP_ComputeKeyFromSeed, which also receives the resource. The built-in test
+//  algorithm is the one of the simulated slave.
+//
+#ifndef __CCPSEEDKEYH__
+#define __CCPSEEDKEYH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpProtocol.h"
+#include "CcpSession.h"
+
+#include <memory>
+
+////////////////////////////////////////////////////////////
+// Interface definitions
+////////////////////////////////////////////////////////////
+
+// Computes the UNLOCK key of a GET_SEED seed
+//
+class ICcpKeyAlgorithm
+{
+public:
+	virtual ~ICcpKeyAlgorithm() {}
+
+	/// <summary>
+	/// Computes the key of a seed. Called in the context of the channel receive thread
+	/// </summary>
+	/// <param name="Resource">The resource being unlocked (CCP_RSM_*)</param>
+	/// <param name="Seed">The seed returned by the slave (CCP_SEED_SIZE bytes)</param>
+	/// <param name="Key">Buffer for the key (CCP_MAX_KEY_SIZE bytes)</param>
+	/// <param name="KeyLength">Buffer for the length of the key</param>
+	/// <returns>False if no key can be computed</returns>
+	virtual bool ComputeKey(BYTE Resource, const BYTE *Seed, BYTE *Key, BYTE *KeyLength) = 0;
+};
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+// Built-in algorithm of the simulated slave (CCcpSlaveSimulator)
+//
+class CCcpTestKeyAlgorithm : public ICcpKeyAlgorithm
+{
+public:
+	/// <summary>
+	/// Key[i] = rotl(Seed[i] ^ 0xA5, i + 1) + i, CCP_SEED_SIZE bytes
+	/// </summary>
+	static void ComputeTestKey(const BYTE *Seed, BYTE *Key);
+
+	virtual bool ComputeKey(BYTE Resource, const BYTE *Seed, BYTE *Key, BYTE *KeyLength);
+};
+
+// Algorithm exported by a seed & key shared library (.dll / .so)
+//
+class CCcpLibraryKeyAlgorithm : public ICcpKeyAlgorithm
+{
+public:
+	/// <summary>
+	/// Loads a library. A library already in use by another connection is shared
+	/// </summary>
+	/// <returns>NULL if the library cannot be loaded or exports no known entry point</returns>
+	static std::shared_ptr<CCcpLibraryKeyAlgorithm> Load(LPCSTR Path);
+
+	~CCcpLibraryKeyAlgorithm();
+
+	virtual bool ComputeKey(BYTE Resource, const BYTE *Seed, BYTE *Key, BYTE *KeyLength);
+
+private:
+	// bool ASAP1A_CCP_ComputeKeyFromSeed(seed, sizeSeed, key, maxSizeKey, *sizeKey)
+	typedef bool (*TAsap1aComputeKey)(BYTE *Seed, WORD SeedSize, BYTE *Key, WORD MaxKeySize, WORD *KeySize);
+	// DWORD XCP_ComputeKeyFromSeed(privilege, byteLenSeed, seed, *byteLenKey, key). 0: success
+	typedef DWORD (*TXcpComputeKey)(BYTE Privilege, BYTE SeedSize, BYTE *Seed, BYTE *KeySize, BYTE *Key);
+
+	CCcpLibraryKeyAlgorithm();
+
+	void *m_Library;
+	TAsap1aComputeKey m_Asap1aComputeKey;
+	TXcpComputeKey m_XcpComputeKey;
+};
+
+// Command source of CCcpSession::UnlockResources: an optional EXCHANGE_ID to
+// read the protection mask, then GET_SEED + UNLOCK for each resource still
+// protected, back to back
+//
+class CCcpUnlockSource : public ICcpCommandSource
+{
+public:
+	/// <param name="Resources">The resources to unlock (CCP_RSM_*)</param>
+	/// <param name="Probe">Read the protection mask first (resources believed to be unlocked)</param>
+	/// <param name="Algorithms">Key algorithm of each resource, in CCP_RSM_* bit order (CAL, DAQ, PGM)</param>
+	CCcpUnlockSource(BYTE Resources, bool Probe, const std::shared_ptr<ICcpKeyAlgorithm> *Algorithms);
+
+	virtual bool NextCommand(BYTE *Cro);
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm);
+
+	/// <summary>
+	/// Returns CCP_ERROR_KEY_ALGORITHM if a key could not be computed
+	/// </summary>
+	TCCPResult GetResult() const { return m_Result; }
+
+	/// <summary>
+	/// Returns the resources known to be unlocked
+	/// </summary>
+	BYTE GetPrivileges() const { return m_Privileges; }
+
+	static int ResourceIndex(BYTE Resource);
+
+private:
+	BYTE m_Remaining;                                      // Resources not handled yet
+	bool m_Probe;
+	BYTE m_Resource;                                       // Resource of the seed being answered
+	BYTE m_Key[CCP_MAX_KEY_SIZE];
+	BYTE m_KeyLength;                                      // 0: no UNLOCK pending
+	BYTE m_Privileges;
+	TCCPResult m_Result;
+	std::shared_ptr<ICcpKeyAlgorithm> m_Algorithms[CCP_RSM_COUNT];
+};
+
+#endif
@@ -0,0 +1,1310 @@
+//  CcpSession.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  A PCAN-CCP connection between the master and one slave (TCCPHandle)
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpSession.h"
+#include "CcpChannel.h"
+#include "CanTransport.h"
+#include "CcpSeedKey.h"
+#include "CcpDaqConfig.h"
+#include "CcpDtoDecoder.h"
+#include "CcpDaqAssembler.h"
+
+#include <algorithm>
+#include <string.h>
+#include <thread>
+
+// CRM handed to the completions of commands that got no answer
+//
+static const BYTE s_NoCrm[CCP_PACKET_SIZE] = {0};
+
+// Protected resources, in the bit order of the key algorithms
+//
+static const BYTE s_Resources[CCP_RSM_COUNT] = {CCP_RSM_CALIBRATION, CCP_RSM_DATA_ADQUISITION, CCP_RSM_MEMORY_PROGRAMMING};
+
+CCcpSession::CCcpSession(const std::shared_ptr<CCcpChannel> &Channel, const TCCPSlaveData &SlaveData)
+	: m_Channel(Channel)
+	, m_SlaveData(SlaveData)
+	, m_Handle(0)
+	, m_Connected(false)
+	, m_Active(false)
+	, m_Counter(0)
+	, m_PendingCounter(0)
+	, m_Unsent(false)
+	, m_RetryMtaValid(false)
+	, m_RetryMtaExt(0)
+	, m_RetryMtaAddr(0)
+	, m_Privileges(0)
+	, m_PrivilegesVerified(false)
+	, m_Monitor(std::make_shared<CCcpDaqMonitor>((const TCcpDaqLayout *)NULL))
+	, m_PushAssembler(NULL)
+	, m_PushMonitor(m_Monitor.get())
+	, m_Mta0Ext(0)
+	, m_Mta0Addr(0)
+	, m_Queue(new CCcpMsgRing(CCP_MAX_RCV_QUEUE))
+	, m_PushQueue(m_Queue.get())
+	, m_PushEpoch(0)
+	, m_FirstDtoArmed(false)
+	, m_DaqRestarts(0)
+	, m_MonitorRestarts(0)
+{
+	memset(m_SentCro, 0, sizeof(m_SentCro));
+	for (int pid = 0; pid <= CCP_PID_DAQ_MAX; pid++)
+		m_FirstDto[pid] = 0;
+}
+
+std::shared_ptr<CCcpSession> CCcpSession::Create(const std::shared_ptr<CCcpChannel> &Channel, const TCCPSlaveData &SlaveData)
+{
+	std::shared_ptr<CCcpSession> session = std::make_shared<CCcpSession>(Channel, SlaveData);
+
+	Channel->Attach(session.get());
+	return session;
+}
+
+CCcpSession::~CCcpSession()
+{
+	m_Channel->Detach(this);
+	Abort(CCP_RESULT_ILLHANDLE);
+}
+
+TCCPResult CCcpSession::Command(BYTE *Cro, BYTE *Crm, WORD TimeOut)
+{
+	TCcpReply reply = CommandAsync(Cro, TimeOut).get();
+
+	if (Crm)
+		memcpy(Crm, reply.Crm, CCP_PACKET_SIZE);
+	return reply.Result;
+}
+
+TCCPResult CCcpSession::CommandSequence(ICcpCommandSource *Source, WORD TimeOut, DWORD *Commands)
+{
+	std::shared_ptr<std::promise<TCcpReply> > reply = std::make_shared<std::promise<TCcpReply> >();
+	std::future<TCcpReply> future = reply->get_future();
+	TCcpReply value;
+
+	CommandSequenceAsync(Source, TimeOut, [reply](TCCPResult Result, const BYTE *Crm, DWORD Count)
+	{
+		TCcpReply value;
+
+		value.Result = Result;
+		value.Commands = Count;
+		memcpy(value.Crm, Crm, CCP_PACKET_SIZE);
+		reply->set_value(value);
+	});
+	value = future.get();
+	if (Commands)
+		*Commands = value.Commands;
+	return value.Result;
+}
+
+void CCcpSession::CommandAsync(const BYTE *Cro, WORD TimeOut, const TCcpCompletion &Completion)
+{
+	TPCANMsg msg;
+
+	if (CommandDeferred(Cro, TimeOut, Completion, &msg))
+		Transmit(msg);
+}
+
+bool CCcpSession::CommandDeferred(const BYTE *Cro, WORD TimeOut, const TCcpCompletion &Completion, TPCANMsg *Msg)
+{
+	TCcpOperation operation;
+
+	memcpy(operation.Cro, Cro, CCP_PACKET_SIZE);
+	operation.Source = NULL;
+	operation.TimeOut = TimeOut;
+	operation.Commands = 0;
+	operation.Retries = 0;
+	operation.RestoreMta = false;
+	operation.BusyAnswers = 0;
+	operation.BusyWait = false;
+	operation.Completion = Completion;
+	return Submit(operation, Msg);
+}
+
+std::future<TCcpReply> CCcpSession::CommandAsync(const BYTE *Cro, WORD TimeOut)
+{
+	std::shared_ptr<std::promise<TCcpReply> > reply = std::make_shared<std::promise<TCcpReply> >();
+	std::future<TCcpReply> future = reply->get_future();
+
+	CommandAsync(Cro, TimeOut, [reply](TCCPResult Result, const BYTE *Crm, DWORD Count)
+	{
+		TCcpReply value;
+
+		value.Result = Result;
+		value.Commands = Count;
+		memcpy(value.Crm, Crm, CCP_PACKET_SIZE);
+		reply->set_value(value);
+	});
+	return future;
+}
+
+void CCcpSession::CommandSequenceAsync(ICcpCommandSource *Source, WORD TimeOut, const TCcpCompletion &Completion)
+{
+	TCcpOperation operation;
+	TPCANMsg msg;
+
+	memset(operation.Cro, 0, CCP_PACKET_SIZE);
+	if (!Source->NextCommand(operation.Cro))
+	{
+		if (Completion)
+			Completion(CCP_ERROR_ACKNOWLEDGE_OK, s_NoCrm, 0);
+		return;
+	}
+	operation.Source = Source;
+	operation.TimeOut = TimeOut;
+	operation.Commands = 0;
+	operation.Retries = 0;
+	operation.RestoreMta = false;
+	operation.BusyAnswers = 0;
+	operation.BusyWait = false;
+	operation.Completion = Completion;
+	if (Submit(operation, &msg))
+		Transmit(msg);
+}
+
+bool CCcpSession::Submit(TCcpOperation &Operation, TPCANMsg *Msg)
+{
+	std::unique_lock<std::mutex> lock(m_CrmLock);
+
+	// A closed channel has no receive thread left to time the command out.
+	// Checked under the lock: CCcpChannel::Close aborts what got queued before
+	if (!m_Channel->IsOpen())
+	{
+		lock.unlock();
+		if (Operation.Completion)
+			Operation.Completion(CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE), s_NoCrm, 0);
+		return false;
+	}
+
+	// The CRO built is sent by the caller, once the lock is released
+	m_Operations.push_back(std::move(Operation));
+	if (m_Active)
+		return false;
+	return StartNext(Msg);
+}
+
+bool CCcpSession::StartNext(TPCANMsg *Msg)
+{
+	// Called with m_CrmLock held
+	m_Active = !m_Operations.empty();
+	if (!m_Active)
+		return false;
+	BuildCro(m_Operations.front(), Msg);
+	return true;
+}
+
+void CCcpSession::BuildCro(TCcpOperation &Operation, TPCANMsg *Msg)
+{
+	std::chrono::microseconds timeOut;
+
+	// Called with m_CrmLock held. The time out applies to each command of a
+	// sequence: any progress restarts it
+	if (Operation.RestoreMta)
+	{
+		memset(m_SentCro, 0, CCP_PACKET_SIZE);
+		m_SentCro[0] = CCP_CMD_SET_MTA;
+		m_SentCro[3] = m_RetryMtaExt;
+		CcpPutDword(&m_SentCro[4], m_RetryMtaAddr, m_SlaveData.IntelFormat);
+	}
+	else
+		memcpy(m_SentCro, Operation.Cro, CCP_PACKET_SIZE);
+	m_SentCro[1] = m_Counter++;
+	m_PendingCounter = m_SentCro[1];
+	m_Unsent = true;
+	if (m_SentCro[0] == CCP_CMD_START_STOP || m_SentCro[0] == CCP_CMD_START_STOP_ALL)
+		m_DaqRestarts.fetch_add(1, std::memory_order_relaxed);
+	if (!Operation.RestoreMta)
+		Operation.Cro[1] = m_SentCro[1];
+
+	// Explicit time outs are used as given. Commands that can be resent wait
+	// as long as the round trip time suggests
+	if (Operation.TimeOut)
+		timeOut = std::chrono::milliseconds(Operation.TimeOut);
+	else if (CcpGetRetryMode(m_SentCro[0]) != CcpRetryNone)
+		timeOut = std::chrono::microseconds(m_Rtt.GetTimeOut(Operation.Retries));
+	else
+		timeOut = std::chrono::milliseconds(CcpDefaultTimeout(m_SentCro[0]));
+	m_SentAt = std::chrono::steady_clock::now();
+	m_Deadline = m_SentAt + timeOut;
+	m_Channel->WakeBy(m_Deadline);
+
+	CanSetId(Msg, m_SlaveData.IdCRO);
+	Msg->LEN = CCP_PACKET_SIZE;
+	memcpy(Msg->DATA, m_SentCro, CCP_PACKET_SIZE);
+}
+
+bool CCcpSession::Retry(TCcpOperation &Operation)
+{
+	TCcpRetryMode mode = CcpGetRetryMode(m_SentCro[0]);
+	bool retry;
+
+	// Called with m_CrmLock held, when the command on the bus got no answer.
+	// Whether the CRO or the CRM was lost is unknown: only commands without
+	// side effects are resent, or those whose MTA0 move can be undone
+	retry = !Operation.TimeOut && mode != CcpRetryNone && Operation.Retries < m_Rtt.GetParams().MaxRetries;
+	if (mode == CcpRetryRestoreMta && !m_RetryMtaValid)
+		retry = false;
+	m_Rtt.AddTimeOut(retry);
+	if (!retry)
+	{
+		TrackMta(NULL);
+		return false;
+	}
+
+	Operation.Retries++;
+	if (mode == CcpRetryRestoreMta)
+		Operation.RestoreMta = true;
+	return true;
+}
+
+bool CCcpSession::WaitBusy(TCcpOperation &Operation, BYTE Error, std::chrono::steady_clock::time_point Now)
+{
+	std::chrono::microseconds backoff(m_Busy.OnBusy(Error, Operation.BusyAnswers));
+
+	// Called with m_CrmLock held. The pending counter is kept: the final CRM
+	// of the command is accepted until the command is repeated
+	if (!Operation.BusyAnswers)
+		Operation.BusySince = Now;
+	if (Operation.BusyAnswers < 0xFF)
+		Operation.BusyAnswers++;
+	if (Now + backoff - Operation.BusySince > std::chrono::milliseconds(m_Busy.GetParams().MaxBusyTime))
+		return false;
+
+	Operation.BusyWait = true;
+	m_Deadline = Now + backoff;
+	return true;
+}
+
+void CCcpSession::EndBusy(TCcpOperation &Operation, bool GaveUp, std::chrono::steady_clock::time_point Now)
+{
+	// Called with m_CrmLock held
+	m_Busy.OnBusyEnd((UINT64)std::chrono::duration_cast<std::chrono::microseconds>(Now - Operation.BusySince).count(), GaveUp);
+	Operation.BusyAnswers = 0;
+	Operation.BusyWait = false;
+}
+
+void CCcpSession::TrackMta(const BYTE *Crm)
+{
+	bool acknowledged = Crm && Crm[1] == CCP_ERROR_ACKNOWLEDGE_OK;
+
+	// Called with m_CrmLock held, with the answer to m_SentCro (NULL if none)
+	switch (m_SentCro[0])
+	{
+		case CCP_CMD_SET_MTA:
+			if (m_SentCro[2] != 0)
+				break;
+			if (acknowledged)
+			{
+				m_RetryMtaExt = m_SentCro[3];
+				m_RetryMtaAddr = CcpGetDword(&m_SentCro[4], m_SlaveData.IntelFormat);
+				m_RetryMtaValid = true;
+			}
+			else if (!Crm)
+				m_RetryMtaValid = false;
+			break;
+
+		case CCP_CMD_UPLOAD:
+			m_RetryMtaAddr += m_SentCro[2];
+			m_RetryMtaValid = m_RetryMtaValid && acknowledged;
+			break;
+
+		case CCP_CMD_DNLOAD:
+		case CCP_CMD_DNLOAD_6:
+		case CCP_CMD_PROGRAM:
+		case CCP_CMD_PROGRAM_6:
+			if (acknowledged)
+			{
+				m_RetryMtaExt = Crm[3];
+				m_RetryMtaAddr = CcpGetDword(&Crm[4], m_SlaveData.IntelFormat);
+			}
+			m_RetryMtaValid = acknowledged;
+			break;
+
+		case CCP_CMD_CLEAR_MEMORY:
+		case CCP_CMD_BUILD_CHKSUM:
+		case CCP_CMD_MOVE:
+		case CCP_CMD_DIAG_SERVICE:
+		case CCP_CMD_ACTION_SERVICE:
+		case CCP_CMD_EXCHANGE_ID:
+			m_RetryMtaValid = false;
+			break;
+	}
+}
+
+void CCcpSession::Transmit(TPCANMsg &Msg)
+{
+	Transmitted(Msg, m_Channel->Send(&Msg));
+}
+
+void CCcpSession::Transmitted(const TPCANMsg &Msg, TPCANStatus Status)
+{
+	std::unique_lock<std::mutex> lock(m_CrmLock);
+	std::chrono::steady_clock::time_point now;
+
+	// Unless the command was answered or aborted meanwhile
+	if (!m_Active || !m_Unsent || m_PendingCounter != Msg.DATA[1])
+		return;
+	m_Unsent = false;
+	if (Status != PCAN_ERROR_OK)
+	{
+		Complete(lock, CCP_RESULT_PCAN(Status), s_NoCrm);
+		return;
+	}
+
+	// A caller sending the CRO may have been held up since it was built: the
+	// time out runs from the transmission
+	now = std::chrono::steady_clock::now();
+	m_Deadline += now - m_SentAt;
+	m_SentAt = now;
+	m_Channel->WakeBy(m_Deadline);
+}
+
+void CCcpSession::Complete(std::unique_lock<std::mutex> &Lock, TCCPResult Result, const BYTE *Crm)
+{
+	TCcpOperation operation = std::move(m_Operations.front());
+	TPCANMsg next;
+	bool started;
+
+	// Called with m_CrmLock held, released here. The next command goes out
+	// before the completion runs
+	m_Operations.pop_front();
+	started = StartNext(&next);
+	Lock.unlock();
+
+	if (started)
+		Transmit(next);
+	if (operation.Completion)
+		operation.Completion(Result, Crm, operation.Commands);
+}
+
+void CCcpSession::Abort(TCCPResult Result)
+{
+	std::deque<TCcpOperation> operations;
+
+	{
+		std::lock_guard<std::mutex> lock(m_CrmLock);
+
+		operations.swap(m_Operations);
+		if (m_Active)
+			TrackMta(NULL);
+		m_Active = false;
+	}
+	for (size_t i = 0; i < operations.size(); i++)
+	{
+		if (operations[i].Completion)
+			operations[i].Completion(Result, s_NoCrm, operations[i].Commands);
+	}
+}
+
+bool CCcpSession::SetRttParams(const TCCPRttParams &Params)
+{
+	std::lock_guard<std::mutex> lock(m_CrmLock);
+
+	return m_Rtt.SetParams(Params);
+}
+
+void CCcpSession::GetRttStats(TCCPRttStats *Stats)
+{
+	std::lock_guard<std::mutex> lock(m_CrmLock);
+
+	m_Rtt.GetStats(Stats);
+}
+
+bool CCcpSession::SetBusyParams(const TCCPBusyParams &Params)
+{
+	std::lock_guard<std::mutex> lock(m_CrmLock);
+
+	return m_Busy.SetParams(Params);
+}
+
+void CCcpSession::GetBusyStats(TCCPBusyStats *Stats)
+{
+	std::lock_guard<std::mutex> lock(m_CrmLock);
+
+	*Stats = m_Busy.GetStats();
+}
+
+DWORD CCcpSession::CheckTimeout(std::chrono::steady_clock::time_point Now)
+{
+	std::unique_lock<std::mutex> lock(m_CrmLock);
+	TPCANMsg msg;
+
+	// A CRO still to be sent by its caller is not resent: the stale one would
+	// follow it on the bus and move MTA0 behind the back of the sequence
+	if (m_Active && !m_Unsent && Now >= m_Deadline)
+	{
+		TCcpOperation &operation = m_Operations.front();
+		bool repeat = operation.BusyWait;
+
+		// No final CRM after a busy answer: the command is repeated (CCP 2.1)
+		if (repeat)
+		{
+			operation.BusyWait = false;
+			m_Busy.OnRepeat();
+		}
+		else
+			repeat = Retry(operation);
+
+		if (repeat)
+		{
+			BuildCro(operation, &msg);
+			lock.unlock();
+			Transmit(msg);
+		}
+		else
+		{
+			if (operation.BusyAnswers)
+				EndBusy(operation, false, Now);
+			Complete(lock, CCP_ERROR_INTERNAL_TIMEOUT, s_NoCrm);
+		}
+		lock.lock();
+	}
+	if (!m_Active || m_Unsent)
+		return CCP_WAIT_INFINITE;
+	return m_Deadline <= Now ? 0 : (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(m_Deadline - Now).count() + 1;
+}
+
+void CCcpSession::OnReceive(const TPCANMsg &Msg, UINT64 Nanos)
+{
+	if (Msg.LEN == 0)
+		return;
+
+	if (Msg.DATA[0] == CCP_PID_CRM)
+	{
+		std::unique_lock<std::mutex> lock(m_CrmLock);
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		BYTE crm[CCP_PACKET_SIZE] = {0};
+		TPCANMsg next;
+
+		// CRMs not matching the outstanding counter are late answers to
+		// commands that already timed out
+		if (Msg.LEN < 3 || !m_Active || Msg.DATA[2] != m_PendingCounter)
+			return;
+		memcpy(crm, Msg.DATA, Msg.LEN);
+
+		// Long running commands and final CRMs after a busy wait would spoil
+		// the estimation
+		TCcpOperation &operation = m_Operations.front();
+		if (CcpDefaultTimeout(m_SentCro[0]) == CCP_DEFAULT_TIMEOUT && !operation.BusyAnswers)
+			m_Rtt.AddSample((DWORD)std::chrono::duration_cast<std::chrono::microseconds>(now - m_SentAt).count());
+
+		// A busy command stays on the bus until its final CRM or its repetition
+		if (CCcpBusyBackoff::IsBusy(crm[1]) && WaitBusy(operation, crm[1], now))
+			return;
+		if (operation.BusyAnswers)
+			EndBusy(operation, CCcpBusyBackoff::IsBusy(crm[1]), now);
+		TrackMta(crm);
+
+		if (operation.RestoreMta)
+		{
+			// MTA0 restored: the command that got no answer goes again
+			if (crm[1] != CCP_ERROR_ACKNOWLEDGE_OK)
+			{
+				Complete(lock, crm[1], crm);
+				return;
+			}
+			operation.RestoreMta = false;
+			BuildCro(operation, &next);
+			lock.unlock();
+			Transmit(next);
+			return;
+		}
+		if (crm[1] != CCP_ERROR_ACKNOWLEDGE_OK || !operation.Source)
+		{
+			if (crm[1] == CCP_ERROR_ACKNOWLEDGE_OK)
+				operation.Commands++;
+			// The CRM error codes are the CCP_ERROR_* values
+			Complete(lock, crm[1], crm);
+			return;
+		}
+
+		operation.Source->OnResponse(operation.Cro, crm);
+		operation.Commands++;
+		memset(operation.Cro, 0, CCP_PACKET_SIZE);
+		if (!operation.Source->NextCommand(operation.Cro))
+		{
+			Complete(lock, CCP_ERROR_ACKNOWLEDGE_OK, crm);
+			return;
+		}
+
+		// Next command of the sequence, sent right from the receive thread
+		operation.Retries = 0;
+		BuildCro(operation, &next);
+		lock.unlock();
+		Transmit(next);
+		return;
+	}
+
+	// Event messages and DAQ DTOs are queued for CCP_ReadMsg
+	Push(Msg, Nanos);
+}
+
+void CCcpSession::Push(const TPCANMsg &Msg, UINT64 Nanos)
+{
+	BYTE pid = Msg.DATA[0];
+	TCCPMsg ccpMsg;
+
+	// Receive thread only, without any lock: the epoch turns odd before the
+	// monitor, assembler and queue are loaded, and even once they are no
+	// longer used (see WaitForPush)
+	m_PushEpoch.fetch_add(1);
+
+	CCcpDaqMonitor *monitor = m_PushMonitor.load();
+	CCcpDaqAssembler *assembler = m_PushAssembler.load();
+	CCcpMsgRing *queue = m_PushQueue.load();
+	bool assembled = false;
+
+	if (pid <= CCP_PID_DAQ_MAX)
+	{
+		if (m_FirstDtoArmed.load() && !m_FirstDto[pid].load(std::memory_order_relaxed))
+			m_FirstDto[pid].store(Nanos, std::memory_order_relaxed);
+		if (m_MonitorRestarts != m_DaqRestarts.load(std::memory_order_relaxed))
+		{
+			m_MonitorRestarts = m_DaqRestarts.load(std::memory_order_relaxed);
+			monitor->Restart();
+		}
+		const TCcpOdtStep &step = monitor->OnDto(Msg.DATA, Nanos / 1000);
+
+		assembled = assembler && assembler->OnDto(step, Msg.DATA, Nanos);
+	}
+	else if (pid == CCP_PID_EVENT)
+		monitor->OnEvent(Msg.DATA);
+
+	if (!assembled)
+	{
+		ccpMsg.Source = m_Handle;
+		ccpMsg.Length = Msg.LEN;
+		memcpy(ccpMsg.Data, Msg.DATA, sizeof(ccpMsg.Data));
+
+		DWORD fill = queue->Push(ccpMsg, Nanos);
+
+		if (fill)
+			monitor->OnQueued(fill);
+		else
+			monitor->OnQueueFull();
+	}
+	m_PushEpoch.fetch_add(1, std::memory_order_release);
+}
+
+void CCcpSession::WaitForPush()
+{
+	UINT64 epoch = m_PushEpoch.load();
+
+	// Called once a new monitor, assembler or queue is published: the receive
+	// thread may still use the one replaced until it leaves the Push it is in
+	while ((epoch & 1) && m_PushEpoch.load() == epoch)
+		std::this_thread::yield();
+}
+
+DWORD CCcpSession::ReadQueued(TCCPMsg *Msgs, UINT64 *Stamps, DWORD Count)
+{
+	DWORD read = 0;
+
+	// Called with m_ReadLock held
+	if (m_Drain)
+	{
+		read = m_Drain->Read(Msgs, Stamps, Count);
+		if (read == Count)
+			return read;
+		m_Drain.reset();
+	}
+	return read + m_Queue->Read(Msgs + read, Stamps ? Stamps + read : NULL, Count - read);
+}
+
+TCCPResult CCcpSession::ReadMsg(TCCPMsg *Msg)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+
+	if (!ReadQueued(Msg, NULL, 1))
+		return CCP_RESULT_PCAN(PCAN_ERROR_QRCVEMPTY);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult CCcpSession::ReadMsgs(TCCPMsg *Msgs, UINT64 *Stamps, DWORD Count, DWORD *Read)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+	DWORD read = ReadQueued(Msgs, Stamps, Count);
+
+	if (Read)
+		*Read = read;
+	return read ? CCP_ERROR_ACKNOWLEDGE_OK : CCP_RESULT_PCAN(PCAN_ERROR_QRCVEMPTY);
+}
+
+void CCcpSession::ResetQueue()
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+
+	m_Drain.reset();
+	m_Queue->Clear();
+}
+
+void CCcpSession::SetQueueCapacity(DWORD Capacity)
+{
+	std::unique_ptr<CCcpMsgRing> queue(new CCcpMsgRing(Capacity));
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+
+	// The receive thread queues into the new ring from now on; the old one
+	// gets no more messages once it left Push
+	m_PushQueue.store(queue.get());
+	WaitForPush();
+	m_Queue.swap(queue);
+	if (m_Drain && m_Drain->GetFill())
+	{
+		// Replaced twice before the readers caught up: both old rings are
+		// read in order through one
+		std::unique_ptr<CCcpMsgRing> drain(new CCcpMsgRing(m_Drain->GetFill() + queue->GetFill()));
+		TCCPMsg msg;
+		UINT64 nanos;
+
+		while (m_Drain->Read(&msg, &nanos, 1) || queue->Read(&msg, &nanos, 1))
+			drain->Push(msg, nanos);
+		queue.swap(drain);
+	}
+	m_Drain.swap(queue);
+}
+
+TCCPResult CCcpSession::PeekMsgs(TCCPMsgSpan *Spans, DWORD *Count)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+
+	// The spans never mix the two rings: a replaced one is read empty first
+	if (m_Drain && !m_Drain->GetFill())
+		m_Drain.reset();
+	*Count = (m_Drain ? m_Drain : m_Queue)->Peek(Spans);
+	return *Count ? CCP_ERROR_ACKNOWLEDGE_OK : CCP_RESULT_PCAN(PCAN_ERROR_QRCVEMPTY);
+}
+
+TCCPResult CCcpSession::ReleaseMsgs(DWORD Count)
+{
+	std::lock_guard<std::mutex> lock(m_ReadLock);
+
+	return (m_Drain ? m_Drain : m_Queue)->Release(Count) ? CCP_ERROR_ACKNOWLEDGE_OK : CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+}
+
+//------------------------------
+// Connection
+//------------------------------
+
+TCCPResult CCcpSession::Connect(WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_CONNECT};
+	TCCPResult result;
+
+	// The station address is always sent in Intel format
+	CcpPutWord(&cro[2], m_SlaveData.EcuAddress, true);
+
+	result = Command(cro, NULL, TimeOut);
+	m_Connected = result == CCP_ERROR_ACKNOWLEDGE_OK;
+	if (m_Connected)
+	{
+		// Privileges survive a temporary disconnect, if the slave says so
+		std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+		m_PrivilegesVerified = false;
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::Disconnect(bool Temporary, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_DISCONNECT};
+	TCCPResult result;
+
+	cro[2] = Temporary ? 0x00 : 0x01;
+	CcpPutWord(&cro[4], m_SlaveData.EcuAddress, true);
+
+	result = Command(cro, NULL, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		m_Connected = false;
+		if (!Temporary)
+		{
+			// The end of the session locks the resources again
+			std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+			m_Privileges = 0;
+		}
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::Test(WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_TEST};
+
+	CcpPutWord(&cro[2], m_SlaveData.EcuAddress, true);
+	return Command(cro, NULL, TimeOut);
+}
+
+//------------------------------
+// Control + Configuration
+//------------------------------
+
+TCCPResult CCcpSession::GetCcpVersion(BYTE *Main, BYTE *Release, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_GET_CCP_VERSION};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!Main || !Release)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = *Main;
+	cro[3] = *Release;
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		*Main = crm[3];
+		*Release = crm[4];
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::ExchangeId(TCCPExchangeData *ECUData, const BYTE *MasterData, int DataLength, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_EXCHANGE_ID};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!ECUData || DataLength < 0 || DataLength > 6 || (DataLength && !MasterData))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	if (DataLength)
+		memcpy(&cro[2], MasterData, DataLength);
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		ECUData->IdLength = crm[3];
+		ECUData->DataType = crm[4];
+		ECUData->AvailabilityMask = crm[5];
+		ECUData->ProtectionMask = crm[6];
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::GetSeed(BYTE Resource, bool *CurrentStatus, BYTE *Seed, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_GET_SEED};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!CurrentStatus || !Seed)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = Resource;
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		*CurrentStatus = crm[3] != 0;
+		memcpy(Seed, &crm[4], CCP_SEED_SIZE);
+		if (!crm[3])
+		{
+			std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+			m_Privileges |= Resource & CCP_RSM_ALL;
+		}
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::Unlock(const BYTE *KeyBuffer, BYTE KeyLength, BYTE *Privileges, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_UNLOCK};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!KeyBuffer || KeyLength > CCP_MAX_KEY_SIZE)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	memcpy(&cro[2], KeyBuffer, KeyLength);
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+		// The CRM holds the privilege status of all the resources
+		m_Privileges = crm[3] & CCP_RSM_ALL;
+		m_PrivilegesVerified = true;
+		if (Privileges)
+			*Privileges = crm[3];
+	}
+	return result;
+}
+
+void CCcpSession::SetKeyAlgorithm(BYTE Resources, const std::shared_ptr<ICcpKeyAlgorithm> &Algorithm)
+{
+	std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+	for (int i = 0; i < CCP_RSM_COUNT; i++)
+	{
+		if (Resources & s_Resources[i])
+			m_KeyAlgorithms[i] = Algorithm;
+	}
+}
+
+TCCPResult CCcpSession::UnlockResources(BYTE Resources, BYTE *Privileges, WORD TimeOut)
+{
+	std::shared_ptr<ICcpKeyAlgorithm> algorithms[CCP_RSM_COUNT];
+	TCCPResult result;
+	BYTE remaining, granted;
+	bool probe;
+
+	if (!Resources)
+		Resources = CCP_RSM_ALL;
+	if (Resources & ~CCP_RSM_ALL)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	{
+		std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+		// Unlocked since the last CONNECT: nothing to send
+		if (m_PrivilegesVerified && (m_Privileges & Resources) == Resources)
+		{
+			if (Privileges)
+				*Privileges = m_Privileges;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+		}
+
+		// Unlocked before a reconnect: a single EXCHANGE_ID tells which are still
+		probe = !m_PrivilegesVerified && (m_Privileges & Resources) != 0;
+		remaining = m_PrivilegesVerified ? Resources & ~m_Privileges : Resources;
+		for (int i = 0; i < CCP_RSM_COUNT; i++)
+			algorithms[i] = m_KeyAlgorithms[i];
+	}
+
+	CCcpUnlockSource source(remaining, probe, algorithms);
+	result = CommandSequence(&source, TimeOut, NULL);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		result = source.GetResult();
+
+	{
+		std::lock_guard<std::mutex> lock(m_SecurityLock);
+
+		if (m_PrivilegesVerified)
+			m_Privileges |= source.GetPrivileges();
+		else if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		{
+			m_Privileges = source.GetPrivileges();
+			m_PrivilegesVerified = true;
+		}
+		granted = m_Privileges;
+	}
+
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK && (granted & Resources) != Resources)
+		result = CCP_ERROR_ACCESS_LOCKED;
+	if (Privileges)
+		*Privileges = granted;
+	return result;
+}
+
+TCCPResult CCcpSession::SetSessionStatus(BYTE Status, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SET_S_STATUS};
+
+	cro[2] = Status;
+	return Command(cro, NULL, TimeOut);
+}
+
+TCCPResult CCcpSession::GetSessionStatus(BYTE *Status, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_GET_S_STATUS};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!Status)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		*Status = crm[3];
+	return result;
+}
+
+//------------------------------
+// Memory management
+//------------------------------
+
+TCCPResult CCcpSession::SetMemoryTransferAddress(BYTE UsedMTA, BYTE AddrExtension, DWORD Addr, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SET_MTA};
+	TCCPResult result;
+
+	if (UsedMTA > 1)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = UsedMTA;
+	cro[3] = AddrExtension;
+	CcpPutDword(&cro[4], Addr, m_SlaveData.IntelFormat);
+	result = Command(cro, NULL, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK && UsedMTA == 0)
+	{
+		m_Mta0Ext = AddrExtension;
+		m_Mta0Addr = Addr;
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::DataCommand(BYTE Code, const BYTE *Data, BYTE Size, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {Code};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!Data)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	// DNLOAD/PROGRAM carry a size byte, the _6 variants a fixed 6 byte block
+	if (Code == CCP_CMD_DNLOAD_6 || Code == CCP_CMD_PROGRAM_6)
+		memcpy(&cro[2], Data, CCP_BLOCK_6);
+	else
+	{
+		if (Size > CCP_MAX_DNLOAD)
+			return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+		cro[2] = Size;
+		memcpy(&cro[3], Data, Size);
+	}
+
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		m_Mta0Ext = crm[3];
+		m_Mta0Addr = CcpGetDword(&crm[4], m_SlaveData.IntelFormat);
+		if (MTA0Ext)
+			*MTA0Ext = m_Mta0Ext;
+		if (MTA0Addr)
+			*MTA0Addr = m_Mta0Addr;
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::Download(const BYTE *DataBytes, BYTE Size, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut)
+{
+	return DataCommand(CCP_CMD_DNLOAD, DataBytes, Size, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult CCcpSession::Download6(const BYTE *DataBytes, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut)
+{
+	return DataCommand(CCP_CMD_DNLOAD_6, DataBytes, CCP_BLOCK_6, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult CCcpSession::Upload(BYTE Size, BYTE *DataBytes, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_UPLOAD};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!DataBytes || Size > CCP_MAX_UPLOAD)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = Size;
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		memcpy(DataBytes, &crm[3], Size);
+		m_Mta0Addr += Size;
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::ShortUpload(BYTE UploadSize, BYTE MTA0Ext, DWORD MTA0Addr, BYTE *ReqData, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SHORT_UP};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!ReqData || UploadSize > CCP_MAX_UPLOAD)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = UploadSize;
+	cro[3] = MTA0Ext;
+	CcpPutDword(&cro[4], MTA0Addr, m_SlaveData.IntelFormat);
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		memcpy(ReqData, &crm[3], UploadSize);
+	return result;
+}
+
+TCCPResult CCcpSession::Move(DWORD SizeOfData, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_MOVE};
+
+	CcpPutDword(&cro[2], SizeOfData, m_SlaveData.IntelFormat);
+	return Command(cro, NULL, TimeOut);
+}
+
+//------------------------------
+// Calibration
+//------------------------------
+
+TCCPResult CCcpSession::SelectCalibrationDataPage(WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SELECT_CAL_PAGE};
+
+	return Command(cro, NULL, TimeOut);
+}
+
+TCCPResult CCcpSession::GetActiveCalibrationPage(BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_GET_ACTIVE_CAL_PAGE};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!MTA0Ext || !MTA0Addr)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		*MTA0Ext = crm[3];
+		*MTA0Addr = CcpGetDword(&crm[4], m_SlaveData.IntelFormat);
+	}
+	return result;
+}
+
+//------------------------------
+// Data Adquisition
+//------------------------------
+
+TCCPResult CCcpSession::GetDAQListSize(BYTE ListNumber, DWORD *DTOId, BYTE *Size, BYTE *FirstPDI, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_GET_DAQ_SIZE};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!Size || !FirstPDI)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = ListNumber;
+	CcpPutDword(&cro[4], DTOId ? *DTOId : m_SlaveData.IdDTO, m_SlaveData.IntelFormat);
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		SetDaqLayout(std::shared_ptr<const TCcpDaqLayout>());
+		*Size = crm[3];
+		*FirstPDI = crm[4];
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::SetDAQListPointer(BYTE ListNumber, BYTE ODTNumber, BYTE ElementNumber, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_SET_DAQ_PTR};
+
+	cro[2] = ListNumber;
+	cro[3] = ODTNumber;
+	cro[4] = ElementNumber;
+	return Command(cro, NULL, TimeOut);
+}
+
+TCCPResult CCcpSession::WriteDAQListEntry(BYTE SizeElement, BYTE AddrExtension, DWORD AddrDAQ, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_WRITE_DAQ};
+
+	if (SizeElement != 1 && SizeElement != 2 && SizeElement != 4)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = SizeElement;
+	cro[3] = AddrExtension;
+	CcpPutDword(&cro[4], AddrDAQ, m_SlaveData.IntelFormat);
+	return Command(cro, NULL, TimeOut);
+}
+
+TCCPResult CCcpSession::StartStopDataTransmission(const TCCPStartStopData *Data, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_START_STOP};
+
+	if (!Data)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	cro[2] = Data->Mode;
+	cro[3] = Data->ListNumber;
+	cro[4] = Data->LastODTNumber;
+	cro[5] = Data->EventChannel;
+	CcpPutWord(&cro[6], Data->TransmissionRatePrescaler, m_SlaveData.IntelFormat);
+	return Command(cro, NULL, TimeOut);
+}
+
+TCCPResult CCcpSession::StartStopSynchronizedDataTransmission(bool StartOrStop, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_START_STOP_ALL};
+
+	cro[2] = StartOrStop ? 0x01 : 0x00;
+	return Command(cro, NULL, TimeOut);
+}
+
+void CCcpSession::SetDaqLayout(const std::shared_ptr<const TCcpDaqLayout> &Layout)
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+	std::shared_ptr<CCcpDaqAssembler> assembler;
+	std::shared_ptr<CCcpDaqMonitor> monitor = std::make_shared<CCcpDaqMonitor>(Layout.get());
+
+	// The measurement quality starts afresh with the layout
+	m_DaqLayout = Layout;
+	m_Decoder.reset();
+	assembler.swap(m_Assembler);
+	monitor.swap(m_Monitor);
+	m_PushAssembler.store(NULL);
+	m_PushMonitor.store(m_Monitor.get());
+	WaitForPush();
+}
+
+std::shared_ptr<const TCcpDaqLayout> CCcpSession::GetDaqLayout()
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+
+	return m_DaqLayout;
+}
+
+void CCcpSession::SetDecoder(const std::shared_ptr<CCcpDtoDecoder> &Decoder)
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+
+	m_Decoder = Decoder;
+}
+
+std::shared_ptr<CCcpDtoDecoder> CCcpSession::GetDecoder()
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+
+	return m_Decoder;
+}
+
+bool CCcpSession::SetAssembler(const std::shared_ptr<CCcpDaqAssembler> &Assembler)
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+	std::shared_ptr<CCcpDaqAssembler> previous = Assembler;
+
+	// The stage is fed the ODT steps of the monitor of the layout kept
+	if (Assembler && Assembler->GetLayout() != m_DaqLayout)
+		return false;
+	previous.swap(m_Assembler);
+	m_PushAssembler.store(m_Assembler.get());
+	WaitForPush();
+	return true;
+}
+
+std::shared_ptr<CCcpDaqAssembler> CCcpSession::GetAssembler()
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+
+	return m_Assembler;
+}
+
+void CCcpSession::ArmFirstDto()
+{
+	// Disarmed while the times are cleared: a DTO taken by a Push in
+	// progress cannot be recorded after it
+	m_FirstDtoArmed.store(false);
+	WaitForPush();
+	for (int pid = 0; pid <= CCP_PID_DAQ_MAX; pid++)
+		m_FirstDto[pid].store(0, std::memory_order_relaxed);
+	m_FirstDtoArmed.store(true);
+}
+
+bool CCcpSession::GetFirstDto(BYTE Pid, UINT64 *Nanos)
+{
+	UINT64 nanos = Pid <= CCP_PID_DAQ_MAX ? m_FirstDto[Pid].load(std::memory_order_relaxed) : 0;
+
+	if (!nanos)
+		return false;
+	*Nanos = nanos;
+	return true;
+}
+
+void CCcpSession::GetDaqHealth(TCCPDaqHealth *Health, TCCPDaqListHealth *Lists, BYTE MaxLists,
+	TCCPDaqJitterHistogram *Histograms, BYTE MaxHistograms, bool Reset)
+{
+	std::lock_guard<std::mutex> lock(m_DaqLock);
+	DWORD fill, capacity;
+
+	{
+		std::lock_guard<std::mutex> readLock(m_ReadLock);
+
+		fill = m_Queue->GetFill() + (m_Drain ? m_Drain->GetFill() : 0);
+		capacity = m_Queue->GetCapacity();
+	}
+	m_Monitor->Snapshot(fill, capacity, Reset, Health, Lists, MaxLists, Histograms, MaxHistograms);
+}
+
+//------------------------------
+// Flash Programming
+//------------------------------
+
+TCCPResult CCcpSession::ClearMemory(DWORD MemorySize, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_CLEAR_MEMORY};
+
+	CcpPutDword(&cro[2], MemorySize, m_SlaveData.IntelFormat);
+	return Command(cro, NULL, TimeOut);
+}
+
+TCCPResult CCcpSession::Program(const BYTE *Data, BYTE Size, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut)
+{
+	return DataCommand(CCP_CMD_PROGRAM, Data, Size, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult CCcpSession::Program6(const BYTE *Data, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut)
+{
+	return DataCommand(CCP_CMD_PROGRAM_6, Data, CCP_BLOCK_6, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult CCcpSession::BuildChecksum(DWORD BlockSize, BYTE *ChecksumData, BYTE *ChecksumSize, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_BUILD_CHKSUM};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (!ChecksumData || !ChecksumSize)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	CcpPutDword(&cro[2], BlockSize, m_SlaveData.IntelFormat);
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		*ChecksumSize = crm[3] > 4 ? 4 : crm[3];
+		memcpy(ChecksumData, &crm[4], *ChecksumSize);
+	}
+	return result;
+}
+
+//------------------------------
+// Diagnostic
+//------------------------------
+
+TCCPResult CCcpSession::ServiceCommand(BYTE Code, WORD Number, const BYTE *Parameters, BYTE ParametersLength, BYTE *ReturnLength, BYTE *ReturnType, WORD TimeOut)
+{
+	BYTE cro[CCP_PACKET_SIZE] = {Code};
+	BYTE crm[CCP_PACKET_SIZE];
+	TCCPResult result;
+
+	if (ParametersLength > 4 || (ParametersLength && !Parameters))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	CcpPutWord(&cro[2], Number, m_SlaveData.IntelFormat);
+	if (ParametersLength)
+		memcpy(&cro[4], Parameters, ParametersLength);
+	result = Command(cro, crm, TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+	{
+		if (ReturnLength)
+			*ReturnLength = crm[3];
+		if (ReturnType)
+			*ReturnType = crm[4];
+	}
+	return result;
+}
+
+TCCPResult CCcpSession::DiagnosticService(WORD DiagnosticNumber, const BYTE *Parameters, BYTE ParametersLength, BYTE *ReturnLength, BYTE *ReturnType, WORD TimeOut)
+{
+	return ServiceCommand(CCP_CMD_DIAG_SERVICE, DiagnosticNumber, Parameters, ParametersLength, ReturnLength, ReturnType, TimeOut);
+}
+
+TCCPResult CCcpSession::ActionService(WORD ActionNumber, const BYTE *Parameters, BYTE ParametersLength, BYTE *ReturnLength, BYTE *ReturnType, WORD TimeOut)
+{
+	return ServiceCommand(CCP_CMD_ACTION_SERVICE, ActionNumber, Parameters, ParametersLength, ReturnLength, ReturnType, TimeOut);
+}
+
@@ -0,0 +1,473 @@
+//  CcpSession.h
+//
+//  ~~~~~~~~~~~~
+//
+//  A PCAN-CCP connection between the master and one slave (TCCPHandle)
+//
+//  ~~~~~~~~~~~~
+//
+#ifndef __CCPSESSIONH__
+#define __CCPSESSIONH__
+
+#include "WinTypes.h"
+#include "PCCP.h"
+#include "CcpProtocol.h"
+#include "CcpRttEstimator.h"
+#include "CcpBusyBackoff.h"
+#include "CcpDaqMonitor.h"
+#include "CcpMsgRing.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+
+class CCcpChannel;
+class ICcpKeyAlgorithm;
+struct TCcpDaqLayout;
+class CCcpDtoDecoder;
+class CCcpDaqAssembler;
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+// CCcpSession::CheckTimeout result when no command is outstanding
+//
+#define CCP_WAIT_INFINITE                      0xFFFFFFFFU
+
+////////////////////////////////////////////////////////////
+// Interface definitions
+////////////////////////////////////////////////////////////
+
+// Supplier of the commands of a CCcpSession::CommandSequence
+//
+class ICcpCommandSource
+{
+public:
+	virtual ~ICcpCommandSource() {}
+
+	/// <summary>
+	/// Builds the next command of the sequence. Cro[1] (counter) is assigned by the session
+	/// </summary>
+	/// <returns>False when the sequence is complete</returns>
+	virtual bool NextCommand(BYTE *Cro) = 0;
+
+	/// <summary>
+	/// Called for each positively acknowledged command, in the context of the
+	/// channel receive thread, before the next command is built
+	/// </summary>
+	virtual void OnResponse(const BYTE *Cro, const BYTE *Crm) = 0;
+};
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+// Completion of an asynchronous command or command sequence: the result, the
+// last CRM received (zeroed if none) and the number of positively acknowledged
+// commands. Called exactly once, in the context of the channel receive thread,
+// or of the caller if the command could not be queued. It must not block nor
+// wait for other commands; chaining further asynchronous commands is fine
+//
+typedef std::function<void(TCCPResult Result, const BYTE *Crm, DWORD Commands)> TCcpCompletion;
+
+// Outcome of an asynchronous command, as delivered by a future
+//
+typedef struct
+{
+	TCCPResult Result;
+	BYTE Crm[CCP_PACKET_SIZE];
+	DWORD Commands;
+}TCcpReply;
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+// Sessions are always owned by a shared_ptr, made by Create: the channel pins
+// them while it delivers frames outside of its lock
+//
+class CCcpSession : public std::enable_shared_from_this<CCcpSession>
+{
+public:
+	/// <summary>
+	/// Creates a session and attaches it to its channel
+	/// </summary>
+	/// <remarks>The session is attached once owned, so that the receive
+	/// thread can pin it as soon as it is seen</remarks>
+	static std::shared_ptr<CCcpSession> Create(const std::shared_ptr<CCcpChannel> &Channel, const TCCPSlaveData &SlaveData);
+
+	// For make_shared only: a session not made by Create is never attached
+	CCcpSession(const std::shared_ptr<CCcpChannel> &Channel, const TCCPSlaveData &SlaveData);
+	~CCcpSession();
+
+	/// <summary>
+	/// Sends a CRO and waits for the matching Command Return Message
+	/// </summary>
+	/// <remarks>The command counter is assigned here. Only one command is
+	/// outstanding per session; concurrent callers are queued in call order.
+	/// Must not be called from a completion (receive thread)</remarks>
+	/// <param name="Cro">The 8 byte command, Cro[0] being the command code</param>
+	/// <param name="Crm">Buffer for the 8 byte CRM (may be NULL)</param>
+	/// <param name="TimeOut">Wait time (millis) for ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult Command(BYTE *Cro, BYTE *Crm, WORD TimeOut);
+
+	/// <summary>
+	/// Runs a sequence of commands back to back: each CRO is sent by the receive
+	/// thread as soon as the CRM of the previous one arrives, without waking up
+	/// the caller in between
+	/// </summary>
+	/// <remarks>The sequence stops at the first negative CRM, whose error is returned</remarks>
+	/// <param name="Source">Supplier of the commands</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <param name="Commands">Buffer for the number of positively acknowledged commands (may be NULL)</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult CommandSequence(ICcpCommandSource *Source, WORD TimeOut, DWORD *Commands);
+
+	/// <summary>
+	/// Queues a CRO and returns at once. The completion is called with the CRM,
+	/// or with the error that ended the command
+	/// </summary>
+	/// <param name="Cro">The 8 byte command, Cro[0] being the command code</param>
+	/// <param name="TimeOut">Wait time (millis) for ECU response. Zero(0) to use the default time</param>
+	/// <param name="Completion">Called once the command is over (see TCcpCompletion)</param>
+	void CommandAsync(const BYTE *Cro, WORD TimeOut, const TCcpCompletion &Completion);
+
+	/// <summary>
+	/// Queues a CRO and returns a future of its outcome
+	/// </summary>
+	std::future<TCcpReply> CommandAsync(const BYTE *Cro, WORD TimeOut);
+
+	/// <summary>
+	/// Queues a CRO like CommandAsync, but leaves its transmission to the
+	/// caller if it goes out at once: the CROs of several connections can then
+	/// be sent in one write (see CCcpChannel::Send). The outcome of the
+	/// transmission is reported with Transmitted
+	/// </summary>
+	/// <param name="Msg">Buffer for the CAN message to be sent</param>
+	/// <returns>true if 'Msg' was filled and must be sent, false if the command waits for the ones queued before it (or is over already)</returns>
+	bool CommandDeferred(const BYTE *Cro, WORD TimeOut, const TCcpCompletion &Completion, TPCANMsg *Msg);
+
+	/// <summary>
+	/// Takes the outcome of the transmission of a message filled by CommandDeferred
+	/// </summary>
+	void Transmitted(const TPCANMsg &Msg, TPCANStatus Status);
+
+	/// <summary>
+	/// Queues a command sequence (see CommandSequence) and returns at once. The
+	/// source must stay valid until the completion is called
+	/// </summary>
+	void CommandSequenceAsync(ICcpCommandSource *Source, WORD TimeOut, const TCcpCompletion &Completion);
+
+	/// <summary>
+	/// Completes all queued commands with the given result, without sending anything more
+	/// </summary>
+	void Abort(TCCPResult Result);
+
+	/// <summary>
+	/// Called by the channel receive thread: resends or ends the outstanding
+	/// command if its time is over
+	/// </summary>
+	/// <returns>Millis until the outstanding command times out, CCP_WAIT_INFINITE if none</returns>
+	DWORD CheckTimeout(std::chrono::steady_clock::time_point Now);
+
+	/// <summary>
+	/// Called by the channel receive thread for every frame sent on IdDTO
+	/// </summary>
+	/// <param name="Msg">The frame</param>
+	/// <param name="Nanos">Receive time of the frame (see ICanTransport::Read)</param>
+	void OnReceive(const TPCANMsg &Msg, UINT64 Nanos);
+
+	/// <summary>
+	/// Sets the time out policy of the commands sent with TimeOut = 0 (see CCP_SetRttParams)
+	/// </summary>
+	/// <returns>False if the bounds are invalid</returns>
+	bool SetRttParams(const TCCPRttParams &Params);
+	void GetRttStats(TCCPRttStats *Stats);
+
+	/// <summary>
+	/// Sets the handling of busy answers (see CCP_SetBusyParams)
+	/// </summary>
+	/// <returns>False if the bounds are invalid</returns>
+	bool SetBusyParams(const TCCPBusyParams &Params);
+	void GetBusyStats(TCCPBusyStats *Stats);
+
+	//------------------------------
+	// Seed & key
+	//------------------------------
+
+	/// <summary>
+	/// Selects the key algorithm of one or more resources (CCP_RSM_* mask). NULL removes it
+	/// </summary>
+	void SetKeyAlgorithm(BYTE Resources, const std::shared_ptr<ICcpKeyAlgorithm> &Algorithm);
+
+	/// <summary>
+	/// Unlocks resources in one pass (GET_SEED + UNLOCK for each protected one,
+	/// back to back). The privileges are cached: resources unlocked since the
+	/// last CONNECT cost no round trip, and after a reconnect one EXCHANGE_ID
+	/// tells whether the slave still has them unlocked
+	/// </summary>
+	/// <param name="Resources">The resources to unlock (CCP_RSM_*). 0 for all of them</param>
+	/// <param name="Privileges">Buffer for the resources known to be unlocked (may be NULL)</param>
+	/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+	/// <returns>A TCCPResult result code</returns>
+	TCCPResult UnlockResources(BYTE Resources, BYTE *Privileges, WORD TimeOut);
+
+	//------------------------------
+	// DAQ
+	//------------------------------
+
+	/// <summary>
+	/// Keeps the DAQ lists configured on the slave (see CCcpDaqConfigurator). NULL
+	/// clears them. The decoder and the reassembly of the previous lists are removed
+	/// </summary>
+	void SetDaqLayout(const std::shared_ptr<const TCcpDaqLayout> &Layout);
+
+	/// <summary>
+	/// Returns the DAQ lists configured on the slave, NULL if none. A GET_DAQ_SIZE
+	/// sent through GetDAQListSize clears a list, and with it the layout
+	/// </summary>
+	std::shared_ptr<const TCcpDaqLayout> GetDaqLayout();
+
+	/// <summary>
+	/// Keeps the DTO decoder of the connection (see CCP_CreateDecoder). NULL removes it
+	/// </summary>
+	void SetDecoder(const std::shared_ptr<CCcpDtoDecoder> &Decoder);
+	std::shared_ptr<CCcpDtoDecoder> GetDecoder();
+
+	/// <summary>
+	/// Routes the DAQ DTOs of the layout to a reassembly stage instead of the
+	/// receive queue (see CCP_SetDaqAssembly). NULL routes them back
+	/// </summary>
+	/// <returns>False if the stage was prepared for another layout than the one kept</returns>
+	bool SetAssembler(const std::shared_ptr<CCcpDaqAssembler> &Assembler);
+	std::shared_ptr<CCcpDaqAssembler> GetAssembler();
+
+	/// <summary>
+	/// Starts recording the receive time of the first DTO of each PID (DAQ start skew)
+	/// </summary>
+	void ArmFirstDto();
+
+	/// <summary>
+	/// Returns the receive time (nanos) of the first DTO of a PID since ArmFirstDto
+	/// </summary>
+	/// <returns>False if none arrived yet</returns>
+	bool GetFirstDto(BYTE Pid, UINT64 *Nanos);
+
+	/// <summary>
+	/// Takes a snapshot of the measurement quality (see CCP_GetDaqHealth)
+	/// </summary>
+	void GetDaqHealth(TCCPDaqHealth *Health, TCCPDaqListHealth *Lists, BYTE MaxLists,
+		TCCPDaqJitterHistogram *Histograms, BYTE MaxHistograms, bool Reset);
+
+	//------------------------------
+	// CCP commands (see PCCP.h)
+	//------------------------------
+
+	TCCPResult Connect(WORD TimeOut);
+	TCCPResult Disconnect(bool Temporary, WORD TimeOut);
+	TCCPResult Test(WORD TimeOut);
+	TCCPResult GetCcpVersion(BYTE *Main, BYTE *Release, WORD TimeOut);
+	TCCPResult ExchangeId(TCCPExchangeData *ECUData, const BYTE *MasterData, int DataLength, WORD TimeOut);
+	TCCPResult GetSeed(BYTE Resource, bool *CurrentStatus, BYTE *Seed, WORD TimeOut);
+	TCCPResult Unlock(const BYTE *KeyBuffer, BYTE KeyLength, BYTE *Privileges, WORD TimeOut);
+	TCCPResult SetSessionStatus(BYTE Status, WORD TimeOut);
+	TCCPResult GetSessionStatus(BYTE *Status, WORD TimeOut);
+	TCCPResult SetMemoryTransferAddress(BYTE UsedMTA, BYTE AddrExtension, DWORD Addr, WORD TimeOut);
+	TCCPResult Download(const BYTE *DataBytes, BYTE Size, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut);
+	TCCPResult Download6(const BYTE *DataBytes, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut);
+	TCCPResult Upload(BYTE Size, BYTE *DataBytes, WORD TimeOut);
+	TCCPResult ShortUpload(BYTE UploadSize, BYTE MTA0Ext, DWORD MTA0Addr, BYTE *ReqData, WORD TimeOut);
+	TCCPResult Move(DWORD SizeOfData, WORD TimeOut);
+	TCCPResult SelectCalibrationDataPage(WORD TimeOut);
+	TCCPResult GetActiveCalibrationPage(BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut);
+	TCCPResult GetDAQListSize(BYTE ListNumber, DWORD *DTOId, BYTE *Size, BYTE *FirstPDI, WORD TimeOut);
+	TCCPResult SetDAQListPointer(BYTE ListNumber, BYTE ODTNumber, BYTE ElementNumber, WORD TimeOut);
+	TCCPResult WriteDAQListEntry(BYTE SizeElement, BYTE AddrExtension, DWORD AddrDAQ, WORD TimeOut);
+	TCCPResult StartStopDataTransmission(const TCCPStartStopData *Data, WORD TimeOut);
+	TCCPResult StartStopSynchronizedDataTransmission(bool StartOrStop, WORD TimeOut);
+	TCCPResult ClearMemory(DWORD MemorySize, WORD TimeOut);
+	TCCPResult Program(const BYTE *Data, BYTE Size, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut);
+	TCCPResult Program6(const BYTE *Data, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut);
+	TCCPResult BuildChecksum(DWORD BlockSize, BYTE *ChecksumData, BYTE *ChecksumSize, WORD TimeOut);
+	TCCPResult DiagnosticService(WORD DiagnosticNumber, const BYTE *Parameters, BYTE ParametersLength, BYTE *ReturnLength, BYTE *ReturnType, WORD TimeOut);
+	TCCPResult ActionService(WORD ActionNumber, const BYTE *Parameters, BYTE ParametersLength, BYTE *ReturnLength, BYTE *ReturnType, WORD TimeOut);
+
+	//------------------------------
+	// Asynchronous messages
+	//------------------------------
+
+	TCCPResult ReadMsg(TCCPMsg *Msg);
+
+	/// <summary>
+	/// Moves up to Count messages out of the receive queue at once
+	/// </summary>
+	/// <param name="Stamps">Buffer for the receive times (may be NULL)</param>
+	/// <returns>PCAN_ERROR_QRCVEMPTY if the queue is empty</returns>
+	TCCPResult ReadMsgs(TCCPMsg *Msgs, UINT64 *Stamps, DWORD Count, DWORD *Read);
+	void ResetQueue();
+
+	/// <summary>
+	/// Replaces the receive queue. The messages waiting are read before those
+	/// queued from then on
+	/// </summary>
+	void SetQueueCapacity(DWORD Capacity);
+
+	/// <summary>
+	/// Returns the messages of the receive queue in place (see CCP_PeekMsgs)
+	/// </summary>
+	/// <returns>PCAN_ERROR_QRCVEMPTY if the queue is empty</returns>
+	TCCPResult PeekMsgs(TCCPMsgSpan *Spans, DWORD *Count);
+
+	/// <summary>
+	/// Takes the oldest messages returned by PeekMsgs from the receive queue
+	/// </summary>
+	/// <returns>PCAN_ERROR_ILLPARAMVAL if fewer messages are waiting</returns>
+	TCCPResult ReleaseMsgs(DWORD Count);
+
+	//------------------------------
+	// Accessors
+	//------------------------------
+
+	const TCCPSlaveData &GetSlaveData() const { return m_SlaveData; }
+	CCcpChannel *GetChannel() const { return m_Channel.get(); }
+	TCCPHandle GetHandle() const { return m_Handle; }
+	void SetHandle(TCCPHandle Handle) { m_Handle = Handle; }
+	bool IsConnected() const { return m_Connected; }
+
+	/// <summary>
+	/// Returns the last MTA0 known by the master (tracked from SET_MTA and the
+	/// post-incremented addresses returned by the slave)
+	/// </summary>
+	void GetMta0(BYTE *Ext, DWORD *Addr) const { *Ext = m_Mta0Ext; *Addr = m_Mta0Addr; }
+
+	/// <summary>
+	/// Updates the tracked MTA0 after commands sent through CommandSequence
+	/// </summary>
+	void SetMta0(BYTE Ext, DWORD Addr) { m_Mta0Ext = Ext; m_Mta0Addr = Addr; }
+
+private:
+	// A queued command or command sequence
+	//
+	struct TCcpOperation
+	{
+		BYTE Cro[CCP_PACKET_SIZE];                         // Command on the bus (sequences: the current one)
+		ICcpCommandSource *Source;                         // NULL for a single command
+		WORD TimeOut;
+		DWORD Commands;                                    // Commands positively acknowledged
+		BYTE Retries;                                      // Resends of the current command
+		bool RestoreMta;                                   // A SET_MTA is sent before resending the current command
+		BYTE BusyAnswers;                                  // Busy answers to the current command
+		bool BusyWait;                                     // Waiting for the final CRM after a busy answer
+		std::chrono::steady_clock::time_point BusySince;   // First busy answer to the current command
+		TCcpCompletion Completion;
+	};
+
+	bool Submit(TCcpOperation &Operation, TPCANMsg *Msg);
+	bool StartNext(TPCANMsg *Msg);
+	void BuildCro(TCcpOperation &Operation, TPCANMsg *Msg);
+	bool Retry(TCcpOperation &Operation);
+	bool WaitBusy(TCcpOperation &Operation, BYTE Error, std::chrono::steady_clock::time_point Now);
+	void EndBusy(TCcpOperation &Operation, bool GaveUp, std::chrono::steady_clock::time_point Now);
+	void TrackMta(const BYTE *Crm);
+	void Transmit(TPCANMsg &Msg);
+	void Complete(std::unique_lock<std::mutex> &Lock, TCCPResult Result, const BYTE *Crm);
+	void Push(const TPCANMsg &Msg, UINT64 Nanos);
+	void WaitForPush();
+	DWORD ReadQueued(TCCPMsg *Msgs, UINT64 *Stamps, DWORD Count);
+	TCCPResult DataCommand(BYTE Code, const BYTE *Data, BYTE Size, BYTE *MTA0Ext, DWORD *MTA0Addr, WORD TimeOut);
+	TCCPResult ServiceCommand(BYTE Code, WORD Number, const BYTE *Parameters, BYTE ParametersLength, BYTE *ReturnLength, BYTE *ReturnType, WORD TimeOut);
+
+	std::shared_ptr<CCcpChannel> m_Channel;
+	TCCPSlaveData m_SlaveData;
+	TCCPHandle m_Handle;
+	bool m_Connected;
+
+	// Command / CRM exchange (protected by m_CrmLock). The front operation is
+	// on the bus while m_Active
+	//
+	std::mutex m_CrmLock;
+	std::deque<TCcpOperation> m_Operations;
+	bool m_Active;
+	BYTE m_Counter;
+	BYTE m_PendingCounter;
+	bool m_Unsent;                                         // CRO built but not handed to the channel yet: it cannot time out
+	std::chrono::steady_clock::time_point m_Deadline;
+
+	// Round trip times (protected by m_CrmLock). m_SentCro is the CRO on the
+	// bus, which is a SET_MTA while an MTA0 is restored
+	//
+	CCcpRttEstimator m_Rtt;
+	BYTE m_SentCro[CCP_PACKET_SIZE];
+	std::chrono::steady_clock::time_point m_SentAt;
+
+	// Busy answers (protected by m_CrmLock)
+	//
+	CCcpBusyBackoff m_Busy;
+
+	// MTA0 of the slave after the last answered command, to restore it before
+	// resending an UPLOAD / DNLOAD (protected by m_CrmLock)
+	//
+	bool m_RetryMtaValid;
+	BYTE m_RetryMtaExt;
+	DWORD m_RetryMtaAddr;
+
+	// Key algorithms (CCP_RSM_* bit order) and the resources known to be
+	// unlocked; m_PrivilegesVerified is cleared by each CONNECT (protected by
+	// m_SecurityLock)
+	//
+	std::mutex m_SecurityLock;
+	std::shared_ptr<ICcpKeyAlgorithm> m_KeyAlgorithms[CCP_RSM_COUNT];
+	BYTE m_Privileges;
+	bool m_PrivilegesVerified;
+
+	// DAQ lists configured on the slave, their decoder, reassembly stage and
+	// measurement quality (protected by m_DaqLock). Push uses the assembler and
+	// the monitor through m_PushAssembler / m_PushMonitor without any lock: one
+	// replaced is released once Push is left (see WaitForPush)
+	//
+	std::mutex m_DaqLock;
+	std::shared_ptr<const TCcpDaqLayout> m_DaqLayout;
+	std::shared_ptr<CCcpDtoDecoder> m_Decoder;
+	std::shared_ptr<CCcpDaqAssembler> m_Assembler;
+	std::shared_ptr<CCcpDaqMonitor> m_Monitor;
+	std::atomic<CCcpDaqAssembler*> m_PushAssembler;
+	std::atomic<CCcpDaqMonitor*> m_PushMonitor;
+
+	// MTA0 as last reported by the slave
+	//
+	BYTE m_Mta0Ext;
+	DWORD m_Mta0Addr;
+
+	// Asynchronous messages (DAQ and event DTOs). Push queues into
+	// m_PushQueue, the readers take m_ReadLock. A ring replaced by
+	// SetQueueCapacity is read empty (m_Drain) before m_Queue
+	//
+	std::mutex m_ReadLock;
+	std::unique_ptr<CCcpMsgRing> m_Queue;
+	std::unique_ptr<CCcpMsgRing> m_Drain;
+	std::atomic<CCcpMsgRing*> m_PushQueue;
+
+	// Odd while the receive thread is in Push
+	//
+	std::atomic<UINT64> m_PushEpoch;
+
+	// Receive time of the first DTO of each PID since ArmFirstDto, 0 if none
+	// yet (written by Push)
+	//
+	std::atomic<bool> m_FirstDtoArmed;
+	std::atomic<UINT64> m_FirstDto[CCP_PID_DAQ_MAX + 1];
+
+	// START_STOP / START_STOP_ALL sent, and those the monitor has seen
+	// (receive thread only)
+	//
+	std::atomic<DWORD> m_DaqRestarts;
+	DWORD m_MonitorRestarts;
+};
+
+#endif
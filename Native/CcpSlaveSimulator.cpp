@@ -0,0 +1,726 @@
+//  CcpSlaveSimulator.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  In-process CCP 2.1 slave (ECU) on a virtual CAN bus, for deterministic
+//  load, latency and regression testing without ECU or CAN hardware
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpSlaveSimulator.h"
+#include "CcpChecksum.h"
+#include "CcpSeedKey.h"
+
+#include <string.h>
+
+// Resources the simulated slave knows about
+//
+#define CCPSIM_RESOURCES                       (CCP_RSM_CALIBRATION | CCP_RSM_DATA_ADQUISITION | CCP_RSM_MEMORY_PROGRAMMING)
+
+// Device ID returned through EXCHANGE_ID / UPLOAD
+//
+static const char s_SlaveId[] = "PCCPSIM";
+
+TCCPSlaveSimConfig CCcpSlaveSimulator::DefaultConfig()
+{
+	TCCPSlaveSimConfig config;
+
+	memset(&config, 0, sizeof(config));
+	config.Slave.EcuAddress = 0x103;
+	config.Slave.IdCRO = 0x8CFF50FF;
+	config.Slave.IdDTO = 0x8CFF5100;
+	config.Slave.IntelFormat = false;
+	config.ProtectionMask = CCP_RSM_NONE;
+	config.DaqLists = 4;
+	config.OdtsPerList = 16;
+	config.EventPeriodUs[0] = 1000;
+	config.EventPeriodUs[1] = 10000;
+	config.EventPeriodUs[2] = 100000;
+	config.ChecksumType = CCP_CHECKSUM_CRC_16_CITT;
+	config.RandomSeed = 1;
+	return config;
+}
+
+CCcpSlaveSimulator::CCcpSlaveSimulator(const std::shared_ptr<CVirtualCanBus> &Bus, const TCCPSlaveSimConfig &Config)
+	: m_Bus(Bus)
+	, m_Config(Config)
+	, m_Running(true)
+	, m_Connected(false)
+	, m_Protection(Config.ProtectionMask & CCPSIM_RESOURCES)
+	, m_SeedResource(0)
+	, m_SessionStatus(0)
+	, m_Mta0Ext(0), m_Mta1Ext(0), m_CalPageExt(0)
+	, m_Mta0Addr(0), m_Mta1Addr(0), m_CalPageAddr(0)
+	, m_DaqPtrList(0), m_DaqPtrOdt(0), m_DaqPtrElement(0)
+	, m_Random(Config.RandomSeed)
+	, m_DtoCredit(0)
+{
+	if (m_Config.DaqLists > CCPSIM_MAX_DAQ_LISTS)
+		m_Config.DaqLists = CCPSIM_MAX_DAQ_LISTS;
+	if (m_Config.OdtsPerList > CCPSIM_MAX_ODTS)
+		m_Config.OdtsPerList = CCPSIM_MAX_ODTS;
+	// All PIDs must stay below the CRM / event PIDs
+	while (m_Config.DaqLists * m_Config.OdtsPerList > CCP_PID_DAQ_MAX + 1)
+		m_Config.DaqLists--;
+
+	memset(m_Seed, 0, sizeof(m_Seed));
+	memset(&m_Stats, 0, sizeof(m_Stats));
+	m_DaqLists.resize(m_Config.DaqLists);
+	ResetDaq();
+
+	AddMemory(CCPSIM_ID_EXTENSION, 0, sizeof(s_SlaveId) - 1, false);
+	WriteImage(CCPSIM_ID_EXTENSION, 0, (const BYTE*)s_SlaveId, sizeof(s_SlaveId) - 1);
+
+	m_CreditTime = Clock::now();
+	for (int i = 0; i < CCPSIM_MAX_EVENT_CHANNELS; i++)
+		m_NextEvent[i] = m_CreditTime;
+
+	m_Worker = std::thread(&CCcpSlaveSimulator::WorkerThread, this);
+	m_Bus->AddNode(this);
+}
+
+CCcpSlaveSimulator::~CCcpSlaveSimulator()
+{
+	// No more CROs once removed from the bus
+	m_Bus->RemoveNode(this);
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		m_Running = false;
+		m_Signal.notify_all();
+	}
+	m_Worker.join();
+}
+
+//------------------------------
+// Memory image
+//------------------------------
+
+void CCcpSlaveSimulator::AddMemory(BYTE Ext, DWORD Base, DWORD Size, bool Flash)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TRegion region;
+
+	region.Ext = Ext;
+	region.Base = Base;
+	region.Flash = Flash;
+	region.Data.assign(Size, Flash ? 0xFF : 0x00);
+	m_Regions.push_back(region);
+}
+
+CCcpSlaveSimulator::TRegion *CCcpSlaveSimulator::FindRegion(BYTE Ext, DWORD Addr, DWORD Size)
+{
+	for (size_t i = 0; i < m_Regions.size(); i++)
+	{
+		TRegion &region = m_Regions[i];
+
+		if (region.Ext == Ext && Addr >= region.Base &&
+			(UINT64)Addr - region.Base + Size <= region.Data.size())
+			return &region;
+	}
+	return NULL;
+}
+
+bool CCcpSlaveSimulator::ReadImage(BYTE Ext, DWORD Addr, BYTE *Data, DWORD Size)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TRegion *region = FindRegion(Ext, Addr, Size);
+
+	if (!region)
+		return false;
+	memcpy(Data, &region->Data[Addr - region->Base], Size);
+	return true;
+}
+
+bool CCcpSlaveSimulator::WriteImage(BYTE Ext, DWORD Addr, const BYTE *Data, DWORD Size)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TRegion *region = FindRegion(Ext, Addr, Size);
+
+	if (!region)
+		return false;
+	memcpy(&region->Data[Addr - region->Base], Data, Size);
+	return true;
+}
+
+BYTE CCcpSlaveSimulator::ReadMemory(BYTE Ext, DWORD Addr, BYTE *Data, DWORD Size)
+{
+	TRegion *region = FindRegion(Ext, Addr, Size);
+
+	if (!region)
+		return CCP_ERROR_PARAM_OUT_OF_RANGE;
+	memcpy(Data, &region->Data[Addr - region->Base], Size);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+BYTE CCcpSlaveSimulator::WriteMemory(BYTE Ext, DWORD Addr, const BYTE *Data, DWORD Size, bool Program)
+{
+	TRegion *region = FindRegion(Ext, Addr, Size);
+	BYTE *target;
+
+	if (!region)
+		return CCP_ERROR_PARAM_OUT_OF_RANGE;
+	if (region->Flash != Program)
+		return CCP_ERROR_ACCESS_DENIED;
+
+	target = &region->Data[Addr - region->Base];
+	if (Program)
+	{
+		// Flash cells only go from 1 to 0; a block must be cleared first
+		for (DWORD i = 0; i < Size; i++)
+			target[i] &= Data[i];
+	}
+	else
+		memcpy(target, Data, Size);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+BYTE CCcpSlaveSimulator::Checksum(BYTE Ext, DWORD Addr, DWORD Size, DWORD *Value, BYTE *ValueSize)
+{
+	TRegion *region = FindRegion(Ext, Addr, Size);
+	BYTE type = m_Config.ChecksumType ? m_Config.ChecksumType : CCP_CHECKSUM_CRC_16_CITT;
+	CCcpChecksum checksum;
+
+	if (!region)
+		return CCP_ERROR_PARAM_OUT_OF_RANGE;
+	if (!checksum.Reset(type, m_Config.Slave.IntelFormat))
+		return CCP_ERROR_UNKNOWN_COMMAND;
+
+	// Word / dword sums over a size not multiple of the unit are refused
+	checksum.Update(&region->Data[Addr - region->Base], Size);
+	if (!checksum.GetValue(Value))
+		return CCP_ERROR_PARAM_OUT_OF_RANGE;
+	*ValueSize = CCcpChecksum::GetSize(type);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+void CCcpSlaveSimulator::ResetDaq()
+{
+	for (size_t i = 0; i < m_DaqLists.size(); i++)
+	{
+		memset(&m_DaqLists[i], 0, sizeof(TDaqList));
+		m_DaqLists[i].Mode = CCP_SSM_STOP;
+	}
+}
+
+//------------------------------
+// Runtime
+//------------------------------
+
+TCCPSlaveSimStats CCcpSlaveSimulator::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	return m_Stats;
+}
+
+void CCcpSlaveSimulator::SetResponseLatency(DWORD LatencyUs, DWORD JitterUs)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Config.ResponseLatencyUs = LatencyUs;
+	m_Config.ResponseJitterUs = JitterUs;
+}
+
+void CCcpSlaveSimulator::SetMaxDtoPerMs(DWORD MaxDtoPerMs)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Config.MaxDtoPerMs = MaxDtoPerMs;
+}
+
+//------------------------------
+// Command processing
+//------------------------------
+
+void CCcpSlaveSimulator::OnFrame(const TPCANMsg &Msg)
+{
+	BYTE crm[CCP_PACKET_SIZE];
+	DWORD latency = 0;
+	TPCANMsg answer;
+
+	if (CanGetId(&Msg) != m_Config.Slave.IdCRO || Msg.LEN < 2)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		if (!Answer(Msg.DATA, crm, &latency))
+			return;
+
+		CanSetId(&answer, m_Config.Slave.IdDTO);
+		answer.LEN = CCP_PACKET_SIZE;
+		memcpy(answer.DATA, crm, CCP_PACKET_SIZE);
+
+		latency += m_Config.ResponseLatencyUs;
+		if (m_Config.ResponseJitterUs)
+			latency += m_Random() % (m_Config.ResponseJitterUs + 1);
+		m_Stats.Responses++;
+		if (latency)
+		{
+			Schedule(answer, latency);
+			return;
+		}
+	}
+
+	// Immediate answer, sent outside the slave lock
+	m_Bus->Transmit(&answer, 1);
+}
+
+bool CCcpSlaveSimulator::Answer(const BYTE *Cro, BYTE *Crm, DWORD *ExtraLatencyUs)
+{
+	BYTE command = Cro[0];
+	WORD station;
+
+	memset(Crm, 0, CCP_PACKET_SIZE);
+	Crm[0] = CCP_PID_CRM;
+	Crm[2] = Cro[1];
+
+	// Station addressing: CONNECT and TEST are the only commands heard while
+	// not connected. A CONNECT to another station disconnects this one
+	//
+	if (command == CCP_CMD_CONNECT || command == CCP_CMD_TEST)
+	{
+		station = CcpGetWord(&Cro[2], true);
+		if (station != m_Config.Slave.EcuAddress)
+		{
+			if (command == CCP_CMD_CONNECT)
+				m_Connected = false;
+			return false;
+		}
+		if (command == CCP_CMD_CONNECT)
+			m_Connected = true;
+		m_Stats.Commands++;
+		return true;
+	}
+	if (!m_Connected)
+		return false;
+
+	m_Stats.Commands++;
+	if (m_Config.DropPercent && (m_Random() % 100) < m_Config.DropPercent)
+	{
+		m_Stats.DroppedResponses++;
+		return false;
+	}
+	if (m_Config.BusyPercent && command != CCP_CMD_DISCONNECT && (m_Random() % 100) < m_Config.BusyPercent)
+	{
+		m_Stats.BusyResponses++;
+		Crm[1] = CCP_ERROR_CMD_PROCESSOR_BUSY;
+		return true;
+	}
+
+	Crm[1] = Execute(Cro, Crm, ExtraLatencyUs);
+	return true;
+}
+
+BYTE CCcpSlaveSimulator::Execute(const BYTE *Cro, BYTE *Crm, DWORD *ExtraLatencyUs)
+{
+	bool intel = m_Config.Slave.IntelFormat;
+	BYTE error, size;
+	DWORD length, value;
+
+	switch (Cro[0])
+	{
+		case CCP_CMD_DISCONNECT:
+			if (CcpGetWord(&Cro[4], true) != m_Config.Slave.EcuAddress)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			m_Connected = false;
+			if (Cro[2] == 0x01)
+			{
+				// End of session
+				ResetDaq();
+				m_Protection = m_Config.ProtectionMask & CCPSIM_RESOURCES;
+				m_SessionStatus = 0;
+			}
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_GET_CCP_VERSION:
+			Crm[3] = 2;
+			Crm[4] = 1;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_EXCHANGE_ID:
+			Crm[3] = sizeof(s_SlaveId) - 1;
+			Crm[4] = 0;
+			Crm[5] = CCPSIM_RESOURCES;
+			Crm[6] = m_Protection;
+			m_Mta0Ext = CCPSIM_ID_EXTENSION;
+			m_Mta0Addr = 0;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_GET_SEED:
+			if (Cro[2] != CCP_RSM_CALIBRATION && Cro[2] != CCP_RSM_DATA_ADQUISITION && Cro[2] != CCP_RSM_MEMORY_PROGRAMMING)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			for (int i = 0; i < CCPSIM_SEED_SIZE; i++)
+				m_Seed[i] = (BYTE)m_Random();
+			m_SeedResource = Cro[2];
+			Crm[3] = Locked(Cro[2]) ? 1 : 0;
+			memcpy(&Crm[4], m_Seed, CCPSIM_SEED_SIZE);
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_UNLOCK:
+		{
+			BYTE key[CCPSIM_SEED_SIZE];
+
+			if (!m_SeedResource)
+				return CCP_ERROR_SESSION_STS_REQUEST;
+			CCcpTestKeyAlgorithm::ComputeTestKey(m_Seed, key);
+			if (memcmp(key, &Cro[2], CCPSIM_SEED_SIZE) != 0)
+			{
+				m_SeedResource = 0;
+				return CCP_ERROR_ACCESS_LOCKED;
+			}
+			m_Protection &= ~m_SeedResource;
+			m_SeedResource = 0;
+			Crm[3] = CCPSIM_RESOURCES & ~m_Protection;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+		}
+
+		case CCP_CMD_SET_S_STATUS:
+			m_SessionStatus = Cro[2];
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_GET_S_STATUS:
+			Crm[3] = m_SessionStatus;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		//------------------------------
+		// Memory
+		//------------------------------
+
+		case CCP_CMD_SET_MTA:
+			if (Cro[2] > 1)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			if (Cro[2] == 0)
+			{
+				m_Mta0Ext = Cro[3];
+				m_Mta0Addr = CcpGetDword(&Cro[4], intel);
+			}
+			else
+			{
+				m_Mta1Ext = Cro[3];
+				m_Mta1Addr = CcpGetDword(&Cro[4], intel);
+			}
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_DNLOAD:
+		case CCP_CMD_DNLOAD_6:
+		case CCP_CMD_PROGRAM:
+		case CCP_CMD_PROGRAM_6:
+		{
+			bool program = Cro[0] == CCP_CMD_PROGRAM || Cro[0] == CCP_CMD_PROGRAM_6;
+			bool block6 = Cro[0] == CCP_CMD_DNLOAD_6 || Cro[0] == CCP_CMD_PROGRAM_6;
+			const BYTE *data = block6 ? &Cro[2] : &Cro[3];
+
+			if (Locked(program ? CCP_RSM_MEMORY_PROGRAMMING : CCP_RSM_CALIBRATION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			size = block6 ? CCP_BLOCK_6 : Cro[2];
+			if (size > (block6 ? CCP_BLOCK_6 : CCP_MAX_DNLOAD))
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			error = WriteMemory(m_Mta0Ext, m_Mta0Addr, data, size, program);
+			if (error != CCP_ERROR_ACKNOWLEDGE_OK)
+				return error;
+			m_Mta0Addr += size;
+			Crm[3] = m_Mta0Ext;
+			CcpPutDword(&Crm[4], m_Mta0Addr, intel);
+			if (program)
+				*ExtraLatencyUs = m_Config.FlashLatencyUs;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+		}
+
+		case CCP_CMD_UPLOAD:
+			size = Cro[2];
+			if (size > CCP_MAX_UPLOAD)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			error = ReadMemory(m_Mta0Ext, m_Mta0Addr, &Crm[3], size);
+			if (error == CCP_ERROR_ACKNOWLEDGE_OK)
+				m_Mta0Addr += size;
+			return error;
+
+		case CCP_CMD_SHORT_UP:
+			size = Cro[2];
+			if (size > CCP_MAX_UPLOAD)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			return ReadMemory(Cro[3], CcpGetDword(&Cro[4], intel), &Crm[3], size);
+
+		case CCP_CMD_MOVE:
+		{
+			std::vector<BYTE> buffer;
+
+			if (Locked(CCP_RSM_CALIBRATION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			length = CcpGetDword(&Cro[2], intel);
+			buffer.resize(length);
+			error = ReadMemory(m_Mta0Ext, m_Mta0Addr, buffer.data(), length);
+			if (error == CCP_ERROR_ACKNOWLEDGE_OK)
+				error = WriteMemory(m_Mta1Ext, m_Mta1Addr, buffer.data(), length, false);
+			if (error == CCP_ERROR_ACKNOWLEDGE_OK)
+			{
+				m_Mta0Addr += length;
+				m_Mta1Addr += length;
+			}
+			return error;
+		}
+
+		case CCP_CMD_SELECT_CAL_PAGE:
+			m_CalPageExt = m_Mta0Ext;
+			m_CalPageAddr = m_Mta0Addr;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_GET_ACTIVE_CAL_PAGE:
+			Crm[3] = m_CalPageExt;
+			CcpPutDword(&Crm[4], m_CalPageAddr, intel);
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		//------------------------------
+		// Flash
+		//------------------------------
+
+		case CCP_CMD_CLEAR_MEMORY:
+		{
+			TRegion *region;
+
+			if (Locked(CCP_RSM_MEMORY_PROGRAMMING))
+				return CCP_ERROR_ACCESS_LOCKED;
+			length = CcpGetDword(&Cro[2], intel);
+			region = FindRegion(m_Mta0Ext, m_Mta0Addr, length);
+			if (!region)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			if (!region->Flash)
+				return CCP_ERROR_ACCESS_DENIED;
+			memset(&region->Data[m_Mta0Addr - region->Base], 0xFF, length);
+			*ExtraLatencyUs = m_Config.FlashLatencyUs;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+		}
+
+		case CCP_CMD_BUILD_CHKSUM:
+			length = CcpGetDword(&Cro[2], intel);
+			error = Checksum(m_Mta0Ext, m_Mta0Addr, length, &value, &Crm[3]);
+			if (error != CCP_ERROR_ACKNOWLEDGE_OK)
+				return error;
+			if (Crm[3] == 1)
+				Crm[4] = (BYTE)value;
+			else if (Crm[3] == 2)
+				CcpPutWord(&Crm[4], (WORD)value, intel);
+			else
+				CcpPutDword(&Crm[4], value, intel);
+			*ExtraLatencyUs = m_Config.FlashLatencyUs;
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		//------------------------------
+		// Data acquisition
+		//------------------------------
+
+		case CCP_CMD_GET_DAQ_SIZE:
+			if (Locked(CCP_RSM_DATA_ADQUISITION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			if (Cro[2] >= m_DaqLists.size())
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			memset(&m_DaqLists[Cro[2]], 0, sizeof(TDaqList));
+			Crm[3] = m_Config.OdtsPerList;
+			Crm[4] = (BYTE)(Cro[2] * m_Config.OdtsPerList);
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_SET_DAQ_PTR:
+			if (Locked(CCP_RSM_DATA_ADQUISITION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			if (Cro[2] >= m_DaqLists.size() || Cro[3] >= m_Config.OdtsPerList || Cro[4] >= CCP_ODT_DATA_SIZE)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			m_DaqPtrList = Cro[2];
+			m_DaqPtrOdt = Cro[3];
+			m_DaqPtrElement = Cro[4];
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		case CCP_CMD_WRITE_DAQ:
+		{
+			TDaqElement *element;
+
+			if (Locked(CCP_RSM_DATA_ADQUISITION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			size = Cro[2];
+			if ((size != 1 && size != 2 && size != 4) || m_DaqPtrElement + size > CCP_ODT_DATA_SIZE)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			element = &m_DaqLists[m_DaqPtrList].Elements[m_DaqPtrOdt][m_DaqPtrElement];
+			element->Size = size;
+			element->Ext = Cro[3];
+			element->Addr = CcpGetDword(&Cro[4], intel);
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+		}
+
+		case CCP_CMD_START_STOP:
+		{
+			TDaqList *list;
+			BYTE channel = Cro[5];
+
+			if (Locked(CCP_RSM_DATA_ADQUISITION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			if (Cro[2] > CCP_SSM_PREPARE_START || Cro[3] >= m_DaqLists.size() || Cro[4] >= m_Config.OdtsPerList)
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			if (Cro[2] != CCP_SSM_STOP && (channel >= CCPSIM_MAX_EVENT_CHANNELS || !m_Config.EventPeriodUs[channel]))
+				return CCP_ERROR_PARAM_OUT_OF_RANGE;
+			list = &m_DaqLists[Cro[3]];
+			list->Mode = Cro[2];
+			list->LastOdt = Cro[4];
+			list->EventChannel = channel;
+			list->Prescaler = CcpGetWord(&Cro[6], intel);
+			list->EventCount = 0;
+			m_Signal.notify_all();
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+		}
+
+		case CCP_CMD_START_STOP_ALL:
+			if (Locked(CCP_RSM_DATA_ADQUISITION))
+				return CCP_ERROR_ACCESS_LOCKED;
+			for (size_t i = 0; i < m_DaqLists.size(); i++)
+			{
+				if (Cro[2] == 0x00)
+					m_DaqLists[i].Mode = CCP_SSM_STOP;
+				else if (m_DaqLists[i].Mode == CCP_SSM_PREPARE_START)
+				{
+					m_DaqLists[i].Mode = CCP_SSM_START;
+					m_DaqLists[i].EventCount = 0;
+				}
+			}
+			m_Signal.notify_all();
+			return CCP_ERROR_ACKNOWLEDGE_OK;
+
+		default:
+			return CCP_ERROR_UNKNOWN_COMMAND;
+	}
+}
+
+//------------------------------
+// Transmission
+//------------------------------
+
+void CCcpSlaveSimulator::Schedule(const TPCANMsg &Msg, DWORD LatencyUs)
+{
+	TPending pending;
+
+	pending.Due = Clock::now() + std::chrono::microseconds(LatencyUs);
+	pending.Msg = Msg;
+	m_Pending.push(pending);
+	m_Signal.notify_all();
+}
+
+void CCcpSlaveSimulator::RunEvent(int Channel, std::vector<TPCANMsg> &Out)
+{
+	Clock::time_point now = Clock::now();
+	TPCANMsg msg;
+
+	// Refill the DTO budget of the slave
+	if (m_Config.MaxDtoPerMs)
+	{
+		m_DtoCredit += std::chrono::duration<double, std::milli>(now - m_CreditTime).count() * m_Config.MaxDtoPerMs;
+		if (m_DtoCredit > m_Config.MaxDtoPerMs)
+			m_DtoCredit = m_Config.MaxDtoPerMs;
+	}
+	m_CreditTime = now;
+
+	CanSetId(&msg, m_Config.Slave.IdDTO);
+	msg.LEN = CCP_PACKET_SIZE;
+
+	for (size_t list = 0; list < m_DaqLists.size(); list++)
+	{
+		TDaqList &daq = m_DaqLists[list];
+
+		if (daq.Mode != CCP_SSM_START || daq.EventChannel != Channel)
+			continue;
+		if (daq.Prescaler > 1 && (daq.EventCount++ % daq.Prescaler) != 0)
+			continue;
+
+		for (int odt = 0; odt <= daq.LastOdt; odt++)
+		{
+			if (m_Config.MaxDtoPerMs)
+			{
+				if (m_DtoCredit < 1.0)
+				{
+					// The rest of the cycle is lost: signal the overload
+					m_Stats.DaqOverloads++;
+					memset(msg.DATA, 0, sizeof(msg.DATA));
+					msg.DATA[0] = CCP_PID_EVENT;
+					msg.DATA[1] = CCP_ERROR_DAQ_OVERLOAD;
+					msg.DATA[2] = (BYTE)list;
+					Out.push_back(msg);
+					break;
+				}
+				m_DtoCredit -= 1.0;
+			}
+
+			memset(msg.DATA, 0, sizeof(msg.DATA));
+			msg.DATA[0] = (BYTE)(list * m_Config.OdtsPerList + odt);
+			for (int pos = 0; pos < CCP_ODT_DATA_SIZE; pos++)
+			{
+				const TDaqElement &element = daq.Elements[odt][pos];
+
+				if (element.Size)
+					ReadMemory(element.Ext, element.Addr, &msg.DATA[1 + pos], element.Size);
+			}
+			Out.push_back(msg);
+			m_Stats.DaqMessages++;
+		}
+	}
+}
+
+void CCcpSlaveSimulator::WorkerThread()
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	std::vector<TPCANMsg> out;
+	Clock::time_point now, wake;
+	bool active[CCPSIM_MAX_EVENT_CHANNELS];
+
+	while (m_Running)
+	{
+		now = Clock::now();
+		wake = now + std::chrono::seconds(1);
+
+		// Event channels driving at least one running DAQ list
+		for (int ch = 0; ch < CCPSIM_MAX_EVENT_CHANNELS; ch++)
+			active[ch] = false;
+		for (size_t i = 0; i < m_DaqLists.size(); i++)
+		{
+			if (m_DaqLists[i].Mode == CCP_SSM_START)
+				active[m_DaqLists[i].EventChannel] = true;
+		}
+
+		for (int ch = 0; ch < CCPSIM_MAX_EVENT_CHANNELS; ch++)
+		{
+			std::chrono::microseconds period(m_Config.EventPeriodUs[ch]);
+
+			if (!active[ch] || !period.count())
+			{
+				m_NextEvent[ch] = now;
+				continue;
+			}
+			if (m_NextEvent[ch] <= now)
+			{
+				RunEvent(ch, out);
+				m_NextEvent[ch] += period;
+				// Too late by more than a period: restart the raster instead of bursting
+				if (m_NextEvent[ch] < now)
+					m_NextEvent[ch] = now + period;
+			}
+			if (m_NextEvent[ch] < wake)
+				wake = m_NextEvent[ch];
+		}
+
+		while (!m_Pending.empty() && m_Pending.top().Due <= now)
+		{
+			out.push_back(m_Pending.top().Msg);
+			m_Pending.pop();
+		}
+		if (!m_Pending.empty() && m_Pending.top().Due < wake)
+			wake = m_Pending.top().Due;
+
+		if (!out.empty())
+		{
+			// Sent without the slave lock: the bus may call back into OnFrame
+			lock.unlock();
+			m_Bus->Transmit(out.data(), (int)out.size());
+			out.clear();
+			lock.lock();
+			continue;
+		}
+		m_Signal.wait_until(lock, wake);
+	}
+}
@@ -0,0 +1,212 @@
+//  CcpSlaveSimulator.h
+//
+//  ~~~~~~~~~~~~
+//
+//  In-process CCP 2.1 slave (ECU) on a virtual CAN bus, for deterministic
+//  load, latency and regression testing without ECU or CAN hardware
+//
+//  ~~~~~~~~~~~~
+//
+//  Emulates:
+//  - a memory image made of RAM and flash regions (per address extension)
+//  - DAQ lists / ODTs driven by periodic event channels, with prescalers
+//  - seed & key protection of the calibration, DAQ and programming resources
+//    (keys of CCcpTestKeyAlgorithm)
+//  - CLEAR_MEMORY / PROGRAM / PROGRAM_6 and BUILD_CHKSUM
+//  - response latency and jitter, DAQ bandwidth limit (overload), busy
+//    answers and lost CRMs, all drawn from a seeded generator
+//
+//  DAQ element numbers (SET_DAQ_PTR) are byte positions within the 7 data
+//  bytes of an ODT.
+//
+#ifndef __CCPSLAVESIMULATORH__
+#define __CCPSLAVESIMULATORH__
+
+#include "WinTypes.h"
+#include "PCCP.h"
+#include "CcpProtocol.h"
+#include "VirtualCanBus.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+#define CCPSIM_MAX_EVENT_CHANNELS              8         // Event channels of the simulated ECU
+#define CCPSIM_MAX_DAQ_LISTS                   8         // Upper bound of TCCPSlaveSimConfig::DaqLists
+#define CCPSIM_MAX_ODTS                        64        // Upper bound of TCCPSlaveSimConfig::OdtsPerList
+#define CCPSIM_ID_EXTENSION                    0xFF      // Address extension of the slave ID (EXCHANGE_ID)
+#define CCPSIM_SEED_SIZE                       4         // Bytes of a seed / key
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+// Configuration of a simulated slave
+//
+typedef struct
+{
+	TCCPSlaveData Slave;                                   // Station address, CRO/DTO Ids and byte order
+	BYTE ProtectionMask;                                   // Resources locked until unlocked (CCP_RSM_*)
+	BYTE DaqLists;                                         // Number of DAQ lists
+	BYTE OdtsPerList;                                      // ODTs of each DAQ list
+	DWORD EventPeriodUs[CCPSIM_MAX_EVENT_CHANNELS];        // Period of each event channel (0: channel not available)
+	DWORD ResponseLatencyUs;                               // Time from CRO to CRM
+	DWORD ResponseJitterUs;                                // Random extra time added to the latency (0..value)
+	DWORD FlashLatencyUs;                                  // Extra time of CLEAR_MEMORY / PROGRAM / BUILD_CHKSUM
+	BYTE ChecksumType;                                     // BUILD_CHKSUM algorithm (CCP_CHECKSUM_*). 0: CRC-16 CCITT
+	DWORD MaxDtoPerMs;                                     // DAQ bandwidth of the slave. 0: unlimited
+	BYTE BusyPercent;                                      // Commands answered with CCP_ERROR_CMD_PROCESSOR_BUSY
+	BYTE DropPercent;                                      // CRMs never sent (lost frames)
+	DWORD RandomSeed;                                      // Seed of latency / busy / drop decisions
+}TCCPSlaveSimConfig;
+
+// Counters of a simulated slave
+//
+typedef struct
+{
+	UINT64 Commands;                                       // CROs processed
+	UINT64 Responses;                                      // CRMs sent
+	UINT64 DroppedResponses;                               // CRMs lost on purpose
+	UINT64 BusyResponses;                                  // Commands answered busy
+	UINT64 DaqMessages;                                    // DAQ DTOs sent
+	UINT64 DaqOverloads;                                   // DAQ cycles (partly) lost to the bandwidth limit
+}TCCPSlaveSimStats;
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+class CCcpSlaveSimulator : public IVirtualCanNode
+{
+public:
+	/// <summary>
+	/// Returns the configuration of the ECU used by CCPDemo (station 0x103,
+	/// CRO 0x8CFF50FF, DTO 0x8CFF5100, Motorola format), answering immediately
+	/// </summary>
+	static TCCPSlaveSimConfig DefaultConfig();
+
+	CCcpSlaveSimulator(const std::shared_ptr<CVirtualCanBus> &Bus, const TCCPSlaveSimConfig &Config);
+	virtual ~CCcpSlaveSimulator();
+
+	//------------------------------
+	// Memory image
+	//------------------------------
+
+	/// <summary>
+	/// Adds a memory region to the image. Flash regions are only written by
+	/// PROGRAM commands and erased (0xFF) by CLEAR_MEMORY
+	/// </summary>
+	void AddMemory(BYTE Ext, DWORD Base, DWORD Size, bool Flash);
+
+	/// <summary>
+	/// Direct access to the image, bypassing CCP (test setup and verification)
+	/// </summary>
+	bool ReadImage(BYTE Ext, DWORD Addr, BYTE *Data, DWORD Size);
+	bool WriteImage(BYTE Ext, DWORD Addr, const BYTE *Data, DWORD Size);
+
+	//------------------------------
+	// Runtime
+	//------------------------------
+
+	TCCPSlaveSimStats GetStats();
+	void SetResponseLatency(DWORD LatencyUs, DWORD JitterUs);
+	void SetMaxDtoPerMs(DWORD MaxDtoPerMs);
+
+	// IVirtualCanNode
+	virtual void OnFrame(const TPCANMsg &Msg);
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct TRegion
+	{
+		BYTE Ext;
+		DWORD Base;
+		bool Flash;
+		std::vector<BYTE> Data;
+	};
+
+	struct TDaqElement
+	{
+		BYTE Size;
+		BYTE Ext;
+		DWORD Addr;
+	};
+
+	struct TDaqList
+	{
+		TDaqElement Elements[CCPSIM_MAX_ODTS][CCP_ODT_DATA_SIZE];   // [ODT][byte position]
+		BYTE Mode;                                     // CCP_SSM_*
+		BYTE LastOdt;
+		BYTE EventChannel;
+		WORD Prescaler;
+		DWORD EventCount;
+	};
+
+	struct TPending
+	{
+		Clock::time_point Due;
+		TPCANMsg Msg;
+		bool operator<(const TPending &Other) const { return Due > Other.Due; }
+	};
+
+	// Command processing (called with m_Lock held)
+	//
+	bool Answer(const BYTE *Cro, BYTE *Crm, DWORD *ExtraLatencyUs);
+	BYTE Execute(const BYTE *Cro, BYTE *Crm, DWORD *ExtraLatencyUs);
+	TRegion *FindRegion(BYTE Ext, DWORD Addr, DWORD Size);
+	BYTE ReadMemory(BYTE Ext, DWORD Addr, BYTE *Data, DWORD Size);
+	BYTE WriteMemory(BYTE Ext, DWORD Addr, const BYTE *Data, DWORD Size, bool Program);
+	BYTE Checksum(BYTE Ext, DWORD Addr, DWORD Size, DWORD *Value, BYTE *ValueSize);
+	void ResetDaq();
+	bool Locked(BYTE Resource) const { return (m_Protection & Resource) != 0; }
+
+	// Transmission
+	//
+	void Schedule(const TPCANMsg &Msg, DWORD LatencyUs);
+	void WorkerThread();
+	void RunEvent(int Channel, std::vector<TPCANMsg> &Out);
+
+	std::shared_ptr<CVirtualCanBus> m_Bus;
+	TCCPSlaveSimConfig m_Config;
+
+	std::mutex m_Lock;
+	std::condition_variable m_Signal;
+	std::thread m_Worker;
+	bool m_Running;
+
+	// ECU state
+	//
+	bool m_Connected;
+	BYTE m_Protection;
+	BYTE m_SeedResource;
+	BYTE m_Seed[CCPSIM_SEED_SIZE];
+	BYTE m_SessionStatus;
+	BYTE m_Mta0Ext, m_Mta1Ext, m_CalPageExt;
+	DWORD m_Mta0Addr, m_Mta1Addr, m_CalPageAddr;
+	BYTE m_DaqPtrList, m_DaqPtrOdt, m_DaqPtrElement;
+	std::vector<TRegion> m_Regions;
+	std::vector<TDaqList> m_DaqLists;
+	std::mt19937 m_Random;
+
+	// Output scheduling
+	//
+	std::priority_queue<TPending> m_Pending;
+	Clock::time_point m_NextEvent[CCPSIM_MAX_EVENT_CHANNELS];
+	double m_DtoCredit;
+	Clock::time_point m_CreditTime;
+
+	TCCPSlaveSimStats m_Stats;
+};
+
+#endif
@@ -0,0 +1,450 @@
+//  CcpStationMux.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Several slave stations served through one channel by switching the
+//  selected station (temporary DISCONNECT / CONNECT)
+//
+//  ~~~~~~~~~~~~
+//
+#include "CcpStationMux.h"
+#include "CcpProtocol.h"
+#include "CcpChannel.h"
+
+#include <string.h>
+#include <algorithm>
+#include <future>
+
+// CRM handed to the completions of commands that were never sent
+//
+static const BYTE s_NoCrm[CCP_PACKET_SIZE] = {0};
+
+static UINT64 MicrosSince(std::chrono::steady_clock::time_point Start, std::chrono::steady_clock::time_point Now)
+{
+	return (UINT64)std::chrono::duration_cast<std::chrono::microseconds>(Now - Start).count();
+}
+
+CCcpStationMux::CCcpStationMux(const std::shared_ptr<CCcpChannel> &Channel)
+	: m_Channel(Channel)
+	, m_Handle(0)
+	, m_Params(DefaultParams())
+	, m_Current(-1)
+	, m_InFlight(false)
+	, m_Pumping(false)
+	, m_Closed(false)
+	, m_Callbacks(0)
+	, m_SliceCommands(0)
+	, m_Switches(0)
+	, m_SwitchFailures(0)
+	, m_SwitchMicros(0)
+	, m_CommandMicros(0)
+{
+}
+
+CCcpStationMux::~CCcpStationMux()
+{
+	Close();
+
+	// The completions of the sessions refer to this object
+	std::unique_lock<std::mutex> lock(m_Lock);
+	m_Idle.wait(lock, [this] { return m_Callbacks == 0; });
+}
+
+TCCPMuxParams CCcpStationMux::DefaultParams()
+{
+	TCCPMuxParams params;
+
+	params.MaxBatch = CCP_MUX_DEFAULT_BATCH;
+	params.MaxSlice = 0;
+	params.ImplicitSwitch = false;
+	params.SwitchTimeOut = 0;
+	return params;
+}
+
+bool CCcpStationMux::SetParams(const TCCPMuxParams &Params)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Params = Params;
+	if (!m_Params.MaxBatch)
+		m_Params.MaxBatch = CCP_MUX_DEFAULT_BATCH;
+	return true;
+}
+
+bool CCcpStationMux::AddStation(const TCCPSlaveData &SlaveData, BYTE *Station)
+{
+	// The session attaches to the channel, whose receive thread takes m_Lock
+	// in the completions: created (and dropped if refused) outside of it
+	std::shared_ptr<CCcpSession> session = CCcpSession::Create(m_Channel, SlaveData);
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TStation station;
+
+	if (m_Closed || m_Stations.size() >= CCP_MUX_MAX_STATIONS)
+		return false;
+	for (size_t i = 0; i < m_Stations.size(); i++)
+	{
+		const TCCPSlaveData &data = m_Stations[i].Session->GetSlaveData();
+
+		if (data.EcuAddress == SlaveData.EcuAddress && data.IdCRO == SlaveData.IdCRO)
+			return false;
+	}
+
+	station.Session = session;
+	memset(&station.Stats, 0, sizeof(station.Stats));
+	*Station = (BYTE)m_Stations.size();
+	m_Stations.push_back(std::move(station));
+	return true;
+}
+
+bool CCcpStationMux::IsStation(BYTE Station)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	return Station < m_Stations.size();
+}
+
+void CCcpStationMux::CommandAsync(BYTE Station, const BYTE *Cro, WORD TimeOut, const TCcpCompletion &Completion)
+{
+	bool queued = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		TCommand command;
+
+		if (!m_Closed && Station < m_Stations.size())
+		{
+			memcpy(command.Cro, Cro, CCP_PACKET_SIZE);
+			command.TimeOut = TimeOut;
+			command.Completion = Completion;
+			command.Queued = Clock::now();
+			m_Stations[Station].Pending.push_back(std::move(command));
+			m_Stations[Station].Stats.Pending++;
+			queued = true;
+		}
+	}
+
+	if (!queued)
+	{
+		if (Completion)
+			Completion(CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE), s_NoCrm, 0);
+		return;
+	}
+	Pump();
+}
+
+TCCPResult CCcpStationMux::Command(BYTE Station, const BYTE *Cro, BYTE *Crm, WORD TimeOut)
+{
+	std::shared_ptr<std::promise<TCcpReply> > reply = std::make_shared<std::promise<TCcpReply> >();
+	std::future<TCcpReply> future = reply->get_future();
+	TCcpReply value;
+
+	CommandAsync(Station, Cro, TimeOut, [reply](TCCPResult Result, const BYTE *Crm, DWORD Count)
+	{
+		TCcpReply value;
+
+		value.Result = Result;
+		value.Commands = Count;
+		memcpy(value.Crm, Crm, CCP_PACKET_SIZE);
+		reply->set_value(value);
+	});
+	value = future.get();
+	if (Crm)
+		memcpy(Crm, value.Crm, CCP_PACKET_SIZE);
+	return value.Result;
+}
+
+void CCcpStationMux::Close()
+{
+	std::deque<TCommand> commands;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		m_Closed = true;
+		for (size_t i = 0; i < m_Stations.size(); i++)
+		{
+			for (size_t j = 0; j < m_Stations[i].Pending.size(); j++)
+				commands.push_back(std::move(m_Stations[i].Pending[j]));
+			m_Stations[i].Pending.clear();
+			m_Stations[i].Stats.Pending = 0;
+		}
+	}
+	Fail(commands, CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE));
+}
+
+void CCcpStationMux::GetStats(TCCPMuxStats *Stats)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	double sum = 0, squares = 0;
+	DWORD waiting = 0;
+
+	memset(Stats, 0, sizeof(*Stats));
+	Stats->Stations = (BYTE)m_Stations.size();
+	Stats->Switches = m_Switches;
+	Stats->SwitchFailures = m_SwitchFailures;
+	Stats->SwitchMicros = m_SwitchMicros;
+	Stats->CommandMicros = m_CommandMicros;
+	if (m_SwitchMicros + m_CommandMicros)
+		Stats->SwitchOverhead = (WORD)(m_SwitchMicros * 1000 / (m_SwitchMicros + m_CommandMicros));
+
+	// Jain's index (sum x)^2 / (n * sum x^2) over the mean waits of the
+	// stations that sent commands: 1 when all waited alike, 1/n when one
+	// station got all the waiting
+	for (size_t i = 0; i < m_Stations.size(); i++)
+	{
+		const TCCPMuxStationStats &station = m_Stations[i].Stats;
+		double wait;
+
+		Stats->Commands += station.Commands;
+		if (!station.Commands)
+			continue;
+		wait = (double)station.WaitMicros / station.Commands;
+		sum += wait;
+		squares += wait * wait;
+		waiting++;
+	}
+	Stats->Fairness = squares > 0 ? (WORD)(sum * sum * 1000 / (waiting * squares)) : 1000;
+	if (m_Switches)
+		Stats->CommandsPerSwitch = Stats->Commands / m_Switches;
+}
+
+bool CCcpStationMux::GetStationStats(BYTE Station, TCCPMuxStationStats *Stats)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	if (Station >= m_Stations.size())
+		return false;
+	*Stats = m_Stations[Station].Stats;
+	return true;
+}
+
+//------------------------------
+// Scheduling
+//------------------------------
+
+bool CCcpStationMux::SliceOver(Clock::time_point Now) const
+{
+	// Called with m_Lock held
+	if (m_SliceCommands >= m_Params.MaxBatch)
+		return true;
+	return m_Params.MaxSlice && Now - m_SliceStart >= std::chrono::milliseconds(m_Params.MaxSlice);
+}
+
+int CCcpStationMux::NextStation() const
+{
+	int count = (int)m_Stations.size();
+
+	// Called with m_Lock held. Round robin from the station after the
+	// selected one; the selected station comes last
+	for (int i = 1; i <= count; i++)
+	{
+		int station = (m_Current + i) % count;
+
+		if (!m_Stations[station].Pending.empty())
+			return station;
+	}
+	return -1;
+}
+
+void CCcpStationMux::Pump()
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+
+	// A single thread hands out the work. A completion arriving meanwhile
+	// finds the flag set and leaves the next step to that thread, which
+	// checks m_InFlight again after each call
+	if (m_Pumping)
+		return;
+	m_Pumping = true;
+
+	while (!m_InFlight && !m_Closed)
+	{
+		Clock::time_point now = Clock::now();
+		std::shared_ptr<CCcpSession> session;
+		BYTE cro[CCP_PACKET_SIZE] = {0};
+		int next;
+
+		next = NextStation();
+		if (next < 0)
+			break;
+
+		if (m_Current >= 0 && !m_Stations[m_Current].Pending.empty() &&
+			(next == m_Current || !SliceOver(now)))
+		{
+			// The selected station keeps the bus
+			TStation &station = m_Stations[m_Current];
+			TCommand command = std::move(station.Pending.front());
+			UINT64 wait = MicrosSince(command.Queued, now);
+			int current = m_Current;
+
+			station.Pending.pop_front();
+			station.Stats.Pending--;
+			station.Stats.WaitMicros += wait;
+			if (wait > station.Stats.MaxWaitMicros)
+				station.Stats.MaxWaitMicros = (DWORD)std::min<UINT64>(wait, 0xFFFFFFFFU);
+			if (next == m_Current && SliceOver(now))
+			{
+				// Nobody else is waiting: a new slice without switching
+				station.Stats.Slices++;
+				m_SliceCommands = 0;
+				m_SliceStart = now;
+			}
+			m_SliceCommands++;
+			m_InFlight = true;
+			m_Callbacks++;
+			session = station.Session;
+			lock.unlock();
+
+			TCcpCompletion completion = std::move(command.Completion);
+			session->CommandAsync(command.Cro, command.TimeOut, [this, current, completion, now](TCCPResult Result, const BYTE *Crm, DWORD)
+			{
+				OnCommandDone(current, Result, Crm, completion, now);
+			});
+			lock.lock();
+			continue;
+		}
+
+		m_InFlight = true;
+		m_Callbacks++;
+		m_SwitchStart = now;
+		if (m_Current >= 0 && !m_Params.ImplicitSwitch)
+		{
+			// Temporary DISCONNECT of the selected station. The station address
+			// is always sent in Intel format
+			session = m_Stations[m_Current].Session;
+			cro[0] = CCP_CMD_DISCONNECT;
+			cro[2] = 0x00;
+			CcpPutWord(&cro[4], session->GetSlaveData().EcuAddress, true);
+			lock.unlock();
+
+			session->CommandAsync(cro, m_Params.SwitchTimeOut, [this, next](TCCPResult, const BYTE *, DWORD)
+			{
+				OnDisconnectDone(next);
+			});
+		}
+		else
+		{
+			session = m_Stations[next].Session;
+			cro[0] = CCP_CMD_CONNECT;
+			CcpPutWord(&cro[2], session->GetSlaveData().EcuAddress, true);
+			lock.unlock();
+
+			session->CommandAsync(cro, m_Params.SwitchTimeOut, [this, next](TCCPResult Result, const BYTE *, DWORD)
+			{
+				OnConnectDone(next, Result);
+			});
+		}
+		lock.lock();
+	}
+	m_Pumping = false;
+}
+
+void CCcpStationMux::OnCommandDone(int Station, TCCPResult Result, const BYTE *Crm, const TCcpCompletion &Completion, Clock::time_point Sent)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		TCCPMuxStationStats &stats = m_Stations[Station].Stats;
+		UINT64 micros = MicrosSince(Sent, Clock::now());
+
+		stats.Commands++;
+		if (Result != CCP_ERROR_ACKNOWLEDGE_OK)
+			stats.Failed++;
+		stats.BusMicros += micros;
+		m_CommandMicros += micros;
+		m_InFlight = false;
+	}
+
+	// The next command goes out before the completion runs
+	Pump();
+	if (Completion)
+		Completion(Result, Crm, Result == CCP_ERROR_ACKNOWLEDGE_OK ? 1 : 0);
+	EndCallback();
+}
+
+void CCcpStationMux::OnDisconnectDone(int Station)
+{
+	std::shared_ptr<CCcpSession> session;
+	BYTE cro[CCP_PACKET_SIZE] = {CCP_CMD_CONNECT};
+	WORD timeOut;
+
+	// Whatever the answer, the CONNECT that follows deselects the station
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		m_Current = -1;
+		session = m_Stations[Station].Session;
+		timeOut = m_Params.SwitchTimeOut;
+		m_Callbacks++;
+	}
+
+	CcpPutWord(&cro[2], session->GetSlaveData().EcuAddress, true);
+	session->CommandAsync(cro, timeOut, [this, Station](TCCPResult Result, const BYTE *, DWORD)
+	{
+		OnConnectDone(Station, Result);
+	});
+	EndCallback();
+}
+
+void CCcpStationMux::OnConnectDone(int Station, TCCPResult Result)
+{
+	std::deque<TCommand> failed;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		TStation &station = m_Stations[Station];
+		Clock::time_point now = Clock::now();
+
+		m_SwitchMicros += MicrosSince(m_SwitchStart, now);
+		if (Result == CCP_ERROR_ACKNOWLEDGE_OK)
+		{
+			m_Switches++;
+			m_Current = Station;
+			m_SliceCommands = 0;
+			m_SliceStart = now;
+			station.Stats.Slices++;
+		}
+		else
+		{
+			// The station cannot be reached: its commands fail instead of
+			// holding up the others
+			m_SwitchFailures++;
+			m_Current = -1;
+			failed.swap(station.Pending);
+			for (size_t i = 0; i < failed.size(); i++)
+			{
+				UINT64 wait = MicrosSince(failed[i].Queued, now);
+
+				station.Stats.WaitMicros += wait;
+				if (wait > station.Stats.MaxWaitMicros)
+					station.Stats.MaxWaitMicros = (DWORD)std::min<UINT64>(wait, 0xFFFFFFFFU);
+			}
+			station.Stats.Commands += (DWORD)failed.size();
+			station.Stats.Failed += (DWORD)failed.size();
+			station.Stats.Pending = 0;
+		}
+		m_InFlight = false;
+	}
+
+	Pump();
+	Fail(failed, Result);
+	EndCallback();
+}
+
+void CCcpStationMux::EndCallback()
+{
+	// Last access to the object: the destructor may proceed once notified
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Callbacks--;
+	m_Idle.notify_all();
+}
+
+void CCcpStationMux::Fail(std::deque<TCommand> &Commands, TCCPResult Result)
+{
+	for (size_t i = 0; i < Commands.size(); i++)
+	{
+		if (Commands[i].Completion)
+			Commands[i].Completion(Result, s_NoCrm, 0);
+	}
+	Commands.clear();
+}
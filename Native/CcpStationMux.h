@@ -0,0 +1,150 @@
+//  CcpStationMux.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Several slave stations served through one channel by switching the
+//  selected station (temporary DISCONNECT / CONNECT)
+//
+//  ~~~~~~~~~~~~
+//
+//  Stations sharing a CRO identifier hear every command, so only the station
+//  selected by the last CONNECT may be addressed. The multiplexer queues the
+//  commands of each station and hands the bus over in slices: the selected
+//  station sends up to MaxBatch commands (or for MaxSlice millis) while the
+//  others wait, then the next station with pending commands is selected, in
+//  round robin order. Batching keeps the number of switches (two round trips
+//  each) low; the slices bound the wait of the other stations.
+//
+#ifndef __CCPSTATIONMUXH__
+#define __CCPSTATIONMUXH__
+
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpSession.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class CCcpChannel;
+
+class CCcpStationMux
+{
+public:
+	CCcpStationMux(const std::shared_ptr<CCcpChannel> &Channel);
+
+	/// <summary>
+	/// Fails the queued commands and waits for the one on the bus, if any
+	/// </summary>
+	/// <remarks>Must not be called from a completion (receive thread)</remarks>
+	~CCcpStationMux();
+
+	/// <summary>
+	/// Returns the default policy (CCP_MUX_DEFAULT_* values)
+	/// </summary>
+	static TCCPMuxParams DefaultParams();
+
+	/// <summary>
+	/// Changes the policy. It applies from the next slice on
+	/// </summary>
+	/// <returns>False if the parameters are invalid</returns>
+	bool SetParams(const TCCPMuxParams &Params);
+
+	/// <summary>
+	/// Adds a station. It is connected when its first command is sent
+	/// </summary>
+	/// <param name="SlaveData">Station address, CRO/DTO Ids and byte order of the slave</param>
+	/// <param name="Station">Buffer for the index of the station in the multiplexer</param>
+	/// <returns>False if the station is already known or the multiplexer is full</returns>
+	bool AddStation(const TCCPSlaveData &SlaveData, BYTE *Station);
+	bool IsStation(BYTE Station);
+
+	/// <summary>
+	/// Queues a CRO for a station and returns at once. The completion is
+	/// called with the CRM, or with the error that ended the command (the
+	/// CONNECT error if the station could not be selected)
+	/// </summary>
+	/// <param name="Station">Index of the station (see AddStation)</param>
+	/// <param name="Cro">The 8 byte command, Cro[0] being the command code (not CONNECT / DISCONNECT)</param>
+	/// <param name="TimeOut">Wait time (millis) for ECU response. Zero(0) to use the default time</param>
+	/// <param name="Completion">Called once the command is over (see TCcpCompletion)</param>
+	void CommandAsync(BYTE Station, const BYTE *Cro, WORD TimeOut, const TCcpCompletion &Completion);
+
+	/// <summary>
+	/// Sends a CRO to a station and waits for its CRM (see CommandAsync)
+	/// </summary>
+	/// <remarks>Must not be called from a completion (receive thread)</remarks>
+	TCCPResult Command(BYTE Station, const BYTE *Cro, BYTE *Crm, WORD TimeOut);
+
+	/// <summary>
+	/// Fails the queued commands with PCAN_ERROR_INITIALIZE and refuses new ones
+	/// </summary>
+	void Close();
+
+	void GetStats(TCCPMuxStats *Stats);
+	bool GetStationStats(BYTE Station, TCCPMuxStationStats *Stats);
+
+	CCcpChannel *GetChannel() const { return m_Channel.get(); }
+	TCCPHandle GetHandle() const { return m_Handle; }
+	void SetHandle(TCCPHandle Handle) { m_Handle = Handle; }
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	// A command waiting for its station to get the bus
+	//
+	struct TCommand
+	{
+		BYTE Cro[CCP_PACKET_SIZE];
+		WORD TimeOut;
+		TCcpCompletion Completion;
+		Clock::time_point Queued;
+	};
+
+	struct TStation
+	{
+		std::shared_ptr<CCcpSession> Session;
+		std::deque<TCommand> Pending;
+		TCCPMuxStationStats Stats;
+	};
+
+	bool SliceOver(Clock::time_point Now) const;
+	int NextStation() const;
+	void Pump();
+	void OnCommandDone(int Station, TCCPResult Result, const BYTE *Crm, const TCcpCompletion &Completion, Clock::time_point Sent);
+	void OnDisconnectDone(int Station);
+	void OnConnectDone(int Station, TCCPResult Result);
+	void EndCallback();
+	void Fail(std::deque<TCommand> &Commands, TCCPResult Result);
+
+	std::shared_ptr<CCcpChannel> m_Channel;
+	TCCPHandle m_Handle;
+
+	// Scheduling state (protected by m_Lock). The session methods are called
+	// without it: their completions come back here from the receive thread
+	//
+	std::mutex m_Lock;
+	std::condition_variable m_Idle;
+	TCCPMuxParams m_Params;
+	std::vector<TStation> m_Stations;
+	int m_Current;                                         // Selected station, -1 if none
+	bool m_InFlight;                                       // A command, DISCONNECT or CONNECT is on the bus
+	bool m_Pumping;                                        // A thread is handing out the next commands
+	bool m_Closed;
+	int m_Callbacks;                                       // Session completions still to come back
+	DWORD m_SliceCommands;
+	Clock::time_point m_SliceStart;
+	Clock::time_point m_SwitchStart;
+
+	// Totals (protected by m_Lock)
+	//
+	DWORD m_Switches;
+	DWORD m_SwitchFailures;
+	UINT64 m_SwitchMicros;
+	UINT64 m_CommandMicros;
+};
+
+#endif
@@ -0,0 +1,604 @@
+//  PCCP.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Native PCAN-CCP engine: implementation of the API declared in PCCP.h
+//
+//  ~~~~~~~~~~~~
+//
+#include "WinTypes.h"
+#include "PCCP.h"
+#include "PCCPExt.h"
+#include "CcpProtocol.h"
+#include "CcpRegistry.h"
+#include "CcpChannel.h"
+#include "CcpSession.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static std::shared_ptr<CCcpSession> GetSession(TCCPHandle CcpHandle)
+{
+	return CCcpRegistry::Instance().FindSession(CcpHandle);
+}
+
+//------------------------------
+// Extras
+//------------------------------
+
+TCCPResult __stdcall CCP_InitializeChannel(
+	TPCANHandle Channel,
+	TPCANBaudrate Btr0Btr1,
+	TPCANType HwType,
+	DWORD IOPort,
+	WORD Interrupt)
+{
+	return CCcpRegistry::Instance().InitializeChannel(Channel, Btr0Btr1, HwType, IOPort, Interrupt);
+}
+
+TCCPResult __stdcall CCP_UninitializeChannel(
+	TPCANHandle Channel)
+{
+	return CCcpRegistry::Instance().UninitializeChannel(Channel);
+}
+
+TCCPResult __stdcall CCP_ReadMsg(
+	TCCPHandle CcpHandle,
+	TCCPMsg *Msg)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Msg)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return session->ReadMsg(Msg);
+}
+
+TCCPResult __stdcall CCP_Reset(
+	TCCPHandle CcpHandle)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	session->ResetQueue();
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Connection
+//------------------------------
+
+TCCPResult __stdcall CCP_Connect(
+	TPCANHandle Channel,
+	TCCPSlaveData *SlaveData,
+	TCCPHandle *CcpHandle,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpChannel> channel;
+	std::shared_ptr<CCcpSession> session;
+	TCCPResult result;
+
+	if (!SlaveData || !CcpHandle)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	channel = CCcpRegistry::Instance().FindChannel(Channel);
+	if (!channel)
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+
+	// A slave temporarily disconnected keeps its handle
+	session = CCcpRegistry::Instance().FindSession(Channel, *SlaveData);
+	if (session)
+	{
+		result = session->Connect(TimeOut);
+		if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+			*CcpHandle = session->GetHandle();
+		return result;
+	}
+
+	session = CCcpSession::Create(channel, *SlaveData);
+	result = session->Connect(TimeOut);
+	if (result == CCP_ERROR_ACKNOWLEDGE_OK)
+		*CcpHandle = CCcpRegistry::Instance().AddSession(session);
+	return result;
+}
+
+TCCPResult __stdcall CCP_Disconnect(
+	TCCPHandle CcpHandle,
+	bool Temporary,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	TCCPResult result;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+
+	result = session->Disconnect(Temporary, TimeOut);
+
+	// The handle is released even if the slave does not answer
+	if (!Temporary)
+		CCcpRegistry::Instance().RemoveSession(CcpHandle);
+	return result;
+}
+
+TCCPResult __stdcall CCP_Test(
+	TPCANHandle Channel,
+	TCCPSlaveData *SlaveData,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpChannel> channel;
+
+	if (!SlaveData)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	channel = CCcpRegistry::Instance().FindChannel(Channel);
+	if (!channel)
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+
+	// Owned by a shared_ptr like any session: the channel only delivers to
+	// the sessions it can pin
+	return CCcpSession::Create(channel, *SlaveData)->Test(TimeOut);
+}
+
+//------------------------------
+// Control + Configuration
+//------------------------------
+
+TCCPResult __stdcall CCP_GetCcpVersion(
+	TCCPHandle CcpHandle,
+	BYTE *Main,
+	BYTE *Release,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->GetCcpVersion(Main, Release, TimeOut);
+}
+
+TCCPResult __stdcall CCP_ExchangeId(
+	TCCPHandle CcpHandle,
+	TCCPExchangeData *ECUData,
+	BYTE *MasterData,
+	int DataLength,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->ExchangeId(ECUData, MasterData, DataLength, TimeOut);
+}
+
+TCCPResult __stdcall CCP_GetSeed(
+	TCCPHandle CcpHandle,
+	BYTE Resource,
+	bool *CurrentStatus,
+	BYTE *Seed,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->GetSeed(Resource, CurrentStatus, Seed, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Unlock(
+	TCCPHandle CcpHandle,
+	BYTE *KeyBuffer,
+	BYTE KeyLength,
+	BYTE *Privileges,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Unlock(KeyBuffer, KeyLength, Privileges, TimeOut);
+}
+
+TCCPResult __stdcall CCP_SetSessionStatus(
+	TCCPHandle CcpHandle,
+	BYTE Status,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->SetSessionStatus(Status, TimeOut);
+}
+
+TCCPResult __stdcall CCP_GetSessionStatus(
+	TCCPHandle CcpHandle,
+	BYTE *Status,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->GetSessionStatus(Status, TimeOut);
+}
+
+//------------------------------
+// Memory management
+//------------------------------
+
+TCCPResult __stdcall CCP_SetMemoryTransferAddress(
+	TCCPHandle CcpHandle,
+	BYTE UsedMTA,
+	BYTE AddrExtension,
+	DWORD Addr,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->SetMemoryTransferAddress(UsedMTA, AddrExtension, Addr, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Download(
+	TCCPHandle CcpHandle,
+	BYTE *DataBytes,
+	BYTE Size,
+	BYTE *MTA0Ext,
+	DWORD *MTA0Addr,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Download(DataBytes, Size, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Download_6(
+	TCCPHandle CcpHandle,
+	BYTE *DataBytes,
+	BYTE *MTA0Ext,
+	DWORD *MTA0Addr,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Download6(DataBytes, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Upload(
+	TCCPHandle CcpHandle,
+	BYTE Size,
+	BYTE *DataBytes,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Upload(Size, DataBytes, TimeOut);
+}
+
+TCCPResult __stdcall CCP_ShortUpload(
+	TCCPHandle CcpHandle,
+	BYTE UploadSize,
+	BYTE MTA0Ext,
+	DWORD MTA0Addr,
+	BYTE *reqData,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->ShortUpload(UploadSize, MTA0Ext, MTA0Addr, reqData, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Move(
+	TCCPHandle CcpHandle,
+	DWORD SizeOfData,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Move(SizeOfData, TimeOut);
+}
+
+//------------------------------
+// Calibration
+//------------------------------
+
+TCCPResult __stdcall CCP_SelectCalibrationDataPage(
+	TCCPHandle CcpHandle,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->SelectCalibrationDataPage(TimeOut);
+}
+
+TCCPResult __stdcall CCP_GetActiveCalibrationPage(
+	TCCPHandle CcpHandle,
+	BYTE *MTA0Ext,
+	DWORD *MTA0Addr,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->GetActiveCalibrationPage(MTA0Ext, MTA0Addr, TimeOut);
+}
+
+//------------------------------
+// Data Adquisition
+//------------------------------
+
+TCCPResult __stdcall CCP_GetDAQListSize(
+	TCCPHandle CcpHandle,
+	BYTE ListNumber,
+	DWORD *DTOId,
+	BYTE *Size,
+	BYTE *FirstPDI,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->GetDAQListSize(ListNumber, DTOId, Size, FirstPDI, TimeOut);
+}
+
+TCCPResult __stdcall CCP_SetDAQListPointer(
+	TCCPHandle CcpHandle,
+	BYTE ListNumber,
+	BYTE ODTNumber,
+	BYTE ElementNumber,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->SetDAQListPointer(ListNumber, ODTNumber, ElementNumber, TimeOut);
+}
+
+TCCPResult __stdcall CCP_WriteDAQListEntry(
+	TCCPHandle CcpHandle,
+	BYTE SizeElement,
+	BYTE AddrExtension,
+	DWORD AddrDAQ,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->WriteDAQListEntry(SizeElement, AddrExtension, AddrDAQ, TimeOut);
+}
+
+TCCPResult __stdcall CCP_StartStopDataTransmission(
+	TCCPHandle CcpHandle,
+	TCCPStartStopData *Data,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->StartStopDataTransmission(Data, TimeOut);
+}
+
+TCCPResult __stdcall CCP_StartStopSynchronizedDataTransmission(
+	TCCPHandle CcpHandle,
+	bool StartOrStop,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->StartStopSynchronizedDataTransmission(StartOrStop, TimeOut);
+}
+
+//------------------------------
+// Flash Programming
+//------------------------------
+
+TCCPResult __stdcall CCP_ClearMemory(
+	TCCPHandle CcpHandle,
+	DWORD MemorySize,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->ClearMemory(MemorySize, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Program(
+	TCCPHandle CcpHandle,
+	BYTE *Data,
+	BYTE Size,
+	BYTE *MTA0Ext,
+	DWORD *MTA0Addr,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Program(Data, Size, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult __stdcall CCP_Program_6(
+	TCCPHandle CcpHandle,
+	BYTE *Data,
+	BYTE *MTA0Ext,
+	DWORD *MTA0Addr,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->Program6(Data, MTA0Ext, MTA0Addr, TimeOut);
+}
+
+TCCPResult __stdcall CCP_BuildChecksum(
+	TCCPHandle CcpHandle,
+	DWORD BlockSize,
+	BYTE *ChecksumData,
+	BYTE *ChecksumSize,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->BuildChecksum(BlockSize, ChecksumData, ChecksumSize, TimeOut);
+}
+
+//------------------------------
+// Diagnostic
+//------------------------------
+
+TCCPResult __stdcall CCP_DiagnosticService(
+	TCCPHandle CcpHandle,
+	WORD DiagnosticNumber,
+	BYTE *Parameters,
+	BYTE ParametersLength,
+	BYTE *ReturnLength,
+	BYTE *ReturnType,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->DiagnosticService(DiagnosticNumber, Parameters, ParametersLength, ReturnLength, ReturnType, TimeOut);
+}
+
+TCCPResult __stdcall CCP_ActionService(
+	TCCPHandle CcpHandle,
+	WORD ActionNumber,
+	BYTE *Parameters,
+	BYTE ParametersLength,
+	BYTE *ReturnLength,
+	BYTE *ReturnType,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->ActionService(ActionNumber, Parameters, ParametersLength, ReturnLength, ReturnType, TimeOut);
+}
+
+//------------------------------
+// Error text
+//------------------------------
+
+static const char *GetCcpErrorText(TCCPResult errorCode)
+{
+	switch (errorCode)
+	{
+		case CCP_ERROR_ACKNOWLEDGE_OK:          return "Acknowledge / no error";
+		case CCP_ERROR_DAQ_OVERLOAD:            return "DAQ processor overload";
+		case CCP_ERROR_CMD_PROCESSOR_BUSY:      return "Command processor busy";
+		case CCP_ERROR_DAQ_PROCESSOR_BUSY:      return "DAQ processor busy";
+		case CCP_ERROR_INTERNAL_TIMEOUT:        return "Internal timeout";
+		case CCP_ERROR_KEY_REQUEST:             return "Key request";
+		case CCP_ERROR_SESSION_STS_REQUEST:     return "Session status request";
+		case CCP_ERROR_COLD_START_REQUEST:      return "Cold start request";
+		case CCP_ERROR_CAL_DATA_INIT_REQUEST:   return "Calibration data initialization request";
+		case CCP_ERROR_DAQ_LIST_INIT_REQUEST:   return "DAQ list initialization request";
+		case CCP_ERROR_CODE_UPDATE_REQUEST:     return "Code update request";
+		case CCP_ERROR_UNKNOWN_COMMAND:         return "Unknown command";
+		case CCP_ERROR_COMMAND_SYNTAX:          return "Command syntax";
+		case CCP_ERROR_PARAM_OUT_OF_RANGE:      return "Parameter(s) out of range";
+		case CCP_ERROR_ACCESS_DENIED:           return "Access denied";
+		case CCP_ERROR_OVERLOAD:                return "Overload";
+		case CCP_ERROR_ACCESS_LOCKED:           return "Access locked";
+		case CCP_ERROR_NOT_AVAILABLE:           return "Resource/function not available";
+		case CCP_ERROR_VERIFY_FAILED:           return "Verification failed (checksum mismatch)";
+		case CCP_ERROR_IMAGE_FORMAT:            return "Invalid memory image format";
+		case CCP_ERROR_IMAGE_FILE:              return "Memory image file cannot be read";
+		case CCP_ERROR_KEY_ALGORITHM:           return "No seed & key algorithm for a protected resource";
+		case CCP_ERROR_DAQ_CAPACITY:            return "The DAQ signals do not fit into the DAQ lists of the slave";
+		case CCP_ERROR_DAQ_BUSLOAD:             return "The DAQ plan exceeds the bus load budget";
+		default:                                return NULL;
+	}
+}
+
+static const char *GetPcanErrorText(TPCANStatus status)
+{
+	switch (status)
+	{
+		case PCAN_ERROR_XMTFULL:                return "Transmit buffer in CAN controller is full";
+		case PCAN_ERROR_OVERRUN:                return "CAN controller was read too late";
+		case PCAN_ERROR_BUSLIGHT:               return "Bus error: an error counter reached the 'light' limit";
+		case PCAN_ERROR_BUSHEAVY:               return "Bus error: an error counter reached the 'heavy' limit";
+		case PCAN_ERROR_BUSPASSIVE:             return "Bus error: the CAN controller is error passive";
+		case PCAN_ERROR_BUSOFF:                 return "Bus error: the CAN controller is in bus-off state";
+		case PCAN_ERROR_QRCVEMPTY:              return "Receive queue is empty";
+		case PCAN_ERROR_QOVERRUN:               return "Receive queue was read too late";
+		case PCAN_ERROR_QXMTFULL:               return "Transmit queue is full";
+		case PCAN_ERROR_REGTEST:                return "Test of the CAN controller hardware registers failed (no hardware found)";
+		case PCAN_ERROR_NODRIVER:               return "Driver not loaded";
+		case PCAN_ERROR_HWINUSE:                return "Hardware already in use by a Net";
+		case PCAN_ERROR_NETINUSE:               return "A Client is already connected to the Net";
+		case PCAN_ERROR_ILLHW:                  return "Hardware handle is invalid";
+		case PCAN_ERROR_ILLNET:                 return "Net handle is invalid";
+		case PCAN_ERROR_ILLCLIENT:              return "Client handle is invalid";
+		case PCAN_ERROR_RESOURCE:               return "Resource (FIFO, Client, timeout) cannot be created";
+		case PCAN_ERROR_ILLPARAMTYPE:           return "Invalid parameter";
+		case PCAN_ERROR_ILLPARAMVAL:            return "Invalid parameter value";
+		case PCAN_ERROR_UNKNOWN:                return "Unknown error";
+		case PCAN_ERROR_ILLDATA:                return "Invalid data, function, or action";
+		case PCAN_ERROR_CAUTION:                return "An operation was successfully carried out, however, irregularities were registered";
+		case PCAN_ERROR_INITIALIZE:             return "Channel is not initialized";
+		case PCAN_ERROR_ILLOPERATION:           return "Invalid operation";
+		default:                                return NULL;
+	}
+}
+
+TCCPResult __stdcall CCP_GetErrorText(
+	TCCPResult errorCode,
+	LPSTR textBuffer)
+{
+	const char *text;
+
+	if (!textBuffer)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	if (errorCode & CCP_ERROR_PCAN)
+	{
+		text = GetPcanErrorText(errorCode & ~CCP_ERROR_PCAN);
+		if (text)
+			snprintf(textBuffer, 256, "PCAN error: %s", text);
+		else
+			snprintf(textBuffer, 256, "PCAN error: 0x%X", (unsigned int)(errorCode & ~CCP_ERROR_PCAN));
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+
+	text = GetCcpErrorText(errorCode);
+	if (!text)
+	{
+		textBuffer[0] = '\0';
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	}
+	snprintf(textBuffer, 256, "%s", text);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
@@ -0,0 +1,780 @@
+//  PCCPExt.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  Native PCAN-CCP engine: implementation of the API extensions declared in PCCPExt.h
+//
+//  ~~~~~~~~~~~~
+//
+#include "WinTypes.h"
+#include "PCCPExt.h"
+#include "CcpProtocol.h"
+#include "CcpRegistry.h"
+#include "CcpSession.h"
+#include "CcpStationMux.h"
+#include "CcpMemoryTransfer.h"
+#include "CcpFlashProgrammer.h"
+#include "CcpChecksum.h"
+#include "CcpSeedKey.h"
+#include "CcpDaqConfig.h"
+#include "CcpDtoDecoder.h"
+#include "CcpDaqAssembler.h"
+#include "CcpDaqPlanner.h"
+#include "CcpChannel.h"
+
+#include <algorithm>
+#include <string.h>
+
+static std::shared_ptr<CCcpSession> GetSession(TCCPHandle CcpHandle)
+{
+	return CCcpRegistry::Instance().FindSession(CcpHandle);
+}
+
+//------------------------------
+// Memory management
+//------------------------------
+
+TCCPResult __stdcall CCP_ReadMemory(
+	TCCPHandle CcpHandle,
+	BYTE AddrExtension,
+	DWORD Addr,
+	DWORD Length,
+	BYTE *Buffer,
+	TCCPTransferStats *Stats,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return CCcpMemoryTransfer(session.get()).Read(AddrExtension, Addr, Length, Buffer, Stats, TimeOut);
+}
+
+TCCPResult __stdcall CCP_WriteMemory(
+	TCCPHandle CcpHandle,
+	TCCPMemoryBlock *Blocks,
+	DWORD Count,
+	TCCPTransferStats *Stats,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return CCcpMemoryTransfer(session.get()).Write(Blocks, Count, Stats, TimeOut);
+}
+
+TCCPResult __stdcall CCP_VerifyMemory(
+	TCCPHandle CcpHandle,
+	BYTE ChecksumType,
+	BYTE AddrExtension,
+	DWORD Addr,
+	DWORD Length,
+	BYTE *Expected,
+	bool *Match,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return CCcpMemoryTransfer(session.get()).Verify(ChecksumType, AddrExtension, Addr, Length, Expected, Match, TimeOut);
+}
+
+//------------------------------
+// Asynchronous commands
+//------------------------------
+
+TCCPResult __stdcall CCP_SendCommandAsync(
+	TCCPHandle CcpHandle,
+	BYTE *Cro,
+	WORD TimeOut,
+	TCCPCommandCallback Callback,
+	void *Context)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Cro || !Callback)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	session->CommandAsync(Cro, TimeOut, [Callback, Context](TCCPResult Result, const BYTE *Crm, DWORD)
+	{
+		Callback(Context, Result, Crm);
+	});
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_ReadMemoryAsync(
+	TCCPHandle CcpHandle,
+	BYTE AddrExtension,
+	DWORD Addr,
+	DWORD Length,
+	BYTE *Buffer,
+	WORD TimeOut,
+	TCCPTransferCallback Callback,
+	void *Context)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Callback)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCcpMemoryTransfer(session.get()).ReadAsync(AddrExtension, Addr, Length, Buffer, TimeOut, [Callback, Context](TCCPResult Result, const TCCPTransferStats *Stats)
+	{
+		Callback(Context, Result, Stats);
+	});
+}
+
+TCCPResult __stdcall CCP_WriteMemoryAsync(
+	TCCPHandle CcpHandle,
+	TCCPMemoryBlock *Blocks,
+	DWORD Count,
+	WORD TimeOut,
+	TCCPTransferCallback Callback,
+	void *Context)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Callback)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCcpMemoryTransfer(session.get()).WriteAsync(Blocks, Count, TimeOut, [Callback, Context](TCCPResult Result, const TCCPTransferStats *Stats)
+	{
+		Callback(Context, Result, Stats);
+	});
+}
+
+//------------------------------
+// Adaptive time outs
+//------------------------------
+
+TCCPResult __stdcall CCP_SetRttParams(
+	TCCPHandle CcpHandle,
+	TCCPRttParams *Params)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!session->SetRttParams(Params ? *Params : CCcpRttEstimator::DefaultParams()))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_GetRttStats(
+	TCCPHandle CcpHandle,
+	TCCPRttStats *Stats)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Stats)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	session->GetRttStats(Stats);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Busy slaves
+//------------------------------
+
+TCCPResult __stdcall CCP_SetBusyParams(
+	TCCPHandle CcpHandle,
+	TCCPBusyParams *Params)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!session->SetBusyParams(Params ? *Params : CCcpBusyBackoff::DefaultParams()))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_GetBusyStats(
+	TCCPHandle CcpHandle,
+	TCCPBusyStats *Stats)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Stats)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	session->GetBusyStats(Stats);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Seed & key
+//------------------------------
+
+TCCPResult __stdcall CCP_SetKeyAlgorithm(
+	TCCPHandle CcpHandle,
+	BYTE Resources,
+	LPCSTR LibraryPath)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<ICcpKeyAlgorithm> algorithm;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Resources || (Resources & ~CCP_RSM_ALL))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+
+	if (LibraryPath)
+	{
+		algorithm = CCcpLibraryKeyAlgorithm::Load(LibraryPath);
+		if (!algorithm)
+			return CCP_ERROR_KEY_ALGORITHM;
+	}
+	else
+		algorithm = std::make_shared<CCcpTestKeyAlgorithm>();
+	session->SetKeyAlgorithm(Resources, algorithm);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_UnlockResources(
+	TCCPHandle CcpHandle,
+	BYTE Resources,
+	BYTE *Privileges,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->UnlockResources(Resources, Privileges, TimeOut);
+}
+
+//------------------------------
+// DAQ configuration
+//------------------------------
+
+TCCPResult __stdcall CCP_ConfigureDaq(
+	TCCPHandle CcpHandle,
+	BYTE DaqLists,
+	TCCPDaqSignal *Signals,
+	DWORD Count,
+	TCCPDaqPlacement *Placements,
+	TCCPDaqConfigStats *Stats,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return CCcpDaqConfigurator(session.get()).Configure(DaqLists, Signals, Count, Placements, Stats, TimeOut);
+}
+
+TCCPResult __stdcall CCP_StartStopDaq(
+	TCCPHandle CcpHandle,
+	BYTE Mode,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return CCcpDaqConfigurator(session.get()).StartStop(Mode, TimeOut);
+}
+
+//------------------------------
+// Receive queue
+//------------------------------
+
+TCCPResult __stdcall CCP_SetRcvQueueCapacity(
+	TCCPHandle CcpHandle,
+	DWORD Capacity)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (Capacity > CCP_RCV_QUEUE_MAX_CAPACITY)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	session->SetQueueCapacity(Capacity ? Capacity : CCP_MAX_RCV_QUEUE);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_PeekMsgs(
+	TCCPHandle CcpHandle,
+	TCCPMsgSpan *Spans,
+	DWORD *Count)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Spans || !Count)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return session->PeekMsgs(Spans, Count);
+}
+
+TCCPResult __stdcall CCP_ReleaseMsgs(
+	TCCPHandle CcpHandle,
+	DWORD Count)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	return session->ReleaseMsgs(Count);
+}
+
+//------------------------------
+// DTO decoding
+//------------------------------
+
+TCCPResult __stdcall CCP_ReadMsgs(
+	TCCPHandle CcpHandle,
+	TCCPMsg *Msgs,
+	UINT64 *Timestamps,
+	DWORD Count,
+	DWORD *Read)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Msgs || !Count || !Read)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return session->ReadMsgs(Msgs, Timestamps, Count, Read);
+}
+
+TCCPResult __stdcall CCP_CreateDecoder(
+	TCCPHandle CcpHandle,
+	DWORD Capacity)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<const TCcpDaqLayout> layout;
+	std::shared_ptr<CCcpDtoDecoder> decoder;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	layout = session->GetDaqLayout();
+	if (!layout)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+
+	decoder.reset(new CCcpDtoDecoder());
+	if (!decoder->Compile(*layout, session->GetSlaveData().IntelFormat, Capacity))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	session->SetDecoder(decoder);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_DecodeMsgs(
+	TCCPHandle CcpHandle,
+	TCCPMsg *Msgs,
+	UINT64 *Timestamps,
+	DWORD Count,
+	DWORD *Decoded)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<CCcpDtoDecoder> decoder;
+	DWORD decoded;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Msgs && Count)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	decoder = session->GetDecoder();
+	if (!decoder)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+
+	decoded = decoder->Decode(Msgs, Timestamps, Count);
+	if (Decoded)
+		*Decoded = decoded;
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_ReadSamples(
+	TCCPHandle CcpHandle,
+	DWORD Signal,
+	DWORD *Samples,
+	UINT64 *Timestamps,
+	DWORD Count,
+	DWORD *Read,
+	DWORD *Lost)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<CCcpDtoDecoder> decoder;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Samples || !Read)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	decoder = session->GetDecoder();
+	if (!decoder)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+	if (!decoder->ReadSamples(Signal, Samples, Timestamps, Count, Read, Lost))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Synchronized DAQ start
+//------------------------------
+
+TCCPResult __stdcall CCP_StartDaqSynchronized(
+	TPCANHandle Channel,
+	WORD WaitTime,
+	TCCPDaqStartReport *Reports,
+	DWORD MaxReports,
+	DWORD *Count,
+	TCCPDaqStartStats *Stats)
+{
+	std::vector<std::shared_ptr<CCcpSession> > sessions, configured;
+	std::vector<TCCPDaqStartReport> reports;
+	TCCPDaqStartStats stats;
+	TCCPResult result;
+
+	if (!CCcpRegistry::Instance().FindChannel(Channel))
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+	CCcpRegistry::Instance().GetSessions(Channel, sessions);
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		if (sessions[i]->IsConnected() && sessions[i]->GetDaqLayout())
+			configured.push_back(sessions[i]);
+	}
+	if (configured.empty())
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+
+	result = CCcpDaqConfigurator::StartSynchronized(configured, WaitTime, reports, &stats);
+	if (Reports)
+	{
+		for (size_t i = 0; i < reports.size() && i < MaxReports; i++)
+			Reports[i] = reports[i];
+	}
+	if (Count)
+		*Count = (DWORD)std::min<size_t>(reports.size(), Reports ? MaxReports : 0);
+	if (Stats)
+		*Stats = stats;
+	return result;
+}
+
+TCCPResult __stdcall CCP_StopDaqSynchronized(
+	TPCANHandle Channel)
+{
+	std::vector<std::shared_ptr<CCcpSession> > sessions, connected;
+
+	if (!CCcpRegistry::Instance().FindChannel(Channel))
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+	CCcpRegistry::Instance().GetSessions(Channel, sessions);
+	for (size_t i = 0; i < sessions.size(); i++)
+	{
+		if (sessions[i]->IsConnected())
+			connected.push_back(sessions[i]);
+	}
+	return CCcpDaqConfigurator::StartStopAll(connected, false);
+}
+
+//------------------------------
+// DAQ planning
+//------------------------------
+
+TCCPResult __stdcall CCP_PlanDaq(
+	TCCPHandle CcpHandle,
+	DWORD *EventPeriodsUs,
+	BYTE EventChannels,
+	TCCPDaqRequest *Requests,
+	DWORD Count,
+	WORD Budget,
+	TCCPDaqSignal *Signals,
+	TCCPDaqPlanStats *Stats)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!EventPeriodsUs || (Count && (!Requests || !Signals)))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCcpDaqPlanner::Plan(Requests, Count, EventPeriodsUs, EventChannels,
+		CanGetBitrate(session->GetChannel()->GetBaudrate()), (session->GetSlaveData().IdDTO & 0x80000000U) != 0,
+		Budget ? Budget : CCP_DAQ_DEFAULT_BUDGET, Signals, Stats);
+}
+
+//------------------------------
+// DAQ cycle reassembly
+//------------------------------
+
+TCCPResult __stdcall CCP_SetDaqAssembly(
+	TCCPHandle CcpHandle,
+	bool Enable,
+	DWORD Capacity)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<const TCcpDaqLayout> layout;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Enable)
+	{
+		session->SetAssembler(std::shared_ptr<CCcpDaqAssembler>());
+		return CCP_ERROR_ACKNOWLEDGE_OK;
+	}
+	if (Capacity > CCP_DAQ_MAX_CAPACITY)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	layout = session->GetDaqLayout();
+	if (!layout)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+
+	// The layout may have changed meanwhile
+	if (!session->SetAssembler(std::make_shared<CCcpDaqAssembler>(layout, Capacity ? Capacity : CCP_DAQ_DEFAULT_CAPACITY)))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_ReadDaqSample(
+	TCCPHandle CcpHandle,
+	BYTE ListNumber,
+	BYTE *Data,
+	WORD Size,
+	TCCPDaqSampleInfo *Info)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<CCcpDaqAssembler> assembler;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Data || !Info)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	assembler = session->GetAssembler();
+	if (!assembler)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+	return assembler->ReadSample(ListNumber, Data, Size, Info);
+}
+
+TCCPResult __stdcall CCP_GetDaqCycleStats(
+	TCCPHandle CcpHandle,
+	BYTE ListNumber,
+	TCCPDaqCycleStats *Stats)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+	std::shared_ptr<CCcpDaqAssembler> assembler;
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Stats)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	assembler = session->GetAssembler();
+	if (!assembler)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLOPERATION);
+	if (!assembler->GetStats(ListNumber, Stats))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// DAQ health
+//------------------------------
+
+TCCPResult __stdcall CCP_GetDaqHealth(
+	TCCPHandle CcpHandle,
+	TCCPDaqHealth *Health,
+	TCCPDaqListHealth *Lists,
+	BYTE MaxLists,
+	TCCPDaqJitterHistogram *Histograms,
+	BYTE MaxHistograms,
+	bool Reset)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Health)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	session->GetDaqHealth(Health, Lists, MaxLists, Histograms, MaxHistograms, Reset);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Channel receive
+//------------------------------
+
+TCCPResult __stdcall CCP_SetRxMode(
+	TPCANHandle Channel,
+	BYTE Mode)
+{
+	std::shared_ptr<CCcpChannel> channel;
+
+	if (Mode != CCP_RX_MODE_EVENT && Mode != CCP_RX_MODE_BUSY_POLL)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	channel = CCcpRegistry::Instance().FindChannel(Channel);
+	if (!channel)
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+	channel->SetBusyPoll(Mode == CCP_RX_MODE_BUSY_POLL);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_GetChannelStats(
+	TPCANHandle Channel,
+	TCCPChannelStats *Stats)
+{
+	std::shared_ptr<CCcpChannel> channel;
+
+	if (!Stats)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	channel = CCcpRegistry::Instance().FindChannel(Channel);
+	if (!channel)
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+	channel->GetStats(Stats);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Station multiplexer
+//------------------------------
+
+TCCPResult __stdcall CCP_MuxCreate(
+	TPCANHandle Channel,
+	TCCPMuxParams *Params,
+	TCCPHandle *MuxHandle)
+{
+	std::shared_ptr<CCcpChannel> channel;
+	std::shared_ptr<CCcpStationMux> mux;
+
+	if (!MuxHandle)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	channel = CCcpRegistry::Instance().FindChannel(Channel);
+	if (!channel)
+		return CCP_RESULT_PCAN(PCAN_ERROR_INITIALIZE);
+
+	mux = std::make_shared<CCcpStationMux>(channel);
+	if (Params && !mux->SetParams(*Params))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	*MuxHandle = CCcpRegistry::Instance().AddMux(mux);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_MuxAddStation(
+	TCCPHandle MuxHandle,
+	TCCPSlaveData *SlaveData,
+	BYTE *Station)
+{
+	std::shared_ptr<CCcpStationMux> mux = CCcpRegistry::Instance().FindMux(MuxHandle);
+
+	if (!mux)
+		return CCP_RESULT_ILLHANDLE;
+	if (!SlaveData || !Station || !mux->AddStation(*SlaveData, Station))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_MuxSendCommand(
+	TCCPHandle MuxHandle,
+	BYTE Station,
+	BYTE *Cro,
+	BYTE *Crm,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpStationMux> mux = CCcpRegistry::Instance().FindMux(MuxHandle);
+
+	if (!mux)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Cro || Cro[0] == CCP_CMD_CONNECT || Cro[0] == CCP_CMD_DISCONNECT || !mux->IsStation(Station))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return mux->Command(Station, Cro, Crm, TimeOut);
+}
+
+TCCPResult __stdcall CCP_MuxSendCommandAsync(
+	TCCPHandle MuxHandle,
+	BYTE Station,
+	BYTE *Cro,
+	WORD TimeOut,
+	TCCPCommandCallback Callback,
+	void *Context)
+{
+	std::shared_ptr<CCcpStationMux> mux = CCcpRegistry::Instance().FindMux(MuxHandle);
+
+	if (!mux)
+		return CCP_RESULT_ILLHANDLE;
+	if (!Cro || !Callback || Cro[0] == CCP_CMD_CONNECT || Cro[0] == CCP_CMD_DISCONNECT || !mux->IsStation(Station))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	mux->CommandAsync(Station, Cro, TimeOut, [Callback, Context](TCCPResult Result, const BYTE *Crm, DWORD)
+	{
+		Callback(Context, Result, Crm);
+	});
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_MuxGetStats(
+	TCCPHandle MuxHandle,
+	TCCPMuxStats *Stats,
+	TCCPMuxStationStats *StationStats,
+	BYTE Count)
+{
+	std::shared_ptr<CCcpStationMux> mux = CCcpRegistry::Instance().FindMux(MuxHandle);
+
+	if (!mux)
+		return CCP_RESULT_ILLHANDLE;
+	if (!StationStats && Count)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	if (Stats)
+		mux->GetStats(Stats);
+	for (BYTE i = 0; i < Count; i++)
+	{
+		if (!mux->GetStationStats(i, &StationStats[i]))
+			memset(&StationStats[i], 0, sizeof(StationStats[i]));
+	}
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+TCCPResult __stdcall CCP_MuxRelease(
+	TCCPHandle MuxHandle)
+{
+	if (!CCcpRegistry::Instance().FindMux(MuxHandle))
+		return CCP_RESULT_ILLHANDLE;
+	CCcpRegistry::Instance().RemoveMux(MuxHandle);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Checksums
+//------------------------------
+
+TCCPResult __stdcall CCP_CalculateChecksum(
+	BYTE ChecksumType,
+	bool IntelFormat,
+	BYTE *Data,
+	DWORD Length,
+	DWORD *Checksum,
+	BYTE *ChecksumSize)
+{
+	CCcpChecksum checksum;
+
+	if (!Checksum || (!Data && Length) || !checksum.Reset(ChecksumType, IntelFormat))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	checksum.Update(Data, Length);
+	if (!checksum.GetValue(Checksum))
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	if (ChecksumSize)
+		*ChecksumSize = CCcpChecksum::GetSize(ChecksumType);
+	return CCP_ERROR_ACKNOWLEDGE_OK;
+}
+
+//------------------------------
+// Flash Programming
+//------------------------------
+
+TCCPResult __stdcall CCP_FlashImage(
+	TCCPHandle CcpHandle,
+	LPCSTR FileName,
+	TCCPFlashParams *Params,
+	TCCPFlashProgressCallback Callback,
+	void *Context,
+	TCCPFlashProgress *Progress,
+	WORD TimeOut)
+{
+	std::shared_ptr<CCcpSession> session = GetSession(CcpHandle);
+
+	if (!session)
+		return CCP_RESULT_ILLHANDLE;
+	if (!FileName)
+		return CCP_RESULT_PCAN(PCAN_ERROR_ILLPARAMVAL);
+	return CCcpFlashProgrammer(session.get()).Program(FileName, Params, Callback, Context, Progress, TimeOut);
+}
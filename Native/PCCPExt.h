@@ -0,0 +1,1167 @@
+//  PCCPExt.h
+//
+//  ~~~~~~~~~~~~
+//
+//  PCAN-CCP API extensions of the native engine (not available in PCCP.dll)
+//
+//  ~~~~~~~~~~~~
+//
+//  Language: ANSI-C
+//
+#ifndef __PCCPEXTH__
+#define __PCCPEXTH__
+
+////////////////////////////////////////////////////////////
+// Inclusion of other needed files
+////////////////////////////////////////////////////////////
+
+#ifndef __PCCPH__
+#include "PCCP.h"                                        // PCAN-CCP API
+#endif
+
+////////////////////////////////////////////////////////////
+// Value definitions
+////////////////////////////////////////////////////////////
+
+// Result and Error values of the extensions (detected by the master)
+//
+#define CCP_ERROR_VERIFY_FAILED                0x100     // A block checksum (BUILD_CHKSUM) differs from the image
+#define CCP_ERROR_IMAGE_FORMAT                 0x101     // Invalid Intel HEX / Motorola S-record image
+#define CCP_ERROR_IMAGE_FILE                   0x102     // The image file cannot be opened or read
+#define CCP_ERROR_KEY_ALGORITHM                0x103     // No key algorithm for a protected resource, or it failed
+#define CCP_ERROR_DAQ_CAPACITY                 0x104     // The DAQ signals do not fit into the DAQ lists of the slave
+#define CCP_ERROR_DAQ_BUSLOAD                  0x105     // The DAQ plan exceeds the bus load budget
+
+// Checksum types of BUILD_CHKSUM (same numbering as the XCP checksum types)
+//
+#define CCP_CHECKSUM_ADD_BB                    0x01      // Sum of bytes into a byte
+#define CCP_CHECKSUM_ADD_BW                    0x02      // Sum of bytes into a word
+#define CCP_CHECKSUM_ADD_BD                    0x03      // Sum of bytes into a dword
+#define CCP_CHECKSUM_ADD_WW                    0x04      // Sum of words into a word
+#define CCP_CHECKSUM_ADD_WD                    0x05      // Sum of words into a dword
+#define CCP_CHECKSUM_ADD_DD                    0x06      // Sum of dwords into a dword
+#define CCP_CHECKSUM_CRC_16                    0x07      // CRC-16 (polynomial 0x8005, reflected, initial value 0)
+#define CCP_CHECKSUM_CRC_16_CITT               0x08      // CRC-16 CCITT (polynomial 0x1021, initial value 0xFFFF)
+#define CCP_CHECKSUM_CRC_32                    0x09      // CRC-32 (IEEE 802.3)
+
+// Flash programming defaults
+//
+#define CCP_FLASH_DEFAULT_BLOCK                0x400     // Bytes programmed and verified per block
+
+// Adaptive time out defaults (see TCCPRttParams)
+//
+#define CCP_RTT_DEFAULT_RETRIES                3         // Resends of a command that got no answer
+#define CCP_RTT_DEFAULT_MIN_TIMEOUT            2         // Lower bound of the adaptive time out (millis)
+#define CCP_RTT_DEFAULT_MAX_TIMEOUT            1000      // Upper bound of the adaptive time out (millis)
+
+// Busy slave defaults (see TCCPBusyParams)
+//
+#define CCP_BUSY_DEFAULT_MIN_BACKOFF           500       // Wait after a first busy answer (micros)
+#define CCP_BUSY_DEFAULT_MAX_BACKOFF           20000     // Longest wait between two attempts (micros)
+#define CCP_BUSY_DEFAULT_MAX_TIME              2000      // Time after which a busy command fails (millis)
+
+// Station multiplexer defaults (see TCCPMuxParams)
+//
+#define CCP_MUX_MAX_STATIONS                   64        // Stations served by one multiplexer
+#define CCP_MUX_DEFAULT_BATCH                  16        // Commands a station sends in a row while others wait
+
+// DAQ cycle reassembly (see CCP_SetDaqAssembly)
+//
+#define CCP_DAQ_ALL_LISTS                      0xFF      // CCP_GetDaqCycleStats: totals of all the lists
+#define CCP_DAQ_DEFAULT_CAPACITY               256       // Samples kept per DAQ list when Capacity is 0
+
+// DAQ planning (see CCP_PlanDaq)
+//
+#define CCP_DAQ_DEFAULT_BUDGET                 700       // Share of the bit rate the DAQ may use (per mille) when Budget is 0
+
+// Receive queue (see CCP_SetRcvQueueCapacity)
+//
+#define CCP_RCV_QUEUE_MAX_CAPACITY             0x100000  // Upper bound of the messages a receive queue can hold
+#define CCP_MSG_SPANS                          2         // Spans returned by CCP_PeekMsgs: the ring up to its end, then from its start
+
+// DAQ health (see CCP_GetDaqHealth)
+//
+#define CCP_JITTER_BUCKETS                     16        // Buckets of a jitter histogram. Bucket n: deviations below 2^n micros (last: any)
+
+// Receive modes of a channel (see CCP_SetRxMode)
+//
+#define CCP_RX_MODE_EVENT                      0x00      // The receive thread sleeps until the transport signals frames (default)
+#define CCP_RX_MODE_BUSY_POLL                  0x01      // The receive thread polls the transport without ever sleeping
+
+////////////////////////////////////////////////////////////
+// Structure definitions
+////////////////////////////////////////////////////////////
+
+// A block of slave memory (CCP_WriteMemory)
+//
+typedef struct
+{
+	BYTE AddrExtension;                                    // Address extension of the block
+	DWORD Addr;                                            // Start address of the block
+	DWORD Length;                                          // Size of the block, in bytes
+	BYTE *Data;                                            // Data of the block
+}TCCPMemoryBlock;
+
+// Figures of a bulk memory transfer (CCP_ReadMemory / CCP_WriteMemory)
+//
+typedef struct
+{
+	DWORD Bytes;                                           // Data bytes transferred
+	DWORD Commands;                                        // Commands acknowledged by the slave (round trips)
+	DWORD ElapsedMicros;                                   // Duration of the transfer, in microseconds
+	DWORD BytesPerSecond;                                  // Achieved throughput
+}TCCPTransferStats;
+
+// Parameters of a flash programming (CCP_FlashImage)
+//
+typedef struct
+{
+	BYTE AddrExtension;                                    // Address extension of the flash memory
+	DWORD SectorSize;                                      // Erase unit of the flash. 0: erase exactly the programmed blocks
+	DWORD BlockSize;                                       // Bytes programmed and verified at once. 0: CCP_FLASH_DEFAULT_BLOCK
+	bool Verify;                                           // Verify each block with BUILD_CHKSUM
+	BYTE ChecksumType;                                     // Checksum type of the slave (CCP_CHECKSUM_*). 0: CCP_CHECKSUM_CRC_16_CITT
+	bool Delta;                                            // Program only the sectors whose content differs from the image
+}TCCPFlashParams;
+
+// Progress of a flash programming (CCP_FlashImage)
+//
+typedef struct
+{
+	UINT64 ImageBytesRead;                                 // Bytes of the image file parsed so far
+	UINT64 ImageSize;                                      // Size of the image file
+	DWORD BytesProgrammed;                                 // Data bytes programmed so far
+	DWORD SectorsCleared;                                  // CLEAR_MEMORY commands issued
+	DWORD BlocksVerified;                                  // Blocks whose checksum matched
+	DWORD BytesSkipped;                                    // Data bytes already in the slave (Delta)
+	DWORD SectorsSkipped;                                  // Sectors left untouched (Delta)
+	DWORD Commands;                                        // Commands acknowledged by the slave (round trips)
+	DWORD ElapsedMicros;                                   // Duration so far, in microseconds
+	DWORD BytesPerSecond;                                  // Programming throughput
+}TCCPFlashProgress;
+
+// Time out policy of a connection for the commands sent with TimeOut = 0
+// (CCP_SetRttParams). Explicit time outs are always used as given
+//
+typedef struct
+{
+	bool Adaptive;                                         // Time out from the measured round trip times (else the fixed default)
+	BYTE MaxRetries;                                       // Resends of an idempotent command that got no answer
+	WORD MinTimeOut;                                       // Lower bound of the adaptive time out (millis)
+	WORD MaxTimeOut;                                       // Upper bound of the adaptive time out, resends included (millis)
+}TCCPRttParams;
+
+// Round trip time estimation of a connection (CCP_GetRttStats). Only the
+// short commands are measured; flash and checksum commands keep their default time out
+//
+typedef struct
+{
+	DWORD SmoothedRtt;                                     // Smoothed round trip time, in microseconds. 0 before the first answer
+	DWORD RttVariation;                                    // Mean deviation of the round trip time, in microseconds
+	DWORD TimeOut;                                         // Time out of the next short command, in microseconds
+	DWORD Samples;                                         // Answers measured
+	DWORD Retries;                                         // Commands resent after a time out
+	DWORD TimeOuts;                                        // Time outs, resent commands included
+}TCCPRttStats;
+
+// Handling of the commands answered CCP_ERROR_CMD_PROCESSOR_BUSY or
+// CCP_ERROR_DAQ_PROCESSOR_BUSY (CCP_SetBusyParams)
+//
+typedef struct
+{
+	DWORD MinBackoff;                                      // Wait for the final CRM after a first busy answer (micros)
+	DWORD MaxBackoff;                                      // Upper bound of the wait, doubled with each busy answer (micros)
+	WORD MaxBusyTime;                                      // Time after which the busy error is returned (millis). 0: at once
+}TCCPBusyParams;
+
+// Busy answers of a connection (CCP_GetBusyStats)
+//
+typedef struct
+{
+	DWORD CmdBusyAnswers;                                  // CRMs with CCP_ERROR_CMD_PROCESSOR_BUSY
+	DWORD DaqBusyAnswers;                                  // CRMs with CCP_ERROR_DAQ_PROCESSOR_BUSY
+	DWORD Repeats;                                         // Commands repeated after a busy answer
+	DWORD BusyCommands;                                    // Commands that got at least one busy answer
+	DWORD GaveUp;                                          // Commands that ended with a busy error
+	UINT64 BusyMicros;                                     // Total time from first busy answer to final CRM
+	DWORD MaxBusyMicros;                                   // Longest busy period of a command
+}TCCPBusyStats;
+
+// Hand over of the bus between the stations of a multiplexer (CCP_MuxCreate)
+//
+typedef struct
+{
+	WORD MaxBatch;                                         // Commands a station sends in a row while others wait. 0: CCP_MUX_DEFAULT_BATCH
+	WORD MaxSlice;                                         // Time a station keeps the bus while others wait (millis). 0: no limit
+	bool ImplicitSwitch;                                   // Select the next station by CONNECT only (no temporary DISCONNECT first)
+	WORD SwitchTimeOut;                                    // Wait time (millis) for the DISCONNECT / CONNECT answers. 0: default time
+}TCCPMuxParams;
+
+// Figures of a multiplexer (CCP_MuxGetStats)
+//
+typedef struct
+{
+	BYTE Stations;                                         // Stations added
+	DWORD Commands;                                        // Commands completed, failed ones included
+	DWORD Switches;                                        // Selections of a station (CONNECT)
+	DWORD SwitchFailures;                                  // CONNECTs that failed (the pending commands of the station fail with them)
+	UINT64 SwitchMicros;                                   // Bus time spent switching, in microseconds
+	UINT64 CommandMicros;                                  // Bus time spent in commands, in microseconds
+	WORD SwitchOverhead;                                   // Share of the bus time spent switching, per mille
+	WORD Fairness;                                         // Jain's index of the mean waits of the stations, per mille (1000: equal waits)
+	DWORD CommandsPerSwitch;                               // Mean number of commands sent per selection
+}TCCPMuxStats;
+
+// Figures of one station of a multiplexer (CCP_MuxGetStats)
+//
+typedef struct
+{
+	DWORD Commands;                                        // Commands completed, failed ones included
+	DWORD Failed;                                          // Commands that did not end with CCP_ERROR_ACKNOWLEDGE_OK
+	DWORD Slices;                                          // Times the station got the bus
+	DWORD Pending;                                         // Commands waiting for the bus
+	UINT64 WaitMicros;                                     // Total time from queuing to sending, in microseconds
+	DWORD MaxWaitMicros;                                   // Longest wait of a command, in microseconds
+	UINT64 BusMicros;                                      // Total time from sending to completion, in microseconds
+}TCCPMuxStationStats;
+
+// A signal measured through DAQ (CCP_ConfigureDaq). Signals sampled by the
+// same event channel with the same prescaler share DAQ lists
+//
+typedef struct
+{
+	BYTE AddrExtension;                                    // Address extension of the signal
+	DWORD Addr;                                            // Address of the signal
+	BYTE Size;                                             // Size of the signal: 1, 2 or 4 bytes (one DAQ element)
+	BYTE EventChannel;                                     // Event channel sampling the signal
+	WORD Prescaler;                                        // Transmission rate prescaler (0 or 1: every event)
+}TCCPDaqSignal;
+
+// Where a signal is transmitted (CCP_ConfigureDaq)
+//
+typedef struct
+{
+	BYTE ListNumber;                                       // DAQ list of the signal
+	BYTE OdtNumber;                                        // ODT of the signal within the list
+	BYTE Pid;                                              // PID of the DTO carrying the signal (FirstPDI + OdtNumber)
+	BYTE Offset;                                           // Position of the signal within the 7 data bytes of the DTO
+}TCCPDaqPlacement;
+
+// Figures of a DAQ configuration (CCP_ConfigureDaq)
+//
+typedef struct
+{
+	BYTE Lists;                                            // DAQ lists used
+	WORD Odts;                                             // ODTs used: DTOs sent per cycle of all the lists
+	DWORD Elements;                                        // DAQ elements written
+	DWORD Bytes;                                           // Signal bytes per cycle of all the lists
+	WORD Fill;                                             // Share of the DTO data bytes carrying signals, per mille
+	DWORD Commands;                                        // Commands sent to configure the lists
+}TCCPDaqConfigStats;
+
+// Start of a DAQ list by CCP_StartDaqSynchronized
+//
+typedef struct
+{
+	TCCPHandle CcpHandle;                                  // Connection of the list
+	BYTE ListNumber;                                       // The DAQ list
+	BYTE Started;                                          // 1 if a DTO of the list arrived within the wait time
+	DWORD SkewUs;                                          // Time from the first DTO of all the lists to the first DTO of this one (micros)
+}TCCPDaqStartReport;
+
+// Figures of a synchronized DAQ start (CCP_StartDaqSynchronized)
+//
+typedef struct
+{
+	BYTE Ecus;                                             // Connections started
+	WORD Lists;                                            // DAQ lists started
+	DWORD FireSpreadUs;                                    // Time taken to send START_STOP_ALL to all the connections (micros)
+	DWORD MaxSkewUs;                                       // Largest SkewUs of the lists that started
+}TCCPDaqStartStats;
+
+// A signal to be measured at a given rate (CCP_PlanDaq)
+//
+typedef struct
+{
+	BYTE AddrExtension;                                    // Address extension of the signal
+	DWORD Addr;                                            // Address of the signal
+	BYTE Size;                                             // Size of the signal: 1, 2 or 4 bytes
+	DWORD PeriodUs;                                        // Longest acceptable sampling period (micros)
+}TCCPDaqRequest;
+
+// Figures of a DAQ plan (CCP_PlanDaq)
+//
+typedef struct
+{
+	BYTE Rates;                                            // Distinct event channel / prescaler pairs: DAQ lists needed at least
+	WORD Odts;                                             // ODTs per cycle of all the rates
+	DWORD FramesPerSecond;                                 // DTOs per second
+	DWORD Bitrate;                                         // Bit rate of the channel (bit/s)
+	WORD BusLoad;                                          // Share of the bit rate taken by the DTOs (per mille, worst case stuffing)
+	WORD Upsampled;                                        // Signals moved to a faster rate because it costs no extra DTOs
+}TCCPDaqPlanStats;
+
+// A complete DAQ cycle (CCP_ReadDaqSample)
+//
+typedef struct
+{
+	UINT64 Timestamp;                                      // Receive time of the DTO of ODT 0 (nanos)
+	DWORD Cycle;                                           // Cycles begun by the list up to this one (gaps: cycles lost)
+	WORD Length;                                           // Data bytes: the 7 data bytes of each ODT, in ODT order
+}TCCPDaqSampleInfo;
+
+// Outcome of the DAQ cycles of a list (CCP_GetDaqCycleStats)
+//
+typedef struct
+{
+	UINT64 Complete;                                       // Cycles with all their ODTs, in order
+	UINT64 Torn;                                           // Cycles dropped: an ODT missing or out of order
+	UINT64 Incomplete;                                     // Cycles dropped: the next cycle began before the last ODT
+	UINT64 Overruns;                                       // Complete cycles dropped: samples not read in time
+}TCCPDaqCycleStats;
+
+// Messages of the receive queue, in place (CCP_PeekMsgs)
+//
+typedef struct
+{
+	TCCPMsg *Msgs;                                         // First message of the span
+	UINT64 *Timestamps;                                    // Receive time of each message (nanos)
+	DWORD Count;                                           // Messages in the span
+}TCCPMsgSpan;
+
+// Frames received on a channel (CCP_GetChannelStats)
+//
+typedef struct
+{
+	UINT64 Frames;                                         // Frames read from the transport
+	UINT64 Unknown;                                        // Frames dropped: no connection listens to their identifier
+	DWORD Sessions;                                        // Connections attached to the channel
+	DWORD Ids;                                             // Distinct IdDTO of the connections
+	BYTE Filtering;                                        // 1 if the transport filters the frames by IdDTO (acceptance filters)
+	BYTE RxMode;                                           // Receive mode: CCP_RX_MODE_EVENT or CCP_RX_MODE_BUSY_POLL
+	UINT64 Reads;                                          // Read calls made to the transport
+}TCCPChannelStats;
+
+// Measurement quality of a DAQ list (CCP_GetDaqHealth)
+//
+typedef struct
+{
+	BYTE ListNumber;                                       // The DAQ list
+	BYTE EventChannel;                                     // Event channel sampling the list
+	UINT64 Dtos;                                           // DTOs received
+	UINT64 Cycles;                                         // Cycles begun (ODT 0 received)
+	UINT64 LostCycles;                                     // Cycles never begun: gaps of more than 1.5 periods between two ODT 0
+	UINT64 TornCycles;                                     // Cycles begun with an ODT missing or out of order
+	UINT64 Overloads;                                      // CCP_ERROR_DAQ_OVERLOAD events naming the list
+	DWORD PeriodUs;                                        // Measured period of the cycles (micros, 0 until nine cycles arrived)
+}TCCPDaqListHealth;
+
+// Deviation of the cycle periods of the lists of an event channel (CCP_GetDaqHealth)
+//
+typedef struct
+{
+	BYTE EventChannel;                                     // The event channel
+	UINT64 Intervals;                                      // Periods measured
+	DWORD MaxJitterUs;                                     // Largest deviation from the measured period (micros)
+	UINT64 Buckets[CCP_JITTER_BUCKETS];                    // Periods by deviation. See CCP_JITTER_BUCKETS
+}TCCPDaqJitterHistogram;
+
+// Measurement quality of a connection (CCP_GetDaqHealth)
+//
+typedef struct
+{
+	UINT64 Dtos;                                           // DAQ DTOs received, lists of the configuration or not
+	UINT64 Events;                                         // Event messages received
+	UINT64 Overloads;                                      // CCP_ERROR_DAQ_OVERLOAD events, naming a configured list or not
+	DWORD QueueFill;                                       // Messages waiting in the receive queue
+	DWORD QueuePeak;                                       // Highest QueueFill of the period
+	DWORD QueueCapacity;                                   // Messages the receive queue can hold (see CCP_SetRcvQueueCapacity)
+	UINT64 QueueDrops;                                     // Messages lost to a full receive queue
+	UINT64 PeriodUs;                                       // Time covered by the counters (micros)
+	BYTE Lists;                                            // Entries written to the list buffer
+	BYTE Channels;                                         // Entries written to the histogram buffer
+}TCCPDaqHealth;
+
+// Called by CCP_FlashImage after each programmed block and each skipped sector
+//
+typedef void (__stdcall *TCCPFlashProgressCallback)(void *Context, const TCCPFlashProgress *Progress);
+
+// Called once when an asynchronous command completes (CCP_SendCommandAsync).
+// 'Crm' is the 8 byte answer, zeroed if none arrived
+//
+typedef void (__stdcall *TCCPCommandCallback)(void *Context, TCCPResult Result, const BYTE *Crm);
+
+// Called once when an asynchronous memory transfer completes (CCP_ReadMemoryAsync,
+// CCP_WriteMemoryAsync)
+//
+typedef void (__stdcall *TCCPTransferCallback)(void *Context, TCCPResult Result, const TCCPTransferStats *Stats);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////////////////////////
+// PCAN-CCP API extension function declarations
+////////////////////////////////////////////////////////////
+
+//------------------------------
+// Memory management
+//------------------------------
+
+/// <summary>
+/// Reads a memory range of any length from a connected slave
+/// </summary>
+/// <remarks>Up to 5 bytes are read with a single SHORT_UP. Longer ranges set
+/// MTA0 once and are read with back to back UPLOAD commands; MTA0 is left
+/// after the last byte read</remarks>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="AddrExtension">Address extension of the range</param>
+/// <param name="Addr">Start address of the range</param>
+/// <param name="Length">Size of the range, in bytes</param>
+/// <param name="Buffer">Buffer for the data (at least 'Length' bytes)</param>
+/// <param name="Stats">Optional buffer for the transfer figures, also filled on errors</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_ReadMemory(
+		TCCPHandle CcpHandle,
+		BYTE AddrExtension,
+		DWORD Addr,
+		DWORD Length,
+		BYTE *Buffer,
+		TCCPTransferStats *Stats,
+		WORD TimeOut);
+
+/// <summary>
+/// Writes a scatter list of memory blocks into a connected slave
+/// </summary>
+/// <remarks>Blocks are sorted and adjacent or overlapping blocks merged (on
+/// overlaps the block given last wins). Each merged range costs one SET_MTA;
+/// its data is sent with DNLOAD_6 for full 6 byte chunks and a final DNLOAD
+/// for the rest, all back to back</remarks>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Blocks">The blocks to be written. See 'TCCPMemoryBlock' structure above</param>
+/// <param name="Count">Number of blocks</param>
+/// <param name="Stats">Optional buffer for the transfer figures, also filled on errors</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_WriteMemory(
+		TCCPHandle CcpHandle,
+		TCCPMemoryBlock *Blocks,
+		DWORD Count,
+		TCCPTransferStats *Stats,
+		WORD TimeOut);
+
+/// <summary>
+/// Compares a memory range of a connected slave with the expected data without
+/// reading it: the checksum built by the slave (BUILD_CHKSUM) is compared with
+/// the checksum of the expected data computed by the master
+/// </summary>
+/// <remarks>MTA0 is set to 'Addr'. Costs two round trips for any size</remarks>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="ChecksumType">Checksum type implemented by the slave (CCP_CHECKSUM_*)</param>
+/// <param name="AddrExtension">Address extension of the range</param>
+/// <param name="Addr">Start address of the range</param>
+/// <param name="Length">Size of the range, in bytes</param>
+/// <param name="Expected">The data expected in the range</param>
+/// <param name="Match">Buffer for the comparison result</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_VerifyMemory(
+		TCCPHandle CcpHandle,
+		BYTE ChecksumType,
+		BYTE AddrExtension,
+		DWORD Addr,
+		DWORD Length,
+		BYTE *Expected,
+		bool *Match,
+		WORD TimeOut);
+
+//------------------------------
+// Asynchronous commands
+//------------------------------
+
+// The asynchronous functions queue their commands on the connection and return
+// at once. The commands of a connection go out one after the other (the next
+// CRO is sent by the receive thread of the channel as soon as a CRM arrives);
+// commands of different connections are in progress at the same time.
+// Callbacks run in the context of the receive thread: they must return
+// quickly and must not call the blocking CCP_* functions, but may queue
+// further asynchronous commands. When a function returns an error, its
+// callback is not called.
+
+/// <summary>
+/// Queues a raw CCP command and returns without waiting for the answer
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Cro">The 8 byte command (Cro[0]: command code. Cro[1], the counter, is assigned by the engine)</param>
+/// <param name="TimeOut">Wait time (millis) for ECU response. Zero(0) to use the default time</param>
+/// <param name="Callback">Called once with the result and the CRM</param>
+/// <param name="Context">User value passed to the callback</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_SendCommandAsync(
+		TCCPHandle CcpHandle,
+		BYTE *Cro,
+		WORD TimeOut,
+		TCCPCommandCallback Callback,
+		void *Context);
+
+/// <summary>
+/// Queues the read of a memory range (SET_MTA + back to back UPLOADs) and
+/// returns without waiting
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="AddrExtension">Address extension of the range</param>
+/// <param name="Addr">Start address of the range</param>
+/// <param name="Length">Size of the range, in bytes</param>
+/// <param name="Buffer">Buffer for the data. It must stay valid until the callback is called</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <param name="Callback">Called once with the result and the transfer figures</param>
+/// <param name="Context">User value passed to the callback</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_ReadMemoryAsync(
+		TCCPHandle CcpHandle,
+		BYTE AddrExtension,
+		DWORD Addr,
+		DWORD Length,
+		BYTE *Buffer,
+		WORD TimeOut,
+		TCCPTransferCallback Callback,
+		void *Context);
+
+/// <summary>
+/// Queues the write of a scatter list of memory blocks (see CCP_WriteMemory)
+/// and returns without waiting. The data is copied before returning
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Blocks">The blocks to be written. See 'TCCPMemoryBlock' structure above</param>
+/// <param name="Count">Number of blocks</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <param name="Callback">Called once with the result and the transfer figures</param>
+/// <param name="Context">User value passed to the callback</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_WriteMemoryAsync(
+		TCCPHandle CcpHandle,
+		TCCPMemoryBlock *Blocks,
+		DWORD Count,
+		WORD TimeOut,
+		TCCPTransferCallback Callback,
+		void *Context);
+
+//------------------------------
+// Adaptive time outs
+//------------------------------
+
+// Commands sent with TimeOut = 0 wait for their CRM as long as the round trip
+// time of the connection suggests (smoothed RTT + 4 x its mean deviation, as
+// TCP does), starting from the default time out until a first answer is
+// measured. An idempotent command that gets no answer is sent again with a
+// doubled time out; a lost UPLOAD / DNLOAD is preceded by a SET_MTA back to
+// its start address. Late answers are told apart by their command counter.
+
+/// <summary>
+/// Sets the time out policy of a connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Params">The policy (NULL for the defaults). See 'TCCPRttParams' structure above</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_SetRttParams(
+		TCCPHandle CcpHandle,
+		TCCPRttParams *Params);
+
+/// <summary>
+/// Returns the round trip time estimation of a connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Stats">Buffer for the estimation. See 'TCCPRttStats' structure above</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_GetRttStats(
+		TCCPHandle CcpHandle,
+		TCCPRttStats *Stats);
+
+//------------------------------
+// Busy slaves
+//------------------------------
+
+// A command answered CCP_ERROR_CMD_PROCESSOR_BUSY or CCP_ERROR_DAQ_PROCESSOR_BUSY
+// stays on the bus: as CCP 2.1 requires, the master waits for its final CRM and
+// repeats it if none arrives, the wait doubling with each busy answer (with a
+// random part). The caller only sees the busy error once MaxBusyTime is over.
+// The commands queued behind it wait meanwhile.
+
+/// <summary>
+/// Sets the handling of busy answers of a connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Params">The policy (NULL for the defaults). See 'TCCPBusyParams' structure above</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_SetBusyParams(
+		TCCPHandle CcpHandle,
+		TCCPBusyParams *Params);
+
+/// <summary>
+/// Returns the busy answer statistics of a connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Stats">Buffer for the statistics. See 'TCCPBusyStats' structure above</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_GetBusyStats(
+		TCCPHandle CcpHandle,
+		TCCPBusyStats *Stats);
+
+//------------------------------
+// Seed & key
+//------------------------------
+
+// Key algorithms are loaded from the seed & key libraries of the ECU vendors
+// (.dll / .so exporting ASAP1A_CCP_ComputeKeyFromSeed, or
+// XCP_ComputeKeyFromSeed which also receives the resource). A library is
+// loaded once for all the connections that use it.
+// CCP_UnlockResources unlocks the protected resources of a connection in one
+// pass and caches the privileges granted: resources unlocked since the last
+// CONNECT cost no round trip, and after a reconnect a single EXCHANGE_ID tells
+// whether the slave still has them unlocked.
+
+/// <summary>
+/// Selects the key algorithm of one or more resources of a connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Resources">The resources using the algorithm (CCP_RSM_* mask)</param>
+/// <param name="LibraryPath">Path of the seed & key library. NULL for the built-in test algorithm of the simulated ECU</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_SetKeyAlgorithm(
+		TCCPHandle CcpHandle,
+		BYTE Resources,
+		LPCSTR LibraryPath);
+
+/// <summary>
+/// Unlocks protected resources of a connection (GET_SEED + UNLOCK for each
+/// resource still protected, sent back to back)
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Resources">The resources needed (CCP_RSM_* mask). 0 for calibration, DAQ and programming</param>
+/// <param name="Privileges">Buffer for the resources unlocked (may be NULL)</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code. CCP_ERROR_KEY_ALGORITHM if no key could be computed for a protected resource</returns>
+TCCPResult __stdcall CCP_UnlockResources(
+		TCCPHandle CcpHandle,
+		BYTE Resources,
+		BYTE *Privileges,
+		WORD TimeOut);
+
+//------------------------------
+// DAQ configuration
+//------------------------------
+
+// CCP_ConfigureDaq turns a set of signals into DAQ lists: the signals of each
+// rate (event channel and prescaler) are packed into as few 7 byte ODTs as
+// possible, which is the number of DTOs sent per cycle, and the ODTs are
+// spread over the DAQ lists of the slave within the sizes and first PIDs it
+// reports through GET_DAQ_SIZE. The lists are written with SET_DAQ_PTR /
+// WRITE_DAQ sent back to back, and kept by the connection for
+// CCP_StartStopDaq. The DAQ resource must be unlocked.
+
+/// <summary>
+/// Configures the DAQ lists of a slave for a set of signals
+/// </summary>
+/// <remarks>The DAQ lists 0 to DaqLists - 1 are cleared (GET_DAQ_SIZE), which stops them</remarks>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="DaqLists">Number of DAQ lists of the slave</param>
+/// <param name="Signals">The signals to be measured. See 'TCCPDaqSignal' structure above</param>
+/// <param name="Count">Number of signals</param>
+/// <param name="Placements">Buffer for the placement of each signal (Count entries, may be NULL)</param>
+/// <param name="Stats">Buffer for the figures of the configuration (may be NULL)</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code. CCP_ERROR_DAQ_CAPACITY if the signals need more ODTs than the lists offer</returns>
+TCCPResult __stdcall CCP_ConfigureDaq(
+		TCCPHandle CcpHandle,
+		BYTE DaqLists,
+		TCCPDaqSignal *Signals,
+		DWORD Count,
+		TCCPDaqPlacement *Placements,
+		TCCPDaqConfigStats *Stats,
+		WORD TimeOut);
+
+/// <summary>
+/// Starts, prepares or stops all the DAQ lists configured by CCP_ConfigureDaq
+/// (one START_STOP per list, with its event channel, prescaler and last ODT)
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Mode">CCP_SSM_START, CCP_SSM_PREPARE_START or CCP_SSM_STOP</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_StartStopDaq(
+		TCCPHandle CcpHandle,
+		BYTE Mode,
+		WORD TimeOut);
+
+//------------------------------
+// Receive queue
+//------------------------------
+
+// The receive queue of a connection is a preallocated ring written by the
+// receive thread and read without locking it: CCP_ReadMsg and CCP_ReadMsgs
+// copy messages out of it, CCP_PeekMsgs hands them out in place, with their
+// receive times. A full queue drops the new messages; they are counted as
+// QueueDrops by CCP_GetDaqHealth. The messages returned by CCP_PeekMsgs stay
+// valid until CCP_ReleaseMsgs: in between the connection must have no other
+// reader, and its queue must not be resized.
+// Receive times are 64 bit nanosecond counts taken as close to the bus as
+// the transport allows: the time stamp of the CAN controller (PCAN-Basic,
+// SocketCAN drivers with hardware time stamps), else of the kernel. Their
+// origin depends on the transport; only differences are meaningful, and
+// only between connections of the same channel.
+
+/// <summary>
+/// Sets the number of messages the receive queue of a connection can hold.
+/// The messages waiting are kept, as far as they fit
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Capacity">Messages the queue can hold, up to CCP_RCV_QUEUE_MAX_CAPACITY. Zero(0) for CCP_MAX_RCV_QUEUE</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_SetRcvQueueCapacity(
+		TCCPHandle CcpHandle,
+		DWORD Capacity);
+
+/// <summary>
+/// Returns the messages waiting in the receive queue of a connection, in place
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Spans">Buffer for CCP_MSG_SPANS spans of messages, oldest first. See 'TCCPMsgSpan' structure above</param>
+/// <param name="Count">Buffer for the number of messages in the spans</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_QRCVEMPTY if the queue is empty</returns>
+TCCPResult __stdcall CCP_PeekMsgs(
+		TCCPHandle CcpHandle,
+		TCCPMsgSpan *Spans,
+		DWORD *Count);
+
+/// <summary>
+/// Takes the oldest messages returned by CCP_PeekMsgs from the receive queue
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Count">Number of messages done with</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_ILLPARAMVAL if fewer messages are waiting</returns>
+TCCPResult __stdcall CCP_ReleaseMsgs(
+		TCCPHandle CcpHandle,
+		DWORD Count);
+
+//------------------------------
+// DTO decoding
+//------------------------------
+
+// CCP_CreateDecoder compiles the DAQ lists of CCP_ConfigureDaq into a decode
+// plan per PID. CCP_DecodeMsgs runs the plans over batches of messages (as
+// read by CCP_ReadMsgs) and stores the value of each signal, unsigned and in
+// host byte order, into a column of Capacity samples. CCP_ReadSamples moves
+// the samples of one signal out of its column. Signals are numbered as in the
+// Signals array of CCP_ConfigureDaq.
+
+/// <summary>
+/// Reads up to Count messages from the receive queue of a PCAN-CCP connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Msgs">Buffer for the messages</param>
+/// <param name="Timestamps">Buffer for the receive time of each message, in nanos (may be NULL)</param>
+/// <param name="Count">Number of messages the buffer can hold</param>
+/// <param name="Read">Buffer for the number of messages read</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_QRCVEMPTY if the queue is empty</returns>
+TCCPResult __stdcall CCP_ReadMsgs(
+		TCCPHandle CcpHandle,
+		TCCPMsg *Msgs,
+		UINT64 *Timestamps,
+		DWORD Count,
+		DWORD *Read);
+
+/// <summary>
+/// Compiles the DAQ lists configured by CCP_ConfigureDaq into the DTO decoder
+/// of the connection. The samples of a previous decoder are discarded
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Capacity">Samples kept per signal (rounded up to a power of 2). Zero(0) for 4096</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_ILLOPERATION if no DAQ lists are configured</returns>
+TCCPResult __stdcall CCP_CreateDecoder(
+		TCCPHandle CcpHandle,
+		DWORD Capacity);
+
+/// <summary>
+/// Decodes a batch of messages. Messages that are not DAQ DTOs of the
+/// configured lists (events) are skipped
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Msgs">The messages</param>
+/// <param name="Timestamps">The receive time of each message, as read by CCP_ReadMsgs (may be NULL)</param>
+/// <param name="Count">Number of messages</param>
+/// <param name="Decoded">Buffer for the number of DAQ DTOs decoded (may be NULL)</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_ILLOPERATION if there is no decoder</returns>
+TCCPResult __stdcall CCP_DecodeMsgs(
+		TCCPHandle CcpHandle,
+		TCCPMsg *Msgs,
+		UINT64 *Timestamps,
+		DWORD Count,
+		DWORD *Decoded);
+
+/// <summary>
+/// Moves the oldest decoded samples of a signal into a buffer
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Signal">Index of the signal in the configuration</param>
+/// <param name="Samples">Buffer for the samples</param>
+/// <param name="Timestamps">Buffer for the receive time of the DTO of each sample, in nanos (may be NULL)</param>
+/// <param name="Count">Number of samples the buffer can hold</param>
+/// <param name="Read">Buffer for the number of samples read</param>
+/// <param name="Lost">Buffer for the samples overwritten since the last read (may be NULL)</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_ReadSamples(
+		TCCPHandle CcpHandle,
+		DWORD Signal,
+		DWORD *Samples,
+		UINT64 *Timestamps,
+		DWORD Count,
+		DWORD *Read,
+		DWORD *Lost);
+
+//------------------------------
+// Synchronized DAQ start
+//------------------------------
+
+// CCP_StartDaqSynchronized starts the DAQ lists of all the connections of a
+// channel together: each list configured by CCP_ConfigureDaq is prepared
+// (START_STOP with CCP_SSM_PREPARE_START), then START_STOP_ALL is sent to
+// every connection back to back. The receive time of the first DTO of each
+// list tells how far apart the lists actually started; event channels with
+// long periods add up to one period to the skew of their lists.
+
+/// <summary>
+/// Prepares the configured DAQ lists of all the connections of a channel and starts them at once
+/// </summary>
+/// <param name="Channel">The handle of a PCAN Channel</param>
+/// <param name="WaitTime">Wait time (millis) for the first DTO of each list. Zero(0) not to measure the skew</param>
+/// <param name="Reports">Buffer for the start of each list (may be NULL)</param>
+/// <param name="MaxReports">Number of reports the buffer can hold</param>
+/// <param name="Count">Buffer for the number of reports written (may be NULL)</param>
+/// <param name="Stats">Buffer for the figures of the start (may be NULL)</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_ILLOPERATION if no connection has DAQ lists configured</returns>
+TCCPResult __stdcall CCP_StartDaqSynchronized(
+		TPCANHandle Channel,
+		WORD WaitTime,
+		TCCPDaqStartReport *Reports,
+		DWORD MaxReports,
+		DWORD *Count,
+		TCCPDaqStartStats *Stats);
+
+/// <summary>
+/// Stops the DAQ lists of all the connections of a channel (START_STOP_ALL, back to back)
+/// </summary>
+/// <param name="Channel">The handle of a PCAN Channel</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_StopDaqSynchronized(
+		TPCANHandle Channel);
+
+//------------------------------
+// DAQ planning
+//------------------------------
+
+// CCP_PlanDaq chooses the event channel and prescaler of each signal: the
+// slowest rate the event channels offer that still meets its period. Each
+// rate is sent by a list of its own, so rates are shared when they sample
+// equally, and slower signals move into the spare bytes of faster ODTs when
+// that saves DTOs. The DTOs per second of the packed ODTs give the predicted
+// bus load at the bit rate of the channel. The signals returned are the input
+// of CCP_ConfigureDaq.
+
+/// <summary>
+/// Plans the rates of a set of signals and predicts their bus load
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="EventPeriodsUs">Period of each event channel of the slave (micros). Zero(0) for channels not available</param>
+/// <param name="EventChannels">Number of event channels</param>
+/// <param name="Requests">The signals and their periods. See 'TCCPDaqRequest' structure above</param>
+/// <param name="Count">Number of signals</param>
+/// <param name="Budget">Share of the bit rate the DAQ may use (per mille). Zero(0) for the default</param>
+/// <param name="Signals">Buffer for the planned signals (Count entries), for CCP_ConfigureDaq</param>
+/// <param name="Stats">Buffer for the figures of the plan (may be NULL)</param>
+/// <returns>A TCCPResult result code. CCP_ERROR_DAQ_BUSLOAD if the plan exceeds the budget
+/// (the plan and its figures are returned anyway)</returns>
+TCCPResult __stdcall CCP_PlanDaq(
+		TCCPHandle CcpHandle,
+		DWORD *EventPeriodsUs,
+		BYTE EventChannels,
+		TCCPDaqRequest *Requests,
+		DWORD Count,
+		WORD Budget,
+		TCCPDaqSignal *Signals,
+		TCCPDaqPlanStats *Stats);
+
+//------------------------------
+// DAQ cycle reassembly
+//------------------------------
+
+// A DAQ cycle arrives as one DTO per ODT. With the reassembly on, the DTOs of
+// the lists configured by CCP_ConfigureDaq no longer go to the receive queue:
+// they are collected per list, and a cycle becomes a sample once ODT 0 to
+// the last ODT arrived in order. The samples are handed from the receive
+// thread to the readers through a lock-free ring per list.
+
+/// <summary>
+/// Turns the reassembly of the DAQ cycles on or off. A new DAQ configuration turns it off
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Enable">True to turn the reassembly on (counters and samples start afresh)</param>
+/// <param name="Capacity">Samples kept per list (rounded up to a power of 2). Zero(0) for the default</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_ILLOPERATION if no DAQ lists are configured, or if they were configured anew meanwhile</returns>
+TCCPResult __stdcall CCP_SetDaqAssembly(
+		TCCPHandle CcpHandle,
+		bool Enable,
+		DWORD Capacity);
+
+/// <summary>
+/// Reads the oldest complete cycle of a DAQ list
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="ListNumber">The DAQ list</param>
+/// <param name="Data">Buffer for the data of the ODTs (7 bytes each)</param>
+/// <param name="Size">Size of the buffer</param>
+/// <param name="Info">Buffer for the timestamp, number and length of the cycle. See 'TCCPDaqSampleInfo' above</param>
+/// <returns>A TCCPResult result code. PCAN_ERROR_QRCVEMPTY if no cycle is complete</returns>
+TCCPResult __stdcall CCP_ReadDaqSample(
+		TCCPHandle CcpHandle,
+		BYTE ListNumber,
+		BYTE *Data,
+		WORD Size,
+		TCCPDaqSampleInfo *Info);
+
+/// <summary>
+/// Returns the outcome of the DAQ cycles of a list, or of all of them
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="ListNumber">The DAQ list, or CCP_DAQ_ALL_LISTS</param>
+/// <param name="Stats">Buffer for the counters. See 'TCCPDaqCycleStats' above</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_GetDaqCycleStats(
+		TCCPHandle CcpHandle,
+		BYTE ListNumber,
+		TCCPDaqCycleStats *Stats);
+
+//------------------------------
+// DAQ health
+//------------------------------
+
+// Each connection keeps counters of the quality of its measurement, always
+// on: the receive thread only adds to them while it queues the DTOs. Losses
+// on the slave side show as lost cycles and overload events; a host reading
+// too slowly shows as a full receive queue while the slave keeps its cycles
+// (with the reassembly on, as overruns: see CCP_GetDaqCycleStats). The lists are those configured by
+// CCP_ConfigureDaq; the counters start afresh with each configuration and,
+// on request, with each snapshot, so that periodic snapshots cover
+// consecutive periods without a gap.
+
+/// <summary>
+/// Takes a snapshot of the measurement quality of a connection
+/// </summary>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="Health">Buffer for the figures of the connection. See 'TCCPDaqHealth' structure above</param>
+/// <param name="Lists">Buffer for the figures of each configured DAQ list (may be NULL)</param>
+/// <param name="MaxLists">Number of entries the list buffer can hold</param>
+/// <param name="Histograms">Buffer for the jitter histogram of each event channel in use (may be NULL)</param>
+/// <param name="MaxHistograms">Number of entries the histogram buffer can hold</param>
+/// <param name="Reset">True to start the counters afresh</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_GetDaqHealth(
+		TCCPHandle CcpHandle,
+		TCCPDaqHealth *Health,
+		TCCPDaqListHealth *Lists,
+		BYTE MaxLists,
+		TCCPDaqJitterHistogram *Histograms,
+		BYTE MaxHistograms,
+		bool Reset);
+
+//------------------------------
+// Channel receive
+//------------------------------
+
+// One receive thread per channel reads the frames of all its connections in
+// batches and routes each one by its CAN identifier through a hash table of
+// the IdDTO of the connections, built when a connection is opened or closed.
+// At the same time the transport is given the tightest acceptance filters
+// its backend offers for these identifiers, so that most frames of other
+// nodes never reach the host. Frames on identifiers nobody listens to that
+// still arrive are dropped and counted.
+// The receive thread sleeps in the transport until frames arrive (PCAN-Basic
+// receive event, epoll on SocketCAN) and is woken at once when the channel
+// is closed. For the lowest command latency it can instead poll the
+// transport without sleeping, at the price of a CPU core.
+
+/// <summary>
+/// Sets how the receive thread of a channel waits for frames
+/// </summary>
+/// <param name="Channel">The handle of a PCAN Channel</param>
+/// <param name="Mode">CCP_RX_MODE_EVENT or CCP_RX_MODE_BUSY_POLL</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_SetRxMode(
+		TPCANHandle Channel,
+		BYTE Mode);
+
+/// <summary>
+/// Returns the counters of the receive thread of a channel
+/// </summary>
+/// <param name="Channel">The handle of a PCAN Channel</param>
+/// <param name="Stats">Buffer for the counters. See 'TCCPChannelStats' structure above</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_GetChannelStats(
+		TPCANHandle Channel,
+		TCCPChannelStats *Stats);
+
+//------------------------------
+// Station multiplexer
+//------------------------------
+
+// A multiplexer serves several stations on one channel (typically slaves that
+// share their CRO / DTO identifiers and differ only by station address). Only
+// the station selected by the last CONNECT is addressed: the multiplexer
+// queues the commands of each station and switches the selection by a
+// temporary DISCONNECT followed by a CONNECT. The selected station sends up
+// to MaxBatch commands in a row (or for MaxSlice millis) while the others
+// wait, then the next station with pending commands gets the bus, in round
+// robin order. Stations are addressed by their index (CCP_MuxAddStation).
+// The connections of a multiplexer have no TCCPHandle: its stations must not
+// be opened with CCP_Connect at the same time.
+
+/// <summary>
+/// Creates a station multiplexer on an initialized channel
+/// </summary>
+/// <param name="Channel">The handle of a PCAN Channel</param>
+/// <param name="Params">The hand over policy (NULL for the defaults). See 'TCCPMuxParams' structure above</param>
+/// <param name="MuxHandle">Buffer for the handle of the multiplexer</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_MuxCreate(
+		TPCANHandle Channel,
+		TCCPMuxParams *Params,
+		TCCPHandle *MuxHandle);
+
+/// <summary>
+/// Adds a station to a multiplexer. It is connected when its first command is sent
+/// </summary>
+/// <param name="MuxHandle">The handle of a multiplexer</param>
+/// <param name="SlaveData">Station address, CRO/DTO Ids and byte order of the slave</param>
+/// <param name="Station">Buffer for the index of the station</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_MuxAddStation(
+		TCCPHandle MuxHandle,
+		TCCPSlaveData *SlaveData,
+		BYTE *Station);
+
+/// <summary>
+/// Sends a raw CCP command to a station of a multiplexer and waits for its answer
+/// </summary>
+/// <param name="MuxHandle">The handle of a multiplexer</param>
+/// <param name="Station">Index of the station</param>
+/// <param name="Cro">The 8 byte command (Cro[0]: command code, not CONNECT / DISCONNECT. Cro[1] is assigned by the engine)</param>
+/// <param name="Crm">Buffer for the 8 byte answer (may be NULL)</param>
+/// <param name="TimeOut">Wait time (millis) for ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_MuxSendCommand(
+		TCCPHandle MuxHandle,
+		BYTE Station,
+		BYTE *Cro,
+		BYTE *Crm,
+		WORD TimeOut);
+
+/// <summary>
+/// Queues a raw CCP command for a station of a multiplexer and returns without
+/// waiting (see 'Asynchronous commands' above)
+/// </summary>
+/// <param name="MuxHandle">The handle of a multiplexer</param>
+/// <param name="Station">Index of the station</param>
+/// <param name="Cro">The 8 byte command (Cro[0]: command code, not CONNECT / DISCONNECT. Cro[1] is assigned by the engine)</param>
+/// <param name="TimeOut">Wait time (millis) for ECU response. Zero(0) to use the default time</param>
+/// <param name="Callback">Called once with the result and the CRM</param>
+/// <param name="Context">User value passed to the callback</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_MuxSendCommandAsync(
+		TCCPHandle MuxHandle,
+		BYTE Station,
+		BYTE *Cro,
+		WORD TimeOut,
+		TCCPCommandCallback Callback,
+		void *Context);
+
+/// <summary>
+/// Returns the switch and fairness figures of a multiplexer
+/// </summary>
+/// <param name="MuxHandle">The handle of a multiplexer</param>
+/// <param name="Stats">Buffer for the totals (may be NULL). See 'TCCPMuxStats' structure above</param>
+/// <param name="StationStats">Buffer for the figures of the first Count stations (may be NULL)</param>
+/// <param name="Count">Number of entries of StationStats</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_MuxGetStats(
+		TCCPHandle MuxHandle,
+		TCCPMuxStats *Stats,
+		TCCPMuxStationStats *StationStats,
+		BYTE Count);
+
+/// <summary>
+/// Destroys a multiplexer. Its queued commands fail with PCAN_ERROR_INITIALIZE;
+/// the command on the bus, if any, is waited for
+/// </summary>
+/// <param name="MuxHandle">The handle of a multiplexer</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_MuxRelease(
+		TCCPHandle MuxHandle);
+
+//------------------------------
+// Checksums
+//------------------------------
+
+/// <summary>
+/// Computes locally the checksum a slave returns through CCP_BuildChecksum
+/// </summary>
+/// <param name="ChecksumType">Checksum type (CCP_CHECKSUM_*)</param>
+/// <param name="IntelFormat">Byte order of the slave (word / dword sums and checksum value)</param>
+/// <param name="Data">The data</param>
+/// <param name="Length">Size of the data, in bytes (multiple of the word / dword size for ADD_W* / ADD_DD)</param>
+/// <param name="Checksum">Buffer for the checksum value</param>
+/// <param name="ChecksumSize">Buffer for the checksum size in bytes, as in the BUILD_CHKSUM CRM (may be NULL)</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_CalculateChecksum(
+		BYTE ChecksumType,
+		bool IntelFormat,
+		BYTE *Data,
+		DWORD Length,
+		DWORD *Checksum,
+		BYTE *ChecksumSize);
+
+//------------------------------
+// Flash Programming
+//------------------------------
+
+/// <summary>
+/// Programs an Intel HEX or Motorola S-record image into the flash memory of a
+/// connected slave. The file is streamed: only one block is held in memory
+/// </summary>
+/// <remarks>For each block: CLEAR_MEMORY of the sectors not cleared yet, then
+/// SET_MTA and PROGRAM_6 / PROGRAM, then SET_MTA and BUILD_CHKSUM (if Verify),
+/// sent back to back. The PGM resource must be unlocked.
+/// With Delta, the blocks of each sector (of each block if SectorSize is 0) are
+/// first compared with the slave memory through BUILD_CHKSUM, and the sector is
+/// cleared and programmed only if a checksum differs. One sector is then held
+/// in memory</remarks>
+/// <param name="CcpHandle">The handle of a PCAN-CCP connection</param>
+/// <param name="FileName">Path of the .hex / .s19 / .s28 / .s37 image</param>
+/// <param name="Params">Programming parameters (NULL for defaults). See 'TCCPFlashParams' structure above</param>
+/// <param name="Callback">Optional progress callback</param>
+/// <param name="Context">User value passed to the callback</param>
+/// <param name="Progress">Optional buffer for the final progress figures, also filled on errors</param>
+/// <param name="TimeOut">Wait time (millis) for each ECU response. Zero(0) to use the default time</param>
+/// <returns>A TCCPResult result code</returns>
+TCCPResult __stdcall CCP_FlashImage(
+		TCCPHandle CcpHandle,
+		LPCSTR FileName,
+		TCCPFlashParams *Params,
+		TCCPFlashProgressCallback Callback,
+		void *Context,
+		TCCPFlashProgress *Progress,
+		WORD TimeOut);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
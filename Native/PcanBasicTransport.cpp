@@ -0,0 +1,246 @@
+//  PcanBasicTransport.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  CAN transport backend over the PCAN-Basic API (PEAK hardware)
+//
+//  ~~~~~~~~~~~~
+//
+#include "PcanBasicTransport.h"
+#include "CanAcceptance.h"
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+CPcanBasicTransport::CPcanBasicTransport(TPCANHandle Channel, TPCANType HwType, DWORD IOPort, WORD Interrupt)
+	: m_Channel(Channel)
+	, m_HwType(HwType)
+	, m_IOPort(IOPort)
+	, m_Interrupt(Interrupt)
+	, m_Initialized(false)
+#ifdef _WIN32
+	, m_RcvEvent(NULL)
+	, m_WakeEvent(CreateEvent(NULL, FALSE, FALSE, NULL))
+#else
+	, m_RcvEvent(-1)
+	, m_WakeEvent(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+#endif
+{
+}
+
+CPcanBasicTransport::~CPcanBasicTransport()
+{
+	Uninitialize();
+#ifdef _WIN32
+	if (m_WakeEvent)
+		CloseHandle(m_WakeEvent);
+#else
+	if (m_WakeEvent >= 0)
+		close(m_WakeEvent);
+#endif
+}
+
+TPCANStatus CPcanBasicTransport::Initialize(TPCANBaudrate Btr0Btr1)
+{
+	TPCANStatus status;
+
+	status = CAN_Initialize(m_Channel, Btr0Btr1, m_HwType, m_IOPort, m_Interrupt);
+	m_Initialized = status == PCAN_ERROR_OK;
+	if (m_Initialized)
+		OpenEvents();
+	return status;
+}
+
+TPCANStatus CPcanBasicTransport::Uninitialize()
+{
+	TPCANStatus status;
+
+	if (!m_Initialized)
+		return PCAN_ERROR_OK;
+	m_Initialized = false;
+	status = CAN_Uninitialize(m_Channel);
+	CloseEvents();
+	return status;
+}
+
+//------------------------------
+// Receive events
+//------------------------------
+
+void CPcanBasicTransport::OpenEvents()
+{
+#ifdef _WIN32
+	m_RcvEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (m_RcvEvent && CAN_SetValue(m_Channel, PCAN_RECEIVE_EVENT, &m_RcvEvent, sizeof(m_RcvEvent)) != PCAN_ERROR_OK)
+	{
+		CloseHandle(m_RcvEvent);
+		m_RcvEvent = NULL;
+	}
+#else
+	// The driver owns the descriptor it hands out
+	if (CAN_GetValue(m_Channel, PCAN_RECEIVE_EVENT, &m_RcvEvent, sizeof(m_RcvEvent)) != PCAN_ERROR_OK)
+		m_RcvEvent = -1;
+#endif
+}
+
+void CPcanBasicTransport::CloseEvents()
+{
+	// m_WakeEvent stays open: Wake may be called by any thread meanwhile
+#ifdef _WIN32
+	if (m_RcvEvent)
+		CloseHandle(m_RcvEvent);
+	m_RcvEvent = NULL;
+#else
+	m_RcvEvent = -1;
+#endif
+}
+
+bool CPcanBasicTransport::WaitEvents(DWORD TimeOut)
+{
+#ifdef _WIN32
+	HANDLE events[2] = { m_RcvEvent, m_WakeEvent };
+
+	if (m_RcvEvent && m_WakeEvent)
+		return WaitForMultipleObjects(2, events, FALSE, TimeOut) != WAIT_OBJECT_0 + 1;
+#else
+	struct pollfd fds[2];
+	UINT64 wakes;
+
+	if (m_RcvEvent >= 0 && m_WakeEvent >= 0)
+	{
+		fds[0].fd = m_RcvEvent;
+		fds[1].fd = m_WakeEvent;
+		fds[0].events = fds[1].events = POLLIN;
+		fds[0].revents = fds[1].revents = 0;
+		if (poll(fds, 2, (int)TimeOut) > 0 && (fds[1].revents & POLLIN))
+			return read(m_WakeEvent, &wakes, sizeof(wakes)) != sizeof(wakes);
+		return true;
+	}
+#endif
+	std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	return true;
+}
+
+void CPcanBasicTransport::Wake()
+{
+#ifdef _WIN32
+	if (m_WakeEvent)
+		SetEvent(m_WakeEvent);
+#else
+	UINT64 one = 1;
+
+	if (m_WakeEvent >= 0 && write(m_WakeEvent, &one, sizeof(one)) < 0)
+		return;
+#endif
+}
+
+//------------------------------
+// Transfer
+//------------------------------
+
+TPCANStatus CPcanBasicTransport::Write(const TPCANMsg *Msgs, int Count, int *Sent)
+{
+	TPCANStatus status = PCAN_ERROR_OK;
+	TPCANMsg msg;
+	int i;
+
+	for (i = 0; i < Count; i++)
+	{
+		msg = Msgs[i];
+		status = CAN_Write(m_Channel, &msg);
+		if (status != PCAN_ERROR_OK)
+			break;
+	}
+	if (Sent)
+		*Sent = i;
+	return status;
+}
+
+TPCANStatus CPcanBasicTransport::Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut)
+{
+	std::chrono::steady_clock::time_point deadline, now;
+	TPCANTimestamp stamp;
+	TPCANStatus status;
+	int count = 0;
+
+	deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TimeOut);
+	while (m_Initialized)
+	{
+		// Drain whatever the driver has queued
+		//
+		while (count < MaxCount)
+		{
+			// The time stamp of the hardware, in micros
+			status = CAN_Read(m_Channel, &Msgs[count], &stamp);
+			// The driver may add the bus state to an empty queue (QRCVEMPTY | BUSLIGHT...)
+			if (status & PCAN_ERROR_QRCVEMPTY)
+				break;
+			if (status != PCAN_ERROR_OK && !(status & PCAN_ERROR_ANYBUSERR))
+			{
+				*Received = count;
+				return status;
+			}
+			// Status frames are not forwarded to the CCP layer
+			if (status == PCAN_ERROR_OK && !(Msgs[count].MSGTYPE & (PCAN_MESSAGE_STATUS | PCAN_MESSAGE_ERRFRAME)))
+			{
+				if (Stamps)
+					Stamps[count] = CanGetNanos(&stamp);
+				count++;
+			}
+		}
+		if (count > 0)
+			break;
+		now = std::chrono::steady_clock::now();
+		if (now >= deadline)
+			break;
+
+		// Up to the deadline, unless woken
+		if (!WaitEvents((DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::microseconds(999)).count()))
+			break;
+	}
+	*Received = count;
+	return count > 0 ? PCAN_ERROR_OK : PCAN_ERROR_QRCVEMPTY;
+}
+
+TPCANStatus CPcanBasicTransport::Reset()
+{
+	return CAN_Reset(m_Channel);
+}
+
+TPCANStatus CPcanBasicTransport::SetAcceptance(const DWORD *Ids, int Count)
+{
+	std::vector<TCanFilter> filters;
+	// A format without identifiers only lets its highest one through
+	UINT64 standard = (0x7FFULL << 32), extended = (0x1FFFFFFFULL << 32);
+	DWORD mode;
+	TPCANStatus status;
+
+	if (!m_Initialized)
+		return PCAN_ERROR_INITIALIZE;
+	mode = Count ? PCAN_FILTER_OPEN : PCAN_FILTER_CLOSE;
+	status = CAN_SetValue(m_Channel, PCAN_MESSAGE_FILTER, &mode, sizeof(mode));
+	if (status != PCAN_ERROR_OK || !Count)
+		return status;
+
+	// One code / mask pair per format, the code in the upper DWORD. As for
+	// the SJA1000, mask bits set are the ones not compared
+	CanBuildFilters(Ids, Count, 1, filters);
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		if (filters[i].Code & 0x80000000U)
+			extended = ((UINT64)(filters[i].Code & 0x1FFFFFFFU) << 32) | (~filters[i].Mask & 0x1FFFFFFFU);
+		else
+			standard = ((UINT64)(filters[i].Code & 0x7FFU) << 32) | (~filters[i].Mask & 0x7FFU);
+	}
+	status = CAN_SetValue(m_Channel, PCAN_ACCEPTANCE_FILTER_11BIT, &standard, sizeof(standard));
+	if (status == PCAN_ERROR_OK)
+		status = CAN_SetValue(m_Channel, PCAN_ACCEPTANCE_FILTER_29BIT, &extended, sizeof(extended));
+	return status;
+}
@@ -0,0 +1,52 @@
+//  PcanBasicTransport.h
+//
+//  ~~~~~~~~~~~~
+//
+//  CAN transport backend over the PCAN-Basic API (PEAK hardware)
+//
+//  ~~~~~~~~~~~~
+//
+//  Reception waits on the receive event of the driver (PCAN_RECEIVE_EVENT:
+//  an event object on Windows, a file descriptor on Linux) along with an
+//  event of its own signaled by Wake. Drivers without a receive event are
+//  polled every millisecond.
+//
+#ifndef __PCANBASICTRANSPORTH__
+#define __PCANBASICTRANSPORTH__
+
+#include "CanTransport.h"
+
+class CPcanBasicTransport : public ICanTransport
+{
+public:
+	CPcanBasicTransport(TPCANHandle Channel, TPCANType HwType = 0, DWORD IOPort = 0, WORD Interrupt = 0);
+	virtual ~CPcanBasicTransport();
+
+	virtual TPCANStatus Initialize(TPCANBaudrate Btr0Btr1);
+	virtual TPCANStatus Uninitialize();
+	virtual TPCANStatus Write(const TPCANMsg *Msgs, int Count, int *Sent);
+	virtual TPCANStatus Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut);
+	virtual TPCANStatus Reset();
+	virtual TPCANStatus SetAcceptance(const DWORD *Ids, int Count);
+	virtual void Wake();
+
+private:
+	void OpenEvents();
+	void CloseEvents();
+	bool WaitEvents(DWORD TimeOut);
+
+	TPCANHandle m_Channel;
+	TPCANType m_HwType;
+	DWORD m_IOPort;
+	WORD m_Interrupt;
+	volatile bool m_Initialized;
+#ifdef _WIN32
+	HANDLE m_RcvEvent;                                     // Set by the driver on reception, NULL if none
+	HANDLE m_WakeEvent;                                    // Set by Wake, open as long as the transport
+#else
+	int m_RcvEvent;                                        // Readable on reception (driver owned), -1 if none
+	int m_WakeEvent;                                       // eventfd signaled by Wake, open as long as the transport
+#endif
+};
+
+#endif
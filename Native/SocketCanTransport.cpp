@@ -0,0 +1,370 @@
+//  SocketCanTransport.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  CAN transport backend over Linux SocketCAN (CAN_RAW), batching reception
+//  and transmission with recvmmsg / sendmmsg
+//
+//  ~~~~~~~~~~~~
+//
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "SocketCanTransport.h"
+#include "CanAcceptance.h"
+
+#include <errno.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include <linux/can/raw.h>
+#include <linux/net_tstamp.h>
+
+// Time stamp of a received frame (nanos), 0 if the kernel gave none
+//
+static UINT64 GetStamp(const struct msghdr &Header)
+{
+	struct cmsghdr *control;
+	struct timespec stamps[3];
+
+	for (control = CMSG_FIRSTHDR(&Header); control; control = CMSG_NXTHDR((struct msghdr*)&Header, control))
+	{
+		if (control->cmsg_level != SOL_SOCKET)
+			continue;
+		if (control->cmsg_type == SO_TIMESTAMPING && control->cmsg_len >= CMSG_LEN(sizeof(stamps)))
+		{
+			// Software stamp first, the raw hardware one last
+			memcpy(stamps, CMSG_DATA(control), sizeof(stamps));
+			if (stamps[2].tv_sec || stamps[2].tv_nsec)
+				return (UINT64)stamps[2].tv_sec * 1000000000 + stamps[2].tv_nsec;
+			return (UINT64)stamps[0].tv_sec * 1000000000 + stamps[0].tv_nsec;
+		}
+		if (control->cmsg_type == SO_TIMESTAMPNS && control->cmsg_len >= CMSG_LEN(sizeof(stamps[0])))
+		{
+			memcpy(stamps, CMSG_DATA(control), sizeof(stamps[0]));
+			return (UINT64)stamps[0].tv_sec * 1000000000 + stamps[0].tv_nsec;
+		}
+	}
+	return 0;
+}
+
+CSocketCanTransport::CSocketCanTransport(const char *Interface)
+	: m_Interface(Interface ? Interface : "")
+	, m_Socket(-1)
+	, m_Epoll(-1)
+	, m_WakeEvent(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+	memset(m_RxHeaders, 0, sizeof(m_RxHeaders));
+	memset(m_TxHeaders, 0, sizeof(m_TxHeaders));
+
+	// The message headers point to fixed frame slots once and for all
+	for (int i = 0; i < SOCKETCAN_MAX_BATCH; i++)
+	{
+		m_RxVectors[i].iov_base = &m_RxFrames[i];
+		m_RxVectors[i].iov_len = sizeof(struct can_frame);
+		m_RxHeaders[i].msg_hdr.msg_iov = &m_RxVectors[i];
+		m_RxHeaders[i].msg_hdr.msg_iovlen = 1;
+		m_RxHeaders[i].msg_hdr.msg_control = m_RxControl[i];
+
+		m_TxVectors[i].iov_base = &m_TxFrames[i];
+		m_TxVectors[i].iov_len = sizeof(struct can_frame);
+		m_TxHeaders[i].msg_hdr.msg_iov = &m_TxVectors[i];
+		m_TxHeaders[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+CSocketCanTransport::~CSocketCanTransport()
+{
+	Uninitialize();
+	if (m_WakeEvent >= 0)
+		close(m_WakeEvent);
+}
+
+std::string CSocketCanTransport::DefaultInterface(TPCANHandle Channel)
+{
+	// First handle of channels 1..8 and of channels 9..16 of each kind
+	static const struct { WORD First; WORD Last; int Offset; } ranges[] =
+	{
+		{PCAN_ISABUS1, PCAN_ISABUS8, 0},
+		{PCAN_DNGBUS1, PCAN_DNGBUS1, 0},
+		{PCAN_PCIBUS1, PCAN_PCIBUS8, 0},
+		{PCAN_PCIBUS9, PCAN_PCIBUS16, 8},
+		{PCAN_USBBUS1, PCAN_USBBUS8, 0},
+		{PCAN_USBBUS9, PCAN_USBBUS16, 8},
+		{PCAN_PCCBUS1, PCAN_PCCBUS2, 0},
+		{PCAN_LANBUS1, PCAN_LANBUS16, 0},
+	};
+	char name[IFNAMSIZ];
+
+	for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++)
+	{
+		if (Channel >= ranges[i].First && Channel <= ranges[i].Last)
+		{
+			snprintf(name, sizeof(name), "can%d", ranges[i].Offset + (Channel - ranges[i].First));
+			return name;
+		}
+	}
+	return "";
+}
+
+TPCANStatus CSocketCanTransport::Initialize(TPCANBaudrate Btr0Btr1)
+{
+	struct sockaddr_can addr;
+	struct epoll_event event;
+	struct ifreq ifr;
+	int flags, on = 1;
+
+	(void)Btr0Btr1;
+
+	if (m_Socket >= 0)
+		return PCAN_ERROR_INITIALIZE;
+	if (m_Interface.empty() || m_Interface.size() >= IFNAMSIZ)
+		return PCAN_ERROR_ILLHW;
+
+	m_Socket = socket(PF_CAN, SOCK_RAW | SOCK_CLOEXEC, CAN_RAW);
+	if (m_Socket < 0)
+		return PCAN_ERROR_NODRIVER;
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, m_Interface.c_str(), IFNAMSIZ - 1);
+	if (ioctl(m_Socket, SIOCGIFINDEX, &ifr) < 0)
+	{
+		close(m_Socket);
+		m_Socket = -1;
+		return PCAN_ERROR_ILLHW;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	if (bind(m_Socket, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		close(m_Socket);
+		m_Socket = -1;
+		return PCAN_ERROR_HWINUSE;
+	}
+
+	// Time stamps of the controller where its driver has them, else of the kernel
+	flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	if (setsockopt(m_Socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+		setsockopt(m_Socket, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+
+	// The set waited for is built once, not per Read
+	m_Epoll = epoll_create1(EPOLL_CLOEXEC);
+	if (m_Epoll < 0 || m_WakeEvent < 0)
+	{
+		Uninitialize();
+		return PCAN_ERROR_RESOURCE;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = m_Socket;
+	epoll_ctl(m_Epoll, EPOLL_CTL_ADD, m_Socket, &event);
+	event.data.fd = m_WakeEvent;
+	epoll_ctl(m_Epoll, EPOLL_CTL_ADD, m_WakeEvent, &event);
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus CSocketCanTransport::Uninitialize()
+{
+	if (m_Socket < 0)
+		return PCAN_ERROR_OK;
+	// m_WakeEvent stays open: Wake may be called by any thread meanwhile
+	if (m_Epoll >= 0)
+		close(m_Epoll);
+	close(m_Socket);
+	m_Socket = -1;
+	m_Epoll = -1;
+	return PCAN_ERROR_OK;
+}
+
+void CSocketCanTransport::Wake()
+{
+	UINT64 one = 1;
+
+	if (m_WakeEvent >= 0 && write(m_WakeEvent, &one, sizeof(one)) < 0)
+		return;
+}
+
+TPCANStatus CSocketCanTransport::Write(const TPCANMsg *Msgs, int Count, int *Sent)
+{
+	int done = 0, batch, result, i;
+
+	if (m_Socket < 0)
+		return PCAN_ERROR_INITIALIZE;
+
+	while (done < Count)
+	{
+		batch = Count - done;
+		if (batch > SOCKETCAN_MAX_BATCH)
+			batch = SOCKETCAN_MAX_BATCH;
+
+		for (i = 0; i < batch; i++)
+		{
+			const TPCANMsg &msg = Msgs[done + i];
+			struct can_frame &frame = m_TxFrames[i];
+
+			frame.can_id = msg.ID;
+			if (msg.MSGTYPE & PCAN_MESSAGE_EXTENDED)
+				frame.can_id |= CAN_EFF_FLAG;
+			if (msg.MSGTYPE & PCAN_MESSAGE_RTR)
+				frame.can_id |= CAN_RTR_FLAG;
+			frame.can_dlc = msg.LEN > 8 ? 8 : msg.LEN;
+			memcpy(frame.data, msg.DATA, 8);
+		}
+
+		result = sendmmsg(m_Socket, m_TxHeaders, batch, 0);
+		if (result < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (Sent)
+				*Sent = done;
+			return (errno == ENOBUFS || errno == EAGAIN) ? PCAN_ERROR_QXMTFULL : PCAN_ERROR_UNKNOWN;
+		}
+		done += result;
+	}
+	if (Sent)
+		*Sent = done;
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus CSocketCanTransport::Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut)
+{
+	struct epoll_event events[2];
+	struct timespec now;
+	UINT64 host = 0, wakes;
+	int count = 0, batch, result, i;
+
+	*Received = 0;
+	if (m_Socket < 0)
+		return PCAN_ERROR_INITIALIZE;
+
+	// Without wait time (busy polling) the socket is drained straight away
+	if (TimeOut)
+	{
+		result = epoll_wait(m_Epoll, events, 2, (int)TimeOut);
+		if (result < 0)
+			return errno == EINTR ? PCAN_ERROR_QRCVEMPTY : PCAN_ERROR_UNKNOWN;
+		if (result == 0)
+			return PCAN_ERROR_QRCVEMPTY;
+
+		// Consume a Wake; the socket may have nothing then
+		for (i = 0; i < result; i++)
+		{
+			if (events[i].data.fd == m_WakeEvent && read(m_WakeEvent, &wakes, sizeof(wakes)) != sizeof(wakes))
+				break;
+		}
+	}
+
+	// Drain up to MaxCount frames, SOCKETCAN_MAX_BATCH per system call
+	//
+	while (count < MaxCount)
+	{
+		batch = MaxCount - count;
+		if (batch > SOCKETCAN_MAX_BATCH)
+			batch = SOCKETCAN_MAX_BATCH;
+
+		for (i = 0; i < batch; i++)
+			m_RxHeaders[i].msg_hdr.msg_controllen = SOCKETCAN_CONTROL_SIZE;
+		result = recvmmsg(m_Socket, m_RxHeaders, batch, MSG_DONTWAIT, NULL);
+		if (result <= 0)
+			break;
+
+		for (i = 0; i < result; i++)
+		{
+			const struct can_frame &frame = m_RxFrames[i];
+			TPCANMsg &msg = Msgs[count];
+
+			// Error frames are not forwarded to the CCP layer
+			if (frame.can_id & CAN_ERR_FLAG)
+				continue;
+
+			if (frame.can_id & CAN_EFF_FLAG)
+			{
+				msg.ID = frame.can_id & CAN_EFF_MASK;
+				msg.MSGTYPE = PCAN_MESSAGE_EXTENDED;
+			}
+			else
+			{
+				msg.ID = frame.can_id & CAN_SFF_MASK;
+				msg.MSGTYPE = PCAN_MESSAGE_STANDARD;
+			}
+			if (frame.can_id & CAN_RTR_FLAG)
+				msg.MSGTYPE |= PCAN_MESSAGE_RTR;
+			msg.LEN = frame.can_dlc > 8 ? 8 : frame.can_dlc;
+			memcpy(msg.DATA, frame.data, 8);
+			if (Stamps)
+			{
+				Stamps[count] = GetStamp(m_RxHeaders[i].msg_hdr);
+				if (!Stamps[count])
+				{
+					// No kernel time stamp: host reception time of the batch
+					if (!host)
+					{
+						clock_gettime(CLOCK_REALTIME, &now);
+						host = (UINT64)now.tv_sec * 1000000000 + now.tv_nsec;
+					}
+					Stamps[count] = host;
+				}
+			}
+			count++;
+		}
+		if (result < batch)
+			break;
+	}
+
+	*Received = count;
+	return count > 0 ? PCAN_ERROR_OK : PCAN_ERROR_QRCVEMPTY;
+}
+
+TPCANStatus CSocketCanTransport::Reset()
+{
+	TPCANMsg msgs[SOCKETCAN_MAX_BATCH];
+	int received;
+
+	// Discard what the socket has already queued
+	while (Read(msgs, NULL, SOCKETCAN_MAX_BATCH, &received, 0) == PCAN_ERROR_OK)
+		;
+	return m_Socket < 0 ? PCAN_ERROR_INITIALIZE : PCAN_ERROR_OK;
+}
+
+TPCANStatus CSocketCanTransport::SetAcceptance(const DWORD *Ids, int Count)
+{
+	std::vector<TCanFilter> filters;
+	std::vector<struct can_filter> rawFilters;
+
+	if (m_Socket < 0)
+		return PCAN_ERROR_INITIALIZE;
+
+	// No filter at all lets no frame through; RTR frames never pass
+	CanBuildFilters(Ids, Count, SOCKETCAN_MAX_FILTERS, filters);
+	for (size_t i = 0; i < filters.size(); i++)
+	{
+		struct can_filter filter;
+
+		if (filters[i].Code & 0x80000000U)
+		{
+			filter.can_id = (filters[i].Code & CAN_EFF_MASK) | CAN_EFF_FLAG;
+			filter.can_mask = (filters[i].Mask & CAN_EFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+		}
+		else
+		{
+			filter.can_id = filters[i].Code & CAN_SFF_MASK;
+			filter.can_mask = (filters[i].Mask & CAN_SFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+		}
+		rawFilters.push_back(filter);
+	}
+	if (setsockopt(m_Socket, SOL_CAN_RAW, CAN_RAW_FILTER, rawFilters.empty() ? NULL : &rawFilters[0],
+		(socklen_t)(rawFilters.size() * sizeof(struct can_filter))) < 0)
+		return PCAN_ERROR_UNKNOWN;
+	return PCAN_ERROR_OK;
+}
@@ -0,0 +1,88 @@
+//  SocketCanTransport.h
+//
+//  ~~~~~~~~~~~~
+//
+//  CAN transport backend over Linux SocketCAN (CAN_RAW), batching reception
+//  and transmission with recvmmsg / sendmmsg
+//
+//  ~~~~~~~~~~~~
+//
+//  Reception waits in epoll on the socket and on an eventfd, which Wake
+//  signals; a Read without wait time goes straight to recvmmsg.
+//
+//  Frames are time stamped by the kernel (SO_TIMESTAMPING): by the
+//  controller if its driver supports it, else on reception by the network
+//  stack (CLOCK_REALTIME). Kernels without SO_TIMESTAMPING fall back to
+//  SO_TIMESTAMPNS.
+//
+//  The bit rate of a SocketCAN interface is configured by the system
+//  (ip link set canX type can bitrate ...); the Btr0Btr1 value passed to
+//  CCP_InitializeChannel is ignored by this backend.
+//
+#ifndef __SOCKETCANTRANSPORTH__
+#define __SOCKETCANTRANSPORTH__
+
+#include "CanTransport.h"
+
+#include <linux/can.h>
+#include <sys/socket.h>
+
+#include <string>
+
+// Maximum frames moved per recvmmsg / sendmmsg system call
+//
+#define SOCKETCAN_MAX_BATCH                    64
+
+// Acceptance filters (CAN_RAW_FILTER) set per identifier format
+//
+#define SOCKETCAN_MAX_FILTERS                  64
+
+// Room for the control messages (time stamps) of a received frame
+//
+#define SOCKETCAN_CONTROL_SIZE                 128
+
+class CSocketCanTransport : public ICanTransport
+{
+public:
+	/// <summary>
+	/// Creates a transport bound to a SocketCAN interface
+	/// </summary>
+	/// <param name="Interface">Network interface name, e.g. "can0" or "vcan0"</param>
+	explicit CSocketCanTransport(const char *Interface);
+	virtual ~CSocketCanTransport();
+
+	virtual TPCANStatus Initialize(TPCANBaudrate Btr0Btr1);
+	virtual TPCANStatus Uninitialize();
+	virtual TPCANStatus Write(const TPCANMsg *Msgs, int Count, int *Sent);
+	virtual TPCANStatus Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut);
+	virtual TPCANStatus Reset();
+	virtual TPCANStatus SetAcceptance(const DWORD *Ids, int Count);
+	virtual void Wake();
+
+	/// <summary>
+	/// Returns the interface used by default for a PCAN channel: the n-th
+	/// channel of a kind (PCAN_USBBUS1, PCAN_PCIBUS1...) maps to "can{n-1}"
+	/// </summary>
+	static std::string DefaultInterface(TPCANHandle Channel);
+
+private:
+	std::string m_Interface;
+	int m_Socket;
+	int m_Epoll;                                           // Waits for the socket and m_WakeEvent
+	int m_WakeEvent;                                       // eventfd signaled by Wake, open as long as the transport
+
+	// Receive side, used by the channel receive thread only
+	//
+	struct mmsghdr m_RxHeaders[SOCKETCAN_MAX_BATCH];
+	struct iovec m_RxVectors[SOCKETCAN_MAX_BATCH];
+	struct can_frame m_RxFrames[SOCKETCAN_MAX_BATCH];
+	alignas(struct cmsghdr) char m_RxControl[SOCKETCAN_MAX_BATCH][SOCKETCAN_CONTROL_SIZE];
+
+	// Transmit side, serialized by the channel
+	//
+	struct mmsghdr m_TxHeaders[SOCKETCAN_MAX_BATCH];
+	struct iovec m_TxVectors[SOCKETCAN_MAX_BATCH];
+	struct can_frame m_TxFrames[SOCKETCAN_MAX_BATCH];
+};
+
+#endif
@@ -0,0 +1,217 @@
+//  VirtualCanBus.cpp
+//
+//  ~~~~~~~~~~~~
+//
+//  In-process CAN bus: connects master channels (ports) and simulated nodes
+//  without any CAN hardware
+//
+//  ~~~~~~~~~~~~
+//
+#include "VirtualCanBus.h"
+
+#include <algorithm>
+#include <chrono>
+
+//------------------------------
+// CVirtualCanBus
+//------------------------------
+
+CVirtualCanBus::CVirtualCanBus()
+	: m_FrameCount(0)
+{
+}
+
+std::shared_ptr<ICanTransport> CVirtualCanBus::CreatePort()
+{
+	return std::make_shared<CVirtualCanPort>(shared_from_this());
+}
+
+void CVirtualCanBus::AddNode(IVirtualCanNode *Node)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Lock);
+
+	m_Nodes.push_back(Node);
+}
+
+void CVirtualCanBus::RemoveNode(IVirtualCanNode *Node)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Lock);
+
+	m_Nodes.erase(std::remove(m_Nodes.begin(), m_Nodes.end(), Node), m_Nodes.end());
+}
+
+void CVirtualCanBus::RemovePort(CVirtualCanPort *Port)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Lock);
+
+	m_Ports.erase(std::remove(m_Ports.begin(), m_Ports.end(), Port), m_Ports.end());
+}
+
+void CVirtualCanBus::Transmit(const TPCANMsg *Msgs, int Count)
+{
+	Deliver(NULL, Msgs, Count);
+}
+
+void CVirtualCanBus::Deliver(CVirtualCanPort *Source, const TPCANMsg *Msgs, int Count)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_Lock);
+
+	m_FrameCount += Count;
+	for (size_t i = 0; i < m_Ports.size(); i++)
+	{
+		if (m_Ports[i] != Source)
+			m_Ports[i]->Push(Msgs, Count);
+	}
+
+	// Nodes only listen to the masters
+	if (Source)
+	{
+		for (int msg = 0; msg < Count; msg++)
+			for (size_t i = 0; i < m_Nodes.size(); i++)
+				m_Nodes[i]->OnFrame(Msgs[msg]);
+	}
+}
+
+//------------------------------
+// CVirtualCanPort
+//------------------------------
+
+CVirtualCanPort::CVirtualCanPort(const std::shared_ptr<CVirtualCanBus> &Bus)
+	: m_Bus(Bus)
+	, m_Open(false)
+	, m_Woken(false)
+	, m_Overruns(0)
+	, m_Filtering(false)
+	, m_Filtered(0)
+{
+}
+
+CVirtualCanPort::~CVirtualCanPort()
+{
+	Uninitialize();
+}
+
+TPCANStatus CVirtualCanPort::Initialize(TPCANBaudrate Btr0Btr1)
+{
+	(void)Btr0Btr1;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		if (m_Open)
+			return PCAN_ERROR_INITIALIZE;
+		m_Open = true;
+		m_Queue.clear();
+		m_Woken = false;
+		m_Filtering = false;
+	}
+
+	std::lock_guard<std::recursive_mutex> lock(m_Bus->m_Lock);
+	m_Bus->m_Ports.push_back(this);
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus CVirtualCanPort::Uninitialize()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+
+		if (!m_Open)
+			return PCAN_ERROR_OK;
+		m_Open = false;
+		m_Signal.notify_all();
+	}
+	m_Bus->RemovePort(this);
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus CVirtualCanPort::Write(const TPCANMsg *Msgs, int Count, int *Sent)
+{
+	if (!m_Open)
+		return PCAN_ERROR_INITIALIZE;
+
+	m_Bus->Deliver(this, Msgs, Count);
+	if (Sent)
+		*Sent = Count;
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus CVirtualCanPort::SetAcceptance(const DWORD *Ids, int Count)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	if (!m_Open)
+		return PCAN_ERROR_INITIALIZE;
+	CanBuildFilters(Ids, Count, VIRTUALCAN_PORT_FILTERS, m_Filters);
+	m_Filtering = true;
+	return PCAN_ERROR_OK;
+}
+
+void CVirtualCanPort::Wake()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Woken = true;
+	m_Signal.notify_all();
+}
+
+void CVirtualCanPort::Push(const TPCANMsg *Msgs, int Count)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	TFrame frame;
+	bool queued = false;
+
+	if (!m_Open)
+		return;
+	frame.Nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	for (int i = 0; i < Count; i++)
+	{
+		if (m_Filtering && std::none_of(m_Filters.begin(), m_Filters.end(), [&](const TCanFilter &Filter) { return CanAcceptId(Filter, CanGetId(&Msgs[i])); }))
+			m_Filtered++;
+		else if (m_Queue.size() >= VIRTUALCAN_PORT_QUEUE)
+			m_Overruns++;
+		else
+		{
+			frame.Msg = Msgs[i];
+			m_Queue.push_back(frame);
+			queued = true;
+		}
+	}
+	// Frames kept out wake nobody up
+	if (queued)
+		m_Signal.notify_one();
+}
+
+TPCANStatus CVirtualCanPort::Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut)
+{
+	std::unique_lock<std::mutex> lock(m_Lock);
+	int count = 0;
+
+	*Received = 0;
+	if (TimeOut && !m_Signal.wait_for(lock, std::chrono::milliseconds(TimeOut), [this] { return !m_Queue.empty() || !m_Open || m_Woken; }))
+		return PCAN_ERROR_QRCVEMPTY;
+	if (!m_Open)
+		return PCAN_ERROR_INITIALIZE;
+	m_Woken = false;
+	if (m_Queue.empty())
+		return PCAN_ERROR_QRCVEMPTY;
+
+	while (count < MaxCount && !m_Queue.empty())
+	{
+		Msgs[count] = m_Queue.front().Msg;
+		if (Stamps)
+			Stamps[count] = m_Queue.front().Nanos;
+		m_Queue.pop_front();
+		count++;
+	}
+	*Received = count;
+	return PCAN_ERROR_OK;
+}
+
+TPCANStatus CVirtualCanPort::Reset()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+
+	m_Queue.clear();
+	return PCAN_ERROR_OK;
+}
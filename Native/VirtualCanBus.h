@@ -0,0 +1,144 @@
+//  VirtualCanBus.h
+//
+//  ~~~~~~~~~~~~
+//
+//  In-process CAN bus: connects master channels (ports) and simulated nodes
+//  without any CAN hardware
+//
+//  ~~~~~~~~~~~~
+//
+//  A frame written to a port is delivered to every other port and to every
+//  node. A frame transmitted by a node is delivered to every port. Ports
+//  time stamp the frames when they are delivered, as a controller would.
+//
+#ifndef __VIRTUALCANBUSH__
+#define __VIRTUALCANBUSH__
+
+#include "CanTransport.h"
+#include "CanAcceptance.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Frames a port retains before dropping (models the driver receive queue)
+//
+#define VIRTUALCAN_PORT_QUEUE                  32768
+
+// Acceptance filters a port offers per identifier format
+//
+#define VIRTUALCAN_PORT_FILTERS                16
+
+class CVirtualCanPort;
+
+////////////////////////////////////////////////////////////
+// Interface definitions
+////////////////////////////////////////////////////////////
+
+class IVirtualCanNode
+{
+public:
+	virtual ~IVirtualCanNode() {}
+
+	/// <summary>
+	/// Called for every frame written by a port, in the context of the writer
+	/// </summary>
+	virtual void OnFrame(const TPCANMsg &Msg) = 0;
+};
+
+////////////////////////////////////////////////////////////
+// Class definitions
+////////////////////////////////////////////////////////////
+
+class CVirtualCanBus : public std::enable_shared_from_this<CVirtualCanBus>
+{
+public:
+	CVirtualCanBus();
+
+	/// <summary>
+	/// Creates a master side transport on the bus, to be attached to a PCAN channel
+	/// (see CCcpRegistry::AttachTransport)
+	/// </summary>
+	std::shared_ptr<ICanTransport> CreatePort();
+
+	void AddNode(IVirtualCanNode *Node);
+	void RemoveNode(IVirtualCanNode *Node);
+
+	/// <summary>
+	/// Sends frames from a node to all the ports
+	/// </summary>
+	void Transmit(const TPCANMsg *Msgs, int Count);
+
+	/// <summary>
+	/// Total frames carried by the bus
+	/// </summary>
+	UINT64 GetFrameCount() const { return m_FrameCount; }
+
+private:
+	friend class CVirtualCanPort;
+
+	void Deliver(CVirtualCanPort *Source, const TPCANMsg *Msgs, int Count);
+	void RemovePort(CVirtualCanPort *Port);
+
+	// Recursive: a node may answer from within OnFrame
+	std::recursive_mutex m_Lock;
+	std::vector<CVirtualCanPort*> m_Ports;
+	std::vector<IVirtualCanNode*> m_Nodes;
+	std::atomic<UINT64> m_FrameCount;
+};
+
+class CVirtualCanPort : public ICanTransport
+{
+public:
+	explicit CVirtualCanPort(const std::shared_ptr<CVirtualCanBus> &Bus);
+	virtual ~CVirtualCanPort();
+
+	virtual TPCANStatus Initialize(TPCANBaudrate Btr0Btr1);
+	virtual TPCANStatus Uninitialize();
+	virtual TPCANStatus Write(const TPCANMsg *Msgs, int Count, int *Sent);
+	virtual TPCANStatus Read(TPCANMsg *Msgs, UINT64 *Stamps, int MaxCount, int *Received, DWORD TimeOut);
+	virtual TPCANStatus Reset();
+	virtual TPCANStatus SetAcceptance(const DWORD *Ids, int Count);
+	virtual void Wake();
+
+	/// <summary>
+	/// Frames lost because the port queue was full
+	/// </summary>
+	UINT64 GetOverruns() const { return m_Overruns; }
+
+	/// <summary>
+	/// Frames kept out by the acceptance filters
+	/// </summary>
+	UINT64 GetFiltered() const { return m_Filtered; }
+
+private:
+	friend class CVirtualCanBus;
+
+	// A queued frame and its delivery time (nanos, steady clock)
+	struct TFrame
+	{
+		TPCANMsg Msg;
+		UINT64 Nanos;
+	};
+
+	void Push(const TPCANMsg *Msgs, int Count);
+
+	std::shared_ptr<CVirtualCanBus> m_Bus;
+	std::mutex m_Lock;
+	std::condition_variable m_Signal;
+	std::deque<TFrame> m_Queue;
+	bool m_Open;
+	bool m_Woken;
+	std::atomic<UINT64> m_Overruns;
+
+	// Acceptance filters (protected by m_Lock)
+	//
+	bool m_Filtering;
+	std::vector<TCanFilter> m_Filters;
+	std::atomic<UINT64> m_Filtered;
+};
+
+#endif
@@ -0,0 +1,44 @@
+//  WinTypes.h
+//
+//  ~~~~~~~~~~~~
+//
+//  Windows base types used by PCANBasic.h / PCCP.h
+//
+//  ~~~~~~~~~~~~
+//
+//  The PEAK headers rely on <windows.h> for their base types. This header
+//  provides them on other platforms so the native PCAN-CCP engine can be
+//  built on Linux with the very same PCCP.h / PCANBasic.h
+//
+#ifndef __WINTYPESH__
+#define __WINTYPESH__
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+#else
+
+#include <stdint.h>
+
+typedef uint8_t                BYTE;
+typedef uint16_t               WORD;
+typedef uint32_t               DWORD;
+typedef uint64_t               UINT64;
+typedef unsigned int           UINT;
+typedef int                    BOOL;
+typedef char*                  LPSTR;
+typedef const char*            LPCSTR;
+typedef WORD*                  PWORD;
+typedef DWORD*                 LPDWORD;
+
+#ifndef __stdcall
+#define __stdcall
+#endif
+
+#endif
+
+#endif